@@ -58,6 +58,7 @@ static int readnotes(struct mbx *m,kFILE *ifile,int update);
 static long isnewmail(struct mbx *m);
 static int initnotes(struct mbx *m);
 static int lockit(struct mbx *m);
+static void scannotes(struct mbx *m,long diff);
 static long fsize(char *name);
 static void mfclose(struct mbx *m);
 static int tkeywait(char *prompt,int flush);
@@ -84,10 +85,8 @@ struct mbx *m;
 		(void) kfclose(ifile);
 		return -1;
 	}
+	ksetvbuf(ifile, NULL, _kIOMAP, 0);	/* Scanned start to end */
 #ifdef	SETVBUF
-	if (m->stdinbuf == NULL)
-		m->stdinbuf = mallocw(MYBUF);
-	ksetvbuf(ifile, m->stdinbuf, _kIOFBF, MYBUF);
 	if (m->stdoutbuf == NULL)
 		m->stdoutbuf = mallocw(MYBUF);
 	ksetvbuf(m->mfile, m->stdoutbuf, _kIOFBF, MYBUF);
@@ -387,7 +386,7 @@ struct mbx *m;
 	register struct	let *cmsg;
 	register char *line;
 	char tstring[LINELEN], buf[256];
-	long size;
+	long size, diff;
 	int i, nostatus = 0, nodelete;
 	kFILE	*nfile;
 
@@ -426,9 +425,17 @@ struct mbx *m;
 		}
 	}
 	line = tstring;
-	scanmail(m);
 	if(lockit(m))
 		return -1;
+	/* Pick up new mail under the same lock as the rewrite, since the
+	 * writes below yield and a delivery in between would be lost
+	 */
+	if((diff = isnewmail(m)) != 0L)
+		scannotes(m,diff);
+	if(m->mfile == NULL) {
+		rmlock(Mailspool,m->area);
+		return -1;
+	}
 	sprintf(buf,"%s/%s.txt",Mailspool,m->area);
 	if ((nfile = kfopen(buf,WRITE_TEXT)) == NULL) {
 		kprintf(Noaccess,buf);
@@ -457,12 +464,10 @@ struct mbx *m;
 				break;
 			}
 			kfputs(line,nfile);
-			/* kwait(NULL);  can cause problems if exiting NOS */
 		}
 		while (size > 0 && kfgets(line,LINELEN,m->mfile) != NULL) {
 			kfputs(line,nfile);
 			size -= strlen(line);
-			/* kwait(NULL);   dont want no damaged files */
 			if (kferror(nfile)) {
 				kprintf("Error writing mail file\n");
 				(void) kfclose(nfile);
@@ -827,15 +832,26 @@ void
 scanmail(m)		 /* Get any new mail */
 struct mbx *m;
 {
-	kFILE *nfile;
-	int ret, cnt;
-	char buf[256];
 	long diff;
 
 	if ((diff = isnewmail(m)) == 0L)
 		return;
 	if(lockit(m))
 		return;
+	scannotes(m,diff);
+	rmlock(Mailspool,m->area);
+}
+
+/* Reread the mail file, which the caller has locked */
+static void
+scannotes(m,diff)
+struct mbx *m;
+long diff;
+{
+	kFILE *nfile;
+	int ret, cnt;
+	char buf[256];
+
 	if(m->mfile == NULL || diff < 0L) {
 		/* This is the first time scanmail is called, or the
 		 * mail file size has decreased. In the latter case,
@@ -843,7 +859,6 @@ struct mbx *m;
 		 * is not fatal.
 		 */
 		initnotes(m);
-		rmlock(Mailspool,m->area);
 		return;
 	}
 	sprintf(buf,"%s/%s.txt",Mailspool,m->area);
@@ -866,7 +881,6 @@ struct mbx *m;
 		if (ret != 0)
 			kprintf("Error updating mail file\n");
 	}
-	rmlock(Mailspool,m->area);
 }
 
 /* Check the current mailbox to see if new mail has arrived.
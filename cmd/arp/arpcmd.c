@@ -19,13 +19,17 @@
 static int doarpadd(int argc,char *argv[],void *p);
 static int doarpdrop(int argc,char *argv[],void *p);
 static int doarpflush(int argc,char *argv[],void *p);
+static int doarpmaxpend(int argc,char *argv[],void *p);
+static int doarprefresh(int argc,char *argv[],void *p);
 static void dumparp(void);
 
 static struct cmds Arpcmds[] = {
 	{ "add", doarpadd, 0, 4, "arp add <hostid> ether|ax25|netrom|arcnet <ether addr|callsign>" },
 	{ "drop", doarpdrop, 0, 3, "arp drop <hostid> ether|ax25|netrom|arcnet" },
 	{ "flush", doarpflush, 0, 0, NULL },
+	{ "maxpending", doarpmaxpend, 0, 0, NULL },
 	{ "publish", doarpadd, 0, 4, "arp publish <hostid> ether|ax25|netrom|arcnet <ether addr|callsign>" },
+	{ "refresh", doarprefresh, 0, 0, NULL },
 	{ NULL },
 };
 char *Arptypes[] = {
@@ -188,6 +192,24 @@ void *p;
 	}
 	return 0;
 }
+/* Set limit on datagrams held per unresolved entry */
+static int
+doarpmaxpend(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setuns(&Arp_maxpend,"Max pending datagrams per entry",argc,argv);
+}
+/* Set lead time for refreshing entries still in use; 0 disables */
+static int
+doarprefresh(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setuns(&Arp_refresh,"Refresh before expiry (sec)",argc,argv);
+}
 
 /* Dump ARP table */
 static void
@@ -200,6 +222,8 @@ dumparp()
 	kprintf("received %u badtype %u bogus addr %u reqst in %u replies %u reqst out %u\n",
 	 Arp_stat.recv,Arp_stat.badtype,Arp_stat.badaddr,Arp_stat.inreq,
 	 Arp_stat.replies,Arp_stat.outreq);
+	kprintf("queued %u dropped %u (limit %u) refreshes %u\n",
+	 Arp_stat.pendq,Arp_stat.penddrop,Arp_maxpend,Arp_stat.refresh);
 
 	kprintf("IP addr         Type           Time Q Addr\n");
 	for(i=0;i<HASHMOD;i++){
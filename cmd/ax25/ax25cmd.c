@@ -299,7 +299,8 @@ struct ax25_cb *axp;
 	 axp->flags.rejsent ? 'R' : ' ',
 	 axp->flags.remotebusy ? 'B' : ' ');
 	kprintf(" %4d %4d",axp->vs,axp->vr);
-	kprintf(" %02u/%02u %u",axp->unack,axp->maxframe,axp->proto);
+	kprintf(" %02u/%02u %u%s",axp->unack,axp->maxframe,axp->proto,
+	 axp->flags.extseq ? "E" : "");
 	kprintf(" %02u/%02u",axp->retries,axp->n2);
 	kprintf(" %s\n",Ax25states[axp->state]);
 
@@ -444,6 +445,10 @@ int argc;
 char *argv[];
 void *p;
 {
+	if(argc >= 2 && (atoi(argv[1]) < 1 || atoi(argv[1]) > MMASK128)){
+		kprintf("Window size must be 1-%d\n",MMASK128);
+		return 1;
+	}
 	return setuns(&Maxframe,"Window size (frames)",argc,argv);
 }
 
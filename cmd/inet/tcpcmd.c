@@ -17,16 +17,30 @@
 #include "net/inet/internet.h"
 #include "net/inet/tcp.h"
 
+int Tcp_sack = 1;
 int Tcp_tstamps = 1;
-
+int32 Tcp_wmax = DEF_WMAX;
+int32 Tcp_ackdelay = DEF_ACKDELAY;
+int32 Tcp_reseqmax = DEF_RESEQMAX;
+
+static int doackdelay(int argc,char *argv[],void *p);
+static int doautotune(int argc,char *argv[],void *p);
+static int dobacklog(int argc,char *argv[],void *p);
+static int docc(int argc,char *argv[],void *p);
+static int docctrace(int argc,char *argv[],void *p);
 static int doirtt(int argc,char *argv[],void *p);
+static int dometrics(int argc,char *argv[],void *p);
 static int domss(int argc,char *argv[],void *p);
 static int dortt(int argc,char *argv[],void *p);
 static int dotcpkick(int argc,char *argv[],void *p);
+static int doreseq(int argc,char *argv[],void *p);
 static int dotcpreset(int argc,char *argv[],void *p);
 static int dotcpstat(int argc,char *argv[],void *p);
 static int dotcptr(int argc,char *argv[],void *p);
 static int dowindow(int argc,char *argv[],void *p);
+static int dosack(int argc,char *argv[],void *p);
+static int dosyncache(int argc,char *argv[],void *p);
+static int dosyncookies(int argc,char *argv[],void *p);
 static int dosyndata(int argc,char *argv[],void *p);
 static int dotimestamps(int argc,char *argv[],void *p);
 static int tstat(void);
@@ -35,12 +49,23 @@ static void tcprepstat(int interval,void *p1,void *p2);
 
 /* TCP subcommand table */
 static struct cmds Tcpcmds[] = {
+	{ "ackdelay",	doackdelay,	0, 0,	NULL },
+	{ "autotune",	doautotune,	0, 0,	NULL },
+	{ "backlog",	dobacklog,	0, 0,	NULL },
+	{ "cctrace",	docctrace,	0, 0,	NULL },
+	{ "congestion",	docc,		0, 0,
+		"tcp congestion [<module> [<tcb> | <target>[/<bits>]]]" },
 	{ "irtt",	doirtt,		0, 0,	NULL },
 	{ "kick",	dotcpkick,	0, 2,	"tcp kick <tcb>" },
+	{ "metrics",	dometrics,	0, 0,	NULL },
 	{ "mss",	domss,		0, 0,	NULL },
+	{ "reseq",	doreseq,	0, 0,	NULL },
 	{ "reset",	dotcpreset,	0, 2,	"tcp reset <tcb>" },
 	{ "rtt",	dortt,		0, 3,	"tcp rtt <tcb> <val>" },
+	{ "sack",	dosack,		0, 0,	NULL },
 	{ "status",	dotcpstat,	0, 0,	"tcp stat <tcb> [<interval>]" },
+	{ "syncache",	dosyncache,	0, 0,	NULL },
+	{ "syncookies",	dosyncookies,	0, 0,	NULL },
 	{ "syndata",	dosyndata,	0, 0,	NULL },
 	{ "timestamps",	dotimestamps,	0, 0,   NULL },
 	{ "trace",	dotcptr,	0, 0,	NULL },
@@ -97,17 +122,33 @@ int argc;
 char *argv[];
 void *p;
 {
-	struct tcp_rtt *tp;
+	return setlong(&Tcp_irtt,"TCP default irtt",argc,argv);
+}
 
-	setlong(&Tcp_irtt,"TCP default irtt",argc,argv);
-	if(argc < 2){
-		for(tp = &Tcp_rtt[0];tp < &Tcp_rtt[RTTCACHE];tp++){
-			if(tp->addr != 0){
-				kprintf("%s: srtt %lu mdev %lu\n",
-				 inet_ntoa(tp->addr),
-				 tp->srtt,tp->mdev);
-			}
-		}
+/* Show the destination metrics cache, set its size, or flush it */
+static int
+dometrics(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct tcp_metric *tm;
+
+	if(argc > 1 && strcmp(argv[1],"flush") == 0){
+		tcpm_flush();
+		return 0;
+	}
+	setint(&Tcp_mcmax,"TCP metrics cache size",argc,argv);
+	if(argc > 1){
+		tcpm_trim();	/* In case it shrank */
+		return 0;
+	}
+	kprintf("Destination        srtt  mdev ssthresh  cwind   mtu  loss%%   uses\n");
+	for(tm = tcpm_next(NULL);tm != NULL;tm = tcpm_next(tm)){
+		kprintf("%-16s %6ld %5ld %8ld %6ld %5u %2u.%02u %6lu\n",
+		 inet_ntoa(tm->addr),(long)tm->srtt,(long)tm->mdev,
+		 (long)tm->ssthresh,(long)tm->cwind,tm->mtu,
+		 tm->loss / 100,tm->loss % 100,tm->uses);
 	}
 	return 0;
 }
@@ -157,6 +198,145 @@ void *p;
 	return setuns(&Tcp_mss,"TCP MSS",argc,argv);
 }
 
+/* Set default delayed ack time; 0 acks every segment at once */
+static int
+doackdelay(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Tcp_ackdelay,"TCP ack delay (ms)",argc,argv);
+}
+
+/* Set cap on out-of-order data held per connection; 0 means no cap */
+static int
+doreseq(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Tcp_reseqmax,"TCP reseq limit",argc,argv);
+}
+
+/* Set default accept backlog for server sockets */
+static int
+dobacklog(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Tcp_backlog,"TCP accept backlog",argc,argv);
+}
+
+/* Set size of the SYN cache */
+static int
+dosyncache(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Tcp_synmax,"TCP SYN cache size",argc,argv);
+}
+
+/* Enable or disable SYN cookies when the SYN cache is full */
+static int
+dosyncookies(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setbool(&Tcp_syncookies,"TCP SYN cookies",argc,argv);
+}
+
+/* Set cap on auto-tuned receive buffers; 0 turns auto-tuning off */
+static int
+doautotune(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Tcp_wmax,"TCP autotune limit",argc,argv);
+}
+
+/* Show or set congestion control: the default for new connections,
+ * that for connections over a given route, or that of one connection
+ */
+static int
+docc(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct tcp_cc *cc;
+	struct tcb *tcb;
+	struct route *rp;
+	char *bitp;
+	unsigned bits;
+	int32 target;
+	int i;
+
+	if(argc < 2){
+		kprintf("Default %s; available:",Tcp_ccdef->name);
+		for(cc = Tcp_cc;cc->name != NULL;cc++)
+			kprintf(" %s",cc->name);
+		kprintf("\n");
+		if(R_default.tcpcc != 0)
+			kprintf("default: %s\n",Tcp_cc[R_default.tcpcc-1].name);
+		for(bits=1;bits<=32;bits++){
+			for(i=0;i<HASHMOD;i++){
+				for(rp = Routes[bits-1][i];rp != NULL;rp = rp->next){
+					if(rp->tcpcc == 0)
+						continue;
+					kprintf("%s/%u: %s\n",inet_ntoa(rp->target),
+					 bits,Tcp_cc[rp->tcpcc-1].name);
+				}
+			}
+		}
+		return 0;
+	}
+	if((cc = cc_lookup(argv[1])) == NULL){
+		kprintf("Unknown congestion control %s\n",argv[1]);
+		return 1;
+	}
+	if(argc < 3){
+		Tcp_ccdef = cc;
+		return 0;
+	}
+	tcb = (struct tcb *)htol(argv[2]);
+	if(tcpval(tcb)){
+		cc_select(tcb,cc);
+		return 0;
+	}
+	if((bitp = strchr(argv[2],'/')) != NULL){
+		*bitp++ = '\0';
+		bits = atoi(bitp);
+	} else
+		bits = 32;
+	if(strcmp(argv[2],"default") == 0){
+		rp = &R_default;
+	} else {
+		if((target = resolve(argv[2])) == 0){
+			kprintf(Badhost,argv[2]);
+			return 1;
+		}
+		rp = rt_blookup(target,bits);
+	}
+	if(rp == NULL){
+		kprintf("No route to %s/%u\n",argv[2],bits);
+		return 1;
+	}
+	rp->tcpcc = cc - Tcp_cc + 1;
+	return 0;
+}
+static int
+docctrace(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setbool(&Tcp_cctrace,"TCP congestion window tracing",argc,argv);
+}
+
 /* Set default window size */
 static int
 dowindow(argc,argv,p)
@@ -175,7 +355,14 @@ void *p;
 {
 	return setbool(&Tcp_syndata,"TCP syn+data piggybacking",argc,argv);
 }
-
+static int
+dosack(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setbool(&Tcp_sack,"TCP selective acks",argc,argv);
+}
 
 /* Display status of TCBs */
 static int
@@ -254,6 +441,21 @@ tstat()
 	}
 	if((j % 2) == 0)
 		kprintf("\n");
+	kprintf("Acked %lu resent %lu; SACK conns %u blocks in %lu out %lu holes resent %lu bytes skipped %lu\n",
+	 Tcp_stat.acked,Tcp_stat.resent,Tcp_stat.sackconn,
+	 Tcp_stat.sackblks,Tcp_stat.sacksent,Tcp_stat.sackrxt,
+	 Tcp_stat.sackskip);
+	kprintf("Acks delayed %lu sent by timer %lu\n",Tcp_stat.delayed,
+	 Tcp_stat.ackto);
+	kprintf("Out of order: duplicate bytes %lu merged %lu dropped bytes %lu\n",
+	 Tcp_stat.rsqdup,Tcp_stat.rsqmerge,Tcp_stat.rsqdrop);
+	kprintf("SYN cache %d/%d: added %u completed %u resent %u expired %u evicted %u reset %u\n",
+	 syn_count(),Tcp_synmax,Tcp_stat.synadd,Tcp_stat.synok,
+	 Tcp_stat.synrexmit,Tcp_stat.synexpire,Tcp_stat.synevict,
+	 Tcp_stat.synreset);
+	kprintf("Cookies sent %u accepted %u bad %u; backlog drops %u\n",
+	 Tcp_stat.cookiesent,Tcp_stat.cookieok,Tcp_stat.cookiebad,
+	 Tcp_stat.synbacklog);
 
 	kprintf(__FWPTR"  Rcv-Q  Snd-Q           Local socket          Remote socket State\n", "&TCB");
 	for(tcb=Tcbs;tcb != NULL;tcb = tcb->next){
@@ -261,8 +463,11 @@ tstat()
 		kprintf("%22s ",pinet(&tcb->conn.local));
 		kprintf("%22s ",pinet(&tcb->conn.remote));
 		kprintf("%s",Tcpstates[tcb->state]);
-		if(tcb->state == TCP_LISTEN && tcb->flags.clone)
+		if(tcb->state == TCP_LISTEN && tcb->flags.clone){
 			kprintf(" (S)");
+			if(tcb->backlog != 0)
+				kprintf(" %d/%d",tcb->aqlen,tcb->backlog);
+		}
 		kprintf("\n");
 	}
 	return 0;
@@ -330,7 +535,16 @@ struct tcb *tcb;
 
 	kprintf("Recv:          %08lx%7lu            %6lu     %6lu%9lu%11lu\n",
 	 tcb->rcv.nxt,tcb->rerecv,tcb->rcv.wnd,tcb->rcvcnt,rxbw,recvd);
+	kprintf("Buffer: %lu (window %lu) scale %u/%u",(long)tcb->rcvbuf,
+	 (long)tcb->window,tcb->rcv.wind_scale,tcb->snd.wind_scale);
+	if(!tcb->flags.ws_ok)
+		kprintf(" (not in use)");
+	if(tcb->rcv_rtt != 0)
+		kprintf(" rcv rtt %lu",(long)tcb->rcv_rtt);
+	kprintf(" ack delay %lu",(long)tcb->ackdelay);
+	kprintf("\n");
 
+	kprintf("Congestion control %s\n",tcb->cc->name);
 	kprintf("Dup acks   Backoff   Timeouts   Source Quench   Unreachables   Power\n");
 	kprintf("%8u%10u%11lu%16lu%15lu",tcb->dupacks,tcb->backoff,tcb->timeouts,
 	 tcb->quench,tcb->unreach);
@@ -358,12 +572,24 @@ struct tcb *tcb;
 	 (long)dur_timer(&tcb->timer),tcb->rtt,tcb->srtt,tcb->mdev);
 	kprintf("   %s\n",tcb->flags.ts_ok ? "timestamps":"standard");
 
-	if(tcb->reseq != (struct reseq *)NULL){
+	if(tcb->flags.sack_ok){
+		int i;
+
+		kprintf("SACK: blocks in %lu out %lu holes resent %lu bytes skipped %lu\n",
+		 (long)tcb->sackblks,(long)tcb->sacksent,(long)tcb->sackrxt,
+		 (long)tcb->sackskip);
+		for(i=0;i<tcb->nsacked;i++)
+			kprintf("  sacked x%lx-x%lx\n",(long)tcb->sacked[i].start,
+			 (long)tcb->sacked[i].end);
+	}
+
+	if(tcb->reseq[0] != (struct reseq *)NULL){
 		struct reseq *rp;
 
-		kprintf("Reassembly queue:\n");
-		for(rp = tcb->reseq;rp != (struct reseq *)NULL; rp = rp->next){
-			kprintf("  seq x%lx %u bytes\n",rp->seg.seq,rp->length);
+		kprintf("Reassembly queue: %ld bytes\n",(long)tcb->rsqbytes);
+		for(rp = tcb->reseq[0];rp != (struct reseq *)NULL; rp = rp->next[0]){
+			kprintf("  seq x%lx %u bytes%s\n",rp->seg.seq,rp->length,
+			 rp->seg.flags.fin ? " FIN" : "");
 		}
 	}
 }
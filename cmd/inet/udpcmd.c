@@ -14,8 +14,10 @@
 #include "net/inet/internet.h"
 
 static int doudpstat(int argc,char *argv[],void *p);
+static int doudprcvmax(int argc,char *argv[],void *p);
 
 static struct cmds Udpcmds[] = {
+	{ "rcvmax",	doudprcvmax,	0, 0,	NULL },
 	{ "status",	doudpstat,	0, 0,	NULL },
 	{ NULL },
 };
@@ -27,15 +29,25 @@ void *p;
 {
 	return subcmd(Udpcmds,argc,argv,p);
 }
+/* Set the receive queue limit given to new UDP sockets */
+static int
+doudprcvmax(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Udp_rcvmax,"UDP receive queue limit",argc,argv);
+}
 int
 st_udp(udp,n)
 struct udp_cb *udp;
 int n;
 {
 	if(n == 0)
-		kprintf("&UCB      Rcv-Q  Local socket\n");
+		kprintf("&UCB      Rcv-Q  Max    Drops  Local socket\n");
 
-	return kprintf("%09p%6u  %s\n",udp,udp->rcvcnt,pinet(&udp->socket));
+	return kprintf("%09p%6u%5u%9lu  %s\n",udp,udp->rcvcnt,udp->rcvmax,
+	 (unsigned long)udp->drops,pinet(&udp->socket));
 }
 
 /* Dump UDP statistics and control blocks */
@@ -59,7 +71,7 @@ void *p;
 	if((i % 2) == 0)
 		kprintf("\n");
 
-	kprintf("    &UCB Rcv-Q  Local socket\n");
+	kprintf("    &UCB Rcv-Q  Max    Drops  Local socket\n");
 	for(udp = Udps;udp != NULL; udp = udp->next){
 		if(st_udp(udp,1) == kEOF)
 			return 0;
@@ -0,0 +1,599 @@
+/* Throughput measurements for the link-level and TCP data paths
+ */
+#include "top.h"
+
+#include "lib/std/stdio.h"
+#include "global.h"
+#include "net/core/mbuf.h"
+#include "core/proc.h"
+#include "core/timer.h"
+#include "lib/util/cmdparse.h"
+#include "lib/util/crc.h"
+#include "net/core/framer.h"
+#include "lib/inet/netuser.h"
+#include "net/inet/internet.h"
+#include "net/inet/ip.h"
+#include "net/inet/tcp.h"
+#include "net/core/iface.h"
+#include "net/ax25/ax25.h"
+#include "net/ax25/lapb.h"
+#include "core/usock.h"
+#include "core/socket.h"
+#include "commands.h"
+
+static int dobenchcrc(int argc,char *argv[],void *p);
+static int dobenchframe(int argc,char *argv[],void *p);
+static int dobenchlapb(int argc,char *argv[],void *p);
+static int dobenchprintf(int argc,char *argv[],void *p);
+static int dobenchtcphdr(int argc,char *argv[],void *p);
+static struct mbuf *benchpkt(uint size);
+static int benchsame(struct mbuf *bp1,struct mbuf *bp2);
+static int benchtcp(struct tcb *tcb,struct mbuf *bp,struct tcp *seg);
+static void benchrate(char *what,long bytes,int32 ms);
+static void benchsegs(char *what,long count,int32 ms);
+static long benchlink(int maxframe,int32 rtt,long bytes,int32 *ms,int *ext);
+static struct ax25_cb *benchcb(struct iface *ifp,struct iface *peer,
+	int maxframe,int32 rtt);
+static int benchraw(struct iface *ifp,struct mbuf **bpp);
+static void benchdeliver(void);
+static void benchunlog(struct iface *ifp);
+static void benchsink(int s,void *p1,void *p2);
+
+static struct cmds Benchcmds[] = {
+	{ "crc",	dobenchcrc,	0,	0,	NULL },
+	{ "frame",	dobenchframe,	0,	0,	NULL },
+	{ "lapb",	dobenchlapb,	0,	0,	NULL },
+	{ "printf",	dobenchprintf,	0,	0,	NULL },
+	{ "tcphdr",	dobenchtcphdr,	0,	0,	NULL },
+	{ NULL },
+};
+
+int
+dobench(int argc,char *argv[],void *p)
+{
+	return subcmd(Benchcmds,argc,argv,p);
+}
+/* Time the HDLC FCS over a packet, the old byte at a time way and with
+ * crc_mbuf(): bench crc [size [count]]
+ */
+static int
+dobenchcrc(int argc,char *argv[],void *p)
+{
+	struct mbuf *bp,*bp1;
+	uint size = 1500;
+	long count = 10000,i;
+	uint16 crc1,crc2;
+	uint j;
+	int32 start;
+
+	if(argc > 1)
+		size = atoi(argv[1]);
+	if(argc > 2)
+		count = atol(argv[2]);
+	if(size == 0 || count <= 0){
+		kprintf("Usage: bench crc [size [count]]\n");
+		return 1;
+	}
+	bp = benchpkt(size);
+
+	start = msclock();
+	for(i=0;i<count;i++){
+		crc1 = FCS_START;
+		for(bp1 = bp;bp1 != NULL;bp1 = bp1->next)
+			for(j=0;j<bp1->cnt;j++)
+				crc1 = FCS(crc1,bp1->data[j]);
+	}
+	benchrate("bytewise",(long)size * count,msclock() - start);
+
+	start = msclock();
+	for(i=0;i<count;i++)
+		crc_mbuf(bp,0,size,&crc2);
+	benchrate("crc_mbuf",(long)size * count,msclock() - start);
+
+	if(crc1 != crc2)
+		kprintf("MISMATCH: %04x vs %04x\n",crc1,crc2);
+	free_p(&bp);
+	return 0;
+}
+/* Byte stuffing as set up by each of its users */
+static struct {
+	char *name;
+	int type;
+	int32 accm;
+} Benchfr[] = {
+	{ "slip",	FR_SLIP,	0 },	/* and KISS */
+	{ "ppp",	FR_HDLC,	0xffffffff },	/* Default ACCM */
+	{ "ahdlc",	FR_HDLC,	0 },	/* and PPP with no ACCM */
+	{ NULL },
+};
+
+/* Time encoding and decoding a packet with each kind of framing:
+ * bench frame [size [count]]
+ */
+static int
+dobenchframe(int argc,char *argv[],void *p)
+{
+	struct framer fr;
+	struct mbuf *bp,*obp,*fbp;
+	uint size = 1500;
+	long count = 10000,i;
+	uint8 *cp;
+	uint cnt;
+	int32 start;
+	int j,ok;
+	char what[32];
+
+	if(argc > 1)
+		size = atoi(argv[1]);
+	if(argc > 2)
+		count = atol(argv[2]);
+	if(size == 0 || count <= 0){
+		kprintf("Usage: bench frame [size [count]]\n");
+		return 1;
+	}
+	bp = benchpkt(size);
+
+	for(j=0;Benchfr[j].name != NULL;j++){
+		fr_init(&fr,Benchfr[j].type,128,0);
+		fr_txaccm(&fr,Benchfr[j].accm);
+		fr_rxaccm(&fr,Benchfr[j].accm);
+
+		obp = NULL;
+		start = msclock();
+		for(i=0;i<count;i++){
+			free_p(&obp);
+			obp = ambufw(fr_stufflen(&fr,bp) + 2);
+			cp = obp->data;
+			*cp++ = fr.flag;
+			cp = fr_stuff_mbuf(&fr,cp,bp);
+			*cp++ = fr.flag;
+			obp->cnt = cp - obp->data;
+		}
+		sprintf(what,"%s encode",Benchfr[j].name);
+		benchrate(what,(long)size * count,msclock() - start);
+
+		ok = 0;
+		start = msclock();
+		for(i=0;i<count;i++){
+			cp = obp->data;
+			cnt = obp->cnt;
+			while(cnt != 0){
+				if(fr_unstuff(&fr,&cp,&cnt,&fbp) != FR_FRAME)
+					continue;
+				if(i == 0)
+					ok = benchsame(bp,fbp);
+				free_p(&fbp);
+			}
+		}
+		sprintf(what,"%s decode",Benchfr[j].name);
+		benchrate(what,(long)size * count,msclock() - start);
+		if(!ok)
+			kprintf("%s: MISMATCH\n",Benchfr[j].name);
+		free_p(&obp);
+		fr_reset(&fr);
+	}
+	free_p(&bp);
+	return 0;
+}
+/* Two LAPB stations joined by a simulated link: each frame waits for
+ * its transmitter to free up, takes len*8/bps to send and arrives
+ * rtt/2 later
+ */
+struct benchfr {
+	struct benchfr *next;
+	int32 due;		/* Time of arrival, ms */
+	struct iface *to;	/* Receiving station */
+	struct mbuf *bp;
+};
+static struct benchfr *Benchq;
+static struct iface *Benchif[2];
+static int32 Benchbusy[2];	/* When each transmitter frees up */
+static int32 Benchdelay;	/* One-way delay, ms */
+static int32 Benchbps;
+
+/* Push a bulk transfer over LAPB with maxframe 7 and 127:
+ * bench lapb [rtt [bps [bytes]]]
+ */
+static int
+dobenchlapb(int argc,char *argv[],void *p)
+{
+	static int maxframe[] = { 7, 127 };
+	struct iface *ifp;
+	int32 rtt = 1000;
+	long bytes = 20000,got;
+	int32 ms;
+	int i,ext;
+
+	Benchbps = 56000;
+	if(argc > 1)
+		rtt = atol(argv[1]);
+	if(argc > 2)
+		Benchbps = atol(argv[2]);
+	if(argc > 3)
+		bytes = atol(argv[3]);
+	if(rtt < 0 || Benchbps <= 0 || bytes <= 0){
+		kprintf("Usage: bench lapb [rtt [bps [bytes]]]\n");
+		return 1;
+	}
+	Benchdelay = rtt / 2;
+	for(i=0;i<2;i++){
+		ifp = (struct iface *)callocw(1,sizeof(struct iface));
+		ifp->name = i == 0 ? "bench0" : "bench1";
+		ifp->mtu = Paclen;
+		ifp->hwaddr = mallocw(AXALEN);
+		setcall(ifp->hwaddr,i == 0 ? "BENCH-1" : "BENCH-2");
+		ifp->raw = benchraw;
+		Benchif[i] = ifp;
+	}
+	if(lookup_ax25(Benchif[0]->hwaddr) != NULL
+	 || lookup_ax25(Benchif[1]->hwaddr) != NULL){
+		kprintf("bench: BENCH-1 or BENCH-2 already in use\n");
+	} else {
+		for(i=0;i<2;i++){
+			got = benchlink(maxframe[i],rtt,bytes,&ms,&ext);
+			kprintf("maxframe %3d mod %-3s %ld bytes in %ld ms",
+			 maxframe[i],ext ? "128" : "8",got,(long)ms);
+			if(ms != 0)
+				kprintf(" (%ld bytes/sec)",got * 1000 / ms);
+			kprintf("%s\n",got < bytes ? " INCOMPLETE" : "");
+		}
+	}
+	for(i=0;i<2;i++){
+		benchunlog(Benchif[i]);
+		free(Benchif[i]->hwaddr);
+		free(Benchif[i]);
+		Benchif[i] = NULL;
+	}
+	return 0;
+}
+/* Send bytes from BENCH-1 to BENCH-2 and return how many arrived
+ * within two minutes
+ */
+static long
+benchlink(int maxframe,int32 rtt,long bytes,int32 *ms,int *ext)
+{
+	struct ax25_cb *axp,*bxp;
+	struct benchfr *fp;
+	struct mbuf *bp;
+	long queued = 0,got = 0;
+	int32 start;
+
+	Benchq = NULL;
+	Benchbusy[0] = Benchbusy[1] = 0;
+	bxp = benchcb(Benchif[1],Benchif[0],maxframe,rtt);
+	axp = benchcb(Benchif[0],Benchif[1],maxframe,rtt);
+	start = msclock();
+	open_ax25(Benchif[0],Benchif[0]->hwaddr,Benchif[1]->hwaddr,
+	 AX_ACTIVE,axp->window,NULL,NULL,NULL,0);
+	while(got < bytes && msclock() - start < 120000L){
+		if(axp->state == LAPB_DISCONNECTED)
+			break;
+		/* Keep a couple of windows' worth queued */
+		while(queued < bytes && len_q(axp->txq) < 2*maxframe){
+			bp = ambufw(axp->paclen);
+			memset(bp->data,'x',axp->paclen);
+			bp->cnt = axp->paclen;
+			send_ax25(axp,&bp,PID_NO_L3);
+			queued += axp->paclen;
+		}
+		benchdeliver();
+		got += len_p(bxp->rxq);
+		free_q(&bxp->rxq);
+		ppause(5L);
+	}
+	*ms = msclock() - start;
+	*ext = axp->flags.extseq;
+
+	disc_ax25(axp);
+	start = msclock();
+	while(Benchq != NULL && msclock() - start < 2*rtt + 1000){
+		benchdeliver();
+		ppause(5L);
+	}
+	while((fp = Benchq) != NULL){
+		Benchq = fp->next;
+		free_p(&fp->bp);
+		free(fp);
+	}
+	del_ax25(axp);
+	del_ax25(bxp);
+	return got;
+}
+/* Make a quiet control block on ifp for talking to peer */
+static struct ax25_cb *
+benchcb(struct iface *ifp,struct iface *peer,int maxframe,int32 rtt)
+{
+	struct ax25_cb *axp;
+
+	axp = cr_ax25(peer->hwaddr);
+	memcpy(axp->remote,peer->hwaddr,AXALEN);
+	memcpy(axp->local,ifp->hwaddr,AXALEN);
+	axp->iface = ifp;
+	axp->maxframe = maxframe;
+	axp->proto = V2;
+	axp->r_upcall = NULL;
+	axp->s_upcall = NULL;
+	/* Room for a full window, so the receiver never goes busy, and
+	 * T1 started from the time a full window really takes
+	 */
+	axp->window = (maxframe + 1) * axp->paclen;
+	axp->srt = rtt + (long)maxframe * axp->paclen * 8000L / Benchbps;
+	ax25_set_t1_timer(axp,2 * axp->srt);
+	/* Ack at once so the ack delay doesn't hide the window */
+	set_timer(&axp->t2,10L);
+	return axp;
+}
+static int
+benchraw(struct iface *ifp,struct mbuf **bpp)
+{
+	struct benchfr *fp,**fpp;
+	int i = ifp == Benchif[1];
+	int32 now = msclock();
+
+	if(Benchbusy[i] < now)
+		Benchbusy[i] = now;
+	Benchbusy[i] += len_p(*bpp) * 8000L / Benchbps;
+	fp = (struct benchfr *)callocw(1,sizeof(struct benchfr));
+	fp->due = Benchbusy[i] + Benchdelay;
+	fp->to = Benchif[!i];
+	fp->bp = *bpp;
+	*bpp = NULL;
+	for(fpp = &Benchq;*fpp != NULL;fpp = &(*fpp)->next)
+		;
+	*fpp = fp;
+	return 0;
+}
+/* Hand over every frame that has arrived. Receiving one may queue
+ * another, so start over each time
+ */
+static void
+benchdeliver(void)
+{
+	struct benchfr *fp,**fpp;
+
+	for(fpp = &Benchq;(fp = *fpp) != NULL;){
+		if(fp->due > msclock()){
+			fpp = &fp->next;
+			continue;
+		}
+		*fpp = fp->next;
+		ax_recv(fp->to,&fp->bp);
+		free(fp);
+		fpp = &Benchq;
+	}
+}
+/* Drop the heard list entries made by the bench interfaces */
+static void
+benchunlog(struct iface *ifp)
+{
+	struct lq *lp,**lpp;
+	struct ld *dp,**dpp;
+
+	for(lpp = &Lq;(lp = *lpp) != NULL;){
+		if(lp->iface == ifp){
+			*lpp = lp->next;
+			free(lp);
+		} else
+			lpp = &lp->next;
+	}
+	for(dpp = &Ld;(dp = *dpp) != NULL;){
+		if(dp->iface == ifp){
+			*dpp = dp->next;
+			free(dp);
+		} else
+			dpp = &dp->next;
+	}
+}
+/* Measure formatted output to a socket: kfprintf() lines like the
+ * socket display into a local stream socket, with a process at the
+ * other end throwing them away: bench printf [lines]
+ */
+static int
+dobenchprintf(int argc,char *argv[],void *p)
+{
+	int sv[2];
+	kFILE *fp;
+	long lines = 10000;
+	long i,bytes = 0;
+	int32 start,ms;
+
+	if(argc > 1)
+		lines = atol(argv[1]);
+	if(lines <= 0){
+		kprintf("Usage: bench printf [lines]\n");
+		return 1;
+	}
+	if(socketpair(kAF_LOCAL,kSOCK_STREAM,0,sv) == -1){
+		kperror("socketpair");
+		return 1;
+	}
+	newproc("bench sink",512,benchsink,sv[1],NULL,NULL,0);
+	fp = kfdopen(sv[0],"w+t");
+	start = msclock();
+	for(i=0;i<lines;i++){
+		bytes += kfprintf(fp,"%4d %-8s%-9p %-22s%-9p %-10s\n",
+		 sv[0],Socktypes[TYPE_LOCAL_STREAM],fp,"",Curproc,
+		 Curproc->name);
+	}
+	kfflush(fp);
+	ms = msclock() - start;
+	kfclose(fp);
+	benchrate("kfprintf",bytes,ms);
+	return 0;
+}
+static void
+benchsink(int s,void *p1,void *p2)
+{
+	struct mbuf *bp;
+
+	while(recv_mbuf(s,&bp,0,NULL,NULL) > 0)
+		free_p(&bp);
+	close_s(s);
+}
+/* Time building TCP segments the old way with htontcp() and from the
+ * connection's template with htontcp_tmpl(), without and with the
+ * timestamp option: bench tcphdr [size [count]]
+ * The default size of 0 is a pure ack.
+ */
+static int
+dobenchtcphdr(int argc,char *argv[],void *p)
+{
+	struct tcb *tcb;
+	struct tcp seg;
+	struct mbuf *bp,*obp1,*obp2;
+	uint size = 0;
+	long count = 100000,i;
+	int32 start;
+	int ts;
+	char what[32];
+
+	if(argc > 1)
+		size = atoi(argv[1]);
+	if(argc > 2)
+		count = atol(argv[2]);
+	if(count <= 0){
+		kprintf("Usage: bench tcphdr [size [count]]\n");
+		return 1;
+	}
+	bp = size != 0 ? benchpkt(size) : NULL;
+	tcb = (struct tcb *)callocw(1,sizeof(struct tcb));
+	tcb->conn.local.address = 0x2c000001;
+	tcb->conn.local.port = 1024;
+	tcb->conn.remote.address = 0x2c000002;
+	tcb->conn.remote.port = 23;
+
+	memset(&seg,0,sizeof(seg));
+	seg.source = tcb->conn.local.port;
+	seg.dest = tcb->conn.remote.port;
+	seg.flags.ack = 1;
+	seg.flags.psh = size != 0;
+	seg.wnd = DEF_WND;
+	seg.tsecr = 0x01020304;
+
+	for(ts=0;ts<2;ts++){
+		tcb->flags.ts_ok = ts;
+		seg.flags.tstamp = ts;
+		tcp_template(tcb);
+
+		obp1 = NULL;
+		start = msclock();
+		for(i=0;i<count;i++){
+			free_p(&obp1);
+			seg.seq = seg.ack = seg.tsval = i;
+			seg.checksum = 0;
+			dup_p(&obp1,bp,0,size);
+			htontcp(&seg,&obp1,tcb->conn.local.address,
+			 tcb->conn.remote.address);
+		}
+		sprintf(what,"htontcp%s",ts ? " ts" : "");
+		benchsegs(what,count,msclock() - start);
+
+		obp2 = NULL;
+		start = msclock();
+		for(i=0;i<count;i++){
+			free_p(&obp2);
+			seg.seq = seg.ack = seg.tsval = i;
+			dup_p(&obp2,bp,0,size);
+			htontcp_tmpl(tcb,&seg,&obp2);
+		}
+		sprintf(what,"template%s",ts ? " ts" : "");
+		benchsegs(what,count,msclock() - start);
+
+		/* The two lay out the timestamp option differently,
+		 * so compare what they say rather than their bytes
+		 */
+		if(!benchtcp(tcb,obp1,&seg) || !benchtcp(tcb,obp2,&seg))
+			kprintf("%s: MISMATCH\n",what);
+		free_p(&obp1);
+		free_p(&obp2);
+	}
+	free(tcb);
+	free_p(&bp);
+	return 0;
+}
+/* Return 1 if a segment has a good checksum and the header fields
+ * in seg
+ */
+static int
+benchtcp(struct tcb *tcb,struct mbuf *bp,struct tcp *seg)
+{
+	struct pseudo_header ph;
+	struct tcp tcph;
+	struct mbuf *bp1;
+	int ok;
+
+	ph.source = tcb->conn.local.address;
+	ph.dest = tcb->conn.remote.address;
+	ph.protocol = TCP_PTCL;
+	ph.length = len_p(bp);
+	if(cksum(&ph,bp,ph.length) != 0)
+		return 0;
+	dup_p(&bp1,bp,0,ph.length);
+	ntohtcp(&tcph,&bp1);
+	ok = tcph.source == seg->source && tcph.dest == seg->dest
+	 && tcph.seq == seg->seq && tcph.ack == seg->ack
+	 && tcph.flags.ack == seg->flags.ack && tcph.flags.psh == seg->flags.psh
+	 && tcph.wnd == seg->wnd && tcph.flags.tstamp == seg->flags.tstamp
+	 && (!seg->flags.tstamp
+	  || (tcph.tsval == seg->tsval && tcph.tsecr == seg->tsecr));
+	free_p(&bp1);
+	return ok;
+}
+/* Make a test packet of pseudo-random bytes, split over a few mbufs
+ * the way one coming up through the stack usually is
+ */
+static struct mbuf *
+benchpkt(uint size)
+{
+	struct mbuf *bp = NULL,*bp1;
+	uint len;
+	uint32 r = 1;
+
+	while(size != 0){
+		len = min(size,bp == NULL ? 40 : 512);
+		bp1 = ambufw(len);
+		for(bp1->cnt=0;bp1->cnt<len;bp1->cnt++){
+			r = r * 1103515245 + 12345;
+			bp1->data[bp1->cnt] = r >> 16;
+		}
+		append(&bp,&bp1);
+		size -= len;
+	}
+	return bp;
+}
+/* Return 1 if two packets have the same contents */
+static int
+benchsame(struct mbuf *bp1,struct mbuf *bp2)
+{
+	uint i1 = 0,i2 = 0;
+
+	if(len_p(bp1) != len_p(bp2))
+		return 0;
+	while(bp1 != NULL && bp2 != NULL){
+		if(i1 == bp1->cnt){
+			bp1 = bp1->next;
+			i1 = 0;
+		} else if(i2 == bp2->cnt){
+			bp2 = bp2->next;
+			i2 = 0;
+		} else if(bp1->data[i1++] != bp2->data[i2++])
+			return 0;
+	}
+	return 1;
+}
+static void
+benchrate(char *what,long bytes,int32 ms)
+{
+	kprintf("%-14s %ld bytes in %ld ms",what,bytes,(long)ms);
+	if(ms != 0)
+		kprintf(" (%ld kbytes/sec)",bytes / ms);
+	kprintf("\n");
+}
+static void
+benchsegs(char *what,long count,int32 ms)
+{
+	kprintf("%-14s %ld segments in %ld ms",what,count,(long)ms);
+	if(ms != 0)
+		kprintf(" (%ld segments/sec)",count * 1000 / ms);
+	kprintf("\n");
+}
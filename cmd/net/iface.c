@@ -8,6 +8,7 @@
 #include "net/core/mbuf.h"
 #include "core/proc.h"
 #include "net/core/iface.h"
+#include "net/core/qdisc.h"
 #include "net/enet/enet.h"
 #include "lib/util/cmdparse.h"
 #include "commands.h"
@@ -28,8 +29,10 @@ static int ifmtu(int argc,char *argv[],void *p);
 static int ifforw(int argc,char *argv[],void *p);
 static int ifencap(int argc,char *argv[],void *p);
 static int iftxqlen(int argc,char *argv[],void *p);
+static int ifackdelay(int argc,char *argv[],void *p);
 
 struct cmds Ifcmds[] = {
+	{ "ackdelay",		ifackdelay,	0,	2,	NULL },
 	{ "broadcast",		ifbroad,	0,	2,	NULL },
 	{ "encapsulation",	ifencap,	0,	2,	NULL },
 	{ "forward",		ifforw,		0,	2,	NULL },
@@ -78,14 +81,18 @@ showiface(struct iface *ifp)
 	 kprintf("           output forward to %s\n",ifp->forw->name);
 	kprintf("           sent: ip %lu tot %lu idle %s qlen %u",
 	ifp->ipsndcnt,ifp->rawsndcnt,tformat(secclock() - ifp->lastsent),
-	 len_q(ifp->outq));
+	 len_q(ifp->outq) + (ifp->qdisc != NULL ? ifp->qdisc->len : 0));
 	if(ifp->outlim != 0)
 		kprintf("/%u",ifp->outlim);
+	if(ifp->qdisc != NULL)
+		kprintf(" qdisc %s",ifp->qdisc->type->name);
 	if(ifp->txbusy)
 		kprintf(" BUSY");
 	kprintf("\n");
 	kprintf("           recv: ip %lu tot %lu idle %s\n",
 	 ifp->iprecvcnt,ifp->rawrecvcnt,tformat(secclock() - ifp->lastrecv));
+	if(ifp->ackdelay != 0)
+		kprintf("           tcp ack delay %lu ms\n",(long)ifp->ackdelay);
 }
 
 /* Set interface parameters */
@@ -251,6 +258,68 @@ iftxqlen(int argc,char *argv[],void *p)
 	return 0;
 }
 
+/* Set TCP delayed ack time for connections through this interface */
+static int
+ifackdelay(int argc,char *argv[],void *p)
+{
+	struct iface *ifp = p;
+
+	setlong(&ifp->ackdelay,"TCP ack delay (ms)",argc,argv);
+	return 0;
+}
+
+/*
+ * qdisc				(show all interfaces)
+ * qdisc <iface>			(show one)
+ * qdisc <iface> none|fifo|tbf|fq [<param> <value>]...
+ * qdisc <iface> <param> <value>...	(adjust the current one)
+ */
+int
+doqdisc(int argc,char *argv[],void *p)
+{
+	struct iface *ifp;
+	struct qdisc *q;
+	int i;
+
+	if(argc < 2){
+		for(ifp = Ifaces;ifp != NULL;ifp = ifp->next)
+			qdisc_show(ifp);
+		return 0;
+	}
+	if((ifp = if_lookup(argv[1])) == NULL){
+		kprintf("Interface %s unknown\n",argv[1]);
+		return 1;
+	}
+	if(argc == 2){
+		qdisc_show(ifp);
+		return 0;
+	}
+	i = 2;
+	if(argc % 2 != 0){
+		/* Odd count: a discipline name precedes the parameters */
+		if(qdisc_set(ifp,argv[2]) != 0){
+			kprintf("Queue discipline '%s' unknown; use none",argv[2]);
+			for(i=0;Qdisc_types[i].name != NULL;i++)
+				kprintf(" %s",Qdisc_types[i].name);
+			kprintf("\n");
+			return 1;
+		}
+		i = 3;
+	}
+	if(i < argc && (q = ifp->qdisc) == NULL){
+		kprintf("No queue discipline on %s\n",ifp->name);
+		return 1;
+	}
+	for(;i<argc-1;i+=2){
+		if((*q->type->set)(q,argv[i],argv[i+1]) != 0){
+			kprintf("Invalid %s parameter: %s %s\n",q->type->name,
+			 argv[i],argv[i+1]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
 /*
  * dial <iface> <seconds> [device dependent args]	(begin autodialing)
  * dial <iface> 0	(stop autodialing) 
@@ -22,6 +22,8 @@
 #include "net/ppp/ppplcp.h"
 #include "net/ppp/ppppap.h"
 #include "net/ppp/pppipcp.h"
+#include "net/ppp/pppccp.h"
+#include "net/ppp/pppmp.h"
 
 static struct iface *ppp_lookup(char *ifname);
 
@@ -33,6 +35,9 @@ static void genstat(struct ppp_s *ppp_p);
 static void lcpstat(struct fsm_s *fsm_p);
 static void papstat(struct fsm_s *fsm_p);
 static void ipcpstat(struct fsm_s *fsm_p);
+static void ccpstat(struct fsm_s *fsm_p);
+static void compstat(char *dir, struct ccp_comp_s *comp_p);
+static void mpstat(struct mp_s *mp_p);
 
 static int dotry_nak(int argc, char *argv[], void *p);
 static int dotry_req(int argc, char *argv[], void *p);
@@ -41,8 +46,10 @@ static int dotry_terminate(int argc, char *argv[], void *p);
 
 /* "ppp" subcommands */
 static struct cmds Pppcmds[] = {
+	{ "ccp",	doppp_ccp,	0,	0,	NULL },
 	{ "ipcp",	doppp_ipcp,	0,	0,	NULL },
 	{ "lcp",	doppp_lcp,	0,	0,	NULL },
+	{ "multilink",	doppp_multilink,	0,	0,	NULL },
 	{ "pap",	doppp_pap,	0,	0,	NULL },
 	{ "quick",	doppp_quick,	0,	0,	NULL },
 	{ "trace",	doppp_trace,	0,	0,	NULL },
@@ -217,6 +224,14 @@ struct iface *ifp;
 		papstat(&(ppp_p->fsm[Pap]));
 	if ( ppp_p->fsm[IPcp].pdv != NULL )
 		ipcpstat(&(ppp_p->fsm[IPcp]));
+	if ( ppp_p->fsm[Ccp].pdv != NULL )
+		ccpstat(&(ppp_p->fsm[Ccp]));
+	if ( ppp_p->mp != NULL )
+		mpstat(ppp_p->mp);
+	if ( ppp_p->mpl != NULL )
+		kprintf("Multilink: %s bundle %s\n",
+			ppp_p->mpl->joined ? "joined" : "waiting to join",
+			ppp_p->mpl->mp_p->ppp_p->iface->name);
 }
 
 
@@ -240,20 +255,22 @@ struct ppp_s *ppp_p;
 		ppp_p->InFrame,
 		ppp_p->InChecksum,
 		ppp_p->InError);
-	kprintf("\t\t%6u Lcp,%6u Pap,%6u IPcp,%6u Unknown\n",
+	kprintf("\t\t%6u Lcp,%6u Pap,%6u IPcp,%6u Ccp,%6u Unknown\n",
 		ppp_p->InNCP[Lcp],
 		ppp_p->InNCP[Pap],
 		ppp_p->InNCP[IPcp],
+		ppp_p->InNCP[Ccp],
 		ppp_p->InUnknown);
 	kprintf("%10lu Out, %10lu Flags,%6u ME, %6u Fail\n",
 		ppp_p->OutTxOctetCount,
 		ppp_p->OutOpenFlag,
 		ppp_p->OutMemory,
 		ppp_p->OutError);
-	kprintf("\t\t%6u Lcp,%6u Pap,%6u IPcp\n",
+	kprintf("\t\t%6u Lcp,%6u Pap,%6u IPcp,%6u Ccp\n",
 		ppp_p->OutNCP[Lcp],
 		ppp_p->OutNCP[Pap],
-		ppp_p->OutNCP[IPcp]);
+		ppp_p->OutNCP[IPcp],
+		ppp_p->OutNCP[Ccp]);
 }
 
 
@@ -360,6 +377,14 @@ struct fsm_s *fsm_p;
 	} else {
 		kprintf( "unused\n" );
 	}
+
+	if ( (localwork | remotework) & LCP_N_MRRU ) {
+		kprintf("\tMRRU:\t");
+		spot( localwork, localwant, localwill, LCP_N_MRRU );
+		kprintf( "%4d local\t", localp->mrru );
+		spot( remotework, remotewant, remotewill, LCP_N_MRRU );
+		kprintf( "%4d remote\n", remotep->mrru );
+	}
 }
 
 
@@ -412,6 +437,54 @@ struct fsm_s *fsm_p;
 }
 
 
+static void
+ccpstat(fsm_p)
+struct fsm_s *fsm_p;
+{
+	struct ccp_s *ccp_p = fsm_p->pdv;
+
+	kprintf("CCP %s\n",
+		NCPStatus[fsm_p->state]);
+	compstat("In", &(ccp_p->in));
+	compstat("Out", &(ccp_p->out));
+	if ( ccp_p->resetting )
+		kprintf("\tWaiting for Reset-Ack\n");
+}
+
+
+static void
+compstat(dir,comp_p)
+char *dir;
+struct ccp_comp_s *comp_p;
+{
+	kprintf("    %s\t", dir);
+	switch ( comp_p->method ) {
+	case CCP_N_PRED1:
+		kprintf("Predictor-1");
+		break;
+	case CCP_N_DEFLATE:
+		kprintf("Deflate");
+		break;
+	default:
+		kprintf("No compression");
+		break;
+	};
+	kprintf(": %u packets, %lu octets, %lu compressed",
+		comp_p->packets,
+		comp_p->octets,
+		comp_p->comp_octets);
+	if ( comp_p->comp_octets != 0 ) {
+		kprintf(" (ratio %lu.%02lu)",
+			comp_p->octets / comp_p->comp_octets,
+			(comp_p->octets % comp_p->comp_octets) * 100
+			 / comp_p->comp_octets);
+	}
+	kprintf("\n\t%u errors, %u resets\n",
+		comp_p->errors,
+		comp_p->resets);
+}
+
+
 /****************************************************************************/
 /* Set timeout interval when waiting for response from remote peer */
 int
@@ -541,3 +614,35 @@ void *p;
 }
 
 
+
+
+static void
+mpstat(mp_p)
+struct mp_s *mp_p;
+{
+	struct mp_link *lp;
+
+	kprintf("Multilink: MRRU %u, fragments of %u or more\n",
+		mp_p->mrru,
+		mp_p->minfrag);
+	kprintf("%10u Out, %6u split\n",
+		mp_p->OutPackets,
+		mp_p->OutSplit);
+	kprintf("%10u In,  %6u lost, %6u late, %6u bad, %6u queued\n",
+		mp_p->InPackets,
+		mp_p->InLost,
+		mp_p->InDup,
+		mp_p->InError,
+		mp_p->rxqlen);
+	for ( lp = mp_p->links; lp != NULL; lp = lp->next ) {
+		kprintf("\t%-10s %-7s", lp->ppp_p->iface->name,
+			lp->joined ? "joined" : "waiting");
+		if ( lp->speed > 0 )
+			kprintf("%8ld bps", lp->speed);
+		else
+			kprintf("line speed  ");
+		kprintf("%8u frags out, %8u in\n",
+			lp->OutFrags,
+			lp->InFrags);
+	}
+}
@@ -83,6 +83,10 @@ int unused;
 			kfprintf(fp,"VJ Compressed TCP/IP\n");
 			vjcomp_dump(fp,bpp,0);
 			break;
+		case PPP_VJTS_PROTOCOL:
+			kfprintf(fp,"VJ Compressed TCP/IP, timestamp deltas\n");
+			vjcomp_dump(fp,bpp,0);
+			break;
 		case PPP_UNCOMP_PROTOCOL:
 			kfprintf(fp,"VJ Uncompressed TCP/IP\n");
 			/* Get our own copy so we can mess with the data */
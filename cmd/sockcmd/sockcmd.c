@@ -5,11 +5,13 @@
 
 #include "lib/std/stdio.h"
 #include "global.h"
+#include "config.h"
 #include "net/core/mbuf.h"
 #include "core/proc.h"
 #include "lzw.h"
 #include "core/usock.h"
 #include "core/socket.h"
+#include "lib/util/cmdparse.h"
 #include "commands.h"
 
 /* Socket status display command */
@@ -43,6 +45,15 @@ void *p;
 			 s,Socktypes[up->type],up->cb.p,cp,
 			 up->owner,up->owner->name);
 		}
+		kprintf("%u in use, peak %u; table %u, limit %u\n",
+		 Sock_inuse,Sock_peak,Nsock,Nsockmax);
+		return 0;
+	}
+	if(strcmp(argv[1],"max") == 0){
+		/* The table only grows, and the descriptor has room for so many */
+		if(setuns(&Nsockmax,"Socket limit",argc-1,argv+1) != 0)
+			return 1;
+		Nsockmax = min(max(Nsockmax,Nsock),NSOCKLIM);
 		return 0;
 	}
 	s = atoi(argv[1]);
@@ -57,6 +68,14 @@ void *p;
 	}
 	sp = up->sp;
 	kprintf("%s %p\n",Socktypes[up->type],up->cb.p);
+#ifdef	LZW
+	if(up->zout != NULL){
+		kprintf("LZW %d bits: sent %ld compressed to %ld",
+		 up->zout->maxbits,(long)up->zout->cnt,(long)up->zout->zcnt);
+		kprintf("; received %ld expanded to %ld\n",
+		 (long)up->zin->zcnt,(long)up->zin->cnt);
+	}
+#endif
 	if(! so_is_connected(up)) {
 		return 0;
 	}
@@ -92,6 +92,13 @@ int doicmp(int argc,char *argv[],void *p);
 /* In iface.c: */
 int doifconfig(int argc,char *argv[],void *p);
 int dodetach(int argc,char *argv[],void *p);
+int doqdisc(int argc,char *argv[],void *p);
+
+/* In bench.c: */
+int dobench(int argc,char *argv[],void *p);
+
+/* In hostio_unix.c: */
+int dohostio(int argc,char *argv[],void *p);
 
 /* In ipcmd.c: */
 int doip(int argc,char *argv[],void *p);
@@ -98,6 +98,7 @@ static void axnr(struct iface *iface,struct ax25_cb *axp,uint8 *src,
 struct mbuf *Hopper;		/* Queue of incoming packets */
 unsigned Nsessions = NSESSIONS;
 unsigned Nsock = DEFNSOCK;		/* Number of socket entries */
+unsigned Nsockmax = DEFNSOCKMAX;	/* Socket table may grow to this */
 
 /* Free memory threshold, below which things start to happen to conserve
  * memory, like garbage collection, source quenching and refusing connects
@@ -128,6 +129,7 @@ struct cmds Cmds[] = {
 #ifdef	AXIP
 	{ "axudp",	doaxudp,	0, 2, "axudp <interface> <subcmd> ..." },
 #endif
+	{ "bench",	dobench,	0, 2, "bench <crc|frame|lapb|printf|tcphdr>" },
 #ifdef	BOOTP
 	{ "bootp",	dobootp,	0, 0, NULL },
 	{ "bootpd",	bootpdcmd,	0, 0, NULL },
@@ -174,6 +176,9 @@ struct cmds Cmds[] = {
 	{ "help",	dohelp,		0, 0, NULL },
 #ifdef	HOPCHECK
 	{ "hop",	dohop,		0, 0, NULL },
+#endif
+#ifdef	UNIX
+	{ "hostio",	dohostio,	0, 0, NULL },
 #endif
 	{ "hostname",	dohostname,	0, 0, NULL },
 #ifdef	HS
@@ -227,6 +232,7 @@ struct cmds Cmds[] = {
 #if	!defined(AMIGA)
 	{ "pwd",	docd,		0, 0, NULL },
 #endif
+	{ "qdisc",	doqdisc,	0, 0, NULL },
 	{ "record",	dorecord,	0, 0, NULL },
 	{ "rename",	dorename,	0, 3, "rename <oldfile> <newfile>" },
 	{ "repeat",	dorepeat,	1024, 3, "repeat <interval> <command> [args...]" },
@@ -364,6 +370,7 @@ struct cmds Remcmds[] = {
 #if	!defined(AMIGA)
 	{ "pwd",	docd,		0, 0, NULL },
 #endif
+	{ "qdisc",	doqdisc,	0, 0, NULL },
 	{ "rename",	dorename,	0, 3, "rename <oldfile> <newfile>" },
 	{ "reset",	doreset,	0, 0, NULL },
 	{ "reboot",	doreboot,	0, 0, NULL },
@@ -467,6 +474,10 @@ struct cmds Attab[] = {
 #ifdef	KSP
 	{ "ksp", ksp_attach, 0, 5, "attach ksp <base> <irq> <label> <mtu>" },
 #endif
+#ifdef	PPP
+	/* Multilink PPP bundle */
+	{ "mlppp", mp_attach, 0, 3, "attach mlppp <label> <mtu>" },
+#endif
 #ifdef AXIP
 	{ "axudp", axudp_attach, 0, 4, "attach axudp <listenip> <port> <label> [automap] [autobroadcast]" },
 #endif
@@ -479,7 +490,7 @@ static struct cmds Startcmds[] = {
 #if	defined(AX25) && defined(MAILBOX)
 	{ "ax25",	ax25start,	256, 0, NULL },
 #endif
-	{ "discard",	dis1,		256, 0, NULL },
+	{ "discard",	dis1,		576, 0, NULL },
 	{ "echo",	echo1,		256, 0, NULL },
 	{ "finger",	finstart,	256, 0, NULL },
 	{ "ftp",	ftpstart,	256, 0, NULL },
@@ -539,13 +550,15 @@ struct socklink Socklink[] = {
 	 * socket,	bind,		listen,		connect,
 	 * accept,	recv,		send,		qlen,
 	 * kick,	shut,		close,		check,
-	 * error,	state,		status,		eol_seq
+	 * error,	state,		status,		eol_seq,
+	 * accepted,	poll
 	 */
 	{ TYPE_TCP,
 	so_tcp,		NULL,		so_tcp_listen,	so_tcp_conn,
 	TRUE,		so_tcp_recv,	so_tcp_send,	so_tcp_qlen,
 	so_tcp_kick,	so_tcp_shut,	so_tcp_close,	checkipaddr,
-	Tcpreasons,	tcpstate,	so_tcp_stat,	Inet_eol },
+	Tcpreasons,	tcpstate,	so_tcp_stat,	Inet_eol,
+	so_tcp_accepted,	so_tcp_poll },
 
 	{ TYPE_UDP,
 	so_udp,		so_udp_bind,	NULL,		so_udp_conn,
@@ -592,13 +605,15 @@ struct socklink Socklink[] = {
 	so_los,		NULL,		NULL,		NULL,
 	TRUE,		so_lo_recv,	so_los_send,	so_los_qlen,
 	NULL,		so_loc_shut,	so_loc_close,	NULL,
-	NULL,		NULL,		so_loc_stat,	Eol },
+	NULL,		NULL,		so_loc_stat,	Eol,
+	NULL,		so_loc_poll },
 
 	{ TYPE_LOCAL_DGRAM,
 	so_lod,		NULL,		NULL,		NULL,
 	FALSE,		so_lo_recv,	so_lod_send,	so_lod_qlen,
 	NULL,		so_loc_shut,	so_loc_close,	NULL,
-	NULL,		NULL,		so_loc_stat,	Eol },
+	NULL,		NULL,		so_loc_stat,	Eol,
+	NULL,		so_loc_poll },
 #endif
 
 	{ -1 },
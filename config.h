@@ -34,6 +34,7 @@
 #define	MTHRESH		8192	/* Default memory threshold */
 #define	NSESSIONS	20	/* Number of interactive clients */
 #define DEFNSOCK	100	/* Default number of sockets */
+#define	DEFNSOCKMAX	1024	/* Default limit on growth of socket table */
 #define	DEFNFILES	128	/* Default number of kopen files */
 
 /* Hardware driver options */
@@ -59,9 +59,9 @@ int *fromlen
 	*bpp = dequeue(&up->cb.local->q);
 	if(up->cb.local->q == NULL && (up->cb.local->flags & LOC_SHUTDOWN)){
 		s = up->index;
-		close_s(s);
-	}
-	ksignal(up,0);
+		close_s(s);	/* which does the wakeup */
+	} else
+		sockwake(up,0);
 	return len_p(*bpp);
 }
 int
@@ -76,7 +76,7 @@ struct ksockaddr *to
 		return -1;
 	}
 	append(&up->cb.local->peer->cb.local->q,bpp);
-	ksignal(up->cb.local->peer,0);
+	sockwake(up->cb.local->peer,0);
 	/* If high water mark has been reached, block */
 	while(up->cb.local->peer != NULL &&
 	      len_p(up->cb.local->peer->cb.local->q) >=
@@ -106,7 +106,7 @@ struct ksockaddr *to
 		return -1;
 	}
 	enqueue(&up->cb.local->peer->cb.local->q,bpp);
-	ksignal(up->cb.local->peer,0);
+	sockwake(up->cb.local->peer,0);
 	/* If high water mark has been reached, block */
 	while(up->cb.local->peer != NULL &&
 	      len_q(up->cb.local->peer->cb.local->q) >=
@@ -176,7 +176,7 @@ so_loc_close(struct usock *up)
 {
 	if(up->cb.local->peer != NULL){
 		up->cb.local->peer->cb.local->peer = NULL;
-		ksignal(up->cb.local->peer,0);
+		sockwake(up->cb.local->peer,0);
 	}
 	free_q(&up->cb.local->q);
 	free(up->cb.local);
@@ -187,6 +187,22 @@ lopsocket(struct ksockaddr *p)
 {
 	return "";
 }
+/* Which kPOLL conditions hold for a local socket */
+int
+so_loc_poll(struct usock *up)
+{
+	struct usock *peer = up->cb.local->peer;
+	int ev = 0;
+
+	if(up->cb.local->q != NULL || peer == NULL)
+		ev |= kPOLLIN;
+	if(peer == NULL)
+		ev |= kPOLLHUP;
+	else if((up->type == TYPE_LOCAL_STREAM ? len_p(peer->cb.local->q)
+	 : len_q(peer->cb.local->q)) < peer->cb.local->hiwat)
+		ev |= kPOLLOUT;
+	return ev;
+}
 int
 so_loc_stat(struct usock *up)
 {
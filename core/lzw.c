@@ -0,0 +1,379 @@
+/* LZW compression for stream sockets.
+ *
+ * Once lzwinit() has been called on a socket, everything sent on it is
+ * compressed and everything received is expanded. Each send_mbuf() is
+ * coded as a unit ending in a ZFLUSH codeword and padded to a byte
+ * boundary, so the receiver can expand all of it as soon as it arrives;
+ * the string table carries over from one send to the next, so a long
+ * conversation keeps compressing better until the table fills, at which
+ * point it is cleared with ZCC and built again.
+ *
+ * Codewords are packed least significant bit first. Their width grows
+ * from LZWBITS up to the sender's maxbits, which is given in a two byte
+ * header (version, maxbits) ahead of the first codeword. Each side works
+ * out the width from the number of codes the decoder will know about by
+ * the time it reads the codeword, so no width changes are signalled.
+ *
+ * The encoder finds strings through hash chains; LZWCOMPACT mode uses
+ * a smaller set of chain heads than LZWFAST, trading speed for memory.
+ */
+#include "top.h"
+
+#include "global.h"
+#include "config.h"
+#include "net/core/mbuf.h"
+#include "core/proc.h"
+#include "lib/std/errno.h"
+#include "lzw.h"
+#include "core/usock.h"
+#include "core/socket.h"
+
+#ifdef	LZW
+
+static struct lzw *lzwalloc(int bits,int mode,int decoder);
+static void lzwreset(struct lzw *lzw);
+static uint lzwwidth(uint n);
+static void putcode(struct lzw *lzw,uint code,uint8 **cpp);
+static int32 lookup(struct lzw *lzw,uint code,uint8 c);
+static void addentry(struct lzw *lzw,uint code,uint8 c);
+static void putstring(struct lzw *lzw,uint code,struct mbuf **bpp,
+	struct mbuf **tail);
+
+#define	zhash(lzw,code,c)	((((code) << 4) ^ (c)) & (lzw)->hmask)
+
+/* Start compressing both directions of a stream socket, with codewords
+ * of up to 'bits' bits. Both ends must switch at the same point in the
+ * data stream, normally just after agreeing to.
+ */
+int
+lzwinit(
+int s,		/* Socket index */
+int bits,	/* Maximum codeword size, 0 for default */
+int mode	/* LZWCOMPACT or LZWFAST */
+){
+	struct usock *up;
+
+	if((up = itop(s)) == NULL){
+		kerrno = kEBADF;
+		return -1;
+	}
+	if(up->zout != NULL)
+		return 0;	/* Already on */
+	if(bits == 0)
+		bits = DEF_LZWBITS;
+	bits = min(max(bits,LZWBITS),LZWMAXBITS);
+	if((up->zout = lzwalloc(bits,mode,0)) == NULL
+	 || (up->zin = lzwalloc(0,mode,1)) == NULL){
+		lzwfree(up);
+		kerrno = kENOMEM;
+		return -1;
+	}
+	return 0;
+}
+/* Release a socket's compression state */
+void
+lzwfree(struct usock *up)
+{
+	struct lzw *lzw;
+	int i;
+
+	for(i=0;i<2;i++){
+		lzw = i == 0 ? up->zout : up->zin;
+		if(lzw == NULL)
+			continue;
+		free(lzw->tbl);
+		free(lzw->hash);
+		free(lzw->stack);
+		free(lzw);
+	}
+	up->zout = up->zin = NULL;
+}
+/* Replace *bpp with its compressed form, ending in a flush */
+void
+lzwencode(
+struct lzw *lzw,
+struct mbuf **bpp
+){
+	struct mbuf *bp,*zbp;
+	uint8 *cp;
+	int32 code;
+	uint len,i;
+	uint8 c;
+
+	len = len_p(*bpp);
+	/* At most one codeword per byte, plus clears, the last string,
+	 * the flush and the header
+	 */
+	zbp = ambufw((uint)(((int32)len + len/128 + 4) * lzw->maxbits / 8 + 8));
+	cp = zbp->data;
+	if(lzw->hdr != 0){
+		*cp++ = ZVERSION;
+		*cp++ = lzw->maxbits;
+		lzw->hdr = 0;
+	}
+	for(bp = *bpp;bp != NULL;bp = bp->next){
+		for(i=0;i<bp->cnt;i++){
+			c = bp->data[i];
+			if(lzw->prefix == -1){
+				lzw->prefix = c;
+				continue;
+			}
+			if((code = lookup(lzw,(uint)lzw->prefix,c)) != -1){
+				lzw->prefix = code;
+				continue;
+			}
+			putcode(lzw,(uint)lzw->prefix,&cp);
+			addentry(lzw,(uint)lzw->prefix,c);
+			if(lzw->next == (1U << lzw->maxbits)){
+				/* Table full; start over */
+				putcode(lzw,ZCC,&cp);
+				lzwreset(lzw);
+			}
+			lzw->prefix = c;
+		}
+	}
+	/* Send what's been matched so far, then tell the decoder to
+	 * forget it, since we don't know how it will be continued
+	 */
+	if(lzw->prefix != -1){
+		putcode(lzw,(uint)lzw->prefix,&cp);
+		lzw->pending = 1;
+		lzw->prefix = -1;
+	}
+	putcode(lzw,ZFLUSH,&cp);
+	lzw->pending = 0;
+	if(lzw->nextbit != 0){
+		*cp++ = lzw->code;
+		lzw->code = 0;
+		lzw->nextbit = 0;
+	}
+	zbp->cnt = (uint)(cp - zbp->data);
+	lzw->cnt += len;
+	lzw->zcnt += zbp->cnt;
+	free_p(bpp);
+	*bpp = zbp;
+}
+/* Replace *bpp with its expansion, which may be nothing if it ends
+ * partway through a codeword
+ */
+void
+lzwdecode(
+struct lzw *lzw,
+struct mbuf **bpp
+){
+	struct mbuf *out = NULL,*tail = NULL;
+	uint code,n,width,k;
+	int c;
+
+	lzw->zcnt += len_p(*bpp);
+	while((c = PULLCHAR(bpp)) != -1){
+		if(lzw->hdr != 0){
+			/* Version, then codeword size */
+			if(lzw->hdr-- == 2){
+				if(c != ZVERSION)
+					lzw->version = -1;
+				continue;
+			}
+			if(lzw->version == -1 || c < LZWBITS || c > LZWMAXBITS){
+				/* Can't be ours; give up on the stream */
+				lzw->version = -1;
+				continue;
+			}
+			lzw->maxbits = c;
+			if((lzw->tbl = (struct zentry *)malloc(((1U << c) - ZFIRST)
+			 * sizeof(struct zentry))) == NULL
+			 || (lzw->stack = (uint8 *)malloc(1U << c)) == NULL)
+				lzw->version = -1;
+			continue;
+		}
+		if(lzw->version == -1)
+			continue;	/* Broken; discard */
+		lzw->code |= (uint32)c << lzw->nextbit;
+		lzw->nextbit += 8;
+		for(;;){
+			n = lzw->next + (lzw->prefix != -1);
+			width = lzwwidth(n);
+			if(lzw->nextbit < width)
+				break;
+			code = lzw->code & ((1U << width) - 1);
+			lzw->code >>= width;
+			lzw->nextbit -= width;
+
+			if(code == ZCC){
+				lzwreset(lzw);
+				continue;
+			}
+			if(code == ZFLUSH){
+				/* Sender padded to a byte boundary */
+				lzw->prefix = -1;
+				lzw->code >>= lzw->nextbit % 8;
+				lzw->nextbit -= lzw->nextbit % 8;
+				continue;
+			}
+			if(code >= n){
+				/* Out of step with the sender; nothing we
+				 * decode from here on can be trusted
+				 */
+				lzw->version = -1;
+				break;
+			}
+			if(lzw->prefix != -1 && lzw->next < (1U << lzw->maxbits)){
+				/* The entry the sender made when it sent the
+				 * last code: that string plus our first char
+				 */
+				k = code == lzw->next ? (uint)lzw->prefix : code;
+				while(k >= ZFIRST)
+					k = lzw->tbl[k - ZFIRST].code;
+				addentry(lzw,(uint)lzw->prefix,(uint8)k);
+			}
+			putstring(lzw,code,&out,&tail);
+			lzw->prefix = code;
+		}
+	}
+	if(out != NULL)
+		lzw->cnt += len_p(out);
+	*bpp = out;
+}
+
+static struct lzw *
+lzwalloc(
+int bits,
+int mode,
+int decoder
+){
+	struct lzw *lzw;
+
+	if((lzw = (struct lzw *)calloc(1,sizeof(struct lzw))) == NULL)
+		return NULL;
+	lzw->mode = mode;
+	lzw->version = ZVERSION;
+	lzw->hdr = 2;
+	if(!decoder){
+		/* The decoder's table is sized by the header it receives */
+		lzw->maxbits = bits;
+		if((lzw->tbl = (struct zentry *)malloc(((1U << bits) - ZFIRST)
+		 * sizeof(struct zentry))) == NULL){
+			free(lzw);
+			return NULL;
+		}
+		lzw->hmask = (mode == LZWFAST ? ZHASH : ZHASHSMALL) - 1;
+		if((lzw->hash = (uint *)malloc((lzw->hmask + 1)
+		 * sizeof(uint))) == NULL){
+			free(lzw->tbl);
+			free(lzw);
+			return NULL;
+		}
+	}
+	lzwreset(lzw);
+	return lzw;
+}
+/* Empty the string table */
+static void
+lzwreset(struct lzw *lzw)
+{
+	uint i;
+
+	lzw->next = ZFIRST;
+	lzw->codebits = LZWBITS;
+	lzw->prefix = -1;
+	if(lzw->hash != NULL){
+		for(i=0;i<=lzw->hmask;i++)
+			lzw->hash[i] = ZNONE;
+	}
+}
+/* Codeword size needed to send any of n codes */
+static uint
+lzwwidth(uint n)
+{
+	uint width = LZWBITS;
+
+	while((1U << width) < n)
+		width++;
+	return width;
+}
+/* Append a codeword to the output */
+static void
+putcode(
+struct lzw *lzw,
+uint code,
+uint8 **cpp
+){
+	lzw->codebits = lzwwidth(lzw->next + lzw->pending);
+	lzw->code |= (uint32)code << lzw->nextbit;
+	lzw->nextbit += lzw->codebits;
+	while(lzw->nextbit >= 8){
+		*(*cpp)++ = lzw->code;
+		lzw->code >>= 8;
+		lzw->nextbit -= 8;
+	}
+}
+/* Find the code for string 'code' followed by c; -1 if none */
+static int32
+lookup(
+struct lzw *lzw,
+uint code,
+uint8 c
+){
+	struct zentry *zp;
+	uint i;
+
+	for(i = lzw->hash[zhash(lzw,code,c)];i != ZNONE;i = zp->link){
+		zp = &lzw->tbl[i - ZFIRST];
+		if(zp->code == code && zp->data == c)
+			return i;
+	}
+	return -1;
+}
+static void
+addentry(
+struct lzw *lzw,
+uint code,
+uint8 c
+){
+	struct zentry *zp;
+	uint h;
+
+	zp = &lzw->tbl[lzw->next - ZFIRST];
+	zp->code = code;
+	zp->data = c;
+	if(lzw->hash != NULL){
+		h = zhash(lzw,code,c);
+		zp->link = lzw->hash[h];
+		lzw->hash[h] = lzw->next;
+	}
+	lzw->next++;
+}
+/* Append the string for a code to the output chain */
+static void
+putstring(
+struct lzw *lzw,
+uint code,
+struct mbuf **bpp,
+struct mbuf **tail
+){
+	struct mbuf *bp;
+	uint8 *sp;
+	uint len;
+
+	/* The table holds strings back to front */
+	sp = lzw->stack;
+	while(code >= ZFIRST){
+		*sp++ = lzw->tbl[code - ZFIRST].data;
+		code = lzw->tbl[code - ZFIRST].code;
+	}
+	*sp++ = code;
+	len = (uint)(sp - lzw->stack);
+	while(len != 0){
+		if((bp = *tail) == NULL || bp->cnt == bp->size){
+			bp = ambufw(max(len,256));
+			if(*tail == NULL)
+				*bpp = bp;
+			else
+				(*tail)->next = bp;
+			*tail = bp;
+		}
+		while(len != 0 && bp->cnt < bp->size)
+			bp->data[bp->cnt++] = *--sp, len--;
+	}
+}
+#endif	/* LZW */
@@ -11,8 +11,10 @@
 #endif
 #include "lib/std/errno.h"
 #include "global.h"
+#include "config.h"
 #include "net/core/mbuf.h"
 #include "core/proc.h"
+#include "core/timer.h"
 #include "lzw.h"
 #include "core/usock.h"
 #include "core/socket.h"
@@ -46,6 +48,19 @@ char *Sock_errlist[] = {
 
 char Badsocket[] = "Bad socket";
 struct usock **Usock;		/* Socket entry array */
+unsigned Sock_inuse;		/* Sockets now open */
+unsigned Sock_peak;		/* Most ever open at once */
+
+/* Free slots in Usock[] are kept on a stack, so that finding one doesn't
+ * mean scanning the table. When the stack runs dry the table is doubled,
+ * up to Nsockmax entries.
+ */
+static int *Sock_free;
+static unsigned Sock_nfree;
+
+static void sock_addfree(unsigned lo,unsigned hi);
+static int sockready(struct usock *up);
+static int sock_grow(void);
 
 /* Initialize user socket array */
 void
@@ -53,7 +68,42 @@ sockinit(void)
 {
 	if(Usock != (struct usock **)NULL)
 		return;	/* Already initialized */
+	Nsock = min(max(Nsock,1),NSOCKLIM);
+	Nsockmax = min(max(Nsockmax,Nsock),NSOCKLIM);
 	Usock = (struct usock **)callocw(Nsock,sizeof(struct usock *));
+	Sock_free = (int *)mallocw(Nsock*sizeof(int));
+	sock_addfree(0,Nsock);
+}
+/* Put slots lo through hi-1 on the free stack, lowest on top */
+static void
+sock_addfree(
+unsigned lo,
+unsigned hi
+){
+	while(hi > lo)
+		Sock_free[Sock_nfree++] = --hi;
+}
+/* Enlarge the socket table; return -1 if at the limit or out of memory */
+static int
+sock_grow(void)
+{
+	struct usock **up;
+	int *fp;
+	unsigned n;
+
+	if(Nsock >= Nsockmax)
+		return -1;
+	n = min(2*Nsock,Nsockmax);
+	if((up = (struct usock **)realloc(Usock,n*sizeof(struct usock *))) == NULL)
+		return -1;
+	Usock = up;
+	memset(&Usock[Nsock],0,(n - Nsock)*sizeof(struct usock *));
+	if((fp = (int *)realloc(Sock_free,n*sizeof(int))) == NULL)
+		return -1;
+	Sock_free = fp;
+	sock_addfree(Nsock,n);
+	Nsock = n;
+	return 0;
 }
 
 /* Create a user socket, return socket index
@@ -77,20 +127,25 @@ int protocol	/* Used for raw IP sockets */
 	struct socklink *sp;
 	int s;
 
-	for(s=0;s<Nsock;s++)
-		if(Usock[s] == NULL)
-			break;
-	if(s == Nsock){
+	if(Sock_nfree == 0 && sock_grow() == -1){
 		kerrno = kEMFILE;
 		return -1;
 	}
-	Usock[s] = up = (struct usock *)calloc(1,sizeof(struct usock));
+	if((up = (struct usock *)calloc(1,sizeof(struct usock))) == NULL){
+		kerrno = kENOMEM;
+		return -1;
+	}
+	s = Sock_free[--Sock_nfree];
+	Usock[s] = up;
+	if(++Sock_inuse > Sock_peak)
+		Sock_peak = Sock_inuse;
 
 	s =_mk_fd(s,_FL_SOCK);
 	up->index = s;
 	up->refcnt = 1;
 	kerrno = 0;
 	up->rdysock = -1;
+	up->pollseq = 1;
 	up->owner = Curproc;
 	switch(af){
 	case kAF_LOCAL:
@@ -314,6 +369,9 @@ int *peernamelen	/* Length of peer name */
 	i = up->rdysock;
 	up->rdysock = -1;
 
+	/* Let the protocol make the next connection ready, if it queues them */
+	if(sp->accepted != NULL)
+		(*sp->accepted)(up,itop(i));
 	up = itop(i);
 	if(peername != NULL && peernamelen != NULL){
 		*peernamelen = min(up->peernamelen,*peernamelen);
@@ -346,6 +404,28 @@ int *fromlen		/* Length of peer address */
 		kerrno = kEOPNOTSUPP;
 		return -1;
 	}
+#ifdef	LZW
+	if(up->zin != NULL){
+		struct mbuf *bp;
+		int cnt;
+
+		/* A segment may hold only part of a codeword, so keep
+		 * reading until something comes out
+		 */
+		do {
+			bp = NULL;
+			if((cnt = (*sp->recv)(up,&bp,from,fromlen)) <= 0)
+				return cnt;
+			lzwdecode(up->zin,&bp);
+		} while(bp == NULL);
+		cnt = len_p(bp);
+		if(bpp != NULL)
+			*bpp = bp;
+		else
+			free_p(&bp);
+		return cnt;
+	}
+#endif
 	return (*sp->recv)(up,bpp,from,fromlen);
 }
 /* Low level send routine; user supplies mbuf for transmission. More
@@ -365,6 +445,7 @@ int tolen		/* Length of destination */
 ){
 	register struct usock *up;
 	int cnt;
+	int len = -1;	/* Uncompressed length, if compressing */
 	struct socklink *sp;
 
 	if((up = itop(s)) == NULL){
@@ -385,6 +466,15 @@ int tolen		/* Length of destination */
 		kerrno = kEAFNOSUPPORT;
 		return -1;
 	}
+#ifdef	LZW
+	if(up->zout != NULL){
+		/* Each send is a complete, flushed unit so the peer can
+		 * expand it as soon as it arrives
+		 */
+		len = len_p(*bpp);
+		lzwencode(up->zout,bpp);
+	}
+#endif
 	/* The proto send routine is expected to free the buffer
 	 * we pass it even if the send fails
 	 */
@@ -392,7 +482,7 @@ int tolen		/* Length of destination */
 		kerrno = kEOPNOTSUPP;
 		return -1;
 	}
-	return cnt;
+	return len != -1 ? len : cnt;
 }
 /* Return local name passed in an earlier bind() call */
 int
@@ -544,12 +634,11 @@ int how		/* (see above) */
 	sp = up->sp;
 
 	/* Just close the socket if special shutdown routine not present */
-	if(sp->shut == NULL){
-		close_s(s);
-	} else if((*sp->shut)(up,how) == -1){
+	if(sp->shut == NULL)
+		return close_s(s);	/* which wakes everybody up */
+	if((*sp->shut)(up,how) == -1)
 		return -1;
-	}
-	ksignal(up,0);
+	sockwake(up,0);
 	return 0;
 }
 /* Close a socket, freeing it for reuse. Try to do a graceful close on a
@@ -574,9 +663,12 @@ int s		/* Socket index */
 
 	free(up->name);
 	free(up->peername);
+	lzwfree(up);
 
-	ksignal(up,0);	/* Wake up anybody doing an accept() or recv() */
+	sockwake(up,0);	/* Wake up anybody doing an accept(), recv() or poll */
 	Usock[_fd_seq(up->index)] = NULL;
+	Sock_free[Sock_nfree++] = _fd_seq(up->index);
+	Sock_inuse--;
 	free(up);
 	return 0;
 }
@@ -603,7 +695,7 @@ freesock(struct proc *pp)
 	for(i=0;i < Nsock;i++){
 		up = Usock[i];
 		if(up != NULL && up->type != NOTUSED && up->owner == pp)
-			kshutdown(i,2);
+			kshutdown(_mk_fd(i,_FL_SOCK),2);
 	}
 }
 /* Set Internet type-of-service to be used */
@@ -619,6 +711,96 @@ settos(int s, int tos)
 	up->tos = tos;
 	return 0;
 }
+/* Wait for any of a set of sockets to become ready, so that one process
+ * can serve many. Each kpollfd names a socket and the kPOLL conditions
+ * wanted; kPOLLHUP and kPOLLNVAL are reported whether asked for or not.
+ * Entries with kPOLLET set are reported only if the socket has seen
+ * activity since they were last reported. Timeout is in ms: 0 means
+ * just look, -1 wait forever. Returns the number of entries with revents
+ * set, 0 on timeout, or -1 with kerrno set if the wait was interrupted.
+ *
+ * Readiness is rechecked whenever one of the sockets' upcalls calls
+ * sockwake(); only one process can poll a given socket at a time.
+ */
+int
+ksockpoll(
+struct kpollfd *fds,
+int nfds,
+int32 timeout
+){
+	struct usock *up;
+	int32 start,left;
+	int i,n,ev;
+
+	start = msclock();
+	for(;;){
+		n = 0;
+		for(i=0;i<nfds;i++){
+			fds[i].revents = 0;
+			if(fds[i].fd < 0)
+				continue;
+			if((up = itop(fds[i].fd)) == NULL){
+				fds[i].revents = kPOLLNVAL;
+				n++;
+				continue;
+			}
+			ev = sockready(up) & (fds[i].events | kPOLLHUP);
+			if(ev != 0 && (fds[i].events & kPOLLET)){
+				if(fds[i].seen == up->pollseq)
+					ev = 0;		/* Nothing new */
+				else
+					fds[i].seen = up->pollseq;
+			}
+			if((fds[i].revents = ev) != 0)
+				n++;
+		}
+		if(n != 0 || timeout == 0)
+			return n;
+		if(timeout > 0 && (left = timeout - (msclock() - start)) <= 0)
+			return 0;
+
+		/* Have every socket's upcalls wake us, then sleep */
+		for(i=0;i<nfds;i++){
+			if(fds[i].fd >= 0 && (up = itop(fds[i].fd)) != NULL)
+				up->pollev = fds;
+		}
+		if(timeout > 0)
+			kalarm(left);
+		ev = kwait(fds);
+		if(timeout > 0)
+			kalarm(0L);
+		for(i=0;i<nfds;i++){
+			if(fds[i].fd >= 0 && (up = itop(fds[i].fd)) != NULL
+			 && up->pollev == fds)
+				up->pollev = NULL;
+		}
+		if(ev != 0 && ev != kEALARM){
+			kerrno = ev;
+			return -1;
+		}
+	}
+}
+/* Return the kPOLL conditions that currently hold for a socket */
+static int
+sockready(struct usock *up)
+{
+	struct socklink *sp;
+	int ev;
+
+	if(! so_is_connected(up))
+		return kPOLLIN | kPOLLHUP;	/* recv fails at once */
+	sp = up->sp;
+	if(sp->poll != NULL)
+		return (*sp->poll)(up);
+
+	/* Without a protocol routine, go by the receive queue and assume
+	 * the send side never blocks
+	 */
+	ev = kPOLLOUT;
+	if(up->rdysock != -1 || (sp->qlen != NULL && (*sp->qlen)(up,0) > 0))
+		ev |= kPOLLIN;
+	return ev;
+}
 
 /* Return a pair of mutually connected sockets in sv[0] and sv[1] */
 int
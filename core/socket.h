@@ -51,6 +51,19 @@
 
 extern char *Sock_errlist[];
 
+/* One socket of interest to ksockpoll() */
+struct kpollfd {
+	int fd;			/* Socket; ignored if negative */
+	short events;		/* Conditions wanted */
+	short revents;		/* Conditions found */
+	unsigned seen;		/* For kPOLLET; set to 0 before first use */
+};
+#define	kPOLLIN		0x01	/* recv or accept won't block */
+#define	kPOLLOUT	0x02	/* send won't block */
+#define	kPOLLHUP	0x04	/* Not (or no longer) connected; always reported */
+#define	kPOLLNVAL	0x08	/* Not an open socket; always reported */
+#define	kPOLLET		0x10	/* Report only after new activity (edge triggered) */
+
 /* In socket.c: */
 extern int Axi_sock;	/* Socket listening to AX25 (there can be only one) */
 
@@ -68,6 +81,7 @@ int send_mbuf(int s,struct mbuf **bp,int flags,struct ksockaddr *to,int tolen);
 int settos(int s,int tos);
 int kshutdown(int s,int how);
 int ksocket(int af,int type,int protocol);
+int ksockpoll(struct kpollfd *fds,int nfds,int32 timeout);
 void sockinit(void);
 int sockkick(int s);
 int socklen(int s,int rtx);
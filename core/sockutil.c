@@ -82,6 +82,22 @@ register int s;	/* Socket index */
 
 	return Usock[s];
 }
+/* Wake up processes waiting on a socket: up to n of those blocked in
+ * it directly (0 = all), and any ksockpoll() that's watching it
+ */
+void
+sockwake(
+struct usock *up,
+int n
+){
+	if(up == NULL)
+		return;
+	if(++up->pollseq == 0)
+		up->pollseq = 1;
+	ksignal(up,n);
+	if(up->pollev != NULL)
+		ksignal(up->pollev,0);
+}
 
 void
 st_garbage(red)
@@ -46,6 +46,8 @@ struct socklink {
 	char *(*state)(struct usock *);
 	int (*status)(struct usock *);
 	char *eol;
+	void (*accepted)(struct usock *,struct usock *);
+	int (*poll)(struct usock *);
 };
 extern struct socklink Socklink[];
 
@@ -89,14 +91,24 @@ struct usock {
 	uint8 errcodes[4];	/* Protocol-specific error codes */
 	uint8 tos;		/* Internet type-of-service */
 	int flag;		/* Mode flags, defined in socket.h */
+	void *pollev;		/* Event of a ksockpoll() watching us */
+	unsigned pollseq;	/* Bumped on every wakeup, never 0 */
+	struct lzw *zout;	/* Compressor for sends, if on */
+	struct lzw *zin;	/* Expander for receives, if on */
 };
 extern char *(*Psock[])(struct ksockaddr *);
 extern char Badsocket[];
 extern char *Socktypes[];
 extern struct usock **Usock;
 extern unsigned Nsock;
+extern unsigned Nsockmax;
+extern unsigned Sock_inuse;
+extern unsigned Sock_peak;
+
+#define	NSOCKLIM	8192	/* Most the descriptor encoding can hold */
 
 struct usock *itop(int s);
+void sockwake(struct usock *up,int n);
 void st_garbage(int red);
 int so_ip_autobind(struct usock *up);
 
@@ -161,6 +173,7 @@ int so_lod_qlen(struct usock *up,int rtx);
 int so_los_qlen(struct usock *up,int rtx);
 int so_loc_shut(struct usock *up,int how);
 int so_loc_close(struct usock *up);
+int so_loc_poll(struct usock *up);
 char *lopsocket(struct ksockaddr *p);
 int so_loc_stat(struct usock *up);
 
@@ -190,6 +203,8 @@ int so_n4_stat(struct usock *up);
 /* In tcpsock.c: */
 int so_tcp(struct usock *up,int protocol);
 int so_tcp_listen(struct usock *up,int backlog);
+void so_tcp_accepted(struct usock *up,struct usock *nup);
+int so_tcp_poll(struct usock *up);
 int so_tcp_conn(struct usock *up);
 int so_tcp_recv(struct usock *up,struct mbuf **bpp,struct ksockaddr *from,
 	int *fromlen);
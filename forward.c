@@ -729,8 +729,23 @@ void *v1, *v2;
 
 	/* send our SID if the peer announced its SID */
 	if(m->sid & MBX_SID) {
-		kputs("[NET-HMR$]");
-		kfflush(m->user);
+#ifdef	LZW
+		if(m->sid & MBX_LZW_SID){
+			/* Compress from here on; the peer switches
+			 * when it reads this SID. Once it is sent the
+			 * ends must agree, so give up if we can't.
+			 */
+			if(kputs("[NET-HMRL$]") == -1 || kfflush(m->user) == -1
+			 || lzwinit(kfileno(m->user),DEF_LZWBITS,LZWFAST) == -1){
+				exitbbs(m);
+				return;
+			}
+		} else
+#endif
+		{
+			kputs("[NET-HMR$]");
+			kfflush(m->user);
+		}
 		for(;;) {
 			if(kfgets(m->line,MBXLINE,m->user) == NULL) {
 				exitbbs(m);
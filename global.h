@@ -305,7 +305,8 @@ extern char System[];
 extern char *Tmpdir;
 
 extern unsigned Nfiles;	/* Maximum number of open files */
-extern unsigned Nsock;	/* Maximum number of open sockets */
+extern unsigned Nsock;	/* Current size of socket table */
+extern unsigned Nsockmax;	/* Maximum number of open sockets */
 
 extern void (*Gcollect[])();
 
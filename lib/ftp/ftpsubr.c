@@ -46,6 +46,7 @@ enum verb_level verb;	/* Verbosity level */
 		kfmode(network,STREAM_ASCII);
 		break;
 	}
+	ksetvbuf(fp,NULL,_kIOBLK,0);	/* Read straight through */
 	buf = mallocw(kBUFSIZ);
 	for(;;){
 		if((cnt = kfread(buf,1,kBUFSIZ,fp)) == 0){
@@ -29,6 +29,27 @@ static char decimal = '.';
 
 #define	PUTC(x)	(putter((x),parg))
 
+/* Runs of characters go to the writer in one call when there is one */
+#define	PUTS(s,n) do { \
+	if (writer != NULL) \
+	  writer((s),(n),parg); \
+	else { \
+	  const char *_s = (s); \
+	  int _n = (n); \
+	  while (--_n >= 0) \
+	    PUTC(*_s++); \
+	} \
+} while (0)
+
+static const char blanks[] = "                ";
+#define	PUTBLANKS(k) do { \
+	int _k = (k); \
+	while (_k > 0) { \
+	  PUTS(blanks, _k < 16 ? _k : 16); \
+	  _k -= 16; \
+	} \
+} while (0)
+
 #define ARG(basetype) \
 	_ulong = flags&LONGINT ? va_arg(argp, long basetype) : \
 	    flags&SHORTINT ? (short basetype)va_arg(argp, int) : \
@@ -71,11 +92,13 @@ static char NULL_REP[] = "(null)";
 int
 _format(
 	void putter(char,void *),	/* User function to accept output */
-	void *parg,			/* Arg passed to user function */
+	void writer(const char *,int,void *),	/* Same for runs, or NULL */
+	void *parg,			/* Arg passed to user functions */
 	const char *fmt0,
 	va_list argp)
 {
   const char *fmt;		/* format string */
+  const char *lit;		/* start of literal text in fmt */
   int ch;			/* character from fmt */
   int cnt;			/* return value accumulator */
   int n;			/* random handy integer */
@@ -103,10 +126,12 @@ _format(
   digs = "0123456789abcdef";
   for (cnt = 0;; ++fmt)
   {
-    while((ch = *fmt) && ch != '%'){
-	PUTC(ch);
-	cnt++;
-	fmt++;
+    for (lit = fmt; (ch = *fmt) && ch != '%'; fmt++)
+      ;
+    if (fmt != lit)
+    {
+      PUTS(lit, fmt - lit);
+      cnt += fmt - lit;
     }
     if (!ch)
       return cnt;
@@ -374,9 +399,8 @@ _format(
 	realsz += 2;
 
       /* right-adjusting blank padding */
-      if ((flags & (LADJUST|ZEROPAD)) == 0 && width)
-	for (n = realsz; n < width; n++)
-	  PUTC(' ');
+      if ((flags & (LADJUST|ZEROPAD)) == 0 && width > realsz)
+	PUTBLANKS(width - realsz);
       /* prefix */
       if (sign)
 	PUTC(sign);
@@ -394,16 +418,13 @@ _format(
 	PUTC('0');
 
       /* the string or number proper */
-      n = size;
-	while (--n >= 0)
-	  PUTC(*t++);
+      PUTS(t, size);
       /* trailing f.p. zeroes */
       while (--fpprec >= 0)
 	PUTC('0');
       /* left-adjusting padding (always blank) */
-      if (flags & LADJUST)
-	for (n = realsz; n < width; n++)
-	  PUTC(' ');
+      if ((flags & LADJUST) && width > realsz)
+	PUTBLANKS(width - realsz);
       /* finally, adjust cnt */
       cnt += width > realsz ? width : realsz;
       break;
@@ -20,6 +20,9 @@
 #ifdef HAVE_FUNOPEN
 #include <stdio.h>
 #endif
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <assert.h>
 #include "global.h"
 #include "lib/std/stdio.h"
@@ -30,18 +33,35 @@
 #include "core/display.h"
 #include "core/asy.h"
 #include "lib/std/errno.h"
+#ifdef UNIX
+#include "unix/hostio_unix.h"
+#endif
 
-#define	_CREAT(a,b)	creat((a),(b))
 #ifdef UNIX
-#define _OPEN(a,b)	open((a),(b))
-#define	_CLOSE(a)	close((a))
-#define	_READ(a,b,c)	read((a),(b),(c))
-#define	_WRITE(a,b,c)	write((a),(b),(c))
+/* File calls go through the host I/O threads, so a slow disk doesn't
+ * hold up the rest of the system
+ */
+#define	_CREAT(a,b,c)	hio_open((a),(b)|O_CREAT|O_TRUNC,(c))
+#define _OPEN(a,b,c)	hio_open((a),(b),(c))
+#define	_CLOSE(a)	hio_close((a))
+#define	_READ(a,b,c)	hio_read((a),(b),(c))
+#define	_WRITE(a,b,c)	hio_write((a),(b),(c))
+#define	_PREAD(a,b,c,d)	hio_pread((a),(b),(c),(d))
+#define	_PWRITE(a,b,c,d) hio_pwrite((a),(b),(c),(d))
+#define	_STAT(a,b)	hio_stat((a),(b))
+#define	_MAPREAD(a,b,c,d,e) hio_mapread((a),(b),(c),(d),(e))
 #else
-#define _OPEN(a,b)	_open((a),(b))
+#define	_CREAT(a,b,c)	creat((a),(c))
+#define _OPEN(a,b,c)	open((a),(b),(c))
 #define	_CLOSE(a)	_close((a))
 #define	_READ(a,b,c)	_read((a),(b),(c))
 #define	_WRITE(a,b,c)	_write((a),(b),(c))
+/* Read or write at an offset; -1 writes at the end */
+#define	_PREAD(a,b,c,d)	(_LSEEK((a),(d),kSEEK_SET),_READ((a),(b),(c)))
+#define	_PWRITE(a,b,c,d) ((d) == -1 ? _LSEEK((a),0L,kSEEK_END) \
+			 : _LSEEK((a),(d),kSEEK_SET),_WRITE((a),(b),(c)))
+#define	_STAT(a,b)	stat((a),(b))
+#define	_MAPREAD(a,b,c,d,e) (memcpy((b),(char *)(c) + (e),(d)),(long)(d))
 #endif
 #define	_LSEEK(a,b,c)	lseek((a),(b),(c))
 #define	_DUP(a)		dup((a))
@@ -49,6 +69,10 @@
 static void _fclose(kFILE *fp);
 static struct mbuf *_fillbuf(kFILE *fp,int cnt);
 static kFILE *_fcreat(void);
+#ifdef HAVE_MMAP
+static struct mbuf *_fillmap(kFILE *fp);
+static void _funmap(kFILE *fp);
+#endif
 
 kFILE *_Files;
 int _clrtmp = 1;
@@ -56,7 +80,8 @@ extern unsigned *Refcnt;
 
 #ifndef HAVE_FUNOPEN
 /* Defined in format.c */
-int _format(void putter(char,void *),void *,const char *,va_list);
+int _format(void putter(char,void *),void writer(const char *,int,void *),
+	void *,const char *,va_list);
 #else
 static int fun_write(void *, const char *, int);
 #endif
@@ -73,7 +98,6 @@ kFILE *fp
 	int create = 0;
 	int append = 0;
 	int fd;
-	struct stat statbuf;
 
 	if(strchr(mode,'r') != NULL){
 		modef = O_RDONLY;
@@ -83,21 +107,28 @@ kFILE *fp
 	} else if(strchr(mode,'a') != NULL){
 		modef = O_WRONLY;
 		append = 1;
-		if(stat(filename,&statbuf) == -1 && errno == ENOENT)
-			create = 1;	/* Doesn't exist, so create */
 	} else
 		return NULL;	/* No recognizable mode! */
 
 	if(strchr(mode,'+') != NULL)
 		modef = O_RDWR;	/* Update implies R/W */
+	/* Create if need be in the same call, so two tasks appending
+	 * to a new file can't truncate each other
+	 */
+	if(append)
+		modef |= O_CREAT;
+#ifdef O_APPEND
+	if(append)
+		modef |= O_APPEND;	/* So each write lands at the end */
+#endif
 
 	if(strchr(mode,'t') != NULL)
 		textmode = 1;
 	
 	if(create)
-		fd = _CREAT(filename,S_IREAD|S_IWRITE);
+		fd = _CREAT(filename,modef,S_IREAD|S_IWRITE);
 	else
-		fd = _OPEN(filename,modef);
+		fd = _OPEN(filename,modef,S_IREAD|S_IWRITE);
 	if(fd == -1)
 		return NULL;
 
@@ -292,24 +323,108 @@ char *buf,	/* User buffer */
 int len,	/* Length of buffer */
 kFILE *fp	/* Input stream */
 ){
-	int c;
+	struct mbuf *bp;
+	uint8 *ep,*nl;
 	char *cp;
+	int cnt,c;
 
+	if(fp == NULL || fp->cookie != _COOKIE)
+		return NULL;
+	kfflush(fp);
 	cp = buf;
-	while(len-- > 1){	/* Allow room for the terminal null */
-		if((c = kgetc(fp)) == kEOF){
+	len--;		/* Allow room for the terminal null */
+	while(len > 0){
+		if(((bp = fp->ibuf) == NULL || bp->cnt == 0)
+		 && (bp = _fillbuf(fp,len)) == NULL)
 			return NULL;
+		/* Take everything up to the next newline, or the start
+		 * of an eol sequence that needs translating, in one piece
+		 */
+		cnt = min(bp->cnt,len);
+		if((nl = memchr(bp->data,'\n',cnt)) != NULL)
+			cnt = nl - bp->data;
+		if(fp->flags.ascii && fp->eol[0] != '\n'
+		 && (ep = memchr(bp->data,fp->eol[0],cnt)) != NULL){
+			cnt = ep - bp->data;
+			nl = NULL;
 		}
-		if(buf != NULL)
+		if(cnt != 0){
+			pullup(&fp->ibuf,cp,cnt);
+			if(cp != NULL)
+				cp += cnt;
+			len -= cnt;
+			continue;
+		}
+		if(nl != NULL){
+			/* Plain newline */
+			pullup(&fp->ibuf,NULL,1);
+			c = '\n';
+		} else if((c = kfgetc(fp)) == kEOF)
+			return NULL;
+		if(cp != NULL)
 			*cp++ = c;
+		len--;
 		if(c == '\n')
 			break;
 	}
+	if(fp->type == _FL_PIPE)
+		ksignal(&fp->obuf,1);
 	if(buf != NULL)
 		*cp = '\0';
 	return buf;
 }
+/* Return the next line without copying it, if it lies entirely within
+ * the first input buffer. The end of line is replaced with a null and
+ * left off the length in *lenp. The line is good until the next input
+ * on the stream. Returns NULL if the line isn't all there, or at EOF;
+ * kfgets() will get it (or report the EOF).
+ */
+char *
+kfgetln(
+kFILE *fp,
+int *lenp
+){
+	struct mbuf *bp;
+	uint8 *cp,*ep;
+	int cnt,eollen;
 
+	if(fp == NULL || fp->cookie != _COOKIE)
+		return NULL;
+	kfflush(fp);
+	if(((bp = fp->ibuf) == NULL || bp->cnt == 0)
+	 && (bp = _fillbuf(fp,1)) == NULL)
+		return NULL;
+	/* We write the null into the buffer, so it must be ours alone */
+	if(bp->dup != NULL || bp->refcnt != 1)
+		return NULL;
+	if((ep = memchr(bp->data,'\n',bp->cnt)) != NULL)
+		cnt = ep - bp->data;
+	else
+		cnt = bp->cnt;
+	eollen = 1;
+	if(fp->flags.ascii && fp->eol[0] != '\n'
+	 && (cp = memchr(bp->data,fp->eol[0],cnt)) != NULL){
+		ep = cp;
+		if(fp->eol[1] != '\0'){
+			/* Both characters of the sequence must be here */
+			if(cp + 1 == bp->data + bp->cnt || cp[1] != fp->eol[1])
+				return NULL;
+			eollen = 2;
+		}
+	}
+	if(ep == NULL)
+		return NULL;	/* No end of line yet */
+	*ep = '\0';
+	cp = bp->data;
+	cnt = ep - cp;
+	bp->data += cnt + eollen;
+	bp->cnt -= cnt + eollen;
+	if(fp->type == _FL_PIPE)
+		ksignal(&fp->obuf,1);
+	if(lenp != NULL)
+		*lenp = cnt;
+	return (char *)cp;
+}
 /* Do printf on a stream */
 int
 kfprintf(kFILE *fp,const char *fmt,...)
@@ -342,10 +457,96 @@ kvprintf(const char *fmt, va_list args)
 }
 
 #ifndef HAVE_FUNOPEN
+/* State of a kvfprintf() in progress. The formatter's output goes
+ * straight into the stream's output buffer; the buffering mode is
+ * honored once, when the whole string has been formatted
+ */
+struct fmtout {
+	kFILE *fp;
+	uint8 *cp;	/* Next free byte in fp->obuf */
+	uint8 *ep;	/* End of fp->obuf */
+	int eol;	/* A newline was written */
+	int err;	/* A flush failed; discard the rest */
+};
+
+/* Make room for 'need' more bytes, flushing the buffer if it's full */
+static int
+fmtroom(struct fmtout *fo,int need)
+{
+	kFILE *fp = fo->fp;
+	struct mbuf *bp;
+
+	if((bp = fp->obuf) != NULL)
+		bp->cnt = fo->cp - bp->data;
+	/* Another process may get at the stream while we're flushing,
+	 * so look at the buffer again each time
+	 */
+	while((bp = fp->obuf) == NULL || bp->size - bp->cnt < need){
+		if(bp == NULL){
+			fp->obuf = ambufw(max(need,fp->bufsize));
+		} else if(kfflush(fp) == kEOF){
+			fo->err = 1;
+			return -1;
+		}
+	}
+	fo->cp = bp->data + bp->cnt;
+	fo->ep = bp->data + bp->size;
+	return 0;
+}
 static void
 putter(char c,void *p)
 {
-	kfputc(c,(kFILE *)p);
+	struct fmtout *fo = (struct fmtout *)p;
+	kFILE *fp = fo->fp;
+	int len;
+
+	if(fo->err)
+		return;
+	if(c == '\n' && fp->flags.ascii){
+		fo->eol = 1;
+		len = strlen(fp->eol);
+		if(fo->ep - fo->cp < len && fmtroom(fo,len) == -1)
+			return;
+		memcpy(fo->cp,fp->eol,len);
+		fo->cp += len;
+		return;
+	}
+	if(fo->cp == fo->ep && fmtroom(fo,1) == -1)
+		return;
+	*fo->cp++ = c;
+}
+/* Copy a run of formatted text, expanding newlines in text mode */
+static void
+writer(const char *buf,int len,void *p)
+{
+	struct fmtout *fo = (struct fmtout *)p;
+	const char *nl;
+	int cnt;
+
+	while(len > 0 && !fo->err){
+		if(fo->fp->flags.ascii
+		 && (nl = memchr(buf,'\n',len)) != NULL)
+			cnt = nl - buf;
+		else {
+			nl = NULL;
+			cnt = len;
+		}
+		while(cnt > 0){
+			if(fo->cp == fo->ep && fmtroom(fo,1) == -1)
+				return;
+			cnt = min(cnt,fo->ep - fo->cp);
+			memcpy(fo->cp,buf,cnt);
+			fo->cp += cnt;
+			buf += cnt;
+			len -= cnt;
+			cnt = (nl != NULL ? nl - buf : len);
+		}
+		if(nl != NULL){
+			putter('\n',p);
+			buf++;
+			len--;
+		}
+	}
 }
 #else
 static int
@@ -365,7 +566,28 @@ kvfprintf(kFILE *fp,const char *fmt, va_list args)
 	fflush(fp->osfp);
 	return res;
 #else
-	return _format(putter,(void *)fp,fmt, args);
+	struct fmtout fo;
+	int cnt;
+
+	fo.fp = fp;
+	fo.eol = fo.err = 0;
+	if(fp->obuf != NULL){
+		fo.cp = fp->obuf->data + fp->obuf->cnt;
+		fo.ep = fp->obuf->data + fp->obuf->size;
+	} else
+		fo.cp = fo.ep = NULL;
+	cnt = _format(putter,writer,(void *)&fo,fmt,args);
+	if(fo.err)
+		return -1;
+	if(fp->obuf == NULL)
+		return cnt;	/* Nothing written */
+	fp->obuf->cnt = fo.cp - fp->obuf->data;
+	if(fp->obuf->cnt == fp->obuf->size || fp->bufmode == _kIONBF
+	 || (fp->bufmode == _kIOLBF && fo.eol)){
+		if(kfflush(fp) == kEOF)
+			return -1;
+	}
+	return cnt;
 #endif
 }
 
@@ -383,7 +605,7 @@ int
 vsprintf(char *s,const char *fmt,va_list args)
 {
 	int r;
-	r = _format(sputter,(void *)&s,fmt,args);
+	r = _format(sputter,NULL,(void *)&s,fmt,args);
 	*s = '\0';
 	return r;
 }
@@ -518,6 +740,7 @@ int
 kfflush(kFILE *fp)
 {
 	struct mbuf *bp;
+	long offset;
 	int cnt;
 
 	if(fp == NULL || fp->cookie != _COOKIE || fp->obuf == NULL)
@@ -542,14 +765,14 @@ kfflush(kFILE *fp)
 		return send_mbuf(fp->fd,&bp,0,NULL,0);
 	case _FL_FILE:
 		do {
-			if(fp->flags.append)
-				_LSEEK(fp->fd,0L,kSEEK_END);
-			else
-				_LSEEK(fp->fd,fp->offset,kSEEK_SET);
-			cnt = _WRITE(fp->fd,bp->data,bp->cnt);
-			if(cnt > 0)
-				fp->offset += cnt;
+			/* Claim our place in the file first, since another
+			 * process may flush more while we wait for this
+			 */
+			offset = fp->flags.append ? -1L : fp->offset;
+			fp->offset += bp->cnt;
+			cnt = _PWRITE(fp->fd,bp->data,bp->cnt,offset);
 			if(cnt != bp->cnt){
+				fp->offset -= bp->cnt - max(cnt,0);
 				fp->flags.err = 1;
 				free_p(&bp);
 				return kEOF;
@@ -703,6 +926,7 @@ kFILE *fp
 	int newlines = 0;
 	int eollen = 1;
 	int doflush = 0;
+	long offset,wcnt;
 	
 	if(fp == NULL || fp->cookie != _COOKIE || size == 0)
 		return 0;
@@ -715,15 +939,16 @@ kFILE *fp
 	/* Optimization for large binary file writes */
 	if(fp->type == _FL_FILE && !fp->flags.ascii && bytes >= fp->bufsize){
 		kfflush(fp);
-		if(fp->flags.append)
-			_LSEEK(fp->fd,0L,kSEEK_END);
-		else
-			_LSEEK(fp->fd,fp->offset,kSEEK_SET);
-		cnt = _WRITE(fp->fd,icp,bytes);
-		if(cnt > 0)
-			fp->offset += cnt;
-		if(cnt != bytes)
-			return cnt/size;
+		/* Claim our place before the write yields, as in kfflush() */
+		offset = fp->flags.append ? -1L : fp->offset;
+		fp->offset += bytes;
+		wcnt = _PWRITE(fp->fd,icp,bytes,offset);
+		if(wcnt != (long)bytes){
+			wcnt = max(wcnt,0L);
+			fp->offset -= bytes - wcnt;
+			fp->flags.err = 1;
+			return wcnt/size;
+		}
 		return n;
 	}
 	if(fp->flags.ascii){
@@ -793,6 +1018,9 @@ _fillbuf(kFILE *fp,int cnt)
 	struct mbuf *bp;
 	int i;
 
+	/* Drop a buffer that kfgetln() left empty */
+	while(fp->ibuf != NULL && fp->ibuf->cnt == 0)
+		free_mbuf(&fp->ibuf);
 	if(fp->ibuf != NULL)
 		return fp->ibuf;	/* Stuff already in the input buffer */
 
@@ -822,11 +1050,14 @@ _fillbuf(kFILE *fp,int cnt)
 		}
 		return fp->ibuf;
 	case _FL_FILE:
+#ifdef HAVE_MMAP
+		if(fp->bufmode == _kIOMAP)
+			return _fillmap(fp);
+#endif
 		/* Read from file */
 		cnt = max(fp->bufsize,cnt);
 		bp = ambufw(cnt);		
-		_LSEEK(fp->fd,fp->offset,kSEEK_SET);
-		cnt = _READ(fp->fd,bp->data,cnt);
+		cnt = _PREAD(fp->fd,bp->data,cnt,fp->offset);
 		if(cnt < 0)
 			fp->flags.err = 1;
 		if(cnt == 0)
@@ -839,12 +1070,80 @@ _fillbuf(kFILE *fp,int cnt)
 		/* Buffer successfully read, store it */
 		bp->cnt = cnt;
 		fp->ibuf = bp;
+#ifdef HAVE_POSIX_FADVISE
+		if(fp->bufmode == _kIOBLK)	/* Get the disk on the next one */
+			posix_fadvise(fp->fd,fp->offset,fp->bufsize,
+			 POSIX_FADV_WILLNEED);
+#endif
 		return bp;
 	case _FL_DISPLAY:	/* Displays are write-only */
 		return NULL;
 	}
 	return NULL;	/* Can't happen */
 }
+#ifdef HAVE_MMAP
+/* Fill the input buffer from a mapping of the file, mapping it again
+ * if it has changed size. The data is copied out at once rather than
+ * lent, since the file could be truncated (and the pages vanish) before
+ * the reader got to it. The copy is where the pages are faulted in from
+ * disk, so like a read it runs on a host I/O thread, which checks the
+ * file is still long enough first.
+ */
+static struct mbuf *
+_fillmap(kFILE *fp)
+{
+	struct stat statbuf;
+	struct mbuf *bp;
+	long cnt;
+
+	if(fstat(fp->fd,&statbuf) == -1){
+		fp->flags.err = 1;
+		return NULL;
+	}
+	if(statbuf.st_size != fp->maplen || (fp->map == NULL && fp->maplen != 0)){
+		_funmap(fp);
+		if(statbuf.st_size != 0){
+			fp->map = mmap(NULL,statbuf.st_size,PROT_READ,MAP_SHARED,
+			 fp->fd,0);
+			if(fp->map == MAP_FAILED){
+				/* Settle for reading big blocks */
+				fp->map = NULL;
+				fp->bufmode = _kIOBLK;
+				return _fillbuf(fp,fp->bufsize);
+			}
+			fp->maplen = statbuf.st_size;
+			madvise(fp->map,fp->maplen,MADV_SEQUENTIAL);
+		}
+	}
+	if(fp->offset >= fp->maplen){
+		fp->flags.eof = 1;
+		return NULL;
+	}
+	cnt = min(fp->bufsize,fp->maplen - fp->offset);
+	bp = ambufw(cnt);
+	/* A file cut short since the fstat is read rather than copied */
+	if((cnt = _MAPREAD(fp->fd,bp->data,fp->map,cnt,fp->offset)) <= 0){
+		free_p(&bp);
+		if(cnt == 0)
+			fp->flags.eof = 1;
+		else
+			fp->flags.err = 1;
+		return NULL;
+	}
+	bp->cnt = cnt;
+	fp->offset += cnt;
+	fp->ibuf = bp;
+	return bp;
+}
+static void
+_funmap(kFILE *fp)
+{
+	if(fp->map != NULL)
+		munmap(fp->map,fp->maplen);
+	fp->map = NULL;
+	fp->maplen = 0;
+}
+#endif
 size_t
 kfread(
 void *ptr,
@@ -870,9 +1169,9 @@ kFILE *fp
 		/* Optimization for large binary file reads */
 		if(fp->ibuf == NULL
 		 && fp->type == _FL_FILE && !fp->flags.ascii
-		 && bytes >= kBUFSIZ){
-			_LSEEK(fp->fd,fp->offset,kSEEK_SET);
-			tmp = _READ(fp->fd,ocp,bytes);
+		 && fp->bufmode != _kIOMAP
+		 && bytes >= max(fp->bufsize,kBUFSIZ)){
+			tmp = _PREAD(fp->fd,ocp,bytes,fp->offset);
 			if(tmp < 0)
 				return 0;
 			if(tmp > 0)
@@ -939,7 +1238,7 @@ int size
 	if(fp == NULL || fp->cookie != _COOKIE)
 		return -1;
 	kfflush(fp);
-	if(size == 0)
+	if(size == 0 && type != _kIOBLK && type != _kIOMAP)
 		type = _kIONBF;
 	switch(type){
 	case _kIOFBF:
@@ -951,9 +1250,28 @@ int size
 	case _kIONBF:
 		fp->bufsize = 1;
 		break;
+	case _kIOBLK:
+	case _kIOMAP:
+		fp->bufsize = size != 0 ? size : kBIGBUFSIZ;
+		if(fp->type != _FL_FILE){
+			/* Nothing to read ahead; just use the big buffer */
+			type = _kIOFBF;
+			break;
+		}
+#ifndef HAVE_MMAP
+		type = _kIOBLK;
+#endif
+#ifdef HAVE_POSIX_FADVISE
+		posix_fadvise(fp->fd,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+		break;
 	default:
 		return -1;	/* Invalid */
 	}
+#ifdef HAVE_MMAP
+	if(type != _kIOMAP)
+		_funmap(fp);
+#endif
 	fp->bufmode = type;
 	return 0;
 }
@@ -980,12 +1298,12 @@ ktmpfile(void)
 	 * current directory.
 	 */
 	if((cp = getenv("TMP")) != NULL
-	 && stat(cp,&statbuf) == 0 && (statbuf.st_mode & S_IFDIR)){
+	 && _STAT(cp,&statbuf) == 0 && (statbuf.st_mode & S_IFDIR)){
 		fname = malloc(strlen(cp) + 11);
 		tmpdir = malloc(strlen(cp) + 2);
 		strcpy(tmpdir,cp);
 		strcat(tmpdir,"/");
-	} else if(stat(Tmpdir,&statbuf) == 0 && (statbuf.st_mode & S_IFDIR)){
+	} else if(_STAT(Tmpdir,&statbuf) == 0 && (statbuf.st_mode & S_IFDIR)){
 		fname = malloc(strlen(Tmpdir) + 11);
 		tmpdir = malloc(strlen(Tmpdir) + 2);
 		strcpy(tmpdir,Tmpdir);
@@ -996,7 +1314,7 @@ ktmpfile(void)
 	}
 	for(;;){
 		sprintf(fname,"%stemp.%03d",tmpdir,num);
-		if(stat(fname,&statbuf) == -1 && errno == ENOENT)
+		if(_STAT(fname,&statbuf) == -1 && errno == ENOENT)
 			break;
 		num++;
 	}
@@ -1046,6 +1364,9 @@ _fclose(kFILE *fp)
 		close_s(fp->fd);
 		break;
 	case _FL_FILE:
+#ifdef HAVE_MMAP
+		_funmap(fp);
+#endif
 		_CLOSE(fp->fd);
 		fp->offset = 0;
 		break;
@@ -1288,6 +1609,12 @@ dofiles(int argc,char *argv[],void *p)
 		case _kIOFBF:
 			kprintf(" full");
 			break;
+		case _kIOBLK:
+			kprintf(" blk ");
+			break;
+		case _kIOMAP:
+			kprintf(" map ");
+			break;
 		}
 		if(fp->flags.eof)
 			kprintf(" EOF");
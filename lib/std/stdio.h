@@ -42,8 +42,10 @@ struct _file{
 	enum {
 		_kIOFBF=1,	/* Full buffering */
 		_kIOLBF,	/* Line buffering */
-		_kIONBF		/* No buffering */
-	} bufmode;		/* Output buffering mode */
+		_kIONBF,	/* No buffering */
+		_kIOBLK,	/* Full, large blocks read ahead (files) */
+		_kIOMAP		/* Full, reads from a mapping (files) */
+	} bufmode;		/* Buffering mode */
 
 	struct {
 		unsigned int err:1;	/* Error on stream */
@@ -58,6 +60,8 @@ struct _file{
 	char eol[EOL_LEN];	/* Text mode end-of-line sequence, if any */
 	int bufsize;		/* Size of buffer to use */
 	void *ptr;		/* File name or display pointer */
+	void *map;		/* File mapping, _kIOMAP only */
+	long maplen;		/* Length of same */
 #ifdef HAVE_FUNOPEN
 	FILE *osfp;
 #endif
@@ -69,6 +73,7 @@ typedef struct _file kFILE;
 #define	NULL	0
 #endif
 #define	kBUFSIZ	2048
+#define	kBIGBUFSIZ	65536	/* Default for _kIOBLK and _kIOMAP */
 #define	kEOF	(-1)
 
 #define	kSEEK_SET	0
@@ -99,6 +104,7 @@ int kfflush(kFILE *fp);
 int kfgetc(kFILE *fp);
 int _kfgetc(kFILE *fp);
 char *kfgets(char *buf,int len,kFILE *fp);
+char *kfgetln(kFILE *fp,int *lenp);
 void kflushall(void);
 int kfmode (kFILE *fp,int mode);
 char *kfpname(kFILE *fp);
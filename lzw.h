@@ -1,50 +1,52 @@
 #ifndef _LZW_H
 #define _LZW_H
 
+#include "global.h"
+#include "net/core/mbuf.h"
+
 /* a string entry */
 struct zentry {
-	uint code;	/* codeword of the prefix string */
-	char data;	/* character to add to the prefix string */
-};
-struct zfast {		/* fast version of string entry */
-	uint owncode;	/* own codeword */
-	uint code;	/* codeword of prefix string */
-	char data;	/* character to add to prefix string */
+	uint16 code;	/* codeword of the prefix string */
+	uint8 data;	/* character to add to the prefix string */
+	uint16 link;	/* next entry on the same hash chain */
 };
 #define ZCC		256	/* clear code table codeword */
 #define ZFLUSH		257	/* codeword that signals a break in coding */
+#define	ZFIRST		258	/* first codeword assigned to a string */
+#define	ZNONE		0	/* end of hash chain (never a string code) */
 
 struct lzw {
 	uint codebits;		/* significant bits in each codeword */
 	int maxbits;		/* maximum number of bits per codeword */
 #define LZWBITS		9	/* initial number of bits in each codeword */
-	int32 prefix;		/* last processed codeword */
+#define	LZWMAXBITS	14	/* most we'll accept from a sender */
+#define	DEF_LZWBITS	12	/* default maximum */
+	int32 prefix;		/* last processed codeword, -1 if none */
 	char mode;		/* Compact or fast compression mode */
 #define LZWCOMPACT	0
 #define LZWFAST		1
-	union {
-		struct zentry **tbl;	/* compact table */
-#define LZWBLK		130		/* size of entry arrays to allocate */
-		struct mbuf **bpp;	/* mbuf version of table */
-#define ZHASH		256	/* hash table size */
-		void *p;	/* generic table pointer */
-	} tu;			/* table of entries */
-	int nextbit;		/* next bit to process in code stream */
+	struct zentry *tbl;	/* entries for codes ZFIRST and up */
+	uint *hash;		/* chain heads, encoder only */
+	uint hmask;		/* hash table size - 1 */
+#define ZHASH		1024	/* hash table size, a power of 2 */
+#define	ZHASHSMALL	64	/* same, compact mode */
+	uint next;		/* next code to be added to the table */
+	int pending;		/* decoder has a string we gave no entry for */
 	int version;		/* version number of sender */
 #define ZVERSION	3	/* version number */
-	int32 cnt;		/* count of processed bytes */
-	int32 code;		/* temporary storage for coding in progress */
-	int32 next;		/* next code to be added to the table */
-	int flushbit;		/* next bit of the ZFLUSH codeword to send */
+	int hdr;		/* decoder: header bytes still expected */
+	uint32 code;		/* bits of codewords in progress */
+	int nextbit;		/* number of them */
+	int32 cnt;		/* count of uncompressed bytes */
+	int32 zcnt;		/* count of compressed bytes */
 	/* the following is used by the decoder only */
-	struct mbuf *buf;	/* decoded buffer */
+	uint8 *stack;		/* string being decoded, reversed */
 };
 
 struct usock;		/* To please Turbo C++ */
-void lzwencode(int s,char c);
-void lzwinit(int s,int bits,int mode);
+int lzwinit(int s,int bits,int mode);
 void lzwfree(struct usock *up);
-void lzwflush(struct usock *up);
-int lzwdecode(struct usock *up);
+void lzwencode(struct lzw *lzw,struct mbuf **bpp);
+void lzwdecode(struct lzw *lzw,struct mbuf **bpp);
 
 #endif  /* _LZW_H */
@@ -58,7 +58,7 @@ unsigned Maxlet = BM_NLET;
 char Noperm[] = "Permission denied.\n";
 char Nosock[] = "Can't create socket\n";
 
-static char Mbbanner[] = "[NET-H$]\nWelcome %s to the %s TCP/IP Mailbox (%s)\n%s";
+static char Mbbanner[] = "[NET-HL$]\nWelcome %s to the %s TCP/IP Mailbox (%s)\n%s";
 static char Mbmenu[] = "Current msg# %d : A,B,C,D,E,F,G,H,I,J,K,L,N,R,S,T,U,V,W,Z,? >\n";
 static char Longmenu1[] = "(?)help    (A)rea     (B)ye      (C)hat     (D)ownload (E)scape   (F)inger\n";
 static char Longmenu2[] = "(G)ateway  (H)elp     (I)nfo     (J)heard   (K)ill     (L)ist     (N)etrom\n";
@@ -417,6 +417,9 @@ static int dowhat(int argc,char *argv[],void *p);
 static int dozap(int argc,char *argv[],void *p);
 static int dosend(int argc,char *argv[],void *p);
 static int dosid(int argc,char *argv[],void *p);
+#ifdef	LZW
+static int sidfeature(char *sid,int c);
+#endif
 static int dosysop(int argc,char *argv[],void *p);
 static int dologin(int argc, char *argv[],void *p);
 static int dostars(int argc,char *argv[],void *p);
@@ -856,8 +859,44 @@ void *p;
 	 && (cp=strchr(cp+1,'h')) != NULL
 	 && strchr(cp+1,'$'))
 		m->sid |= MBX_HIER_SID;	
+#ifdef	LZW
+	/* Only another NOS ([NET-...]) with an 'L' among its features
+	 * can compress. We offer it in our banner; a forwarding station
+	 * that wants it puts it in the SID it answers with. Having read
+	 * that SID we switch, and the peer switched once it was sent.
+	 * If we can't, the two ends no longer agree, so hang up.
+	 */
+	if(m->stype == 'N' && strncmp(argv[1],"et-",3) == 0
+	 && sidfeature(argv[1],'l')){
+		m->sid |= MBX_LZW_SID;
+		if(m->state != MBX_FORWARD){
+			kfflush(m->user);
+			if(lzwinit(kfileno(m->user),DEF_LZWBITS,LZWFAST) == -1)
+				return -2;
+		}
+	}
+#endif
 	return 0;
 }
+#ifdef	LZW
+/* Return 1 if an SID's feature letters, from its last '-' up to the
+ * '$', include c
+ */
+static int
+sidfeature(sid,c)
+char *sid;
+int c;
+{
+	char *cp;
+
+	if((cp = strrchr(sid,'-')) == NULL)
+		return 0;
+	for(cp++;*cp != '\0' && *cp != '$' && *cp != ']';cp++)
+		if(*cp == c)
+			return 1;
+	return 0;
+}
+#endif
 
 int
 dombescape(argc,argv,p)
@@ -42,6 +42,7 @@ struct mbx {
 #define	MBX_RLI_SID	0x02	/* This is an RLI BBS, disconnect after F> */
 #define MBX_HIER_SID	0x04	/* The BBS supports "hierarchical routing */
 				/* designators." */
+#define	MBX_LZW_SID	0x08	/* Both ends will LZW-compress the link */
 				/* Space here for others, currently not of */
 				/* interest to us. */
 	char stype ;		/* BBS send command type (B,P,T, etc.) */
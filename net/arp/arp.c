@@ -9,9 +9,7 @@
 #include "core/timer.h"
 #include "net/core/iface.h"
 
-#include "net/inet/icmp.h"
 #include "net/inet/ip.h"
-#include "net/inet/icmp.h"
 #include "net/enet/enet.h"
 #include "net/ax25/ax25.h"
 #include "net/arp/arp.h"
@@ -22,6 +20,8 @@ static void arp_output(struct iface *iface,enum arp_hwtype hardware,int32 target
 struct arp_tab *Arp_tab[HASHMOD];
 
 struct arp_stat Arp_stat;
+unsigned Arp_maxpend = ARPMAXPEND;
+unsigned Arp_refresh = ARPREFRESH;
 
 /* Resolve an IP address to a hardware address; if not found,
  * initiate query and return NULL.  If an address is returned, the
@@ -37,31 +37,44 @@ int32 target,			/* Target IP address */
 struct mbuf **bpp		/* IP datagram to be queued if unresolved */
 ){
 	struct arp_tab *arp;
-	struct ip ip;
 
-	if((arp = arp_lookup(hardware,target)) != NULL && arp->state == ARP_VALID)
-		return arp->hw_addr;
-	if(arp != NULL){
-		/* Earlier packets are already pending, kick this one back
-		 * as a source quench
+	if((arp = arp_lookup(hardware,target)) != NULL && arp->state == ARP_VALID){
+		/* If a live flow is still using an entry that is about
+		 * to expire, re-resolve it now so the traffic never sees
+		 * it go pending. Manual entries have no timer and are
+		 * left alone.
 		 */
-		ntohip(&ip,bpp);
-		icmp_output(&ip,*bpp,ICMP_QUENCH,0,NULL);
+		if(Arp_refresh != 0 && !arp->refresh
+		 && dur_timer(&arp->timer) != 0
+		 && read_timer(&arp->timer) < Arp_refresh * 1000L){
+			arp->refresh = 1;
+			Arp_stat.refresh++;
+			arp_output(iface,hardware,target);
+		}
+		return arp->hw_addr;
+	}
+	if(arp == NULL){
+		/* Create an entry and send the request */
+		arp = arp_add(target,hardware,NULL,0);
+		arp_output(iface,hardware,target);
+	}
+	/* Hold the datagram pending an answer. When the queue is full
+	 * just drop it; a source quench for every packet of a burst
+	 * only makes TCP back off further.
+	 */
+	if(len_q(arp->pending) >= Arp_maxpend){
+		Arp_stat.penddrop++;
 		free_p(bpp);
 	} else {
-		/* Create an entry and put the datagram on the
-		 * queue pending an answer
-		 */
-		arp = arp_add(target,hardware,NULL,0);
+		Arp_stat.pendq++;
 		enqueue(&arp->pending,bpp);
-		arp_output(iface,hardware,target);
 	}
 	return NULL;
 }
 /* Handle incoming ARP packets. This is almost a direct implementation of
  * the algorithm on page 5 of RFC 826, except for:
- * 1. Outgoing datagrams to unresolved addresses are kept on a queue
- *    pending a reply to our ARP request.
+ * 1. Outgoing datagrams to unresolved addresses are kept on a bounded
+ *    queue pending a reply to our ARP request.
  * 2. The names of the fields in the ARP packet were made more mnemonic.
  * 3. Requests for IP addresses listed in our table as "published" are
  *    responded to, even if the address is not our own.
@@ -227,6 +240,7 @@ int pub;			/* Publish this entry? */
 	} else {
 		/* Response has come in, update entry and run through queue */
 		ap->state = ARP_VALID;
+		ap->refresh = 0;
 		set_timer(&ap->timer,ARPLIFE*1000L);
 		memcpy(ap->hw_addr,hw_addr,at->hwalen);
 		ap->pub = pub;
@@ -10,6 +10,10 @@
 #define	ARPLIFE		900	/* 15 minutes */
 /* Lifetime of a pending ARP entry */
 #define	PENDTIME	15	/* 15 seconds */
+/* Default max datagrams held per pending ARP entry */
+#define	ARPMAXPEND	8
+/* Default seconds before expiry to re-resolve an entry in use */
+#define	ARPREFRESH	30
 
 /* ARP definitions (see RFC 826) */
 
@@ -82,6 +86,7 @@ struct arp_tab {
 	} state;
 	uint8 *hw_addr;		/* Hardware address */
 	unsigned int pub:1;	/* Respond to requests for this entry? */
+	unsigned int refresh:1;	/* Refresh request outstanding */
 };
 extern struct arp_tab *Arp_tab[];
 
@@ -93,8 +98,13 @@ struct arp_stat {
 	unsigned inreq;		/* Incoming requests for us */
 	unsigned replies;	/* Replies sent */
 	unsigned outreq;	/* Outoging requests sent */
+	unsigned pendq;		/* Datagrams queued awaiting resolution */
+	unsigned penddrop;	/* Datagrams dropped, pending queue full */
+	unsigned refresh;	/* Refresh requests for valid entries */
 };
 extern struct arp_stat Arp_stat;
+extern unsigned Arp_maxpend;	/* Pending queue limit per entry */
+extern unsigned Arp_refresh;	/* Refresh lead time, seconds */
 
 /* In arp.c: */
 struct arp_tab *arp_add(int32 ipaddr,enum arp_hwtype hardware,uint8 *hw_addr,
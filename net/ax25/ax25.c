@@ -157,8 +157,7 @@ struct mbuf **bpp	/* Data field (includes PID) */
 	addr.nextdigi = 0;
 
 	/* Allocate mbuf for control field, and fill in */
-	pushdown(bpp,NULL,1);
-	(*bpp)->data[0] = ctl;
+	htonctl(ctl,bpp);
 
 	htonax25(&addr,bpp);
 	/* This shouldn't be necessary because redirection has already been
@@ -148,9 +148,17 @@ int ax_output(struct iface *iface,uint8 *dest,uint8 *source,uint pid,
 int axsend(struct iface *iface,uint8 *dest,uint8 *source,
 	int cmdrsp,int ctl,struct mbuf **data);
 
+/* Control field as passed to axsend(). I and S frames on a modulo-128
+ * (SABME) link have two octets: the first in the low byte, the second
+ * in the next, with CTL_EXT set to tell them from a one-octet field.
+ */
+#define	CTL_EXT		0x10000
+
 /* In axhdr.c: */
 void htonax25(struct ax25 *hdr,struct mbuf **data);
 int ntohax25(struct ax25 *hdr,struct mbuf **bpp);
+void htonctl(int ctl,struct mbuf **bpp);
+int ntohctl(struct mbuf **bpp,int ext);
 
 /* In axlink.c: */
 void getlqentry(struct lqentry *ep,struct mbuf **bpp);
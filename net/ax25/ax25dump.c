@@ -23,9 +23,10 @@ struct mbuf **bpp,
 int check	/* Not used */
 ){
 	char tmp[AXBUF];
-	char frmr[3];
-	int control,pid,seg;
+	uint8 frmr[5];
+	int control,pid,seg,ext,vr,vs,why;
 	uint type;
+	struct ax25_cb *axp;
 	int unsegmented;
 	struct ax25 hdr;
 	uint8 *hp;
@@ -48,14 +49,19 @@ int check	/* Not used */
 			 (hp[ALEN] & REPEATED) ? "*":"");
 		}
 	}
-	if((control = PULLCHAR(bpp)) == -1)
+	/* Only the link state tells a modulo-128 control field from
+	 * a modulo-8 one
+	 */
+	ext = ((axp = lookup_ax25(hdr.dest)) != NULL
+	 || (axp = lookup_ax25(hdr.source)) != NULL) && axp->flags.extseq;
+	if((control = ntohctl(bpp,ext)) == -1)
 		return;
 
 	kputc(' ',fp);
-	type = ftype(control);
+	type = ftype(control & 0xff);
 	kfprintf(fp,"%s",decode_type(type));
 	/* Dump poll/final bit */
-	if(control & PF){
+	if((control & CTL_EXT) ? (control & EPF) : (control & PF)){
 		switch(hdr.cmdrsp){
 		case LAPB_COMMAND:
 			kfprintf(fp,"(P)");
@@ -69,11 +75,16 @@ int check	/* Not used */
 		}
 	}
 	/* Dump sequence numbers */
-	if((type & 0x3) != U)	/* I or S frame? */
+	if(control & CTL_EXT){
+		kfprintf(fp," NR=%d",(control>>9) & MMASK128);
+		if(type == I)
+			kfprintf(fp," NS=%d",(control>>1) & MMASK128);
+	} else if((type & 0x3) != U){	/* I or S frame? */
 		kfprintf(fp," NR=%d",(control>>5)&7);
-	if(type == I || type == UI){	
 		if(type == I)
 			kfprintf(fp," NS=%d",(control>>1)&7);
+	}
+	if(type == I || type == UI){	
 		/* Decode I field */
 		if((pid = PULLCHAR(bpp)) != -1){	/* Get pid */
 			if(pid == PID_SEGMENT){
@@ -117,17 +128,29 @@ int check	/* Not used */
 				kfprintf(fp," pid=0x%x\n",pid);
 			}
 		}
-	} else if(type == FRMR && pullup(bpp,frmr,3) == 3){
+	} else if(type == FRMR
+	 && pullup(bpp,frmr,ext ? 5 : 3) == (ext ? 5 : 3)){
 		kfprintf(fp,": %s",decode_type(ftype(frmr[0])));
-		kfprintf(fp," Vr = %d Vs = %d",(frmr[1] >> 5) & MMASK,
-			(frmr[1] >> 1) & MMASK);
-		if(frmr[2] & W)
+		if(ext){
+			/* Two-byte rejected control field, then V(S) and
+			 * V(R) in bytes of their own
+			 */
+			vs = (frmr[2] >> 1) & MMASK128;
+			vr = (frmr[3] >> 1) & MMASK128;
+			why = frmr[4];
+		} else {
+			vr = (frmr[1] >> 5) & MMASK;
+			vs = (frmr[1] >> 1) & MMASK;
+			why = frmr[2];
+		}
+		kfprintf(fp," Vr = %d Vs = %d",vr,vs);
+		if(why & W)
 			kfprintf(fp," Invalid control field");
-		if(frmr[2] & X)
+		if(why & X)
 			kfprintf(fp," Illegal I-field");
-		if(frmr[2] & Y)
+		if(why & Y)
 			kfprintf(fp," Too-long I-field");
-		if(frmr[2] & Z)
+		if(why & Z)
 			kfprintf(fp," Invalid seq number");
 		kputc('\n',fp);
 	} else
@@ -142,6 +165,8 @@ decode_type(uint type)
 		return "I";
 	case SABM:
 		return "SABM";
+	case SABME:
+		return "SABME";
 	case DISC:
 		return "DISC";
 	case DM:
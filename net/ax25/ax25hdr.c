@@ -104,4 +104,37 @@ struct mbuf **bpp
 	}
 	return -1;	/* Too many digis */
 }
+/* Prepend a LAPB control field, first octet first */
+void
+htonctl(
+int ctl,
+struct mbuf **bpp
+){
+	if(ctl & CTL_EXT){
+		pushdown(bpp,NULL,2);
+		(*bpp)->data[0] = ctl;
+		(*bpp)->data[1] = ctl >> 8;
+	} else {
+		pushdown(bpp,NULL,1);
+		(*bpp)->data[0] = ctl;
+	}
+}
+/* Extract a LAPB control field. If ext is set, I and S frames have
+ * two octets (modulo 128); U frames always have one.
+ * Return -1 if error
+ */
+int
+ntohctl(
+struct mbuf **bpp,
+int ext
+){
+	int ctl,ctl2;
 
+	if((ctl = PULLCHAR(bpp)) == -1)
+		return -1;
+	if(!ext || (ctl & 3) == 3)
+		return ctl;
+	if((ctl2 = PULLCHAR(bpp)) == -1)
+		return -1;
+	return CTL_EXT | (ctl2 << 8) | ctl;
+}
@@ -54,6 +54,18 @@ find_ax25(uint8 *addr)
 	}
 	return NULL;
 }
+/* Look up entry without reordering the table, for the tracer */
+struct ax25_cb *
+lookup_ax25(uint8 *addr)
+{
+	struct ax25_cb *axp;
+
+	for(axp = Ax25_cb; axp != NULL; axp = axp->next){
+		if(addreq(axp->remote,addr))
+			break;
+	}
+	return axp;
+}
 
 /* Remove entry from connection table */
 void
@@ -419,6 +419,8 @@ int cnt
 			nup->name = mallocw(sizeof(struct ksockaddr_ax));
 			nup->peername = mallocw(sizeof(struct ksockaddr_ax));
 			nup->index = ns;
+			nup->pollev = NULL;	/* Not the listener's poller */
+			nup->zout = nup->zin = NULL;
 			/* Store the new socket # in the old one */
 			up->rdysock = ns;
 			up = nup;
@@ -446,12 +448,12 @@ int cnt
 		memcpy(sp.ax->iface,axp->iface->name,ILEN);
 		up->peernamelen = sizeof(struct ksockaddr_ax);
 		/* Wake up the guy accepting it, and let him run */
-		ksignal(oup,1);
+		sockwake(oup,1);
 		kwait(NULL);
 		return;
 	}
 	/* Wake up anyone waiting, and let them run */
-	ksignal(up,1);
+	sockwake(up,1);
 	kwait(NULL);
 }
 /* AX.25 transmit upcall */
@@ -461,7 +463,7 @@ struct ax25_cb *axp,
 int cnt
 ){
 	/* Wake up anyone waiting, and let them run */
-	ksignal(itop(axp->user),1);
+	sockwake(itop(axp->user),1);
 	kwait(NULL);
 }
 /* AX25 state change upcall routine */
@@ -496,7 +498,7 @@ int new
 	default:	/* Other transitions are ignored */
 		break;
 	}
-	ksignal(up,0);	/* In case anybody's waiting */
+	sockwake(up,0);	/* In case anybody's waiting */
 }
 
 /* Issue an automatic bind of a local AX25 address */
@@ -42,8 +42,9 @@ kiss_init(struct iface *ifp)
 
 	sp->iface = ifp;
 	sp->send = asy_send;
-	sp->get = get_asy;
+	sp->read = asy_read;
 	sp->type = CL_KISS;
+	fr_init(&sp->fr,FR_SLIP,SLIP_ALLOC,0);
 	ifp->rxproc = newproc( ifn = if_name( ifp, " rx" ),
 		256,slip_rx,xdev,NULL,NULL,0);
 	free(ifn);
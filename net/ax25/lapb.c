@@ -41,13 +41,16 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 	}
 
 	/* Extract the various parts of the control field for easy use */
-	if((control = PULLCHAR(bpp)) == -1){
+	if((control = ntohctl(bpp,axp->flags.extseq)) == -1){
 		free_p(bpp);	/* Probably not necessary */
 		return -1;
 	}
-	type = ftype(control);
+	type = ftype(control & 0xff);
 	class = type & 0x3;
-	pf = control & PF;
+	if(control & CTL_EXT)
+		pf = (control & EPF) ? PF : 0;
+	else
+		pf = control & PF;
 	/* Check for polls and finals */
 	if(pf){
 		switch(cmdrsp){
@@ -60,7 +63,10 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 		}
 	}
 	/* Extract sequence numbers, if present */
-	switch(class){
+	if(control & CTL_EXT){
+		ns = (control >> 1) & MMASK128;
+		nr = (control >> 9) & MMASK128;
+	} else switch(class){
 	case I:
 	case I+2:
 		ns = (control >> 1) & MMASK;
@@ -73,8 +79,10 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 	case LAPB_DISCONNECTED:
 		switch(type){
 		case SABM:	/* Initialize or reset link */
+		case SABME:
 			sendctl(axp,LAPB_RESPONSE,UA|pf);	/* Always accept */
 			clr_ex(axp);
+			axp->flags.extseq = (type == SABME);
 			axp->unack = axp->vr = axp->vs = 0;
 			lapbstate(axp,LAPB_CONNECTED);/* Resets state counters */
 			axp->srt = Axirtt;
@@ -93,6 +101,13 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 	case LAPB_SETUP:
 		switch(type){
 		case SABM:	/* Simultaneous open */
+			/* The peer wants modulo 8; it will take our SABME
+			 * too if it crossed, so settle on the smaller
+			 */
+			axp->flags.extseq = 0;
+			sendctl(axp,LAPB_RESPONSE,UA|pf);
+			break;
+		case SABME:
 			sendctl(axp,LAPB_RESPONSE,UA|pf);
 			break;
 		case DISC:
@@ -106,6 +121,17 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 			lapbstate(axp,LAPB_CONNECTED);
 			break;			
 		case DM:	/* Connection refused */
+		case FRMR:
+			if(axp->flags.extseq){
+				/* Probably a v2.0 station that doesn't
+				 * know SABME; fall back to modulo 8
+				 */
+				axp->flags.nosabme = 1;
+				est_link(axp);
+				break;
+			}
+			if(type == FRMR)
+				break;
 			free_q(&axp->txq);
 			stop_timer(&axp->t1);
 			axp->reason = LB_DM;
@@ -118,6 +144,7 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 	case LAPB_DISCPENDING:
 		switch(type){
 		case SABM:
+		case SABME:
 			sendctl(axp,LAPB_RESPONSE,DM|pf);
 			break;
 		case DISC:
@@ -137,8 +164,10 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 	case LAPB_CONNECTED:
 		switch(type){
 		case SABM:
+		case SABME:
 			sendctl(axp,LAPB_RESPONSE,UA|pf);
 			clr_ex(axp);
+			axp->flags.extseq = (type == SABME);
 			free_q(&axp->txq);
 			stop_timer(&axp->t1);
 			start_timer(&axp->t3);
@@ -167,7 +196,7 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 			break;
 		case RR:
 		case RNR:
-			axp->flags.remotebusy = (control == RNR) ? YES : NO;
+			axp->flags.remotebusy = (type == RNR) ? YES : NO;
 			if(poll)
 				enq_resp(axp);
 			ackours(axp,nr);
@@ -214,7 +243,7 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 				break;
 			}
 			axp->flags.rejsent = NO;
-			axp->vr = (axp->vr+1) & MMASK;
+			axp->vr = (axp->vr+1) & SEQMASK(axp);
 			tmp = len_p(axp->rxq) >= axp->window ? RNR : RR;
 			if(poll){
 				sendctl(axp,LAPB_RESPONSE,tmp|PF);
@@ -230,8 +259,10 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 	case LAPB_RECOVERY:
 		switch(type){
 		case SABM:
+		case SABME:
 			sendctl(axp,LAPB_RESPONSE,UA|pf);
 			clr_ex(axp);
+			axp->flags.extseq = (type == SABME);
 			stop_timer(&axp->t1);
 			start_timer(&axp->t3);
 			axp->unack = axp->vr = axp->vs = 0;
@@ -260,7 +291,7 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 			break;
 		case RR:
 		case RNR:
-			axp->flags.remotebusy = (control == RNR) ? YES : NO;
+			axp->flags.remotebusy = (type == RNR) ? YES : NO;
 			if(axp->proto == V1 || final){
 				stop_timer(&axp->t1);
 				ackours(axp,nr);
@@ -343,7 +374,7 @@ struct mbuf **bpp		/* Rest of frame, starting with ctl */
 				break;
 			}
 			axp->flags.rejsent = NO;
-			axp->vr = (axp->vr+1) & MMASK;
+			axp->vr = (axp->vr+1) & SEQMASK(axp);
 			tmp = len_p(axp->rxq) >= axp->window ? RNR : RR;
 			if(poll){
 				sendctl(axp,LAPB_RESPONSE,tmp|PF);
@@ -388,7 +419,7 @@ uint n
 	 * If we try to free a null pointer,
 	 * then we have a frame reject condition.
 	 */
-	oldest = (axp->vs - axp->unack) & MMASK;
+	oldest = (axp->vs - axp->unack) & SEQMASK(axp);
 	while(axp->unack != 0 && oldest != n){
 		if((bp = dequeue(&axp->txq)) == NULL){
 			/* Acking unsent frame */
@@ -415,7 +446,7 @@ uint n
 		}
 		axp->flags.retrans = 0;
 		axp->retries = 0;
-		oldest = (oldest + 1) & MMASK;
+		oldest = (oldest + 1) & SEQMASK(axp);
 	}
 	if(axp->unack == 0){
 		/* All frames acked, stop timeout */
@@ -430,7 +461,8 @@ uint n
 		 * may be queued
 		 */
 		if(axp->t_upcall != NULL)
-			(*axp->t_upcall)(axp,axp->paclen * (axp->maxframe - axp->unack));
+			(*axp->t_upcall)(axp,axp->paclen
+			 * (min(axp->maxframe,SEQMASK(axp)) - axp->unack));
 	}
 	return 0;
 }
@@ -441,7 +473,9 @@ est_link(struct ax25_cb *axp)
 {
 	clr_ex(axp);
 	axp->retries = 0;
-	sendctl(axp,LAPB_COMMAND,SABM|PF);
+	/* Ask for modulo 128 if our window needs it, unless refused */
+	axp->flags.extseq = axp->maxframe > MMASK && !axp->flags.nosabme;
+	sendctl(axp,LAPB_COMMAND,axp->flags.extseq ? SABME|PF : SABM|PF);
 	stop_timer(&axp->t3);
 	start_timer(&axp->t1);
 }
@@ -470,7 +504,7 @@ static void
 inv_rex(struct ax25_cb *axp)
 {
 	axp->vs -= axp->unack;
-	axp->vs &= MMASK;
+	axp->vs &= SEQMASK(axp);
 	axp->unack = 0;
 }
 /* Send S or U frame to currently connected station */
@@ -482,8 +516,13 @@ int cmd
 ){
 	struct mbuf *mb = NULL;
 
-	if((ftype((char)cmd) & 0x3) == S)	/* Insert V(R) if S frame */
-		cmd |= (axp->vr << 5);
+	if((ftype((char)cmd) & 0x3) == S){	/* Insert V(R) if S frame */
+		if(axp->flags.extseq)
+			cmd = CTL_EXT | (cmd & ~PF) | (axp->vr << 9)
+			 | ((cmd & PF) ? EPF : 0);
+		else
+			cmd |= (axp->vr << 5);
+	}
 	return sendframe(axp,cmdrsp,cmd,&mb);
 }
 /*
@@ -496,7 +535,8 @@ dlapb_output(struct ax25_cb *axp)
 {
 	struct mbuf *bp;
 	struct mbuf *tbp;
-	char control;
+	int control;
+	uint ns;
 	int sent = 0;
 	int i;
 
@@ -523,9 +563,13 @@ dlapb_output(struct ax25_cb *axp)
 	 * number of unacknowledged frames reaches the maxframe limit,
 	 * or when there are no more frames to send
 	 */
-	while(bp != NULL && axp->unack < axp->maxframe){
-		control = I | (axp->vs++ << 1) | (axp->vr << 5);
-		axp->vs &= MMASK;
+	while(bp != NULL && axp->unack < min(axp->maxframe,SEQMASK(axp))){
+		ns = axp->vs;
+		if(axp->flags.extseq)
+			control = CTL_EXT | I | (ns << 1) | (axp->vr << 9);
+		else
+			control = I | (ns << 1) | (axp->vr << 5);
+		axp->vs = (ns + 1) & SEQMASK(axp);
 		dup_p(&tbp,bp,0,len_p(bp));
 		if(tbp == NULL)
 			return sent;	/* Probably out of memory */
@@ -543,7 +587,7 @@ dlapb_output(struct ax25_cb *axp)
 		bp = bp->anext;
 		if(!axp->flags.rtt_run){
 			/* Start round trip timer */
-			axp->rtt_seq = (control >> 1) & MMASK;
+			axp->rtt_seq = ns;
 			axp->rtt_time = msclock();
 			axp->flags.rtt_run = 1;
 		}
@@ -600,6 +644,8 @@ int s
 	oldstate = axp->state;
 	axp->state = s;
 	if(s == LAPB_DISCONNECTED){
+		axp->flags.extseq = 0;
+		axp->flags.nosabme = 0;
 		stop_timer(&axp->t1);
 		stop_timer(&axp->t2);
 		stop_timer(&axp->t3);
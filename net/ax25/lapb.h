@@ -18,6 +18,7 @@
 #define	REJ	0x09	/* Reject */
 #define	U	0x03	/* Unnumbered frames */
 #define	SABM	0x2f	/* Set Asynchronous Balanced Mode */
+#define	SABME	0x6f	/* SABM Extended (modulo 128), AX.25 v2.2 */
 #define	DISC	0x43	/* Disconnect */
 #define	DM	0x0f	/* Disconnected mode */
 #define	UA	0x63	/* Unnumbered acknowledge */
@@ -26,6 +27,14 @@
 #define	PF	0x10	/* Poll/final bit */
 
 #define	MMASK	7	/* Mask for modulo-8 sequence numbers */
+#define	MMASK128 0x7f	/* Mask for modulo-128 sequence numbers */
+#define	EPF	0x100	/* Poll/final bit in a two-octet (CTL_EXT) field */
+
+/* SABME tries before falling back to SABM when N2 is 0 (unlimited) */
+#define	SABMETRIES	5
+
+/* Sequence number mask in use on a link; also its largest window */
+#define	SEQMASK(axp)	((axp)->flags.extseq ? MMASK128 : MMASK)
 
 /* FRMR reason bits */
 #define	W	1	/* Invalid control field */
@@ -59,6 +68,8 @@ struct ax25_cb {
 		unsigned int rtt_run:1;		/* Round trip "timer" is running */
 		unsigned int retrans:1;		/* A retransmission has occurred */
 		unsigned int clone:1;		/* Server-type cb, will be cloned */
+		unsigned int extseq:1;		/* Modulo 128 (SABME) in use */
+		unsigned int nosabme:1;		/* Peer refused SABME */
 	} flags;
 
 	uint8 reason;			/* Reason for connection closing */
@@ -70,7 +81,8 @@ struct ax25_cb {
 	uint8 vs;			/* Our send state variable */
 	uint8 vr;			/* Our receive state variable */
 	uint8 unack;			/* Number of unacked frames */
-	int maxframe;			/* Transmit flow control level, frames */
+	int maxframe;			/* Transmit flow control level, frames;
+					 * above 7 asks for modulo 128 */
 	uint paclen;			/* Maximum outbound packet size, bytes */
 	uint window;			/* Local flow control limit, bytes */
 	enum {
@@ -130,6 +142,7 @@ void ax25_set_t1_timer(struct ax25_cb *cb, int value);
 struct ax25_cb *cr_ax25(uint8 *addr);
 void del_ax25(struct ax25_cb *axp);
 struct ax25_cb *find_ax25(uint8 *);
+struct ax25_cb *lookup_ax25(uint8 *);
 
 /* In ax25user.c: */
 int ax25val(struct ax25_cb *axp);
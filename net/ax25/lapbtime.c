@@ -31,8 +31,14 @@ recover(void *p)
 			free_q(&axp->txq);
 			axp->reason = LB_TIMEOUT;
 			lapbstate(axp,LAPB_DISCONNECTED);
+		} else if(axp->flags.extseq && axp->retries
+		 > (axp->n2 != 0 ? axp->n2/2 : SABMETRIES)){
+			/* Some v2.0 stations silently ignore SABME */
+			axp->flags.nosabme = 1;
+			est_link(axp);
 		} else {
-			sendctl(axp,LAPB_COMMAND,SABM|PF);
+			sendctl(axp,LAPB_COMMAND,
+			 axp->flags.extseq ? SABME|PF : SABM|PF);
 			start_timer(&axp->t1);
 		}
 		break;
@@ -0,0 +1,331 @@
+/* Byte-stuffed framing for asynchronous lines
+ *
+ * Most of a frame normally needs no escaping, so both directions look
+ * for the next byte that does and copy everything before it in one go.
+ * The search goes a word at a time: a word with none of the flag, the
+ * escape or (when any are special) a control character in it is copied
+ * whole, and only a word that might hold one is looked at bytewise.
+ * Received frames are unstuffed straight into their mbufs.
+ */
+#include "top.h"
+
+#include <string.h>
+#include "global.h"
+#include "net/core/mbuf.h"
+#include "net/core/framer.h"
+
+/* SLIP special characters, as in slip.h */
+#define	FR_END		0300	/* Frame End */
+#define	FR_ESC		0333	/* Frame Escape */
+#define	T_FR_END	0334	/* Transposed frame end */
+#define	T_FR_ESC	0335	/* Transposed frame escape */
+
+/* Async HDLC, as in ppp.h */
+#define	HDLC_FLAG	0x7e
+#define	HDLC_ESC_ASYNC	0x7d
+#define	HDLC_ESC_COMPL	0x20
+
+#define	ISSET(s,c)	((s)->map[(c) >> 3] & (1 << ((c) & 7)))
+
+/* Word-at-a-time tests for a byte equal to, or less than, n */
+#define	ONES		0x0101010101010101ULL
+#define	HIGHS		0x8080808080808080ULL
+#define	HASLESS(w,n)	(((w) - ONES * (n)) & ~(w) & HIGHS)
+#define	HASBYTE(w,n)	HASLESS((w) ^ (ONES * (n)),1)
+
+/* Might the word hold a member of the set? */
+#define	FRHIT(s,w)	(HASBYTE(w,(s)->c1) | HASBYTE(w,(s)->c2) \
+			 | ((s)->ctl ? HASLESS(w,0x20) : 0))
+
+static void frset(struct frset *sp,uint8 c1,uint8 c2,int32 accm);
+static uint8 *frlimit(struct framer *fr);
+static int frgrow(struct framer *fr,uint8 **dpp,uint8 **dep);
+
+void
+fr_init(
+struct framer *fr,
+int type,		/* FR_SLIP or FR_HDLC */
+uint alloc,		/* Receive buffer allocation increment */
+uint maxsize		/* Longest frame to accept, 0 for no limit */
+){
+	memset(fr,0,sizeof(*fr));
+	fr->type = type;
+	if(type == FR_SLIP){
+		fr->flag = FR_END;
+		fr->esc = FR_ESC;
+	} else {
+		fr->flag = HDLC_FLAG;
+		fr->esc = HDLC_ESC_ASYNC;
+	}
+	fr->alloc = alloc;
+	fr->maxsize = maxsize;
+	frset(&fr->tx,fr->flag,fr->esc,0);
+	frset(&fr->rx,fr->flag,fr->esc,0);
+}
+/* Set the control characters to be escaped on transmit */
+void
+fr_txaccm(struct framer *fr,int32 accm)
+{
+	if(fr->type == FR_HDLC && accm != fr->txaccm){
+		fr->txaccm = accm;
+		frset(&fr->tx,fr->flag,fr->esc,accm);
+	}
+}
+/* Set the control characters to be ignored on receive */
+void
+fr_rxaccm(struct framer *fr,int32 accm)
+{
+	if(fr->type == FR_HDLC && accm != fr->rxaccm){
+		fr->rxaccm = accm;
+		frset(&fr->rx,fr->flag,fr->esc,accm);
+	}
+}
+/* Throw away any partly received frame */
+void
+fr_reset(struct framer *fr)
+{
+	free_p(&fr->head);
+	fr->tail = NULL;
+	fr->len = 0;
+	fr->state = 0;
+}
+/* Return the length of a chain once escaped */
+uint
+fr_stufflen(struct framer *fr,struct mbuf *bp)
+{
+	uint len = 0;
+	uint8 *cp,*ep;
+	uint64 w;
+	uint n;
+
+	for(;bp != NULL;bp = bp->next){
+		len += bp->cnt;
+		cp = bp->data;
+		ep = cp + bp->cnt;
+		while(cp != ep){
+			n = ep - cp;
+			if(n >= 8){
+				memcpy(&w,cp,8);
+				if(!FRHIT(&fr->tx,w)){
+					cp += 8;
+					continue;
+				}
+				n = 8;
+			}
+			for(;n != 0;n--,cp++)
+				if(ISSET(&fr->tx,*cp))
+					len++;
+		}
+	}
+	return len;
+}
+/* Copy buf to cp, escaping as needed; return the new end of cp */
+uint8 *
+fr_stuff(struct framer *fr,uint8 *cp,uint8 *buf,uint len)
+{
+	uint8 *ep = buf + len;
+	uint64 w;
+	uint n;
+	uint8 c;
+
+	while(buf != ep){
+		n = ep - buf;
+		if(n >= 8){
+			memcpy(&w,buf,8);
+			if(!FRHIT(&fr->tx,w)){
+				memcpy(cp,buf,8);
+				cp += 8;
+				buf += 8;
+				continue;
+			}
+			n = 8;
+		}
+		/* Something in the next n bytes needs escaping */
+		for(;n != 0;n--){
+			c = *buf++;
+			if(!ISSET(&fr->tx,c)){
+				*cp++ = c;
+				continue;
+			}
+			*cp++ = fr->esc;
+			if(fr->type == FR_HDLC)
+				*cp++ = c ^ HDLC_ESC_COMPL;
+			else
+				*cp++ = c == FR_END ? T_FR_END : T_FR_ESC;
+		}
+	}
+	return cp;
+}
+/* Same, for a whole chain, which is left alone */
+uint8 *
+fr_stuff_mbuf(struct framer *fr,uint8 *cp,struct mbuf *bp)
+{
+	for(;bp != NULL;bp = bp->next)
+		cp = fr_stuff(fr,cp,bp->data,bp->cnt);
+	return cp;
+}
+/* Take received bytes from *cpp up to the end of a frame or of the input,
+ * advancing *cpp and reducing *lenp by the amount used. On FR_FRAME the
+ * frame is in *bpp.
+ */
+int
+fr_unstuff(
+struct framer *fr,
+uint8 **cpp,
+uint *lenp,
+struct mbuf **bpp
+){
+	uint8 *cp = *cpp;
+	uint8 *ep = cp + *lenp;
+	uint8 *dp = NULL;	/* Where the next byte goes */
+	uint8 *de = NULL;	/* and the end of the room for it */
+	/* Stores through dp might alias *fr, so keep what's needed here */
+	uint8 flag = fr->flag;
+	uint8 esc = fr->esc;
+	int state = fr->state;
+	int hdlc = fr->type == FR_HDLC;
+	int32 ignore = hdlc ? fr->rxaccm : 0;
+	uint64 wflag = ONES * flag;
+	uint64 wesc = ONES * esc;
+	int ctl = fr->rx.ctl;
+	uint64 w;
+	int slow = 0;		/* Bytes to go before trying words again */
+	int misses = 0;		/* Words in a row that weren't clean */
+	uint8 c;
+	int ret;
+
+	*bpp = NULL;
+	if(fr->tail != NULL){
+		dp = fr->tail->data + fr->tail->cnt;
+		de = frlimit(fr);
+	}
+	while(cp != ep){
+		/* Copy whole words with nothing special in them */
+		if(slow == 0 && !(state & (FR_ESCAPED|FR_DISCARD))
+		 && ep - cp >= 8 && de - dp >= 8){
+			memcpy(&w,cp,8);
+			if(!(HASLESS(w ^ wflag,1) | HASLESS(w ^ wesc,1)
+			 | (ctl ? HASLESS(w,0x20) : 0))){
+				memcpy(dp,cp,8);
+				dp += 8;
+				cp += 8;
+				misses = 0;
+				continue;
+			}
+			/* Take this word a byte at a time, and more than
+			 * that if words keep needing it
+			 */
+			slow = misses++ < 2 ? 8 : 64;
+		}
+		if(slow != 0)
+			slow--;
+		c = *cp++;
+		if(c == flag){
+			if(fr->tail != NULL)
+				fr->tail->cnt = dp - fr->tail->data;
+			if(state & FR_ESCAPED)
+				ret = FR_ABORT;
+			else if(state & FR_DISCARD)
+				ret = FR_TOSS;
+			else if(fr->head == NULL)
+				ret = FR_EMPTY;
+			else {
+				ret = FR_FRAME;
+				*bpp = fr->head;
+				fr->head = NULL;
+			}
+			fr_reset(fr);
+			*lenp = ep - cp;
+			*cpp = cp;
+			return ret;
+		}
+		/* The order of these matters, as in the old PPP receiver:
+		 * ignored control characters even come between an escape
+		 * and what it escapes.
+		 */
+		if(c < 0x20 && (ignore & (1L << c)))
+			continue;
+		if(state & FR_ESCAPED){
+			state &= ~FR_ESCAPED;
+			if(hdlc)
+				c ^= HDLC_ESC_COMPL;
+			else if(c == T_FR_END)
+				c = FR_END;
+			else if(c == T_FR_ESC)
+				c = FR_ESC;
+			else
+				fr->errors++;
+		} else if(c == esc){
+			state |= FR_ESCAPED;
+			continue;
+		}
+		if(state & FR_DISCARD)
+			continue;
+		if(dp == de && frgrow(fr,&dp,&de) == -1){
+			state |= FR_DISCARD;
+			continue;
+		}
+		*dp++ = c;
+	}
+	if(fr->tail != NULL)
+		fr->tail->cnt = dp - fr->tail->data;
+	fr->state = state;
+	*lenp = 0;
+	*cpp = cp;
+	return FR_MORE;
+}
+
+/* Make up a set of special bytes */
+static void
+frset(struct frset *sp,uint8 c1,uint8 c2,int32 accm)
+{
+	int c;
+
+	memset(sp->map,0,sizeof(sp->map));
+	sp->c1 = c1;
+	sp->c2 = c2;
+	sp->map[c1 >> 3] |= 1 << (c1 & 7);
+	sp->map[c2 >> 3] |= 1 << (c2 & 7);
+	sp->ctl = accm != 0;
+	for(c=0;c<32;c++)
+		if(accm & (1L << c))
+			sp->map[c >> 3] |= 1 << (c & 7);
+}
+/* Return the end of the space for the frame in its last mbuf */
+static uint8 *
+frlimit(struct framer *fr)
+{
+	struct mbuf *bp = fr->tail;
+
+	if(fr->maxsize != 0 && fr->maxsize - fr->len < bp->size)
+		return bp->data + (fr->maxsize - fr->len);
+	return bp->data + bp->size;
+}
+/* Start a new mbuf for the frame, or give up on it if it's too long or
+ * there's no memory
+ */
+static int
+frgrow(struct framer *fr,uint8 **dpp,uint8 **dep)
+{
+	struct mbuf *bp;
+
+	if((bp = fr->tail) != NULL){
+		bp->cnt = *dpp - bp->data;
+		fr->len += bp->cnt;
+	}
+	if((fr->maxsize != 0 && fr->len >= fr->maxsize)
+	 || (bp = alloc_mbuf(fr->alloc)) == NULL){
+		free_p(&fr->head);
+		fr->tail = NULL;
+		*dpp = *dep = NULL;
+		return -1;
+	}
+	if(fr->tail == NULL)
+		fr->head = bp;
+	else
+		fr->tail->next = bp;
+	fr->tail = bp;
+	*dpp = bp->data;
+	*dep = frlimit(fr);
+	return 0;
+}
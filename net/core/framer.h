@@ -0,0 +1,60 @@
+#ifndef	_KA9Q_FRAMER_H
+#define	_KA9Q_FRAMER_H
+
+#include "global.h"
+#include "net/core/mbuf.h"
+
+/* Byte-stuffed framing for asynchronous lines, shared by SLIP, KISS,
+ * async PPP and simplified PPP. Frames are delimited by a flag byte;
+ * flags and escapes within a frame are sent as an escape followed by a
+ * substitute. HDLC framing can also escape control characters picked by
+ * an ACCM on transmit and discard them on receive.
+ */
+
+/* A set of bytes that need attention when scanning */
+struct frset {
+	uint8 map[32];		/* Bitmap of the bytes in the set */
+	uint8 c1,c2;		/* The flag and escape, always members */
+	int ctl;		/* Some control characters are members */
+};
+
+struct framer {
+	int type;
+#define	FR_SLIP		0	/* SLIP and KISS (RFC 1055) */
+#define	FR_HDLC		1	/* Async HDLC (RFC 1662) */
+	uint8 flag;		/* Frame delimiter */
+	uint8 esc;		/* Escape */
+	struct frset tx;	/* Bytes escaped on transmit */
+	struct frset rx;	/* Bytes handled specially on receive */
+	int32 txaccm;		/* Control characters escaped on transmit */
+	int32 rxaccm;		/* and ignored on receive (HDLC only) */
+
+	/* Receiver state */
+	int state;
+#define	FR_ESCAPED	0x01	/* Last byte was an escape */
+#define	FR_DISCARD	0x02	/* Throwing the rest of this frame away */
+	struct mbuf *head;	/* Frame being reassembled */
+	struct mbuf *tail;
+	uint len;		/* Bytes in mbufs before the tail */
+	uint alloc;		/* Receive mbuf allocation size */
+	uint maxsize;		/* Longest frame accepted, 0 if no limit */
+	int32 errors;		/* Invalid escape sequences (SLIP) */
+};
+
+/* fr_unstuff() return values */
+#define	FR_MORE		0	/* Input used up within a frame */
+#define	FR_FRAME	1	/* A complete frame */
+#define	FR_EMPTY	2	/* Flag with nothing before it */
+#define	FR_ABORT	3	/* Escape then flag: frame aborted */
+#define	FR_TOSS		4	/* Frame too long or out of memory */
+
+void fr_init(struct framer *fr,int type,uint alloc,uint maxsize);
+void fr_txaccm(struct framer *fr,int32 accm);
+void fr_rxaccm(struct framer *fr,int32 accm);
+void fr_reset(struct framer *fr);
+uint fr_stufflen(struct framer *fr,struct mbuf *bp);
+uint8 *fr_stuff(struct framer *fr,uint8 *cp,uint8 *buf,uint len);
+uint8 *fr_stuff_mbuf(struct framer *fr,uint8 *cp,struct mbuf *bp);
+int fr_unstuff(struct framer *fr,uint8 **cpp,uint *lenp,struct mbuf **bpp);
+
+#endif	/* _KA9Q_FRAMER_H */
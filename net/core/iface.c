@@ -8,6 +8,7 @@
 #include "net/core/mbuf.h"
 #include "core/proc.h"
 #include "net/core/iface.h"
+#include "net/core/qdisc.h"
 #include "net/enet/enet.h"
 #include "lib/util/cmdparse.h"
 #include "commands.h"
@@ -36,7 +37,9 @@ struct iface Loopback = {
 	NULL,	/* supv		*/
 	NULL,	/* outq		*/
 	0,		/* outlim	*/
+	NULL,		/* qdisc	*/
 	0,		/* txbusy	*/
+	0,		/* ackdelay	*/
 	NULL,		/* dstate	*/
 	NULL,		/* dtickle	*/
 	NULL,		/* dstatus	*/
@@ -77,7 +80,9 @@ struct iface Encap = {
 	NULL,	/* supv		*/
 	NULL,	/* outq		*/
 	0,		/* outlim	*/
+	NULL,		/* qdisc	*/
 	0,		/* txbusy	*/
+	0,		/* ackdelay	*/
 	NULL,		/* dstate	*/
 	NULL,		/* dtickle	*/
 	NULL,		/* dstatus	*/
@@ -109,6 +114,7 @@ char Noipaddr[] = "IP address field missing, and ip address not set\n";
  * General purpose interface transmit task, one for each device that can
  * send IP datagrams. It waits on the interface's IP output queue (outq),
  * extracts IP datagrams placed there in priority order by ip_route(),
+ * or from the interface's queue discipline if one is attached,
  * and sends them to the device's send routine.
  */
 void
@@ -120,11 +126,9 @@ if_tx(int dev,void *arg1,void *unused)
 
 	iface = arg1;
 	for(;;){
-		while(iface->outq == NULL)
-			kwait(&iface->outq);
+		bp = qdisc_get(iface);
 
 		iface->txbusy = 1;
-		bp = dequeue(&iface->outq);
 		pullup(&bp,&qhdr,sizeof(qhdr));
 		if(iface->dtickle != NULL && (*iface->dtickle)(iface) == -1){
 #ifdef	notdef	/* Confuses some non-compliant hosts */
@@ -271,6 +275,7 @@ if_detach(struct iface *ifp)
 	killproc(&ifp->rxproc);
 	killproc(&ifp->txproc);
 	killproc(&ifp->supv);
+	qdisc_free(ifp);
 
 	/* Free allocated memory associated with this interface */
 	if(ifp->name != NULL)
@@ -87,7 +87,9 @@ struct iface {
 
 	struct mbuf *outq;	/* IP datagram transmission queue */
 	int outlim;		/* Limit on outq length */
+	struct qdisc *qdisc;	/* Output queue discipline, if any */
 	int txbusy;		/* Transmitter is busy */
+	int32 ackdelay;		/* TCP delayed ack time, ms; 0 = default */
 
 	void *dstate;		/* Demand dialer link state, if any */
 	int (*dtickle)(struct iface *);
@@ -143,6 +145,8 @@ struct qhdr {
 extern char Noipaddr[];
 extern struct mbuf *Hopper;
 
+struct qdisc;		/* In qdisc.h */
+
 /* In iface.c: */
 int bitbucket(struct iface *ifp,struct mbuf **bp);
 int if_detach(struct iface *ifp);
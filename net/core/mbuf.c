@@ -557,6 +557,21 @@ int
 crc_mbuf(struct mbuf *bp, uint offset, uint len, uint16 *pcrc)
 {
 	uint16 crc;
+
+	crc_init(&crc);
+	if (crc_update_mbuf(bp, offset, len, &crc) != 0)
+		return -1;
+	*pcrc = crc;
+	return 0;
+}
+
+/* Fold len bytes of a chain, starting offset bytes in, into a running CRC
+ * a segment at a time
+ */
+int
+crc_update_mbuf(struct mbuf *bp, uint offset, uint len, uint16 *pcrc)
+{
+	uint16 crc = *pcrc;
 	uint actual;
 
 	/* Skip over offset if greater than first mbuf(s) */
@@ -564,7 +579,6 @@ crc_mbuf(struct mbuf *bp, uint offset, uint len, uint16 *pcrc)
 		offset -= bp->cnt;
 		bp = bp->next;
 	}
-	crc_init(&crc);
 	while (bp != NULL && len > 0) {
 		actual = min(len, bp->cnt - offset);
 		crc_update(&bp->data[offset], actual, &crc);
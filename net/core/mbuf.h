@@ -60,6 +60,8 @@ uint8 *put32(uint8 *cp,int32 x);
 
 /* Non-destructive CRC compute */
 int crc_mbuf(struct mbuf *bp, uint offset, uint len, uint16 *pcrc);
+/* Same, continuing a running CRC */
+int crc_update_mbuf(struct mbuf *bp, uint offset, uint len, uint16 *pcrc);
 /* Non-destructive CRC check */
 int crc_check_mbuf(struct mbuf *bp, uint offset, uint len);
 /* Calculate and append CRC-16 value to mbuf */
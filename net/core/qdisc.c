@@ -0,0 +1,804 @@
+/* Interface output queue disciplines: byte-limited FIFO, token bucket
+ * rate shaper and flow-fair queuing with CoDel active queue management.
+ *
+ * The token bucket is meant for slow radio and serial links, where it
+ * keeps the driver's own queue short so that the interactive band is
+ * always close to the head of the line. Flow queuing hashes each
+ * datagram by address, protocol and port onto one of a set of
+ * sub-queues served deficit round robin, giving newly active (sparse)
+ * flows such as telnet keystrokes priority over bulk transfers, while
+ * CoDel drops from the head of any flow whose packets sit in the queue
+ * too long.
+ */
+#include "top.h"
+
+#include "lib/std/stdio.h"
+#include "global.h"
+#include "net/core/mbuf.h"
+#include "core/proc.h"
+#include "core/timer.h"
+#include "net/core/iface.h"
+#include "net/core/qdisc.h"
+
+static int fifo_init(struct qdisc *q);
+static void fifo_free(struct qdisc *q);
+static void fifo_enqueue(struct qdisc *q,struct mbuf **bpp,uint flow);
+static struct mbuf *fifo_dequeue(struct qdisc *q,int32 *wait);
+static struct mbuf *fifo_drain(struct qdisc *q);
+static int fifo_set(struct qdisc *q,char *param,char *value);
+static void fifo_show(struct qdisc *q);
+static void fifo_garbage(struct qdisc *q,int red);
+
+static int tbf_init(struct qdisc *q);
+static void tbf_free(struct qdisc *q);
+static void tbf_enqueue(struct qdisc *q,struct mbuf **bpp,uint flow);
+static struct mbuf *tbf_dequeue(struct qdisc *q,int32 *wait);
+static struct mbuf *tbf_drain(struct qdisc *q);
+static int tbf_set(struct qdisc *q,char *param,char *value);
+static void tbf_show(struct qdisc *q);
+static void tbf_garbage(struct qdisc *q,int red);
+
+static int fq_init(struct qdisc *q);
+static void fq_free(struct qdisc *q);
+static void fq_enqueue(struct qdisc *q,struct mbuf **bpp,uint flow);
+static struct mbuf *fq_dequeue(struct qdisc *q,int32 *wait);
+static struct mbuf *fq_drain(struct qdisc *q);
+static int fq_set(struct qdisc *q,char *param,char *value);
+static void fq_show(struct qdisc *q);
+static void fq_garbage(struct qdisc *q,int red);
+
+struct qdisc_type Qdisc_types[] = {
+	{ "fifo", fifo_init, fifo_free, fifo_enqueue, fifo_dequeue,
+	  fifo_drain, fifo_set, fifo_show, fifo_garbage },
+	{ "tbf", tbf_init, tbf_free, tbf_enqueue, tbf_dequeue,
+	  tbf_drain, tbf_set, tbf_show, tbf_garbage },
+	{ "fq", fq_init, fq_free, fq_enqueue, fq_dequeue,
+	  fq_drain, fq_set, fq_show, fq_garbage },
+	{ NULL },
+};
+
+/* Append a packet to a queue, keeping the qdisc totals */
+void
+pq_put(struct qdisc *q,struct pktq *pq,struct mbuf **bpp)
+{
+	uint len;
+
+	if(bpp == NULL || *bpp == NULL)
+		return;
+	len = len_p(*bpp);
+	(*bpp)->anext = NULL;
+	if(pq->tail == NULL)
+		pq->head = *bpp;
+	else
+		pq->tail->anext = *bpp;
+	pq->tail = *bpp;
+	*bpp = NULL;
+	pq->len++;
+	pq->bytes += len;
+	q->len++;
+	q->bytes += len;
+	if(q->bytes > q->peak)
+		q->peak = q->bytes;
+}
+/* Remove the packet at the head of a queue */
+struct mbuf *
+pq_get(struct qdisc *q,struct pktq *pq)
+{
+	struct mbuf *bp;
+	uint len;
+
+	if((bp = pq->head) == NULL)
+		return NULL;
+	if((pq->head = bp->anext) == NULL)
+		pq->tail = NULL;
+	bp->anext = NULL;
+	len = len_p(bp);
+	pq->len--;
+	pq->bytes -= len;
+	q->len--;
+	q->bytes -= len;
+	return bp;
+}
+/* Discard a packet on behalf of a qdisc */
+void
+qdisc_drop(struct qdisc *q,struct mbuf **bpp)
+{
+	q->drops++;
+	free_p(bpp);
+}
+
+/* Memory is short: copy each queued packet into contiguous buffers,
+ * and in red alert also discard the older half of the queue
+ */
+void
+pq_garbage(struct qdisc *q,struct pktq *pq,int red)
+{
+	struct mbuf **bpp;
+	struct mbuf *bp;
+	uint n;
+
+	if(red){
+		for(n = (pq->len + 1)/2;n != 0;n--){
+			bp = pq_get(q,pq);
+			qdisc_drop(q,&bp);
+		}
+	}
+	pq->tail = NULL;
+	for(bpp = &pq->head;*bpp != NULL;bpp = &(*bpp)->anext){
+		mbuf_crunch(bpp);
+		pq->tail = *bpp;
+	}
+}
+/* Garbage collection hook, called from ip_garbage() */
+void
+qdisc_garbage(struct iface *ifp,int red)
+{
+	struct qdisc *q;
+
+	if((q = ifp->qdisc) != NULL)
+		(*q->type->garbage)(q,red);
+}
+
+/* Get the next packet to transmit on an interface, waiting until one
+ * is both queued and (if the qdisc shapes) eligible to go.
+ */
+struct mbuf *
+qdisc_get(struct iface *ifp)
+{
+	struct mbuf *bp;
+	struct qdisc *q;
+	int32 wait;
+
+	for(;;){
+		/* Anything on outq goes first. That's everything when no
+		 * qdisc is attached, and otherwise only what was queued
+		 * before the current one was selected.
+		 */
+		if(ifp->outq != NULL)
+			return dequeue(&ifp->outq);
+
+		if((q = ifp->qdisc) == NULL){
+			kwait(&ifp->outq);
+			continue;
+		}
+		wait = 0;
+		if((bp = (*q->type->dequeue)(q,&wait)) != NULL){
+			q->dequeues++;
+			q->sent += len_p(bp) - sizeof(struct qhdr);
+			return bp;
+		}
+		if(wait > 0){
+			/* Shaper is holding a packet back; sleep until it
+			 * is due, or until something else is queued
+			 */
+			kalarm(wait);
+			kwait(&ifp->outq);
+			kalarm(0L);
+		} else
+			kwait(&ifp->outq);
+	}
+}
+/* Hand an IP datagram, qhdr already in front, to the interface's qdisc */
+void
+qdisc_enqueue(struct iface *ifp,struct mbuf **bpp,uint flow)
+{
+	struct qdisc *q = ifp->qdisc;
+
+	q->enqueues++;
+	(*q->type->enqueue)(q,bpp,flow);
+	free_p(bpp);	/* In case the qdisc didn't take it */
+	ksignal(&ifp->outq,1);
+}
+/* Select the queue discipline for an interface. "none" reverts to the
+ * default priority queue. Packets held by the old qdisc are moved to
+ * outq and go out first.
+ */
+int
+qdisc_set(struct iface *ifp,char *name)
+{
+	struct qdisc_type *qt;
+	struct qdisc *q,*old;
+	struct mbuf *bp;
+
+	if(STRNICMP(name,"none",strlen(name)) == 0){
+		qt = NULL;
+	} else {
+		for(qt = Qdisc_types;qt->name != NULL;qt++)
+			if(STRNICMP(qt->name,name,strlen(name)) == 0)
+				break;
+		if(qt->name == NULL)
+			return -1;
+	}
+	old = ifp->qdisc;
+	if(old != NULL && old->type == qt)
+		return 0;	/* Already there, keep its state */
+
+	q = NULL;
+	if(qt != NULL){
+		q = (struct qdisc *)callocw(1,sizeof(struct qdisc));
+		q->type = qt;
+		q->iface = ifp;
+		q->limit = QD_LIMIT;
+		if((*qt->init)(q) == -1){
+			free(q);
+			return -1;
+		}
+	}
+	ifp->qdisc = q;
+	if(old != NULL){
+		while((bp = (*old->type->drain)(old)) != NULL)
+			enqueue(&ifp->outq,&bp);
+		(*old->type->free)(old);
+		free(old);
+		ksignal(&ifp->outq,1);
+	}
+	return 0;
+}
+/* Discard an interface's qdisc and everything on it */
+void
+qdisc_free(struct iface *ifp)
+{
+	struct qdisc *q;
+	struct mbuf *bp;
+
+	if((q = ifp->qdisc) == NULL)
+		return;
+	ifp->qdisc = NULL;
+	while((bp = (*q->type->drain)(q)) != NULL)
+		free_p(&bp);
+	(*q->type->free)(q);
+	free(q);
+}
+/* Display qdisc parameters and statistics */
+void
+qdisc_show(struct iface *ifp)
+{
+	struct qdisc *q;
+
+	if((q = ifp->qdisc) == NULL){
+		kprintf("%-10s qdisc none (priority queue) qlen %u",
+		 ifp->name,len_q(ifp->outq));
+		if(ifp->outlim != 0)
+			kprintf("/%u",ifp->outlim);
+		kprintf("\n");
+		return;
+	}
+	kprintf("%-10s qdisc %s backlog %u pkts %ld bytes (peak %ld) limit %ld\n",
+	 ifp->name,q->type->name,q->len,(long)q->bytes,(long)q->peak,
+	 (long)q->limit);
+	kprintf("           offered %u sent %u (%lu bytes) dropped %u overlimits %u\n",
+	 q->enqueues,q->dequeues,q->sent,q->drops,q->overlimits);
+	(*q->type->show)(q);
+}
+
+/* FIFO with a byte limit (tail drop) */
+static int
+fifo_init(struct qdisc *q)
+{
+	q->priv = callocw(1,sizeof(struct pktq));
+	return 0;
+}
+static void
+fifo_free(struct qdisc *q)
+{
+	free(q->priv);
+}
+static void
+fifo_enqueue(struct qdisc *q,struct mbuf **bpp,uint flow)
+{
+	if(q->limit != 0 && q->len != 0
+	 && q->bytes + (int32)len_p(*bpp) > q->limit){
+		qdisc_drop(q,bpp);
+		return;
+	}
+	pq_put(q,(struct pktq *)q->priv,bpp);
+}
+static struct mbuf *
+fifo_dequeue(struct qdisc *q,int32 *wait)
+{
+	return pq_get(q,(struct pktq *)q->priv);
+}
+static struct mbuf *
+fifo_drain(struct qdisc *q)
+{
+	return pq_get(q,(struct pktq *)q->priv);
+}
+static int
+fifo_set(struct qdisc *q,char *param,char *value)
+{
+	if(STRNICMP(param,"limit",strlen(param)) == 0){
+		q->limit = atol(value);
+		return 0;
+	}
+	return -1;
+}
+static void
+fifo_show(struct qdisc *q)
+{
+}
+static void
+fifo_garbage(struct qdisc *q,int red)
+{
+	pq_garbage(q,(struct pktq *)q->priv,red);
+}
+
+/* Token bucket shaper. Credit is kept in units of 1/8000 byte, so that
+ * adding elapsed milliseconds times the rate in bits/sec is exact and
+ * no fractional tokens are lost on slow links. Underneath is a two-band
+ * FIFO: datagrams with any TOS or interactive bit set by q_pkt() go
+ * ahead of the rest.
+ */
+#define	TBF_BANDS	2
+struct tbf {
+	int32 rate;		/* Bits per second */
+	int32 burst;		/* Bucket size, bytes */
+	uint64 credit;		/* Current tokens, 1/8000 byte units */
+	int32 last;		/* msclock() of last refill */
+	struct pktq band[TBF_BANDS];
+};
+#define	TBF_RATE	9600	/* Default rate, bits/sec */
+#define	TBF_BURST	1600	/* Default bucket, bytes */
+
+static int
+tbf_init(struct qdisc *q)
+{
+	struct tbf *tbf;
+
+	tbf = (struct tbf *)callocw(1,sizeof(struct tbf));
+	tbf->rate = TBF_RATE;
+	tbf->burst = TBF_BURST;
+	tbf->credit = (uint64)tbf->burst * 8000;
+	tbf->last = msclock();
+	q->priv = tbf;
+	return 0;
+}
+static void
+tbf_free(struct qdisc *q)
+{
+	free(q->priv);
+}
+static void
+tbf_enqueue(struct qdisc *q,struct mbuf **bpp,uint flow)
+{
+	struct tbf *tbf = (struct tbf *)q->priv;
+	struct qhdr qhdr;
+
+	if(q->limit != 0 && q->len != 0
+	 && q->bytes + (int32)len_p(*bpp) > q->limit){
+		qdisc_drop(q,bpp);
+		return;
+	}
+	memcpy(&qhdr,(*bpp)->data,sizeof(qhdr));
+	pq_put(q,&tbf->band[qhdr.tos != 0 ? 0 : 1],bpp);
+}
+static struct mbuf *
+tbf_dequeue(struct qdisc *q,int32 *wait)
+{
+	struct tbf *tbf = (struct tbf *)q->priv;
+	struct pktq *pq;
+	uint64 cost,cap;
+	int32 now;
+
+	if(tbf->band[0].head != NULL)
+		pq = &tbf->band[0];
+	else if(tbf->band[1].head != NULL)
+		pq = &tbf->band[1];
+	else
+		return NULL;
+
+	/* Refill the bucket */
+	now = msclock();
+	cap = (uint64)tbf->burst * 8000;
+	if(now - tbf->last > 0){
+		tbf->credit += (uint64)(now - tbf->last) * tbf->rate;
+		if(tbf->credit > cap)
+			tbf->credit = cap;
+	}
+	tbf->last = now;
+
+	/* A packet bigger than the bucket goes when the bucket is full */
+	cost = (uint64)(len_p(pq->head) - sizeof(struct qhdr)) * 8000;
+	if(cost > cap)
+		cost = cap;
+	if(tbf->credit < cost){
+		q->overlimits++;
+		*wait = (int32)((cost - tbf->credit + tbf->rate - 1) / tbf->rate);
+		return NULL;
+	}
+	tbf->credit -= cost;
+	return pq_get(q,pq);
+}
+static struct mbuf *
+tbf_drain(struct qdisc *q)
+{
+	struct tbf *tbf = (struct tbf *)q->priv;
+	struct mbuf *bp;
+
+	if((bp = pq_get(q,&tbf->band[0])) == NULL)
+		bp = pq_get(q,&tbf->band[1]);
+	return bp;
+}
+static int
+tbf_set(struct qdisc *q,char *param,char *value)
+{
+	struct tbf *tbf = (struct tbf *)q->priv;
+	int32 x;
+
+	x = atol(value);
+	if(STRNICMP(param,"limit",strlen(param)) == 0){
+		q->limit = x;
+	} else if(STRNICMP(param,"rate",strlen(param)) == 0){
+		if(x <= 0)
+			return -1;
+		tbf->rate = x;
+	} else if(STRNICMP(param,"burst",strlen(param)) == 0){
+		if(x <= 0)
+			return -1;
+		tbf->burst = x;
+		if(tbf->credit > (uint64)x * 8000)
+			tbf->credit = (uint64)x * 8000;
+	} else
+		return -1;
+	return 0;
+}
+static void
+tbf_show(struct qdisc *q)
+{
+	struct tbf *tbf = (struct tbf *)q->priv;
+
+	kprintf("           rate %ld bit/s burst %ld bytes tokens %lu bands %u/%u\n",
+	 (long)tbf->rate,(long)tbf->burst,(unsigned long)(tbf->credit/8000),
+	 tbf->band[0].len,tbf->band[1].len);
+}
+static void
+tbf_garbage(struct qdisc *q,int red)
+{
+	struct tbf *tbf = (struct tbf *)q->priv;
+	int i;
+
+	for(i=0;i<TBF_BANDS;i++)
+		pq_garbage(q,&tbf->band[i],red);
+}
+
+/* Flow queuing with CoDel, after RFC 8290. Each packet is stamped with
+ * its enqueue time (an int32 pushed ahead of the qhdr) so that CoDel
+ * can measure its sojourn time when it reaches the head.
+ *
+ * The CoDel defaults (5 ms target, 100 ms interval) suit Ethernet; on
+ * a radio channel the target must be at least the time to send one MTU
+ * and the interval a typical round trip, e.g. "target 2000 interval
+ * 20000" at 1200 baud.
+ */
+struct fqflow {
+	struct pktq q;
+	struct fqflow *next;	/* Link on new or old flow list */
+	int32 deficit;		/* DRR deficit, bytes */
+	int active;		/* On one of the lists */
+
+	/* CoDel state */
+	int32 first_above;	/* When sojourn time first went over target */
+	int32 drop_next;	/* Time of next drop while dropping */
+	uint count;		/* Drops in current dropping state */
+	int dropping;
+};
+struct fqlist {
+	struct fqflow *head;
+	struct fqflow *tail;
+};
+struct fq {
+	uint nflows;
+	struct fqflow *flows;
+	struct fqlist newflows;	/* Flows that have just become active */
+	struct fqlist oldflows;
+	int32 quantum;		/* DRR quantum, bytes */
+	int32 target;		/* CoDel target sojourn time, ms */
+	int32 interval;		/* CoDel interval, ms */
+
+	unsigned codeldrops;	/* Dropped by CoDel */
+	unsigned overdrops;	/* Dropped from fattest flow at limit */
+	unsigned sparse;	/* Flows that started on the new list */
+};
+#define	FQ_FLOWS	64
+#define	FQ_TARGET	5
+#define	FQ_INTERVAL	100
+#define	FQ_MAXCOUNT	1023	/* Cap on CoDel drop count */
+
+static void fq_push(struct fqlist *l,struct fqflow *f);
+static struct fqflow *fq_pop(struct fqlist *l);
+static struct mbuf *fq_head(struct qdisc *q,struct fq *fq,
+	struct fqflow *f,int32 now,int *okdrop);
+static struct mbuf *fq_codel(struct qdisc *q,struct fq *fq,
+	struct fqflow *f,int32 now);
+static int32 fq_law(struct fq *fq,int32 t,uint count);
+static uint32 isqrt(uint32 x);
+
+static int
+fq_init(struct qdisc *q)
+{
+	struct fq *fq;
+
+	fq = (struct fq *)callocw(1,sizeof(struct fq));
+	fq->nflows = FQ_FLOWS;
+	fq->flows = (struct fqflow *)callocw(fq->nflows,sizeof(struct fqflow));
+	fq->quantum = q->iface->mtu < 1500 ? q->iface->mtu : 1500;
+	fq->target = FQ_TARGET;
+	fq->interval = FQ_INTERVAL;
+	q->priv = fq;
+	return 0;
+}
+static void
+fq_free(struct qdisc *q)
+{
+	struct fq *fq = (struct fq *)q->priv;
+
+	free(fq->flows);
+	free(fq);
+}
+static void
+fq_push(struct fqlist *l,struct fqflow *f)
+{
+	f->next = NULL;
+	if(l->tail == NULL)
+		l->head = f;
+	else
+		l->tail->next = f;
+	l->tail = f;
+}
+static struct fqflow *
+fq_pop(struct fqlist *l)
+{
+	struct fqflow *f;
+
+	if((f = l->head) != NULL){
+		if((l->head = f->next) == NULL)
+			l->tail = NULL;
+		f->next = NULL;
+	}
+	return f;
+}
+static void
+fq_enqueue(struct qdisc *q,struct mbuf **bpp,uint flow)
+{
+	struct fq *fq = (struct fq *)q->priv;
+	struct fqflow *f,*fat;
+	struct mbuf *bp;
+	int32 now;
+	uint i;
+
+	now = msclock();
+	pushdown(bpp,&now,sizeof(now));
+	f = &fq->flows[flow % fq->nflows];
+	pq_put(q,&f->q,bpp);
+	if(!f->active){
+		f->active = 1;
+		f->deficit = fq->quantum;
+		fq_push(&fq->newflows,f);
+		fq->sparse++;
+	}
+	/* Over the limit, drop from the head of the fattest flow */
+	while(q->limit != 0 && q->bytes > q->limit && q->len > 1){
+		fat = &fq->flows[0];
+		for(i=1;i<fq->nflows;i++)
+			if(fq->flows[i].q.bytes > fat->q.bytes)
+				fat = &fq->flows[i];
+		bp = pq_get(q,&fat->q);
+		fq->overdrops++;
+		qdisc_drop(q,&bp);
+	}
+}
+/* Take the head packet of a flow and evaluate its sojourn time */
+static struct mbuf *
+fq_head(struct qdisc *q,struct fq *fq,struct fqflow *f,int32 now,int *okdrop)
+{
+	struct mbuf *bp;
+	int32 stamp;
+
+	*okdrop = 0;
+	if((bp = pq_get(q,&f->q)) == NULL){
+		f->first_above = 0;
+		return NULL;
+	}
+	pullup(&bp,&stamp,sizeof(stamp));
+	if(now - stamp < fq->target || f->q.bytes <= (int32)q->iface->mtu){
+		/* Below target, or too little left to bother */
+		f->first_above = 0;
+	} else if(f->first_above == 0){
+		if((f->first_above = now + fq->interval) == 0)
+			f->first_above = 1;
+	} else if(now - f->first_above >= 0){
+		*okdrop = 1;
+	}
+	return bp;
+}
+/* CoDel dequeue from one flow */
+static struct mbuf *
+fq_codel(struct qdisc *q,struct fq *fq,struct fqflow *f,int32 now)
+{
+	struct mbuf *bp;
+	int okdrop;
+	int32 delta;
+
+	bp = fq_head(q,fq,f,now,&okdrop);
+	if(f->dropping){
+		if(!okdrop){
+			f->dropping = 0;
+		} else {
+			while(bp != NULL && f->dropping
+			 && now - f->drop_next >= 0){
+				fq->codeldrops++;
+				qdisc_drop(q,&bp);
+				if(f->count < FQ_MAXCOUNT)
+					f->count++;
+				bp = fq_head(q,fq,f,now,&okdrop);
+				if(!okdrop)
+					f->dropping = 0;
+				else
+					f->drop_next = fq_law(fq,f->drop_next,f->count);
+			}
+		}
+	} else if(okdrop && bp != NULL){
+		fq->codeldrops++;
+		qdisc_drop(q,&bp);
+		bp = fq_head(q,fq,f,now,&okdrop);
+		f->dropping = 1;
+		/* Resume near the old drop rate if we were dropping recently */
+		delta = now - f->drop_next;
+		if(f->count > 2 && delta < 8*fq->interval)
+			f->count -= 2;
+		else
+			f->count = 1;
+		f->drop_next = fq_law(fq,now,f->count);
+	}
+	return bp;
+}
+/* CoDel control law: next drop at t + interval/sqrt(count) */
+static int32
+fq_law(struct fq *fq,int32 t,uint count)
+{
+	return t + (int32)(((uint32)fq->interval << 10) / isqrt((uint32)count << 20));
+}
+static uint32
+isqrt(uint32 x)
+{
+	uint32 r,b;
+
+	r = 0;
+	for(b = 1UL << 30;b > x;b >>= 2)
+		;
+	for(;b != 0;b >>= 2){
+		if(x >= r + b){
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else
+			r >>= 1;
+	}
+	return r != 0 ? r : 1;
+}
+static struct mbuf *
+fq_dequeue(struct qdisc *q,int32 *wait)
+{
+	struct fq *fq = (struct fq *)q->priv;
+	struct fqflow *f;
+	struct mbuf *bp;
+	int32 now;
+	int isnew;
+
+	now = msclock();
+	for(;;){
+		if((f = fq_pop(&fq->newflows)) != NULL)
+			isnew = 1;
+		else if((f = fq_pop(&fq->oldflows)) != NULL)
+			isnew = 0;
+		else
+			return NULL;
+
+		if(f->deficit <= 0){
+			/* Used up its share this round */
+			f->deficit += fq->quantum;
+			fq_push(&fq->oldflows,f);
+			continue;
+		}
+		if((bp = fq_codel(q,fq,f,now)) == NULL){
+			/* Empty. A new flow gets one more turn on the old
+			 * list so it can't starve others by going idle and
+			 * coming back as new every time.
+			 */
+			if(isnew && fq->oldflows.head != NULL)
+				fq_push(&fq->oldflows,f);
+			else
+				f->active = 0;
+			continue;
+		}
+		f->deficit -= len_p(bp) - sizeof(struct qhdr);
+		/* Back at the front of its list for the rest of its quantum */
+		if(isnew){
+			f->next = fq->newflows.head;
+			fq->newflows.head = f;
+			if(fq->newflows.tail == NULL)
+				fq->newflows.tail = f;
+		} else {
+			f->next = fq->oldflows.head;
+			fq->oldflows.head = f;
+			if(fq->oldflows.tail == NULL)
+				fq->oldflows.tail = f;
+		}
+		return bp;
+	}
+}
+static struct mbuf *
+fq_drain(struct qdisc *q)
+{
+	struct fq *fq = (struct fq *)q->priv;
+	struct mbuf *bp;
+	int32 stamp;
+	uint i;
+
+	for(i=0;i<fq->nflows;i++){
+		if((bp = pq_get(q,&fq->flows[i].q)) != NULL){
+			pullup(&bp,&stamp,sizeof(stamp));
+			return bp;
+		}
+	}
+	return NULL;
+}
+static int
+fq_set(struct qdisc *q,char *param,char *value)
+{
+	struct fq *fq = (struct fq *)q->priv;
+	int32 x;
+
+	x = atol(value);
+	if(STRNICMP(param,"limit",strlen(param)) == 0){
+		q->limit = x;
+	} else if(STRNICMP(param,"quantum",strlen(param)) == 0){
+		if(x <= 0)
+			return -1;
+		fq->quantum = x;
+	} else if(STRNICMP(param,"target",strlen(param)) == 0){
+		if(x <= 0)
+			return -1;
+		fq->target = x;
+	} else if(STRNICMP(param,"interval",strlen(param)) == 0){
+		if(x <= 0)
+			return -1;
+		fq->interval = x;
+	} else if(STRNICMP(param,"flows",strlen(param)) == 0){
+		/* Can only rehash an empty queue */
+		if(x <= 0 || q->len != 0)
+			return -1;
+		free(fq->flows);
+		fq->nflows = x;
+		fq->flows = (struct fqflow *)callocw(fq->nflows,sizeof(struct fqflow));
+		fq->newflows.head = fq->newflows.tail = NULL;
+		fq->oldflows.head = fq->oldflows.tail = NULL;
+	} else
+		return -1;
+	return 0;
+}
+static void
+fq_show(struct qdisc *q)
+{
+	struct fq *fq = (struct fq *)q->priv;
+	uint i,busy;
+
+	busy = 0;
+	for(i=0;i<fq->nflows;i++)
+		if(fq->flows[i].q.len != 0)
+			busy++;
+	kprintf("           flows %u (%u backlogged) quantum %ld target %ld ms interval %ld ms\n",
+	 fq->nflows,busy,(long)fq->quantum,(long)fq->target,(long)fq->interval);
+	kprintf("           new flows %u codel drops %u limit drops %u\n",
+	 fq->sparse,fq->codeldrops,fq->overdrops);
+}
+/* CoDel keeps its own state per flow; a flow emptied here is simply
+ * found empty and retired by fq_dequeue()
+ */
+static void
+fq_garbage(struct qdisc *q,int red)
+{
+	struct fq *fq = (struct fq *)q->priv;
+	uint i;
+
+	for(i=0;i<fq->nflows;i++)
+		pq_garbage(q,&fq->flows[i].q,red);
+}
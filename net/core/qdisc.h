@@ -0,0 +1,82 @@
+#ifndef	_KA9Q_QDISC_H
+#define	_KA9Q_QDISC_H
+
+#include "global.h"
+#include "net/core/mbuf.h"
+#include "net/core/iface.h"
+
+/* Output queue disciplines. An interface with no qdisc attached uses
+ * the traditional TOS priority queue built directly on iface->outq by
+ * q_pkt(). Attaching a qdisc diverts IP datagrams into it instead; the
+ * interface transmit process then pulls from the qdisc through
+ * qdisc_get(). Queued packets keep their struct qhdr on the front,
+ * exactly as on outq.
+ */
+
+/* Simple packet queue with a tail pointer, linked through anext */
+struct pktq {
+	struct mbuf *head;
+	struct mbuf *tail;
+	uint len;		/* Packets on queue */
+	int32 bytes;		/* Bytes on queue */
+};
+
+struct qdisc;
+struct qdisc_type {
+	char *name;
+	int (*init)(struct qdisc *);
+				/* Allocate private state */
+	void (*free)(struct qdisc *);
+				/* Release private state; queue is empty */
+	void (*enqueue)(struct qdisc *,struct mbuf **,uint flow);
+				/* Accept (or drop) a packet */
+	struct mbuf *(*dequeue)(struct qdisc *,int32 *wait);
+				/* Next packet to send; if none is eligible
+				 * yet, may set *wait to a delay in ms
+				 */
+	struct mbuf *(*drain)(struct qdisc *);
+				/* Remove any packet, ignoring shaping/AQM */
+	int (*set)(struct qdisc *,char *param,char *value);
+				/* Set a named parameter */
+	void (*show)(struct qdisc *);
+				/* Display parameters and private counters */
+	void (*garbage)(struct qdisc *,int red);
+				/* Crunch queued packets; shed some if red */
+};
+extern struct qdisc_type Qdisc_types[];
+
+struct qdisc {
+	struct qdisc_type *type;
+	struct iface *iface;
+	void *priv;		/* Type-specific state */
+
+	uint len;		/* Packets queued */
+	int32 bytes;		/* Bytes queued */
+	int32 limit;		/* Byte limit on queue, 0 = none */
+
+	/* Statistics */
+	unsigned enqueues;	/* Packets accepted */
+	unsigned dequeues;	/* Packets handed to the driver */
+	unsigned drops;		/* Packets dropped (limit or AQM) */
+	unsigned overlimits;	/* Times the shaper held back a packet */
+	unsigned long sent;	/* Bytes handed to the driver */
+	int32 peak;		/* Largest backlog seen, bytes */
+};
+
+/* Default byte limit for new queues */
+#define	QD_LIMIT	16384
+
+/* In qdisc.c: */
+struct mbuf *qdisc_get(struct iface *ifp);
+void qdisc_enqueue(struct iface *ifp,struct mbuf **bpp,uint flow);
+int qdisc_set(struct iface *ifp,char *name);
+void qdisc_free(struct iface *ifp);
+void qdisc_show(struct iface *ifp);
+void qdisc_drop(struct qdisc *q,struct mbuf **bpp);
+void qdisc_garbage(struct iface *ifp,int red);
+
+void pq_put(struct qdisc *q,struct pktq *pq,struct mbuf **bpp);
+struct mbuf *pq_get(struct qdisc *q,struct pktq *pq);
+void pq_garbage(struct qdisc *q,struct pktq *pq,int red);
+
+#endif	/* _KA9Q_QDISC_H */
@@ -10,6 +10,7 @@
 #include "net/core/mbuf.h"
 #include "core/timer.h"
 #include "net/core/iface.h"
+#include "net/core/qdisc.h"
 
 #include "lib/inet/netuser.h"
 #include "net/inet/internet.h"
@@ -535,11 +536,13 @@ ip_garbage(int red)
 	 *
 	 * Also send an ICMP source quench message to one
 	 * randomly chosen packet on each queue. If in red mode,
-	 * also drop the packet.
+	 * also drop the packet. Queues held by a qdisc are crunched,
+	 * and thinned in red mode.
 	 */
 	for(ifp=Ifaces;ifp != NULL;ifp = ifp->next){
 		ttldec(ifp);
 		rquench(ifp,red);
+		qdisc_garbage(ifp,red);
 	}
 }
 /* Decrement the IP TTL field in each packet on the send queue. If
@@ -98,6 +98,9 @@ struct route {
 	} flags;
 	struct timer timer;	/* Time until aging of this entry */
 	int32 uses;		/* Usage count */
+	uint8 tcpcc;		/* TCP congestion control for this route,
+				 * index+1 into Tcp_cc[]; 0 = default
+				 */
 };
 extern struct route *Routes[32][HASHMOD];	/* Routing table */
 extern struct route R_default;			/* Default route entry */
@@ -9,6 +9,7 @@
 #include "global.h"
 #include "net/core/mbuf.h"
 #include "net/core/iface.h"
+#include "net/core/qdisc.h"
 #include "core/timer.h"
 #include "lib/inet/netuser.h"
 #include "service/rip/rip.h"
@@ -38,6 +39,7 @@ int32 Rtchits;
 
 static int q_pkt(struct iface *iface,int32 gateway,struct ip *ip,
 	struct mbuf **bpp,int ckgood);
+static uint q_flow(struct ip *ip,struct mbuf *bp);
 
 
 /* Route an IP datagram. This is the "hopper" through which all IP datagrams,
@@ -373,6 +375,7 @@ int ckgood
 	struct mbuf *tlast,*tbp;
 	struct tcp tcp;
 	struct qhdr qhdr,qtmp;
+	uint flow;
 	int i;
 
 	iface->ipsndcnt++;
@@ -385,7 +388,7 @@ int ckgood
 	qhdr.tos = (ip->tos & 0xfc);
 	qhdr.gateway = gateway;
 
-	if(iface->outq == NULL){
+	if(iface->outq == NULL && iface->qdisc == NULL){
 		/* Queue empty, no priority decisions to be made
 		 * This is the usual case for fast networks like Ethernet,
 		 * so we can avoid some time-consuming stuff
@@ -397,8 +400,8 @@ int ckgood
 		/* See if this packet references a "priority" TCP port number */
 		if(ip->protocol == TCP_PTCL && ip->offset == 0){
 			/* Extract a copy of the TCP header */
-			if(dup_p(&tbp,*bpp,sizeof(struct qhdr)+IPLEN+
-			 ip->optlen,TCPLEN+TCP_MAXOPT) >= TCPLEN){
+			if(dup_p(&tbp,*bpp,IPLEN+ip->optlen,
+			 TCPLEN+TCP_MAXOPT) >= TCPLEN){
 				ntohtcp(&tcp,&tbp);
 
 				for(i=0;Tcp_interact[i] != -1;i++){
@@ -411,6 +414,13 @@ int ckgood
 			}
 			free_p(&tbp);
 		}
+		if(iface->qdisc != NULL){
+			/* Let the queue discipline order it */
+			flow = q_flow(ip,*bpp);
+			pushdown(bpp,&qhdr,sizeof(qhdr));
+			qdisc_enqueue(iface,bpp,flow);
+			return 0;
+		}
 		pushdown(bpp,&qhdr,sizeof(qhdr));
 		/* Search the queue looking for the first packet with precedence
 		 * lower than our packet
@@ -440,6 +450,26 @@ int ckgood
 	}
 	return 0;
 }
+/* Hash a datagram's addresses, protocol and (for unfragmented TCP
+ * and UDP) port numbers into a flow identifier for the qdisc
+ */
+static uint
+q_flow(struct ip *ip,struct mbuf *bp)
+{
+	uint8 ports[4];
+	uint32 h;
+
+	h = ip->source ^ (ip->dest * 31) ^ ((uint32)ip->protocol << 24);
+	if(ip->offset == 0 && !ip->flags.mf
+	 && (ip->protocol == TCP_PTCL || ip->protocol == UDP_PTCL)
+	 && extract(bp,IPLEN+ip->optlen,ports,sizeof(ports)) == sizeof(ports))
+		h ^= get32(ports);
+	/* Mix the high bits down, since the qdisc takes it modulo */
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return (uint)h;
+}
 int
 ip_encap(
 struct mbuf **bpp,
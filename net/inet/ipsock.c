@@ -142,7 +142,7 @@ static void
 rip_recv(rp)
 struct raw_ip *rp;
 {
-	ksignal(itop(rp->user),1);
+	sockwake(itop(rp->user),1);
 	kwait(NULL);
 }
 /* Issue an automatic bind of a local address */
@@ -8,6 +8,7 @@
 #include "net/core/mbuf.h"
 #include "core/timer.h"
 #include "net/core/iface.h"
+#include "net/core/qdisc.h"
 #include "lib/util/cmdparse.h"
 #include "net/inet/ip.h"
 
@@ -83,11 +84,9 @@ sim_tx(int dev,void *arg1,void *unused)
 
         iface = arg1;
         for(;;){
-                while(iface->outq == NULL)
-                        kwait(&iface->outq);
+                bp = qdisc_get(iface);
 
 		iface->txbusy = 1;
-                bp = dequeue(&iface->outq);
                 /* Simulate transmission time */
 		if(Simctl.base+Simctl.perbyte != 0)
 	                ppause(Simctl.base+Simctl.perbyte*len_p(bp));
@@ -14,11 +14,19 @@
 
 #define	DEF_MSS	512	/* Default maximum segment size */
 #define	DEF_WND	2048	/* Default receiver window */
-#define	RTTCACHE 16	/* # of TCP round-trip-time cache entries */
+#define	DEF_TCPMMAX	64	/* Default size of destination metrics cache */
+#define	TCP_TMPLLEN	(TCPLEN + 12)	/* Header plus padded timestamp option */
+#define	DEF_SYNMAX	64	/* Default size of SYN cache */
+#define	DEF_BACKLOG	8	/* Default accept backlog for server sockets */
+#define	TCBHASH	256	/* Hash chains for connected TCBs (power of 2) */
+#define	TCBLHASH 32	/* Hash chains for listening TCBs (power of 2) */
 #define	DEF_RTT	5000	/* Initial guess at round trip time (5 sec) */
 #define	MSL2	30	/* Guess at two maximum-segment lifetimes */
 #define	MIN_RTO	500L	/* Minimum timeout, milliseconds */
-#define	DEF_WSCALE	0	/* Our window scale option */
+#define	DEF_ACKDELAY	200L	/* Delayed ack timer, ms (RFC 1122: < 500) */
+#define	DEF_WMAX	262144L	/* Cap on auto-tuned receive buffer */
+#define	TCP_MAXWSCALE	14	/* Largest legal window scale (RFC 7323) */
+#define	TCP_MAXWIN	65535L	/* Largest unscaled window */
 
 #define	geniss()	((int32)msclock() << 12) /* Increment clock at 4 MB/sec */
 
@@ -38,6 +46,14 @@
  */
 #define TCPLEN		20	/* Minimum Header length, bytes */
 #define	TCP_MAXOPT	40	/* Largest option field, bytes */
+#define	TCP_MAXSACK	4	/* Most SACK blocks that fit in the options */
+#define	TCP_SACKHOLES	8	/* Sender scoreboard size, ranges */
+
+/* Range of sequence space, [start,end) */
+struct sackblk {
+	int32 start;
+	int32 end;
+};
 struct tcp {
 	uint source;	/* Source port */
 	uint dest;	/* Destination port */
@@ -50,6 +66,8 @@ struct tcp {
 	uint8 wsopt;			/* Optional window scale factor */
 	uint32 tsval;			/* Outbound timestamp */
 	uint32 tsecr;			/* Timestamp echo field */
+	int nsack;			/* Number of SACK blocks */
+	struct sackblk sack[TCP_MAXSACK];/* SACK blocks */
 	struct {
 		unsigned int congest:1;	/* Echoed IP congestion experienced bit */
 		unsigned int urg:1;
@@ -61,6 +79,7 @@ struct tcp {
 		unsigned int mss:1;	/* MSS option present */
 		unsigned int wscale:1;	/* Window scale option present */
 		unsigned int tstamp:1;	/* Timestamp option present */
+		unsigned int sackperm:1;/* SACK permitted option present */
 	} flags;
 };
 /* TCP options */
@@ -72,11 +91,20 @@ struct tcp {
 #define	WSCALE_LENGTH	3
 #define	TSTAMP_KIND	8
 #define	TSTAMP_LENGTH	10
+#define	SACKPERM_KIND	4
+#define	SACKPERM_LENGTH	2
+#define	SACK_KIND	5
+#define	SACK_LENGTH(n)	(2 + 8*(n))
 
-/* Resequencing queue entry */
+/* Resequencing queue entry: one contiguous range of out-of-order data,
+ * kept in a skip list sorted by starting sequence number
+ */
+#define	RSQLEVELS	6	/* Skip list levels */
+#define	DEF_RESEQMAX	65536L	/* Default cap on bytes held per connection */
 struct reseq {
-	struct reseq *next;	/* Linked-list pointer */
-	struct tcp seg;		/* TCP header */
+	struct reseq *next[RSQLEVELS];	/* Skip list forward pointers */
+	int level;		/* Number of next[] in use */
+	struct tcp seg;		/* TCP header of first segment */
 	struct mbuf *bp;	/* data */
 	uint length;		/* data length */
 	char tos;		/* Type of service */
@@ -96,9 +124,13 @@ enum tcp_state {
 	TCP_TIME_WAIT,
 };
 
+/* Words of per-connection congestion control state */
+#define	TCP_CCPRIV	4
+
 /* TCP connection control block */
 struct tcb {
 	struct tcb *next;	/* Linked list pointer */
+	struct tcb *hnext;	/* Hash chain pointer */
 
 	struct connection conn;
 
@@ -129,6 +161,8 @@ struct tcb {
 	int32 resent;		/* Count of bytes retransmitted */
 	int32 cwind;		/* Congestion window */
 	int32 ssthresh;		/* Slow-start threshold */
+	struct tcp_cc *cc;	/* Congestion control module */
+	int32 ccpriv[TCP_CCPRIV];/* Module's per-connection state */
 	int dupacks;		/* Count of duplicate (do-nothing) ACKs */
 
 	/* Receive sequence variables */
@@ -146,6 +180,12 @@ struct tcb {
 	int32 mss;		/* Maximum segment size */
 
 	int32 window;		/* Receiver window and send queue limit */
+	int32 rcvbuf;		/* Receive buffer size, auto-tuned upward
+				 * from window as far as Tcp_wmax
+				 */
+	int32 rcv_mseq;		/* rcv.nxt when measurement period began */
+	int32 rcv_mtime;	/* Time measurement period began */
+	int32 rcv_rtt;		/* Receiver's RTT estimate, ms (0 = none) */
 	int32 limit;		/* Send queue limit */
 
 	void (*r_upcall)(struct tcb *tcb,int32 cnt);
@@ -164,6 +204,7 @@ struct tcb {
 		unsigned int congest:1;	/* Copy of last IP congest bit received */
 		int ts_ok:1;	/* We're using timestamps */
 		int ws_ok:1;		/* We're using window scaling */
+		unsigned int sack_ok:1;	/* We're using selective acks */
 	} flags;
 	char tos;		/* Type of service (for IP) */
 	int backoff;		/* Backoff interval */
@@ -176,8 +217,33 @@ struct tcb {
 				 * actually appear on sndq!
 				 */
 
-	struct reseq *reseq;	/* Out-of-order segment queue */
+	struct reseq *reseq[RSQLEVELS];	/* Out-of-order segment queue */
+	int rsqlevel;		/* Levels in use on reseq */
+	int32 rsqbytes;		/* Bytes held on reseq */
+	int32 sack_last;	/* Seq of latest segment put on reseq */
+
+	/* SACK sender scoreboard: ranges above snd.una that the
+	 * receiver has reported holding, sorted and merged
+	 */
+	struct sackblk sacked[TCP_SACKHOLES];
+	int nsacked;
+	int32 sack_rxt;		/* End of last hole retransmission */
+	int32 sackblks;		/* SACK blocks received */
+	int32 sacksent;		/* Segments sent carrying SACK blocks */
+	int32 sackrxt;		/* Hole retransmissions */
+	int32 sackskip;		/* Bytes not resent, already SACKed */
+
 	struct timer timer;	/* Retransmission timer */
+	struct timer acktimer;	/* Delayed ack timer */
+	int32 ackdelay;		/* Delayed ack time, ms; 0 = ack at once */
+
+	/* Prebuilt header for segments once synchronized */
+	uint8 tmpl[TCP_TMPLLEN];
+	uint tmplen;		/* Its length; 0 if there's no template */
+	int32 tmplsum;		/* Unfolded sum of the pseudo-header
+				 * addresses and protocol and of the
+				 * template's constant fields
+				 */
 	int32 rtt_time;		/* Stored clock values for RTT */
 	int32 rttseq;		/* Sequence number being timed */
 	int32 rttack;		/* Ack at start of timing (for txbw calc) */
@@ -197,14 +263,76 @@ struct tcb {
 	int32 lastrx;		/* Time of last received data */
 	int32 inlen;		/* Average receive data size */
 	int32 inrate;		/* Average receive packet interval,ms */
+
+	/* Server (clone) listeners only */
+	int backlog;		/* Most connections awaiting accept (0 = any) */
+	int aqlen;		/* Connections awaiting accept */
+};
+/* SYN cache entry: a connection request to a server socket, held in
+ * place of a TCB until the handshake completes
+ */
+struct syncache {
+	struct syncache *next;	/* Hash chain */
+	struct tcb *listener;	/* Server TCB it will be cloned from */
+	struct connection conn;
+	int32 iss;		/* Our initial sequence number */
+	int32 irs;		/* Their initial sequence number */
+	int32 sent;		/* Time SYN/ACK last sent */
+	int32 due;		/* Time to resend or give up */
+	uint32 tsval;		/* Their SYN's timestamp */
+	uint mss;		/* Their MSS option (0 = none) */
+	uint wnd;		/* Their SYN's window */
+	uint8 tos;
+	uint8 wsopt;		/* Their window scale option */
+	uint8 opts;		/* Options they sent: */
+#define	SC_WSCALE	1
+#define	SC_TSTAMP	2
+#define	SC_SACK		4
+	uint8 rexmits;		/* SYN/ACK retransmissions */
 };
-/* TCP round-trip time cache */
-struct tcp_rtt {
+/* Congestion control module. The hooks adjust cwind and ssthresh only;
+ * update() and tcp_timeout() do the retransmitting, and clamp cwind
+ * to the send queue afterward.
+ */
+struct tcp_cc {
+	char *name;
+	void (*init)(struct tcb *);
+		/* Connection synchronized, or module just selected */
+	int (*ack)(struct tcb *,int32 acked);
+		/* New data acked; snd.una not yet advanced. dupacks is
+		 * still set if we were in fast recovery. Return 1 for a
+		 * partial ack that should keep recovery going.
+		 */
+	void (*dupack)(struct tcb *);
+		/* Duplicate ack, other than the TCPDUPACKS'th */
+	void (*loss)(struct tcb *);
+		/* TCPDUPACKS'th duplicate ack, about to fast retransmit */
+	void (*timeout)(struct tcb *);
+		/* Retransmission timeout */
+	void (*rtt)(struct tcb *,int32 rtt);
+		/* Round trip time sample, ms (may be NULL) */
+};
+extern struct tcp_cc Tcp_cc[];
+extern struct tcp_cc *Tcp_ccdef;
+extern int Tcp_cctrace;
+
+/* TCP per-destination metrics cache entry */
+struct tcp_metric {
+	struct tcp_metric *hnext;	/* Hash chain */
+	struct tcp_metric *prev;	/* LRU list, most recent first */
+	struct tcp_metric *next;
 	int32 addr;		/* Destination IP address */
-	int32 srtt;		/* Most recent SRTT */
-	int32 mdev;		/* Most recent mean deviation */
+	int32 srtt;		/* Smoothed round trip time, ms (0 = none) */
+	int32 mdev;		/* Mean deviation, ms */
+	int32 ssthresh;		/* Slow-start threshold (0 = none learned) */
+	int32 cwind;		/* Congestion window at close (0 = none) */
+	uint mtu;		/* Path MTU in use (0 = unknown) */
+	uint loss;		/* Smoothed fraction retransmitted, 1/10000 */
+	uint nsamples;		/* Connections contributing to loss */
+	int32 time;		/* msclock() at last update */
+	unsigned long uses;	/* Connections seeded from this entry */
 };
-extern struct tcp_rtt Tcp_rtt[];
+extern int Tcp_mcmax;
 extern int (*Kicklist[])();
 
 /* TCP statistics counters */
@@ -215,7 +343,30 @@ struct tcp_stat {
 	uint conin;		/* Incoming connection attempts */
 	uint resets;		/* Resets generated */
 	uint bdcsts;		/* Bogus broadcast packets */
+	uint sackconn;		/* Connections that negotiated SACK */
+	unsigned long sackblks;	/* SACK blocks received */
+	unsigned long sacksent;	/* Segments sent carrying SACK blocks */
+	unsigned long sackrxt;	/* Hole retransmissions */
+	unsigned long sackskip;	/* Bytes not resent, already SACKed */
+	unsigned long acked;	/* Data bytes acknowledged (goodput) */
+	unsigned long resent;	/* Data bytes retransmitted */
+	unsigned long delayed;	/* Acks for in-sequence data deferred */
+	unsigned long ackto;	/* Delayed acks sent by the timer */
+	unsigned long rsqdup;	/* Out-of-order bytes already held */
+	unsigned long rsqmerge;	/* Out-of-order segments joined to a range */
+	unsigned long rsqdrop;	/* Out-of-order bytes dropped over the cap */
+	uint synadd;		/* SYNs entered in the SYN cache */
+	uint synok;		/* SYN cache entries completed */
+	uint synrexmit;		/* SYN/ACKs resent from the SYN cache */
+	uint synexpire;		/* SYN cache entries timed out */
+	uint synevict;		/* SYN cache entries pushed out when full */
+	uint synreset;		/* SYN cache entries reset by the peer */
+	uint synbacklog;	/* SYNs and ACKs dropped, accept backlog full */
+	uint cookiesent;	/* SYN cookies sent with the cache full */
+	uint cookieok;		/* Connections completed from a cookie */
+	uint cookiebad;		/* ACKs with an invalid cookie */
 };
+extern struct tcp_stat Tcp_stat;
 extern struct mib_entry Tcp_mib[];
 #define	tcpRtoAlgorithm	Tcp_mib[1].value.integer
 #define	tcpRtoMin	Tcp_mib[2].value.integer
@@ -238,6 +389,13 @@ extern char *Tcpstates[];
 extern char *Tcpreasons[];
 
 /* In tcpcmd.c: */
+extern int Tcp_sack;
+extern int32 Tcp_wmax;
+extern int32 Tcp_ackdelay;
+extern int32 Tcp_reseqmax;
+extern int Tcp_backlog;
+extern int Tcp_synmax;
+extern int Tcp_syncookies;
 extern int Tcp_tstamps;
 extern int32 Tcp_irtt;
 extern uint Tcp_limit;
@@ -251,7 +409,9 @@ void st_tcp(struct tcb *tcb);
 /* In tcphdr.c: */
 void htontcp(struct tcp *tcph,struct mbuf **data,
 	int32 ipsrc,int32 ipdest);
+void htontcp_tmpl(struct tcb *tcb,struct tcp *tcph,struct mbuf **bpp);
 int ntohtcp(struct tcp *tcph,struct mbuf **bpp);
+void tcp_template(struct tcb *tcb);
 
 /* In tcpin.c: */
 void reset(struct ip *ip,struct tcp *seg);
@@ -261,12 +421,44 @@ void tcp_input(struct iface *iface,struct ip *ip,struct mbuf **bpp,
 void tcp_icmp(int32 icsource,int32 source,int32 dest,
 	uint8 type,uint8 code,struct mbuf **bpp);
 
+/* In tcpmetric.c: */
+void tcpm_flush(void);
+struct tcp_metric *tcpm_get(int32 addr);
+struct tcp_metric *tcpm_next(struct tcp_metric *tm);
+void tcpm_rtt(int32 addr,int32 rtt);
+void tcpm_save(struct tcb *tcb);
+void tcpm_seed(struct tcb *tcb);
+void tcpm_trim(void);
+
+/* In tcpreseq.c: */
+void reseq_add(struct tcb *tcb,uint8 tos,struct tcp *seg,struct mbuf **bpp,
+	uint length);
+void reseq_flush(struct tcb *tcb);
+void reseq_gc(void);
+int reseq_get(struct tcb *tcb,uint8 *tos,struct tcp *seg,struct mbuf **bpp,
+	uint *length);
+
+/* In tcpsyn.c: */
+int syn_count(void);
+void syn_flush(struct tcb *lp);
+int syn_input(struct tcb *lp,struct ip *ip,struct tcp *seg,
+	struct syncache *sc);
+
+/* In tcpsack.c: */
+void sack_build(struct tcb *tcb,struct tcp *seg,int max);
+void sack_clear(struct tcb *tcb);
+int sack_nexthole(struct tcb *tcb,int32 from,int32 *hole);
+void sack_prune(struct tcb *tcb);
+void sack_rexmit(struct tcb *tcb,int32 seq);
+int32 sack_skip(struct tcb *tcb,int32 *limit);
+int32 sack_bytes(struct tcb *tcb,int32 from,int32 to);
+void sack_update(struct tcb *tcb,struct tcp *seg);
+
 /* In tcpsubr.c: */
 void close_self(struct tcb *tcb,int reason);
 struct tcb *create_tcb(struct connection *conn);
+void hash_tcb(struct tcb *tcb);
 struct tcb *lookup_tcb(struct connection *conn);
-void rtt_add(int32 addr,int32 rtt);
-struct tcp_rtt *rtt_get(int32 addr);
 int seq_ge(int32 x,int32 y);
 int seq_gt(int32 x,int32 y);
 int seq_le(int32 x,int32 y);
@@ -274,12 +466,25 @@ int seq_lt(int32 x,int32 y);
 int seq_within(int32 x,int32 low,int32 high);
 void settcpstate(struct tcb *tcb,enum tcp_state newstate);
 void tcp_garbage(int red);
+int tcp_wscale(int32 size);
+void unhash_tcb(struct tcb *tcb);
+
+/* In tcpcc.c: */
+int cc_ack(struct tcb *tcb,int32 acked);
+void cc_dupack(struct tcb *tcb);
+struct tcp_cc *cc_lookup(char *name);
+void cc_loss(struct tcb *tcb);
+void cc_route(struct tcb *tcb);
+void cc_rtt(struct tcb *tcb,int32 rtt);
+void cc_select(struct tcb *tcb,struct tcp_cc *cc);
+void cc_timeout(struct tcb *tcb);
 
 /* In tcpout.c: */
 void tcp_output(struct tcb *tcb);
 
 /* In tcptimer.c: */
 int32 backoff(int n);
+void tcp_acktimeout(void *p);
 void tcp_timeout(void *p);
 
 /* In tcpuser.c: */
@@ -0,0 +1,351 @@
+/* TCP congestion control modules.
+ *
+ * reno		The original algorithm: slow start, congestion avoidance and
+ *		Van Jacobson's fast retransmit/fast recovery, leaving
+ *		recovery on the first new ack.
+ * newreno	RFC 6582: stays in recovery until everything outstanding at
+ *		the time of the loss is acked, resending on each partial ack.
+ * vegas	Delay based, for slow high-latency (e.g., radio) paths.
+ *		Once per round trip compares the lowest RTT seen in it
+ *		with the path's base RTT to estimate how many of our
+ *		segments sit in queues, and holds that between
+ *		VEGAS_ALPHA and VEGAS_BETA instead of filling the queue
+ *		until something drops. Losses with no queue built up
+ *		are taken to be corruption, and cut the window less.
+ *		Recovery is as in newreno.
+ */
+#include "top.h"
+
+#include "lib/std/stdio.h"
+#include "global.h"
+#include "core/timer.h"
+#include "net/core/mbuf.h"
+
+#include "lib/inet/netuser.h"
+
+#include "net/inet/internet.h"
+#include "net/inet/tcp.h"
+#include "net/inet/ip.h"
+
+/* Per-connection state, laid over tcb->ccpriv[] (TCP_CCPRIV int32s) */
+struct ccstate {
+	int32 recover;		/* snd.nxt when loss was detected */
+	int32 base_rtt;		/* Lowest RTT ever seen (vegas) */
+	int32 round_rtt;	/* Lowest RTT this round (vegas) */
+	int32 round_end;	/* Ack that ends this round (vegas) */
+};
+#define	CCSTATE(tcb)	((struct ccstate *)(tcb)->ccpriv)
+
+#define	VEGAS_ALPHA	1	/* Queued segments below which we grow */
+#define	VEGAS_BETA	3	/* Queued segments above which we shrink */
+#define	VEGAS_GAMMA	1	/* Queued segments that end slow start */
+
+static void reno_init(struct tcb *tcb);
+static int reno_ack(struct tcb *tcb,int32 acked);
+static void reno_dupack(struct tcb *tcb);
+static void reno_loss(struct tcb *tcb);
+static void reno_timeout(struct tcb *tcb);
+static int newreno_ack(struct tcb *tcb,int32 acked);
+static void newreno_loss(struct tcb *tcb);
+static void newreno_timeout(struct tcb *tcb);
+static void vegas_init(struct tcb *tcb);
+static int vegas_ack(struct tcb *tcb,int32 acked);
+static void vegas_loss(struct tcb *tcb);
+static void vegas_timeout(struct tcb *tcb);
+static void vegas_rtt(struct tcb *tcb,int32 rtt);
+
+struct tcp_cc Tcp_cc[] = {
+	{ "reno",	reno_init,	reno_ack,	reno_dupack,
+	  reno_loss,	reno_timeout,	NULL },
+	{ "newreno",	reno_init,	newreno_ack,	reno_dupack,
+	  newreno_loss,	newreno_timeout,NULL },
+	{ "vegas",	vegas_init,	vegas_ack,	reno_dupack,
+	  vegas_loss,	vegas_timeout,	vegas_rtt },
+	{ NULL },
+};
+struct tcp_cc *Tcp_ccdef = &Tcp_cc[1];	/* newreno */
+int Tcp_cctrace;
+
+static void cc_trace(struct tcb *tcb,char *event,int32 cwind,int32 ssthresh);
+static void grow(struct tcb *tcb,int32 acked);
+
+/* Find a module by name */
+struct tcp_cc *
+cc_lookup(char *name)
+{
+	struct tcp_cc *cc;
+
+	for(cc = Tcp_cc;cc->name != NULL;cc++)
+		if(strcmp(cc->name,name) == 0)
+			return cc;
+	return NULL;
+}
+/* Put a connection under the given module (default if NULL) */
+void
+cc_select(struct tcb *tcb,struct tcp_cc *cc)
+{
+	if(cc == NULL)
+		cc = Tcp_ccdef;
+	tcb->cc = cc;
+	memset(tcb->ccpriv,0,sizeof(tcb->ccpriv));
+	(*cc->init)(tcb);
+}
+/* Select the module configured on the route to the remote end */
+void
+cc_route(struct tcb *tcb)
+{
+	struct route *rp;
+	struct tcp_cc *cc = NULL;
+
+	if((rp = rt_lookup(tcb->conn.remote.address)) != NULL
+	 && rp->tcpcc != 0)
+		cc = &Tcp_cc[rp->tcpcc - 1];
+	cc_select(tcb,cc);
+}
+
+/* Hook dispatchers, with optional tracing of window changes */
+int
+cc_ack(struct tcb *tcb,int32 acked)
+{
+	int32 cwind = tcb->cwind;
+	int32 ssthresh = tcb->ssthresh;
+	int partial;
+
+	partial = (*tcb->cc->ack)(tcb,acked);
+	if(Tcp_cctrace && (partial || tcb->ssthresh != ssthresh
+	 || (tcb->dupacks >= TCPDUPACKS && tcb->cwind != cwind)))
+		cc_trace(tcb,partial ? "partial ack" : "ack",cwind,ssthresh);
+	return partial;
+}
+void
+cc_dupack(struct tcb *tcb)
+{
+	(*tcb->cc->dupack)(tcb);
+}
+void
+cc_loss(struct tcb *tcb)
+{
+	int32 cwind = tcb->cwind;
+	int32 ssthresh = tcb->ssthresh;
+
+	(*tcb->cc->loss)(tcb);
+	if(Tcp_cctrace)
+		cc_trace(tcb,"loss",cwind,ssthresh);
+}
+void
+cc_timeout(struct tcb *tcb)
+{
+	int32 cwind = tcb->cwind;
+	int32 ssthresh = tcb->ssthresh;
+
+	(*tcb->cc->timeout)(tcb);
+	if(Tcp_cctrace)
+		cc_trace(tcb,"timeout",cwind,ssthresh);
+}
+void
+cc_rtt(struct tcb *tcb,int32 rtt)
+{
+	if(tcb->cc->rtt != NULL)
+		(*tcb->cc->rtt)(tcb,rtt);
+}
+static void
+cc_trace(struct tcb *tcb,char *event,int32 cwind,int32 ssthresh)
+{
+	kprintf("TCB %p %s %s: cwind %ld -> %ld ssthresh %ld -> %ld\n",
+	 tcb,tcb->cc->name,event,(long)cwind,(long)tcb->cwind,
+	 (long)ssthresh,(long)tcb->ssthresh);
+}
+
+/* Slow start below ssthresh, linear growth above, unless this
+ * ack is for a retransmission or the offered window is the limit
+ */
+static void
+grow(struct tcb *tcb,int32 acked)
+{
+	if(tcb->cwind >= tcb->snd.wnd || tcb->flags.retran)
+		return;
+	if(tcb->cwind < tcb->ssthresh){
+		/* Still doing slow start/CUTE, expand by amount acked */
+		tcb->cwind += min(acked,tcb->mss);
+	} else {
+		/* Steady-state test of extra path capacity */
+		tcb->cwind += ((long)tcb->mss * tcb->mss) / tcb->cwind;
+	}
+	/* Don't expand beyond the offered window */
+	if(tcb->cwind > tcb->snd.wnd)
+		tcb->cwind = tcb->snd.wnd;
+}
+
+static void
+reno_init(struct tcb *tcb)
+{
+}
+static int
+reno_ack(struct tcb *tcb,int32 acked)
+{
+	if(tcb->dupacks >= TCPDUPACKS && tcb->cwind > tcb->ssthresh){
+		/* The acks have finally gotten "unstuck". So now we
+		 * can "deflate" the congestion window, i.e. take it
+		 * back down to where it would be after slow start
+		 * finishes.
+		 */
+		tcb->cwind = tcb->ssthresh;
+	}
+	grow(tcb,acked);
+	return 0;
+}
+static void
+reno_dupack(struct tcb *tcb)
+{
+	/* Continue to inflate the congestion window
+	 * until the acks finally get "unstuck".
+	 */
+	if(tcb->dupacks > TCPDUPACKS)
+		tcb->cwind += tcb->mss;
+}
+static void
+reno_loss(struct tcb *tcb)
+{
+	tcb->ssthresh = tcb->cwind/2;
+	tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
+	tcb->cwind = tcb->ssthresh + TCPDUPACKS*tcb->mss;
+}
+static void
+reno_timeout(struct tcb *tcb)
+{
+	/* Reduce slowstart threshold to half current window */
+	tcb->ssthresh = tcb->cwind / 2;
+	tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
+	/* Shrink congestion window to 1 packet */
+	tcb->cwind = tcb->mss;
+}
+
+static int
+newreno_ack(struct tcb *tcb,int32 acked)
+{
+	int32 flight;
+
+	if(tcb->dupacks < TCPDUPACKS){
+		grow(tcb,acked);
+		return 0;
+	}
+	if(seq_lt(tcb->snd.una + acked,CCSTATE(tcb)->recover)){
+		/* Partial ack: deflate by the amount acked, then add
+		 * back a segment for the retransmission it triggers
+		 */
+		tcb->cwind -= min(acked,tcb->cwind);
+		if(acked >= tcb->mss)
+			tcb->cwind += tcb->mss;
+		return 1;
+	}
+	/* Full ack: leave recovery without a burst */
+	flight = tcb->snd.nxt - (tcb->snd.una + acked);
+	tcb->cwind = min(tcb->ssthresh,flight + tcb->mss);
+	return 0;
+}
+static void
+newreno_loss(struct tcb *tcb)
+{
+	tcb->ssthresh = (tcb->snd.nxt - tcb->snd.una)/2;
+	tcb->ssthresh = max(tcb->ssthresh,2*tcb->mss);
+	tcb->cwind = tcb->ssthresh + TCPDUPACKS*tcb->mss;
+	CCSTATE(tcb)->recover = tcb->snd.nxt;
+}
+static void
+newreno_timeout(struct tcb *tcb)
+{
+	tcb->ssthresh = (tcb->snd.nxt - tcb->snd.una)/2;
+	tcb->ssthresh = max(tcb->ssthresh,2*tcb->mss);
+	tcb->cwind = tcb->mss;
+	CCSTATE(tcb)->recover = tcb->snd.nxt;
+}
+
+static void
+vegas_init(struct tcb *tcb)
+{
+	CCSTATE(tcb)->round_end = tcb->snd.nxt;
+}
+static void
+vegas_rtt(struct tcb *tcb,int32 rtt)
+{
+	struct ccstate *cc = CCSTATE(tcb);
+
+	if(rtt <= 0)
+		rtt = 1;
+	if(cc->base_rtt == 0 || rtt < cc->base_rtt)
+		cc->base_rtt = rtt;
+	if(cc->round_rtt == 0 || rtt < cc->round_rtt)
+		cc->round_rtt = rtt;
+}
+/* Our segments sitting in queues along the path, judging by how much
+ * this round's RTT exceeds the base RTT; -1 if unknown
+ */
+static int32
+vegas_queued(struct tcb *tcb)
+{
+	struct ccstate *cc = CCSTATE(tcb);
+
+	if(cc->base_rtt == 0 || cc->round_rtt == 0)
+		return -1;
+	return (tcb->cwind / tcb->mss) * (cc->round_rtt - cc->base_rtt)
+	 / cc->round_rtt;
+}
+static int
+vegas_ack(struct tcb *tcb,int32 acked)
+{
+	int32 queued;
+
+	if(tcb->dupacks >= TCPDUPACKS)
+		return newreno_ack(tcb,acked);
+
+	if(seq_lt(tcb->snd.una + acked,CCSTATE(tcb)->round_end)){
+		/* Mid-round; only slow start acts per ack */
+		if(tcb->cwind < tcb->ssthresh)
+			grow(tcb,acked);
+		return 0;
+	}
+	/* End of a round trip */
+	queued = vegas_queued(tcb);
+	CCSTATE(tcb)->round_end = tcb->snd.nxt;
+	CCSTATE(tcb)->round_rtt = 0;
+
+	if(queued < 0 || tcb->flags.retran){
+		grow(tcb,acked);	/* No usable sample; act like reno */
+	} else if(tcb->cwind < tcb->ssthresh){
+		if(queued > VEGAS_GAMMA){
+			/* Queue starting to build; stop doubling */
+			tcb->ssthresh = tcb->cwind;
+		} else
+			grow(tcb,acked);
+	} else if(queued < VEGAS_ALPHA){
+		if(tcb->cwind < tcb->snd.wnd)
+			tcb->cwind += tcb->mss;
+	} else if(queued > VEGAS_BETA){
+		tcb->cwind -= tcb->mss;
+		tcb->cwind = max(tcb->cwind,2*tcb->mss);
+	}
+	return 0;
+}
+static void
+vegas_loss(struct tcb *tcb)
+{
+	int32 flight,queued;
+
+	flight = tcb->snd.nxt - tcb->snd.una;
+	queued = vegas_queued(tcb);
+	if(queued >= 0 && queued < VEGAS_ALPHA){
+		/* No queue to speak of, so probably not congestion */
+		tcb->ssthresh = flight - flight/4;
+	} else
+		tcb->ssthresh = flight/2;
+	tcb->ssthresh = max(tcb->ssthresh,2*tcb->mss);
+	tcb->cwind = tcb->ssthresh + TCPDUPACKS*tcb->mss;
+	CCSTATE(tcb)->recover = tcb->snd.nxt;
+}
+static void
+vegas_timeout(struct tcb *tcb)
+{
+	newreno_timeout(tcb);
+	CCSTATE(tcb)->round_end = tcb->snd.nxt;
+	CCSTATE(tcb)->round_rtt = 0;
+}
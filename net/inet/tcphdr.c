@@ -10,6 +10,8 @@
 #include "net/inet/ip.h"
 #include "net/inet/internet.h"
 
+static uint8 flagbits(struct tcp *tcph);
+
 /* Convert TCP header in host format into mbuf ready for transmission,
  * link in data (if any).
  *
@@ -25,6 +27,7 @@ int32 ipdest
 ){
 	uint hdrlen;
 	uint8 *cp;
+	int i;
 
 	if(bpp == NULL)
 		return;
@@ -35,6 +38,10 @@ int32 ipdest
 		hdrlen += TSTAMP_LENGTH;
 	if(tcph->flags.wscale)
 		hdrlen += WSCALE_LENGTH;
+	if(tcph->flags.sackperm)
+		hdrlen += SACKPERM_LENGTH;
+	if(tcph->nsack != 0)
+		hdrlen += SACK_LENGTH(tcph->nsack);
 
 	hdrlen = (hdrlen + 3) & 0xfc;	/* Round up to multiple of 4 */
 	pushdown(bpp,NULL,hdrlen);
@@ -45,22 +52,7 @@ int32 ipdest
 	cp = put32(cp,tcph->seq);
 	cp = put32(cp,tcph->ack);
 	*cp++ = hdrlen << 2;	/* Offset field */
-	*cp = 0;
-	if(tcph->flags.congest)
-		*cp |= 64;
-	if(tcph->flags.urg)
-		*cp |= 32;
-	if(tcph->flags.ack)
-		*cp |= 16;
-	if(tcph->flags.psh)
-		*cp |= 8;
-	if(tcph->flags.rst)
-		*cp |= 4;
-	if(tcph->flags.syn)
-		*cp |= 2;
-	if(tcph->flags.fin)
-		*cp |= 1;
-	cp++;
+	*cp++ = flagbits(tcph);
 	cp = put16(cp,tcph->wnd);
 	cp = put16(cp,tcph->checksum);
 	cp = put16(cp,tcph->up);
@@ -82,6 +74,18 @@ int32 ipdest
 		*cp++ = WSCALE_LENGTH;
 		*cp++ = tcph->wsopt;
 	}
+	if(tcph->flags.sackperm){
+		*cp++ = SACKPERM_KIND;
+		*cp++ = SACKPERM_LENGTH;
+	}
+	if(tcph->nsack != 0){
+		*cp++ = SACK_KIND;
+		*cp++ = SACK_LENGTH(tcph->nsack);
+		for(i=0;i<tcph->nsack;i++){
+			cp = put32(cp,tcph->sack[i].start);
+			cp = put32(cp,tcph->sack[i].end);
+		}
+	}
 	if(tcph->checksum == 0){
 		/* Recompute header checksum */
 		struct pseudo_header ph;
@@ -93,13 +97,111 @@ int32 ipdest
 		put16(&(*bpp)->data[16],cksum(&ph,*bpp,ph.length));
 	}
 }
+/* Build the header template for a synchronized connection: ports,
+ * offset and, if timestamps are in use, a NOP-padded timestamp option
+ * so the values land on 32-bit boundaries. The pseudo-header and these
+ * constant fields are summed once here rather than for every segment.
+ */
+void
+tcp_template(struct tcb *tcb)
+{
+	uint8 *cp;
+	int i;
+
+	tcb->tmplen = 0;
+	if(tcb->conn.local.address == 0 || tcb->conn.remote.address == 0)
+		return;
+	cp = tcb->tmpl;
+	memset(cp,0,TCP_TMPLLEN);
+	cp = put16(cp,tcb->conn.local.port);
+	cp = put16(cp,tcb->conn.remote.port);
+	cp += 8;		/* seq, ack */
+	if(tcb->flags.ts_ok){
+		*cp = (TCPLEN + 12) << 2;
+		cp = &tcb->tmpl[TCPLEN];
+		*cp++ = NOOP_KIND;
+		*cp++ = NOOP_KIND;
+		*cp++ = TSTAMP_KIND;
+		*cp = TSTAMP_LENGTH;
+		tcb->tmplen = TCPLEN + 12;
+	} else {
+		*cp = TCPLEN << 2;
+		tcb->tmplen = TCPLEN;
+	}
+	tcb->tmplsum = hiword(tcb->conn.local.address)
+	 + loword(tcb->conn.local.address)
+	 + hiword(tcb->conn.remote.address)
+	 + loword(tcb->conn.remote.address) + TCP_PTCL;
+	for(i=0;i<tcb->tmplen;i += 2)
+		tcb->tmplsum += get16(&tcb->tmpl[i]);
+}
+/* Like htontcp(), but starting from the connection's template, so only
+ * the fields that change from segment to segment are written and summed.
+ * The caller makes sure the segment fits it: no SYN or SACK, and a
+ * timestamp just when the template has room for one.
+ */
+void
+htontcp_tmpl(
+struct tcb *tcb,
+struct tcp *tcph,
+struct mbuf **bpp	/* Data in, packet out */
+){
+	int32 sum;
+	uint dlen;
+	uint8 *cp;
+	uint8 flags;
+
+	dlen = len_p(*bpp);
+	sum = tcb->tmplsum + tcb->tmplen + dlen;
+	if(dlen != 0)
+		sum += ~cksum(NULL,*bpp,dlen) & 0xffff;
+
+	pushdown(bpp,tcb->tmpl,tcb->tmplen);
+	cp = (*bpp)->data;
+	put32(&cp[4],tcph->seq);
+	put32(&cp[8],tcph->ack);
+	cp[13] = flags = flagbits(tcph);
+	put16(&cp[14],tcph->wnd);
+	put16(&cp[18],tcph->up);
+	sum += hiword(tcph->seq) + loword(tcph->seq) + hiword(tcph->ack)
+	 + loword(tcph->ack) + flags + tcph->wnd + tcph->up;
+	if(tcb->tmplen != TCPLEN){
+		put32(&cp[24],tcph->tsval);
+		put32(&cp[28],tcph->tsecr);
+		sum += hiword(tcph->tsval) + loword(tcph->tsval)
+		 + hiword(tcph->tsecr) + loword(tcph->tsecr);
+	}
+	put16(&cp[16],~eac(sum) & 0xffff);
+}
+/* Flag bits for the 14th byte of the header */
+static uint8
+flagbits(struct tcp *tcph)
+{
+	uint8 f = 0;
+
+	if(tcph->flags.congest)
+		f |= 64;
+	if(tcph->flags.urg)
+		f |= 32;
+	if(tcph->flags.ack)
+		f |= 16;
+	if(tcph->flags.psh)
+		f |= 8;
+	if(tcph->flags.rst)
+		f |= 4;
+	if(tcph->flags.syn)
+		f |= 2;
+	if(tcph->flags.fin)
+		f |= 1;
+	return f;
+}
 /* Pull TCP header off mbuf */
 int
 ntohtcp(
 struct tcp *tcph,
 struct mbuf **bpp
 ){
-	int hdrlen,i,optlen,kind;
+	int hdrlen,i,optlen,kind,n;
 	int flags;
 	uint8 hdrbuf[TCPLEN],*cp;
 	uint8 options[TCP_MAXOPT];
@@ -174,9 +276,23 @@ struct mbuf **bpp
 				tcph->flags.tstamp = 1;
 			}
 			break;
+		case SACKPERM_KIND:
+			if(optlen == SACKPERM_LENGTH)
+				tcph->flags.sackperm = 1;
+			break;
+		case SACK_KIND:
+			if(optlen < SACK_LENGTH(1) || optlen > i + 1
+			 || ((optlen - 2) % 8) != 0)
+				break;
+			for(n=0;n<(optlen-2)/8 && n<TCP_MAXSACK;n++){
+				tcph->sack[n].start = get32(cp + 8*n);
+				tcph->sack[n].end = get32(cp + 8*n + 4);
+			}
+			tcph->nsack = n;
+			break;
 		}
 		optlen = max(2,optlen);	/* Enforce legal minimum */
-		i -= optlen;
+		i -= optlen - 1;	/* Kind byte already counted */
 		cp += optlen - 2;
 	}
 	return (int)hdrlen;
@@ -19,13 +19,12 @@
 
 static void update(struct tcb *tcb,struct tcp *seg,uint length);
 static void proc_syn(struct tcb *tcb,uint8 tos,struct tcp *seg);
-static void add_reseq(struct tcb *tcb,uint8 tos,struct tcp *seg,
-	struct mbuf **bp,uint length);
-static void get_reseq(struct tcb *tcb,uint8 *tos,struct tcp *seq,
-	struct mbuf **bp,uint *length);
+static struct tcb *syn_accept(struct tcb *lp,struct syncache *sc);
 static int trim(struct tcb *tcb,struct tcp *seg,struct mbuf **bpp,
 	uint *length);
 static int in_window(struct tcb *tcb,int32 seq);
+static void autotune(struct tcb *tcb,struct tcp *seg);
+static int ack_now(struct tcb *tcb,struct tcp *seg,uint length);
 
 /* This function is called from IP with the IP header in machine byte order,
  * along with a mbuf chain pointing to the TCP header.
@@ -38,8 +37,8 @@ struct mbuf **bpp,	/* Data field, if any */
 int rxbroadcast,	/* Incoming broadcast - discard if true */
 int32 said		/* Authenticated packet */
 ){
-	struct tcb *ntcb;
 	struct tcb *tcb;	/* TCP Protocol control block */
+	struct syncache sc;		/* Completed handshake for a server */
 	struct tcp seg;			/* Local copy of segment header */
 	struct connection conn;		/* Local copy of addresses */
 	struct pseudo_header ph;	/* Pseudo-header for checksumming */
@@ -84,12 +83,6 @@ int32 said		/* Authenticated packet */
 	conn.remote.port = seg.source;
 	
 	if((tcb = lookup_tcb(&conn)) == NULL){
-		/* If this segment doesn't carry a SYN, reject it */
-		if(!seg.flags.syn){
-			free_p(bpp);
-			reset(ip,&seg);
-			return;
-		}
 		/* See if there's a TCP_LISTEN on this socket with
 		 * unspecified remote address and port
 		 */
@@ -98,27 +91,37 @@ int32 said		/* Authenticated packet */
 		if((tcb = lookup_tcb(&conn)) == NULL){
 			/* Nope, try unspecified local address too */
 			conn.local.address = 0;
-			if((tcb = lookup_tcb(&conn)) == NULL){
-				/* No LISTENs, so reject */
+			tcb = lookup_tcb(&conn);
+		}
+		if(tcb != NULL && tcb->flags.clone){
+			/* A server socket. The SYN cache handles the
+			 * handshake, and hands back the makings of a new
+			 * TCB when it's done
+			 */
+			switch(syn_input(tcb,ip,&seg,&sc)){
+			case -1:
+				free_p(bpp);
+				reset(ip,&seg);
+				return;
+			case 0:
+				free_p(bpp);
+				return;
+			}
+			tcb = syn_accept(tcb,&sc);
+		} else {
+			/* Only a SYN can start a connection */
+			if(tcb == NULL || !seg.flags.syn){
 				free_p(bpp);
 				reset(ip,&seg);
 				return;
 			}
+			/* Its connection is about to change */
+			unhash_tcb(tcb);
+			tcb->conn.local.address = ip->dest;
+			tcb->conn.remote.address = ip->source;
+			tcb->conn.remote.port = seg.source;
+			hash_tcb(tcb);
 		}
-		/* We've found an server listen socket, so clone the TCB */
-		if(tcb->flags.clone){
-			ntcb = (struct tcb *)mallocw(sizeof (struct tcb));
-			ASSIGN(*ntcb,*tcb);
-			tcb = ntcb;
-			tcb->timer.arg = tcb;
-			/* Put on list */
-			tcb->next = Tcbs;
-			Tcbs = tcb;
-		}
-		/* Put all the socket info into the TCB */
-		tcb->conn.local.address = ip->dest;
-		tcb->conn.remote.address = ip->source;
-		tcb->conn.remote.port = seg.source;
 	}
 	tcb->flags.congest = ip->flags.congest;
 	/* Do unsynchronized-state processing (p. 65-68) */
@@ -222,7 +225,7 @@ int32 said		/* Authenticated packet */
 	 */
 	if(seg.seq != tcb->rcv.nxt
 	 && (length != 0 || seg.flags.syn || seg.flags.fin)){
-		add_reseq(tcb,ip->tos,&seg,bpp,length);
+		reseq_add(tcb,ip->tos,&seg,bpp,length);
 		if(seg.flags.ack && !seg.flags.rst)
 			tcb->flags.force = 1;
 		seg.flags.syn = seg.flags.fin = 0;
@@ -341,7 +344,19 @@ int32 said		/* Authenticated packet */
 				tcb->rcvcnt += length;
 				tcb->rcv.nxt += length;
 				tcb->rcv.wnd -= length;
-				tcb->flags.force = 1;
+				autotune(tcb,&seg);
+				if(ack_now(tcb,&seg,length)){
+					tcb->flags.force = 1;
+				} else {
+					/* Hold the ack; it may ride on data
+					 * or cover the next segment too
+					 */
+					Tcp_stat.delayed++;
+					if(!run_timer(&tcb->acktimer)){
+						set_timer(&tcb->acktimer,tcb->ackdelay);
+						start_timer(&tcb->acktimer);
+					}
+				}
 				/* Notify user */
 				if(tcb->r_upcall)
 					(*tcb->r_upcall)(tcb,tcb->rcvcnt);
@@ -396,8 +411,9 @@ int32 said		/* Authenticated packet */
 		/* Scan the resequencing queue, looking for a segment we can handle,
 		 * and freeing all those that are now obsolete.
 		 */
-		while(tcb->reseq != NULL && seq_ge(tcb->rcv.nxt,tcb->reseq->seg.seq)){
-			get_reseq(tcb,&ip->tos,&seg,bpp,&length);
+		while(tcb->reseq[0] != NULL
+		 && seq_ge(tcb->rcv.nxt,tcb->reseq[0]->seg.seq)){
+			reseq_get(tcb,&ip->tos,&seg,bpp,&length);
 			if(trim(tcb,&seg,bpp,&length) == 0)
 				goto gotone;
 			/* Segment is an old one; trim has freed it */
@@ -535,6 +551,9 @@ uint length
 	int32 swind;	/* Incoming window, scaled (non-SYN only) */
 	long rtt;	/* measured round trip time */
 	int32 abserr;	/* abs(rtt - srtt) */
+	int recovery;	/* Were in fast recovery */
+	int partial;	/* Partial ack, stay in recovery */
+	int32 hole;
 
 	acked = 0;
 	if(seq_gt(seg->ack,tcb->snd.nxt)){
@@ -571,6 +590,9 @@ uint length
 	if(seq_lt(seg->ack,tcb->snd.una))
 		return;	/* Old ack, ignore */
 
+	if(tcb->flags.sack_ok && seg->nsack != 0)
+		sack_update(tcb,seg);
+
 	if(seg->ack == tcb->snd.una){
 		/* Ack current, but doesn't ack anything */
 		if(tcb->sndcnt == 0 || winupd || length != 0 || seg->flags.syn || seg->flags.fin){
@@ -588,34 +610,41 @@ uint length
 			 * Resend it now to avoid a timeout. (This is
 			 * Van Jacobson's 'quick recovery' algorithm.)
 			 */
-			int32 ptrsave;
+			int32 ptrsave,cwindsave;
 
 			/* Knock the threshold down just as though
 			 * this were a timeout, since we've had
-			 * network congestion.
+			 * network congestion. The congestion control
+			 * module also "inflates" cwind, pretending the
+			 * duplicate acks were normally acking the
+			 * packets beyond the one that was lost.
 			 */
-			tcb->ssthresh = tcb->cwind/2;
-			tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
+			cc_loss(tcb);
 
 			/* Manipulate the machinery in tcp_output() to
 			 * retransmit just the missing packet
 			 */
 			ptrsave = tcb->snd.ptr;
+			cwindsave = tcb->cwind;
 			tcb->snd.ptr = tcb->snd.una;
 			tcb->cwind = tcb->mss;
 			tcp_output(tcb);
+			tcb->sack_rxt = tcb->snd.ptr;
 			tcb->snd.ptr = ptrsave;
-
-			/* "Inflate" the congestion window, pretending as
-			 * though the duplicate acks were normally acking
-			 * the packets beyond the one that was lost.
+			tcb->cwind = cwindsave;
+		} else {
+			/* Typically continues to inflate the congestion
+			 * window until the acks finally get "unstuck"
 			 */
-			tcb->cwind = tcb->ssthresh + TCPDUPACKS*tcb->mss;
-		} else if(tcb->dupacks > TCPDUPACKS){
-			/* Continue to inflate the congestion window
-			 * until the acks finally get "unstuck".
+			cc_dupack(tcb);
+
+			/* With SACK we know where the other holes are;
+			 * fill the next one rather than waiting for
+			 * the timer
 			 */
-			tcb->cwind += tcb->mss;
+			if(tcb->dupacks > TCPDUPACKS && tcb->flags.sack_ok
+			 && sack_nexthole(tcb,tcb->sack_rxt,&hole))
+				sack_rexmit(tcb,hole);
 		}
 		/* Clamp the congestion window at the amount currently
 		 * on the send queue, with a minimum of one packet.
@@ -628,35 +657,9 @@ uint length
 		return;
 	}
 	/* We're here, so the ACK must have actually acked something */
-	if(tcb->dupacks >= TCPDUPACKS && tcb->cwind > tcb->ssthresh){
-		/* The acks have finally gotten "unstuck". So now we
-		 * can "deflate" the congestion window, i.e. take it
-		 * back down to where it would be after slow start
-		 * finishes.
-		 */
-		tcb->cwind = tcb->ssthresh;
-	}
-	tcb->dupacks = 0;
+	recovery = tcb->dupacks >= TCPDUPACKS;
 	acked = seg->ack - tcb->snd.una;
 
-	/* Expand congestion window if not already at limit and if
-	 * this packet wasn't retransmitted
-	 */
-	if(tcb->cwind < tcb->snd.wnd && !tcb->flags.retran){
-		if(tcb->cwind < tcb->ssthresh){
-			/* Still doing slow start/CUTE, expand by amount acked */
-			tcb->cwind += min(acked,tcb->mss);
-		} else {
-			/* Steady-state test of extra path capacity */
-			tcb->cwind += ((long)tcb->mss * tcb->mss) / tcb->cwind;
-		}
-		/* Don't expand beyond the offered window */
-		if(tcb->cwind > tcb->snd.wnd)
-			tcb->cwind = tcb->snd.wnd;
-	}
-	tcb->cwind = min(tcb->cwind,tcb->sndcnt);	/* Clamp */
-	tcb->cwind = max(tcb->cwind,tcb->mss);
-
 	/* Round trip time estimation */
 	rtt = -1;	/* Init to invalid value */
 	if(tcb->flags.ts_ok && seg->flags.tstamp){
@@ -681,7 +684,8 @@ uint length
 		tcb->srtt = ((AGAIN-1)*tcb->srtt + rtt + (AGAIN/2)) >> LAGAIN;
 		tcb->mdev = ((DGAIN-1)*tcb->mdev + abserr + (DGAIN/2)) >> LDGAIN;
 
-		rtt_add(tcb->conn.remote.address,rtt);
+		tcpm_rtt(tcb->conn.remote.address,rtt);
+		cc_rtt(tcb,rtt);
 		/* Reset the backoff level */
 		tcb->backoff = 0;
 			
@@ -691,8 +695,21 @@ uint length
 		tcb->outrate = (7*tcb->outrate + t - tcb->lastack)/8;
 		tcb->lastack = t;
 	}
+	/* Let the congestion control module expand the window or, if
+	 * the acks have finally gotten "unstuck", deflate it. It may
+	 * instead call this a partial ack and stay in recovery.
+	 */
+	partial = cc_ack(tcb,acked);
+	if(!partial)
+		tcb->dupacks = 0;
+	tcb->cwind = min(tcb->cwind,tcb->sndcnt);	/* Clamp */
+	tcb->cwind = max(tcb->cwind,tcb->mss);
+
 	tcb->sndcnt -= acked;	/* Update virtual byte count on snd queue */
 	tcb->snd.una = seg->ack;
+	Tcp_stat.acked += acked;
+	if(tcb->nsacked != 0)
+		sack_prune(tcb);
 
 	/* If we're waiting for an ack of our SYN, note it and adjust count */
 	if(!(tcb->flags.synack)){
@@ -725,6 +742,17 @@ uint length
 	 */
 	tcb->flags.retran = 0;
 
+	/* A partial ack during recovery, or one with SACK ranges still
+	 * outstanding, means the next hole was lost as well. Resend it
+	 * now and stay in recovery.
+	 */
+	if(partial || (recovery && tcb->nsacked != 0)){
+		hole = tcb->snd.una;
+		if(tcb->nsacked == 0 || sack_nexthole(tcb,tcb->snd.una,&hole)){
+			tcb->dupacks = TCPDUPACKS;
+			sack_rexmit(tcb,hole);
+		}
+	}
 	/* If outgoing data was acked, notify the user so he can send more
 	 * unless we've already sent a FIN.
 	 */
@@ -745,6 +773,71 @@ int32 seq
 	return seq_within(seq,tcb->rcv.nxt,(int32)(tcb->rcv.nxt+tcb->rcv.wnd-1));
 }
 
+/* Decide whether in-sequence data must be acked at once (RFC 1122
+ * 4.2.3.2, RFC 5681 4.2). It must if delayed acks are off, if the
+ * connection isn't fully open, if two full segments are now unacked,
+ * if the segment fills a hole in the resequencing queue, or if it's a
+ * short pushed segment the sender is likely holding more data behind
+ * (Nagle) until we answer.
+ */
+static int
+ack_now(
+struct tcb *tcb,
+struct tcp *seg,
+uint length
+){
+	if(tcb->ackdelay <= 0 || tcb->state != TCP_ESTABLISHED
+	 || tcb->reseq[0] != NULL)
+		return 1;
+	if(tcb->rcv.nxt - tcb->last_ack_sent >= 2*tcb->mss)
+		return 1;
+	if(seg->flags.psh && length < tcb->mss)
+		return 1;
+	return 0;
+}
+
+/* Receive buffer auto-tuning. Once per round trip, see how much data
+ * arrived in that time. If the sender could have used more than half
+ * the buffer, make it twice that, up to Tcp_wmax; a slow or idle
+ * connection never grows. The round trip time comes from timestamp
+ * echoes or, failing that, our own measurement as a sender.
+ */
+static void
+autotune(
+struct tcb *tcb,
+struct tcp *seg
+){
+	int32 now,rtt,got,want,cap;
+
+	now = msclock();
+	if(tcb->flags.ts_ok && seg->flags.tstamp && seg->tsecr != 0){
+		rtt = now - seg->tsecr;
+		if(rtt >= 0){
+			if(tcb->rcv_rtt == 0)
+				tcb->rcv_rtt = rtt;
+			else
+				tcb->rcv_rtt = (7*tcb->rcv_rtt + rtt)/8;
+		}
+	}
+	if(Tcp_wmax == 0)
+		return;
+	if((rtt = tcb->rcv_rtt) == 0 && tcb->rtt != 0)
+		rtt = tcb->srtt;
+	if(rtt == 0 || now - tcb->rcv_mtime < rtt)
+		return;
+	got = tcb->rcv.nxt - tcb->rcv_mseq;
+	tcb->rcv_mseq = tcb->rcv.nxt;
+	tcb->rcv_mtime = now;
+
+	/* Without scaling we can't advertise more than 64K anyway */
+	cap = tcb->flags.ws_ok ? Tcp_wmax : min(Tcp_wmax,TCP_MAXWIN);
+	want = min(2*got,cap);
+	if(want <= tcb->rcvbuf)
+		return;
+	tcb->rcv.wnd += want - tcb->rcvbuf;
+	tcb->rcvbuf = want;
+}
+
 /* Process an incoming SYN */
 static void
 proc_syn(
@@ -753,7 +846,7 @@ uint8 tos,
 struct tcp *seg
 ){
 	uint mtu;
-	struct tcp_rtt *tp;
+	struct route *rp;
 
 	tcb->flags.force = 1;	/* Always send a response */
 
@@ -771,14 +864,30 @@ struct tcp *seg
 	if(seg->flags.mss)
 		tcb->mss = seg->mss;
 	if(seg->flags.wscale){
-		tcb->snd.wind_scale = seg->wsopt;
-		tcb->rcv.wind_scale = DEF_WSCALE;
+		/* Our own scale was chosen in open_tcp() */
+		tcb->snd.wind_scale = min(seg->wsopt,TCP_MAXWSCALE);
 		tcb->flags.ws_ok = 1;
-	}
+	} else
+		tcb->rcv.wind_scale = 0;
+	tcb->rcv_mseq = tcb->rcv.nxt;
+	tcb->rcv_mtime = msclock();
+
+	/* Pick the congestion control module for this route */
+	cc_route(tcb);
+
+	/* Slow links may ask for a longer ack delay on their interface */
+	tcb->ackdelay = Tcp_ackdelay;
+	if((rp = rt_lookup(tcb->conn.remote.address)) != NULL
+	 && rp->iface != NULL && rp->iface->ackdelay != 0)
+		tcb->ackdelay = rp->iface->ackdelay;
 	if(seg->flags.tstamp && Tcp_tstamps){
 		tcb->flags.ts_ok = 1;
 		tcb->ts_recent = seg->tsval;
 	}
+	if(seg->flags.sackperm && Tcp_sack && !tcb->flags.sack_ok){
+		tcb->flags.sack_ok = 1;
+		Tcp_stat.sackconn++;
+	}
 	/* Check the MTU of the interface we'll use to reach this guy
 	 * and lower the MSS so that unnecessary fragmentation won't occur
 	 */
@@ -790,11 +899,69 @@ struct tcp *seg
 			mtu -= TCPLEN + IPLEN;
 		tcb->cwind = tcb->mss = min(mtu,tcb->mss);
 	}
-	/* See if there's round-trip time experience */
-	if((tp = rtt_get(tcb->conn.remote.address)) != NULL){
-		tcb->srtt = tp->srtt;
-		tcb->mdev = tp->mdev;
+	/* See if there's experience with this destination */
+	tcpm_seed(tcb);
+	/* Options are settled, so the header template can be built */
+	tcp_template(tcb);
+}
+
+/* Clone server TCB lp for a connection whose handshake the SYN cache
+ * has completed, leaving it in SYN_RECEIVED for the ACK to finish
+ */
+static struct tcb *
+syn_accept(
+struct tcb *lp,
+struct syncache *sc
+){
+	struct tcb *tcb;
+	struct tcp syn;
+
+	tcb = (struct tcb *)mallocw(sizeof (struct tcb));
+	ASSIGN(*tcb,*lp);
+	tcb->timer.arg = tcb;
+	tcb->acktimer.arg = tcb;
+	tcb->backlog = tcb->aqlen = 0;
+	/* Put on list */
+	tcb->next = Tcbs;
+	Tcbs = tcb;
+	ASSIGN(tcb->conn,sc->conn);
+	hash_tcb(tcb);
+
+	/* Replay their SYN */
+	memset(&syn,0,sizeof(syn));
+	syn.seq = sc->irs;
+	syn.wnd = sc->wnd;
+	syn.flags.syn = 1;
+	if(sc->mss != 0){
+		syn.mss = sc->mss;
+		syn.flags.mss = 1;
+	}
+	if(sc->opts & SC_WSCALE){
+		syn.wsopt = sc->wsopt;
+		syn.flags.wscale = 1;
 	}
+	if(sc->opts & SC_TSTAMP){
+		syn.tsval = sc->tsval;
+		syn.flags.tstamp = 1;
+	}
+	if(sc->opts & SC_SACK)
+		syn.flags.sackperm = 1;
+	proc_syn(tcb,sc->tos,&syn);
+
+	/* and account for the SYN/ACK the cache sent */
+	tcb->iss = sc->iss;
+	tcb->rttseq = tcb->snd.wl2 = tcb->snd.una = tcb->iss;
+	tcb->snd.ptr = tcb->snd.nxt = tcb->iss + 1;
+	tcb->sndcnt++;
+	if(sc->rexmits == 0){
+		/* Sent only once, so it gives an RTT sample */
+		tcb->flags.rtt_run = 1;
+		tcb->rtt_time = sc->sent;
+		tcb->rttseq = tcb->snd.nxt;
+		tcb->rttack = tcb->snd.una;
+	}
+	settcpstate(tcb,TCP_SYN_RECEIVED);
+	return tcb;
 }
 
 /* Generate an initial sequence number and put a SYN on the send queue */
@@ -808,74 +975,6 @@ send_syn(struct tcb *tcb)
 	tcb->flags.force = 1;
 }
 
-/* Add an entry to the resequencing queue in the proper place */
-static void
-add_reseq(
-struct tcb *tcb,
-uint8 tos,
-struct tcp *seg,
-struct mbuf **bpp,
-uint length
-){
-	struct reseq *rp,*rp1;
-
-	/* Allocate reassembly descriptor */
-	if((rp = (struct reseq *)malloc(sizeof (struct reseq))) == NULL){
-		/* No space, toss on floor */
-		free_p(bpp);
-		return;
-	}
-	ASSIGN(rp->seg,*seg);
-	rp->tos = tos;
-	rp->bp = (*bpp);
-	*bpp = NULL;
-	rp->length = length;
-
-	/* Place on reassembly list sorting by starting seq number */
-	rp1 = tcb->reseq;
-	if(rp1 == NULL || seq_lt(seg->seq,rp1->seg.seq)){
-		/* Either the list is empty, or we're less than all other
-		 * entries; insert at beginning.
-		 */
-		rp->next = rp1;
-		tcb->reseq = rp;
-	} else {
-		/* Find the last entry less than us */
-		for(;;){
-			if(rp1->next == NULL || seq_lt(seg->seq,rp1->next->seg.seq)){
-				/* We belong just after this one */
-				rp->next = rp1->next;
-				rp1->next = rp;
-				break;
-			}
-			rp1 = rp1->next;
-		}
-	}
-}
-
-/* Fetch the first entry off the resequencing queue */
-static void
-get_reseq(
-struct tcb *tcb,
-uint8 *tos,
-struct tcp *seg,
-struct mbuf **bp,
-uint *length
-){
-	struct reseq *rp;
-
-	if((rp = tcb->reseq) == NULL)
-		return;
-
-	tcb->reseq = rp->next;
-
-	*tos = rp->tos;
-	ASSIGN(*seg,rp->seg);
-	*bp = rp->bp;
-	*length = rp->length;
-	free(rp);
-}
-
 /* Trim segment to fit window. Return 0 if OK, -1 if segment is
  * unacceptable.
  */
@@ -902,7 +1001,7 @@ uint *length
 		 * probably probing us. If so, they might send us acks
 		 * with seg.seq > rcv.nxt. Be sure to accept these
 		 */
-		if(len == 0 && seq_within(seg->seq,tcb->rcv.nxt,tcb->rcv.nxt+tcb->window))
+		if(len == 0 && seq_within(seg->seq,tcb->rcv.nxt,tcb->rcv.nxt+tcb->rcvbuf))
 			return 0;
 		return -1;	/* reject all others */
 	}
@@ -0,0 +1,269 @@
+/* TCP per-destination metrics cache.
+ *
+ * What each connection learns about the path to its peer -- round trip
+ * time and deviation, slow-start threshold, congestion window, segment
+ * size and how much had to be retransmitted -- is kept here by remote
+ * address, so that the next connection to the same place starts from
+ * experience instead of Tcp_irtt and a one-segment window. Entries are
+ * hashed on address and kept on an LRU list; once Tcp_mcmax are in use
+ * the least recently used one is recycled. Entries not refreshed for
+ * TCPM_AGE are ignored, since routes change.
+ */
+#include "top.h"
+
+#include "global.h"
+#include "core/timer.h"
+#include "net/core/mbuf.h"
+
+#include "lib/inet/netuser.h"
+
+#include "net/inet/internet.h"
+#include "net/inet/tcp.h"
+#include "net/inet/ip.h"
+
+#define	TCPMHASH	64		/* Hash chains (power of 2) */
+#define	TCPM_AGE	3600000L	/* Forget metrics after an hour, ms */
+#define	TCPM_LOSSY	100		/* Don't seed cwind above 1% loss */
+
+static struct tcp_metric *Tcpm_hash[TCPMHASH];
+static struct tcp_metric *Tcpm_lru;	/* Most recently used */
+static struct tcp_metric *Tcpm_lrutail;	/* Least recently used */
+static int Tcpm_count;
+int Tcp_mcmax = DEF_TCPMMAX;		/* Most entries kept */
+
+static struct tcp_metric *tcpm_lookup(int32 addr,int create);
+static void tcpm_unlink(struct tcp_metric *tm);
+static void tcpm_unhash(struct tcp_metric *tm);
+
+#define	tcpm_chain(addr)	(&Tcpm_hash[(hiword(addr) ^ loword(addr)) & (TCPMHASH-1)])
+
+/* Fold a new RTT sample into the destination's estimate. This is called
+ * every time a connection updates its own, so it must be quick.
+ */
+void
+tcpm_rtt(
+int32 addr,		/* Destination IP address */
+int32 rtt
+){
+	struct tcp_metric *tm;
+	int32 abserr;
+
+	if((tm = tcpm_lookup(addr,1)) == NULL)
+		return;
+	if(tm->srtt == 0){
+		tm->srtt = rtt;
+		tm->mdev = 0;
+	} else {
+		/* Run our own SRTT and MDEV integrators, with rounding */
+		abserr = (rtt > tm->srtt) ? rtt - tm->srtt : tm->srtt - rtt;
+		tm->srtt = ((AGAIN-1)*tm->srtt + rtt + (AGAIN/2)) >> LAGAIN;
+		tm->mdev = ((DGAIN-1)*tm->mdev + abserr + (DGAIN/2)) >> LDGAIN;
+	}
+	tm->time = msclock();
+}
+/* Return the metrics for a destination, or NULL if none or stale */
+struct tcp_metric *
+tcpm_get(int32 addr)
+{
+	return tcpm_lookup(addr,0);
+}
+/* Start a new connection from what's known about its destination.
+ * Called from proc_syn() once the MSS and congestion control module
+ * are settled, so each connection counts as one use.
+ */
+void
+tcpm_seed(struct tcb *tcb)
+{
+	struct tcp_metric *tm;
+	int32 mss;
+
+	if((tm = tcpm_lookup(tcb->conn.remote.address,0)) == NULL)
+		return;
+	tm->uses++;
+	if(tm->srtt != 0){
+		tcb->srtt = tm->srtt;
+		tcb->mdev = tm->mdev;
+	}
+	if(tm->mtu != 0){
+		mss = (int32)tm->mtu - TCPLEN - IPLEN;
+		if(tcb->flags.ts_ok)
+			mss -= (TSTAMP_LENGTH + 3) & ~3;
+		if(mss > 0 && mss < tcb->mss)
+			tcb->cwind = tcb->mss = mss;
+	}
+	if(tm->ssthresh != 0)
+		tcb->ssthresh = max(tm->ssthresh,2*tcb->mss);
+	/* Skip most of slow start, but only halfway, and not on a
+	 * path that's been losing packets
+	 */
+	if(tm->cwind != 0 && tm->loss < TCPM_LOSSY)
+		tcb->cwind = max(tcb->cwind,min(tm->cwind/2,tcb->ssthresh));
+}
+/* Record what a connection learned as it closes */
+void
+tcpm_save(struct tcb *tcb)
+{
+	struct tcp_metric *tm;
+	int32 sent;
+	uint loss;
+
+	if(!tcb->flags.synack)
+		return;		/* Never got going */
+	if((tm = tcpm_lookup(tcb->conn.remote.address,1)) == NULL)
+		return;
+	if(tm->srtt == 0 && tcb->rtt != 0){
+		tm->srtt = tcb->srtt;
+		tm->mdev = tcb->mdev;
+	}
+	tm->mtu = tcb->mss + TCPLEN + IPLEN;
+	if(tcb->flags.ts_ok)
+		tm->mtu += (TSTAMP_LENGTH + 3) & ~3;
+
+	/* Only a connection that sent a few windows' worth tells us
+	 * much about the path's capacity or loss
+	 */
+	sent = tcb->snd.nxt - tcb->iss - 1;
+	if(sent >= 4*tcb->mss){
+		if(tcb->ssthresh < 65535){
+			/* Slow start ended in a loss, so this is real */
+			if(tm->ssthresh == 0)
+				tm->ssthresh = tcb->ssthresh;
+			else
+				tm->ssthresh = (tm->ssthresh + tcb->ssthresh)/2;
+		}
+		if(tm->cwind == 0)
+			tm->cwind = tcb->cwind;
+		else
+			tm->cwind = (tm->cwind + tcb->cwind)/2;
+		loss = (uint)min((uint64)tcb->resent * 10000 / (uint64)sent,
+		 10000);
+		if(tm->nsamples++ == 0)
+			tm->loss = loss;
+		else
+			tm->loss = (3*tm->loss + loss + 2)/4;
+	}
+	tm->time = msclock();
+}
+/* Forget everything */
+void
+tcpm_flush(void)
+{
+	struct tcp_metric *tm;
+
+	while((tm = Tcpm_lru) != NULL){
+		tcpm_unlink(tm);
+		tcpm_unhash(tm);
+		free(tm);
+	}
+	Tcpm_count = 0;
+}
+/* Recycle the least recently used entries until no more than
+ * Tcp_mcmax are left, as after the limit is lowered
+ */
+void
+tcpm_trim(void)
+{
+	struct tcp_metric *tm;
+
+	while(Tcpm_count > Tcp_mcmax && (tm = Tcpm_lrutail) != NULL){
+		tcpm_unlink(tm);
+		tcpm_unhash(tm);
+		free(tm);
+		Tcpm_count--;
+	}
+}
+/* Walk the cache in LRU order, most recent first */
+struct tcp_metric *
+tcpm_next(struct tcp_metric *tm)
+{
+	return tm == NULL ? Tcpm_lru : tm->next;
+}
+
+/* Find (and optionally create) a destination's entry, moving it to
+ * the front of its hash chain and of the LRU list
+ */
+static struct tcp_metric *
+tcpm_lookup(
+int32 addr,
+int create
+){
+	struct tcp_metric *tm,*tmlast = NULL;
+	struct tcp_metric **chain;
+
+	if(addr == 0)
+		return NULL;
+	chain = tcpm_chain(addr);
+	for(tm = *chain;tm != NULL;tmlast = tm,tm = tm->hnext){
+		if(tm->addr == addr)
+			break;
+	}
+	if(tm != NULL && msclock() - tm->time > TCPM_AGE){
+		/* Too old to trust; start over */
+		if(!create)
+			return NULL;
+		tm->srtt = tm->mdev = tm->ssthresh = tm->cwind = 0;
+		tm->mtu = tm->loss = tm->nsamples = 0;
+		tm->time = msclock();
+	}
+	if(tm != NULL){
+		if(tmlast != NULL){
+			tmlast->hnext = tm->hnext;
+			tm->hnext = *chain;
+			*chain = tm;
+		}
+		tcpm_unlink(tm);
+	} else {
+		if(!create)
+			return NULL;
+		if(Tcpm_count >= Tcp_mcmax && Tcpm_lrutail != NULL){
+			/* Full; recycle the least recently used */
+			tm = Tcpm_lrutail;
+			tcpm_unlink(tm);
+			tcpm_unhash(tm);
+			memset(tm,0,sizeof(*tm));
+		} else if((tm = (struct tcp_metric *)calloc(1,sizeof(*tm))) == NULL){
+			return NULL;
+		} else
+			Tcpm_count++;
+		tm->addr = addr;
+		tm->time = msclock();
+		tm->hnext = *chain;
+		*chain = tm;
+	}
+	/* Put at head of LRU list */
+	tm->prev = NULL;
+	tm->next = Tcpm_lru;
+	if(Tcpm_lru != NULL)
+		Tcpm_lru->prev = tm;
+	else
+		Tcpm_lrutail = tm;
+	Tcpm_lru = tm;
+	return tm;
+}
+/* Take an entry off the LRU list */
+static void
+tcpm_unlink(struct tcp_metric *tm)
+{
+	if(tm->prev != NULL)
+		tm->prev->next = tm->next;
+	else if(Tcpm_lru == tm)
+		Tcpm_lru = tm->next;
+	if(tm->next != NULL)
+		tm->next->prev = tm->prev;
+	else if(Tcpm_lrutail == tm)
+		Tcpm_lrutail = tm->prev;
+	tm->prev = tm->next = NULL;
+}
+/* Take an entry off its hash chain */
+static void
+tcpm_unhash(struct tcp_metric *tm)
+{
+	struct tcp_metric **tpp;
+
+	for(tpp = tcpm_chain(tm->addr);*tpp != NULL;tpp = &(*tpp)->hnext){
+		if(*tpp == tm){
+			*tpp = tm->hnext;
+			break;
+		}
+	}
+}
@@ -28,6 +28,9 @@ tcp_output(struct tcb *tcb)
 	int32 sent;		/* Sequence count (incl SYN/FIN) already
 				 * in the pipe but not yet acked */
 	int32 rto;		/* Retransmit timeout setting */
+	int32 flight;		/* Part of sent not SACKed by the receiver */
+	int32 limit;		/* End of the hole being retransmitted */
+	int hole;
 
 	if(tcb == NULL)
 		return;
@@ -41,8 +44,19 @@ tcp_output(struct tcb *tcb)
 	}
 	for(;;){
 		memset(&seg,0,sizeof(seg));
+		/* When retransmitting, step over anything the receiver
+		 * has told us it already holds
+		 */
+		hole = 0;
+		if(tcb->nsacked != 0 && seq_lt(tcb->snd.ptr,tcb->snd.nxt)){
+			sack_skip(tcb,&limit);
+			hole = seq_lt(tcb->snd.ptr,tcb->snd.nxt);
+		}
 		/* Compute data already in flight */
 		sent = tcb->snd.ptr - tcb->snd.una;
+		flight = sent;
+		if(tcb->nsacked != 0)
+			flight -= sack_bytes(tcb,tcb->snd.una,tcb->snd.ptr);
 
 		/* Compute usable send window as minimum of offered
 		 * and congestion windows, minus data already in flight.
@@ -50,8 +64,8 @@ tcp_output(struct tcb *tcb)
 		 * these are unsigned vars.
 		 */
 		usable = min(tcb->snd.wnd,tcb->cwind);
-		if(usable > sent)
-			usable -= sent;	/* Most common case */
+		if(usable > flight)
+			usable -= flight;	/* Most common case */
 		else if(usable == 0 && sent == 0)
 			usable = 1;	/* Closed window probe */
 		else
@@ -63,7 +77,20 @@ tcp_output(struct tcb *tcb)
 		 */
 		ssize = min(tcb->sndcnt - sent,usable);
 		ssize = min(ssize,tcb->mss);
+		if(hole)
+			ssize = min(ssize,limit - tcb->snd.ptr);
 
+		/* Describe any out-of-order data we hold, and leave
+		 * room for it in the options
+		 */
+		if(tcb->flags.sack_ok && tcb->reseq[0] != NULL
+		 && tcb->state != TCP_SYN_SENT){
+			sack_build(tcb,&seg,tcb->flags.ts_ok ? 3 : TCP_MAXSACK);
+			if(tcb->mss <= SACK_LENGTH(seg.nsack))
+				seg.nsack = 0;	/* Silly small MSS */
+			else if(ssize + SACK_LENGTH(seg.nsack) > tcb->mss)
+				ssize = tcb->mss - SACK_LENGTH(seg.nsack);
+		}
 		/* Now we decide if we actually want to send it.
 		 * Apply John Nagle's "single outstanding segment" rule.
 		 * If data is already in the pipeline, don't send
@@ -72,7 +99,7 @@ tcp_output(struct tcb *tcb)
 		 * ack incoming data).
 		 */
 		if(!tcb->flags.force && sent != 0 && ssize < tcb->mss
-		 && !(tcb->state == TCP_FINWAIT1 && ssize == tcb->sndcnt-sent)){
+		 && !hole && !(tcb->state == TCP_FINWAIT1 && ssize == tcb->sndcnt-sent)){
 			ssize = 0;
 		}
 	 	/* Unless the tcp syndata option is on, inhibit data until
@@ -120,12 +147,20 @@ tcp_output(struct tcb *tcb)
 			/* Also send MSS, wscale and tstamp (if OK) */
 			seg.mss = Tcp_mss;
 			seg.flags.mss = 1;
-			seg.wsopt = DEF_WSCALE;
-			seg.flags.wscale = 1;
+			/* Offer window scaling unless the other end
+			 * has already declined it
+			 */
+			if(tcb->state == TCP_SYN_SENT || tcb->flags.ws_ok){
+				seg.wsopt = tcb->rcv.wind_scale;
+				seg.flags.wscale = 1;
+			}
 			if(Tcp_tstamps){
 				seg.flags.tstamp = 1;
 				seg.tsval = msclock();
 			}
+			if(Tcp_sack && (tcb->state == TCP_SYN_SENT
+			 || tcb->flags.sack_ok))
+				seg.flags.sackperm = 1;
 		}
 		/* If there's no data, use snd.nxt rather than snd.ptr to
 		 * ensure ack acceptance in case we were retransmitting
@@ -136,9 +171,9 @@ tcp_output(struct tcb *tcb)
 			seg.seq = tcb->snd.ptr;
 		tcb->last_ack_sent = seg.ack = tcb->rcv.nxt;
 		if(seg.flags.syn || !tcb->flags.ws_ok)
-			seg.wnd = tcb->rcv.wnd;
+			seg.wnd = min(tcb->rcv.wnd,TCP_MAXWIN);
 		else
-			seg.wnd = tcb->rcv.wnd >> tcb->rcv.wind_scale;
+			seg.wnd = min(tcb->rcv.wnd >> tcb->rcv.wind_scale,TCP_MAXWIN);
 
 		/* Now try to extract some data from the send queue. Since
 		 * SYN and FIN occupy sequence space and are reflected in
@@ -176,8 +211,14 @@ tcp_output(struct tcb *tcb)
 		 * snd.nxt will already be past snd.ptr. In this case,
 		 * compute the amount of retransmitted data and keep score
 		 */
-		if(tcb->snd.ptr < tcb->snd.nxt)
+		if(tcb->snd.ptr < tcb->snd.nxt){
 			tcb->resent += min(tcb->snd.nxt - tcb->snd.ptr,ssize);
+			Tcp_stat.resent += min(tcb->snd.nxt - tcb->snd.ptr,ssize);
+		}
+		if(seg.nsack != 0){
+			tcb->sacksent++;
+			Tcp_stat.sacksent++;
+		}
 
 		tcb->snd.ptr += ssize;
 		/* If this is the first transmission of a range of sequence
@@ -192,9 +233,15 @@ tcp_output(struct tcb *tcb)
 			seg.tsval = msclock();
 			seg.tsecr = tcb->ts_recent;
 		}
-		/* Generate TCP header, compute checksum, and link in data */
-		htontcp(&seg,&dbp,tcb->conn.local.address,
-		 tcb->conn.remote.address);
+		/* Generate TCP header, compute checksum, and link in data.
+		 * Ordinary segments go from the connection's template.
+		 */
+		if(tcb->tmplen != 0 && !seg.flags.syn && seg.nsack == 0
+		 && seg.flags.tstamp == (tcb->tmplen != TCPLEN))
+			htontcp_tmpl(tcb,&seg,&dbp);
+		else
+			htontcp(&seg,&dbp,tcb->conn.local.address,
+			 tcb->conn.remote.address);
 
 		/* If we're sending some data or flags, start retransmission
 		 * and round trip timers if they aren't already running.
@@ -219,6 +266,10 @@ tcp_output(struct tcb *tcb)
 		else
 			tcpOutSegs++;
 
+		/* Any ack we were holding back has now gone out */
+		if(seg.flags.ack)
+			stop_timer(&tcb->acktimer);
+
 		ip_send(tcb->conn.local.address,tcb->conn.remote.address,
 		 TCP_PTCL,tcb->tos,0,&dbp,len_p(dbp),0,0);
 	}
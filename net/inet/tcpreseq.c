@@ -0,0 +1,325 @@
+/* TCP out-of-order segment store.
+ *
+ * Data arriving ahead of rcv.nxt is kept in a skip list of disjoint
+ * sequence ranges, each holding one or more contiguous segments. An
+ * arrival is trimmed against what's already held and merged with the
+ * ranges on either side, so there is one entry per hole however many
+ * segments have arrived, and finding its place takes O(log n) even
+ * when there are many holes. Descriptors come from a small free pool
+ * rather than straight from malloc, and each connection's store is
+ * held to Tcp_reseqmax bytes by discarding from the top.
+ */
+#include "top.h"
+
+#include "global.h"
+#include "core/timer.h"
+#include "net/core/mbuf.h"
+
+#include "lib/inet/netuser.h"
+
+#include "net/inet/internet.h"
+#include "net/inet/tcp.h"
+#include "net/inet/ip.h"
+
+#define	RSQPOOL	32	/* Free descriptors kept for reuse */
+
+static struct reseq *Rsq_pool;	/* Free descriptors, linked via next[0] */
+static int Rsq_npool;
+
+static struct reseq *rsq_alloc(void);
+static void rsq_free(struct reseq *rp);
+static int rsq_level(void);
+static void rsq_search(struct tcb *tcb,int32 seq,int strict,
+	struct reseq **update);
+static void rsq_unlink(struct tcb *tcb,struct reseq **update,
+	struct reseq *rp);
+static void rsq_limit(struct tcb *tcb);
+
+#define	rsq_next(tcb,rp,i)	((rp) == NULL ? (tcb)->reseq[i] : (rp)->next[i])
+
+/* Add an out-of-order segment */
+void
+reseq_add(
+struct tcb *tcb,
+uint8 tos,
+struct tcp *seg,
+struct mbuf **bpp,
+uint length
+){
+	struct reseq *update[RSQLEVELS];
+	struct reseq *p,*n,*rp;
+	int32 start,end,cut;
+	int i,level,fin;
+
+	if(seg->flags.syn){
+		/* Can't happen in a synchronized state */
+		free_p(bpp);
+		return;
+	}
+	tcb->sack_last = seg->seq;
+	start = seg->seq;
+	end = start + length;
+	fin = seg->flags.fin;
+
+	/* p is the range starting at or below us, if any */
+	rsq_search(tcb,start,0,update);
+	p = update[0];
+	if(p != NULL && seq_gt(p->seg.seq + p->length,start)){
+		cut = p->seg.seq + p->length - start;
+		if(!seq_lt(p->seg.seq + p->length,end)
+		 && (!fin || p->seg.flags.fin)){
+			/* Nothing new */
+			Tcp_stat.rsqdup += length;
+			free_p(bpp);
+			return;
+		}
+		cut = min(cut,(int32)length);
+		pullup(bpp,NULL,(uint)cut);
+		Tcp_stat.rsqdup += cut;
+		start += cut;
+		length -= cut;
+	}
+	/* Swallow ranges we cover, and stop short of one we overlap */
+	while((n = rsq_next(tcb,p,0)) != NULL && seq_lt(n->seg.seq,end)){
+		if(seq_gt(n->seg.seq + n->length,end)){
+			cut = end - n->seg.seq;
+			trim_mbuf(bpp,length - (uint)cut);
+			Tcp_stat.rsqdup += cut;
+			length -= cut;
+			end = n->seg.seq;
+			fin = 0;
+			break;
+		}
+		Tcp_stat.rsqdup += n->length;
+		if(n->seg.flags.fin && n->seg.seq + n->length == end)
+			fin = 1;
+		tcb->rsqbytes -= n->length;
+		rsq_unlink(tcb,update,n);
+		free_p(&n->bp);
+		rsq_free(n);
+	}
+	tcb->rsqbytes += length;
+
+	/* Extend the range below */
+	if(p != NULL && !p->seg.flags.fin && p->seg.seq + p->length == start){
+		append(&p->bp,bpp);
+		p->length += length;
+		p->seg.flags.fin = fin;
+		p->seg.flags.psh |= seg->flags.psh;
+		Tcp_stat.rsqmerge++;
+		/* and join it to the one above if that closed the gap */
+		if(n != NULL && !fin && p->seg.seq + p->length == n->seg.seq){
+			append(&p->bp,&n->bp);
+			p->length += n->length;
+			p->seg.flags.fin = n->seg.flags.fin;
+			rsq_unlink(tcb,update,n);
+			rsq_free(n);
+		}
+		rsq_limit(tcb);
+		return;
+	}
+	/* Or the range above */
+	if(n != NULL && !fin && end == n->seg.seq){
+		append(bpp,&n->bp);
+		n->bp = *bpp;
+		*bpp = NULL;
+		n->seg.seq = start;
+		n->length += length;
+		Tcp_stat.rsqmerge++;
+		rsq_limit(tcb);
+		return;
+	}
+	/* Start a new range */
+	if((rp = rsq_alloc()) == NULL){
+		/* No space, toss on floor */
+		tcb->rsqbytes -= length;
+		free_p(bpp);
+		return;
+	}
+	ASSIGN(rp->seg,*seg);
+	rp->seg.seq = start;
+	rp->seg.flags.fin = fin;
+	rp->tos = tos;
+	rp->bp = *bpp;
+	*bpp = NULL;
+	rp->length = length;
+	rp->level = level = rsq_level();
+	if(level > tcb->rsqlevel){
+		for(i=tcb->rsqlevel;i<level;i++)
+			update[i] = NULL;
+		tcb->rsqlevel = level;
+	}
+	for(i=0;i<level;i++){
+		rp->next[i] = rsq_next(tcb,update[i],i);
+		if(update[i] == NULL)
+			tcb->reseq[i] = rp;
+		else
+			update[i]->next[i] = rp;
+	}
+	rsq_limit(tcb);
+}
+/* Remove the lowest range; return -1 if empty */
+int
+reseq_get(
+struct tcb *tcb,
+uint8 *tos,
+struct tcp *seg,
+struct mbuf **bpp,
+uint *length
+){
+	struct reseq *update[RSQLEVELS];
+	struct reseq *rp;
+	int i;
+
+	if((rp = tcb->reseq[0]) == NULL)
+		return -1;
+	for(i=0;i<RSQLEVELS;i++)
+		update[i] = NULL;
+	rsq_unlink(tcb,update,rp);
+	tcb->rsqbytes -= rp->length;
+
+	*tos = rp->tos;
+	ASSIGN(*seg,rp->seg);
+	*bpp = rp->bp;
+	*length = rp->length;
+	rsq_free(rp);
+	return 0;
+}
+/* Discard everything */
+void
+reseq_flush(struct tcb *tcb)
+{
+	struct reseq *rp,*rp1;
+	int i;
+
+	for(rp = tcb->reseq[0];rp != NULL;rp = rp1){
+		rp1 = rp->next[0];
+		free_p(&rp->bp);
+		rsq_free(rp);
+	}
+	for(i=0;i<RSQLEVELS;i++)
+		tcb->reseq[i] = NULL;
+	tcb->rsqlevel = 0;
+	tcb->rsqbytes = 0;
+}
+/* Give the descriptor pool back to the heap */
+void
+reseq_gc(void)
+{
+	struct reseq *rp;
+
+	while((rp = Rsq_pool) != NULL){
+		Rsq_pool = rp->next[0];
+		free(rp);
+	}
+	Rsq_npool = 0;
+}
+
+/* Fill update[] with the last range at each level starting below seq
+ * (strict) or at or below it (!strict). NULL means the list head.
+ */
+static void
+rsq_search(
+struct tcb *tcb,
+int32 seq,
+int strict,
+struct reseq **update
+){
+	struct reseq *x,*nx;
+	int i;
+
+	x = NULL;
+	for(i=RSQLEVELS-1;i>=0;i--){
+		if(i < tcb->rsqlevel){
+			while((nx = rsq_next(tcb,x,i)) != NULL
+			 && (strict ? seq_lt(nx->seg.seq,seq)
+			  : !seq_gt(nx->seg.seq,seq)))
+				x = nx;
+		}
+		update[i] = x;
+	}
+}
+/* Remove rp, given its predecessors at each of its levels */
+static void
+rsq_unlink(
+struct tcb *tcb,
+struct reseq **update,
+struct reseq *rp
+){
+	int i;
+
+	for(i=0;i<rp->level;i++){
+		if(update[i] == NULL)
+			tcb->reseq[i] = rp->next[i];
+		else
+			update[i]->next[i] = rp->next[i];
+	}
+	while(tcb->rsqlevel > 0 && tcb->reseq[tcb->rsqlevel-1] == NULL)
+		tcb->rsqlevel--;
+}
+/* Enforce the per-connection limit, dropping from the highest
+ * sequence numbers, which are least use to us
+ */
+static void
+rsq_limit(struct tcb *tcb)
+{
+	struct reseq *update[RSQLEVELS];
+	struct reseq *rp;
+	int32 excess;
+	int i;
+
+	while(Tcp_reseqmax != 0 && (excess = tcb->rsqbytes - Tcp_reseqmax) > 0){
+		rp = NULL;
+		for(i=tcb->rsqlevel-1;i>=0;i--)
+			while(rsq_next(tcb,rp,i) != NULL)
+				rp = rsq_next(tcb,rp,i);
+		if(rp == NULL)
+			break;
+		Tcp_stat.rsqdrop += min(excess,(int32)rp->length);
+		if(rp->length > excess){
+			rp->length -= excess;
+			trim_mbuf(&rp->bp,rp->length);
+			rp->seg.flags.fin = 0;
+			tcb->rsqbytes -= excess;
+			break;
+		}
+		rsq_search(tcb,rp->seg.seq,1,update);
+		rsq_unlink(tcb,update,rp);
+		tcb->rsqbytes -= rp->length;
+		free_p(&rp->bp);
+		rsq_free(rp);
+	}
+}
+/* Pick a level for a new range: 1 with probability 3/4, 2 with 3/16... */
+static int
+rsq_level(void)
+{
+	int level = 1;
+
+	while(level < RSQLEVELS && (rand() & 3) == 0)
+		level++;
+	return level;
+}
+static struct reseq *
+rsq_alloc(void)
+{
+	struct reseq *rp;
+
+	if((rp = Rsq_pool) != NULL){
+		Rsq_pool = rp->next[0];
+		Rsq_npool--;
+		return rp;
+	}
+	return (struct reseq *)malloc(sizeof(struct reseq));
+}
+static void
+rsq_free(struct reseq *rp)
+{
+	if(Rsq_npool >= RSQPOOL){
+		free(rp);
+		return;
+	}
+	rp->next[0] = Rsq_pool;
+	Rsq_pool = rp;
+	Rsq_npool++;
+}
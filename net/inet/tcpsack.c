@@ -0,0 +1,246 @@
+/* TCP selective acknowledgements (RFC 2018).
+ *
+ * As a receiver we describe the resequencing queue in SACK blocks on
+ * every ACK while it is non-empty. As a sender we keep a small
+ * scoreboard of the ranges the other end reports holding, so that
+ * retransmissions skip over them and go only into the holes.
+ */
+#include "top.h"
+
+#include "global.h"
+#include "core/timer.h"
+#include "net/core/mbuf.h"
+
+#include "lib/inet/netuser.h"
+
+#include "net/inet/internet.h"
+#include "net/inet/tcp.h"
+#include "net/inet/ip.h"
+
+static void sack_insert(struct tcb *tcb,int32 start,int32 end);
+
+/* Describe the resequencing queue in up to max SACK blocks. The
+ * block holding the most recently received segment goes first, as
+ * RFC 2018 requires; the rest follow in sequence order.
+ */
+void
+sack_build(struct tcb *tcb,struct tcp *seg,int max)
+{
+	struct sackblk blk[TCP_SACKHOLES];
+	struct reseq *rp;
+	int32 start,end;
+	int i,n,first;
+
+	n = 0;
+	for(rp = tcb->reseq[0];rp != NULL;rp = rp->next[0]){
+		start = rp->seg.seq;
+		end = start + rp->length;
+		if(rp->seg.flags.syn)
+			end++;
+		if(rp->seg.flags.fin)
+			end++;
+		/* Parts at or below rcv.nxt are already covered by the ack */
+		if(!seq_gt(end,tcb->rcv.nxt))
+			continue;
+		if(seq_lt(start,tcb->rcv.nxt))
+			start = tcb->rcv.nxt;
+		if(n != 0 && seq_ge(blk[n-1].end,start)){
+			/* Overlaps or abuts the previous one */
+			if(seq_gt(end,blk[n-1].end))
+				blk[n-1].end = end;
+			continue;
+		}
+		if(n == TCP_SACKHOLES)
+			break;
+		blk[n].start = start;
+		blk[n].end = end;
+		n++;
+	}
+	seg->nsack = 0;
+	if(n == 0 || max <= 0)
+		return;
+	first = 0;
+	for(i=0;i<n;i++){
+		if(seq_ge(tcb->sack_last,blk[i].start)
+		 && seq_lt(tcb->sack_last,blk[i].end)){
+			first = i;
+			break;
+		}
+	}
+	seg->sack[seg->nsack++] = blk[first];
+	for(i=0;i<n && seg->nsack < max;i++){
+		if(i != first)
+			seg->sack[seg->nsack++] = blk[i];
+	}
+}
+/* Merge the SACK blocks of an incoming ACK into the scoreboard */
+void
+sack_update(struct tcb *tcb,struct tcp *seg)
+{
+	int32 start,end;
+	int i;
+
+	for(i=0;i<seg->nsack;i++){
+		start = seg->sack[i].start;
+		end = seg->sack[i].end;
+		/* Ignore anything nonsensical or already acked */
+		if(!seq_lt(start,end) || seq_gt(end,tcb->snd.nxt)
+		 || !seq_gt(end,seg->ack))
+			continue;
+		if(seq_lt(start,seg->ack))
+			start = seg->ack;
+		tcb->sackblks++;
+		Tcp_stat.sackblks++;
+		sack_insert(tcb,start,end);
+	}
+}
+/* Add a range to the scoreboard, merging with its neighbours */
+static void
+sack_insert(struct tcb *tcb,int32 start,int32 end)
+{
+	struct sackblk *sp;
+	int i;
+
+	for(i=0;i<tcb->nsacked;){
+		sp = &tcb->sacked[i];
+		if(seq_lt(end,sp->start) || seq_gt(start,sp->end)){
+			i++;
+			continue;
+		}
+		/* Absorb it; the merged range is put back below */
+		if(seq_lt(sp->start,start))
+			start = sp->start;
+		if(seq_gt(sp->end,end))
+			end = sp->end;
+		tcb->nsacked--;
+		memmove(sp,sp+1,(tcb->nsacked - i) * sizeof(struct sackblk));
+	}
+	for(i=0;i<tcb->nsacked;i++)
+		if(seq_lt(start,tcb->sacked[i].start))
+			break;
+	if(tcb->nsacked == TCP_SACKHOLES){
+		/* Full. Forget the highest range, since the holes
+		 * nearest snd.una matter most
+		 */
+		if(i == TCP_SACKHOLES)
+			return;
+		tcb->nsacked--;
+	}
+	sp = &tcb->sacked[i];
+	memmove(sp+1,sp,(tcb->nsacked - i) * sizeof(struct sackblk));
+	sp->start = start;
+	sp->end = end;
+	tcb->nsacked++;
+}
+/* Drop scoreboard entries covered by the cumulative ack */
+void
+sack_prune(struct tcb *tcb)
+{
+	int i;
+
+	for(i=0;i<tcb->nsacked && !seq_gt(tcb->sacked[i].end,tcb->snd.una);i++)
+		;
+	if(i != 0){
+		tcb->nsacked -= i;
+		memmove(&tcb->sacked[0],&tcb->sacked[i],
+		 tcb->nsacked * sizeof(struct sackblk));
+	}
+	if(tcb->nsacked != 0 && seq_lt(tcb->sacked[0].start,tcb->snd.una))
+		tcb->sacked[0].start = tcb->snd.una;
+}
+/* Forget everything the receiver told us, e.g., in case it reneged */
+void
+sack_clear(struct tcb *tcb)
+{
+	tcb->nsacked = 0;
+}
+/* Called when retransmitting from snd.ptr: advance it past anything
+ * the receiver already holds and set *limit to the start of the next
+ * such range (snd.nxt if none). Returns the number of bytes skipped.
+ */
+int32
+sack_skip(struct tcb *tcb,int32 *limit)
+{
+	struct sackblk *sp;
+	int32 skipped = 0;
+	int i;
+
+	*limit = tcb->snd.nxt;
+	for(i=0;i<tcb->nsacked;i++){
+		sp = &tcb->sacked[i];
+		if(seq_lt(tcb->snd.ptr,sp->start)){
+			*limit = sp->start;
+			break;
+		}
+		if(seq_lt(tcb->snd.ptr,sp->end)){
+			skipped += sp->end - tcb->snd.ptr;
+			tcb->snd.ptr = sp->end;
+		}
+	}
+	tcb->sackskip += skipped;
+	Tcp_stat.sackskip += skipped;
+	return skipped;
+}
+/* Count of sequence space in [from,to) the receiver has SACKed */
+int32
+sack_bytes(struct tcb *tcb,int32 from,int32 to)
+{
+	struct sackblk *sp;
+	int32 start,end,cnt = 0;
+	int i;
+
+	for(i=0;i<tcb->nsacked;i++){
+		sp = &tcb->sacked[i];
+		start = seq_gt(sp->start,from) ? sp->start : from;
+		end = seq_lt(sp->end,to) ? sp->end : to;
+		if(seq_lt(start,end))
+			cnt += end - start;
+	}
+	return cnt;
+}
+/* Find the first hole at or after from, below the highest SACKed data.
+ * Return 1 and set *hole if there is one, 0 otherwise.
+ */
+int
+sack_nexthole(struct tcb *tcb,int32 from,int32 *hole)
+{
+	struct sackblk *sp;
+	int32 seq;
+	int i;
+
+	seq = seq_lt(from,tcb->snd.una) ? tcb->snd.una : from;
+	for(i=0;i<tcb->nsacked;i++){
+		sp = &tcb->sacked[i];
+		if(seq_lt(seq,sp->start)){
+			*hole = seq;
+			return 1;
+		}
+		if(seq_lt(seq,sp->end))
+			seq = sp->end;
+	}
+	return 0;
+}
+/* Retransmit one segment's worth of the hole starting at seq. Also
+ * used for NewReno partial acks, where the hole is at snd.una.
+ */
+void
+sack_rexmit(struct tcb *tcb,int32 seq)
+{
+	int32 ptrsave,cwindsave;
+
+	ptrsave = tcb->snd.ptr;
+	cwindsave = tcb->cwind;
+	/* Open the window by exactly one segment beyond what's in flight */
+	tcb->snd.ptr = seq;
+	tcb->cwind = seq - tcb->snd.una - sack_bytes(tcb,tcb->snd.una,seq)
+	 + tcb->mss;
+	tcp_output(tcb);
+	tcb->sack_rxt = tcb->snd.ptr;
+	if(seq_gt(ptrsave,tcb->snd.ptr))
+		tcb->snd.ptr = ptrsave;
+	tcb->cwind = cwindsave;
+	if(tcb->nsacked != 0){
+		tcb->sackrxt++;
+		Tcp_stat.sackrxt++;
+	}
+}
@@ -36,8 +36,22 @@ so_tcp_listen(struct usock *up,int backlog)
 	up->cb.tcb = open_tcp(&lsock,NULL,
 	 backlog ? TCP_SERVER:TCP_PASSIVE,0,
 	s_trcall,s_ttcall,s_tscall,up->tos,up->index);
+	/* Old callers pass 1 just to mean "server" */
+	if(up->cb.tcb != NULL && backlog != 0)
+		up->cb.tcb->backlog = backlog > 1 ? backlog : Tcp_backlog;
 	return 0;
 }
+/* accept() has taken the first waiting connection; the next in line,
+ * if any, becomes ready. Waiting sockets are chained through rdysock.
+ */
+void
+so_tcp_accepted(struct usock *up,struct usock *nup)
+{
+	up->rdysock = nup->rdysock;
+	nup->rdysock = -1;
+	if(up->cb.tcb != NULL && up->cb.tcb->aqlen > 0)
+		up->cb.tcb->aqlen--;
+}
 int
 so_tcp_conn(struct usock *up)
 {
@@ -162,6 +176,37 @@ so_tcp_qlen(struct usock *up,int rtx)
 	}
 	return len;
 }
+/* Which kPOLL conditions hold for a TCP socket */
+int
+so_tcp_poll(struct usock *up)
+{
+	struct tcb *tcb = up->cb.tcb;
+	int ev = 0;
+
+	/* A connection to accept, data, or a receive that would fail */
+	if(up->rdysock != -1 || tcb->rcvcnt != 0 || tcb->r_upcall == trdiscard)
+		ev |= kPOLLIN;
+	switch(tcb->state){
+	case TCP_ESTABLISHED:
+		if(tcb->sndcnt <= tcb->window)
+			ev |= kPOLLOUT;
+		break;
+	case TCP_CLOSE_WAIT:
+		if(tcb->sndcnt <= tcb->window)
+			ev |= kPOLLOUT;
+		ev |= kPOLLIN;		/* End of file */
+		break;
+	case TCP_CLOSING:
+	case TCP_LAST_ACK:
+	case TCP_TIME_WAIT:
+	case TCP_CLOSED:
+		ev |= kPOLLIN;		/* End of file */
+		break;
+	default:
+		break;
+	}
+	return ev;
+}
 int
 so_tcp_kick(struct usock *up)
 {
@@ -201,7 +246,7 @@ static void
 s_trcall(struct tcb *tcb,int32 cnt)
 {
 	/* Wake up anybody waiting for data, and let them run */
-	ksignal(itop(tcb->user),1);
+	sockwake(itop(tcb->user),1);
 	kwait(NULL);
 }
 /* TCP transmit upcall routine */
@@ -209,7 +254,7 @@ static void
 s_ttcall(struct tcb *tcb,int32 cnt)
 {
 	/* Wake up anybody waiting to send data, and let them run */
-	ksignal(itop(tcb->user),1);
+	sockwake(itop(tcb->user),1);
 	kwait(NULL);
 }
 /* TCP state change upcall routine */
@@ -217,7 +262,7 @@ static void
 s_tscall(struct tcb *tcb,int old,int new)
 {
 	int s,ns;
-	struct usock *up,*nup,*oup;
+	struct usock *up,*nup,*oup,*qup;
 	union sp sp;
 
 	s = tcb->user;
@@ -238,7 +283,7 @@ s_tscall(struct tcb *tcb,int old,int new)
 			up->errcodes[0] = tcb->reason;
 			up->errcodes[1] = tcb->type;
 			up->errcodes[2] = tcb->code;
-			ksignal(up,0); /* Wake up anybody waiting */
+			sockwake(up,0); /* Wake up anybody waiting */
 		}
 		del_tcp(&tcb);
 		break;
@@ -260,8 +305,21 @@ s_tscall(struct tcb *tcb,int old,int new)
 			nup->name = mallocw(SOCKSIZE);
 			nup->peername = mallocw(SOCKSIZE);
 			nup->index = ns;
-			/* Store the new socket # in the old one */
-			up->rdysock = ns;
+			nup->pollev = NULL;	/* Not the listener's poller */
+			nup->zout = nup->zin = NULL;
+			nup->rdysock = -1;
+			/* Queue the new socket # on the old one */
+			if(up->rdysock == -1){
+				up->rdysock = ns;
+			} else {
+				for(qup = itop(up->rdysock);qup != NULL
+				 && qup->rdysock != -1;qup = itop(qup->rdysock))
+					;
+				if(qup != NULL)
+					qup->rdysock = ns;
+			}
+			if(up->cb.tcb != NULL)
+				up->cb.tcb->aqlen++;
 			up = nup;
 			s = ns;
 		} else {
@@ -286,13 +344,13 @@ s_tscall(struct tcb *tcb,int old,int new)
 		up->peernamelen = SOCKSIZE;
 
 		/* Wake up the guy accepting it, and let him run */
-		ksignal(oup,1);
+		sockwake(oup,1);
 		kwait(NULL);
 		break;
 	default:	/* Ignore all other state transitions */
 		break;
 	}
-	ksignal(up,0);	/* In case anybody's waiting */
+	sockwake(up,0);	/* In case anybody's waiting */
 }
 /* Discard data received on a TCP connection. Used after a receive shutdown or
  * close_s until the TCB disappears.
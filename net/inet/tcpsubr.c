@@ -47,7 +47,7 @@ uint Tcp_mss = DEF_MSS;		/* Maximum segment size to be sent with SYN */
 int32 Tcp_irtt = DEF_RTT;	/* Initial guess at round trip time */
 int Tcp_trace;			/* State change tracing flag */
 int Tcp_syndata;
-struct tcp_rtt Tcp_rtt[RTTCACHE];
+struct tcp_stat Tcp_stat;	/* Counters not in the MIB */
 struct mib_entry Tcp_mib[] = {
 	{ NULL,		{ 0 }},
 	{ "tcpRtoAlgorithm",	{ 4 } },	/* Van Jacobsen's algorithm */
@@ -68,32 +68,82 @@ struct mib_entry Tcp_mib[] = {
 };
 
 
+/* TCBs are kept on two hash tables as well as the Tcbs list. Those
+ * with an unspecified remote socket (listeners) are hashed on local port
+ * alone, everything else on the full 4-tuple, so an incoming segment
+ * finds its connection without scanning, and a SYN for a server socket
+ * doesn't have to miss every established connection first. Tcbs itself
+ * is left in creation order for "tcp status" and the other walkers.
+ */
+static struct tcb *Tcb_hash[TCBHASH];	/* Connected, by 4-tuple */
+static struct tcb *Tcb_listen[TCBLHASH];/* Listeners, by local port */
+
+static struct tcb **
+tcb_chain(struct connection *conn)
+{
+	uint32 h;
+
+	if(conn->remote.address == 0 && conn->remote.port == 0)
+		return &Tcb_listen[conn->local.port & (TCBLHASH-1)];
+	h = (uint32)conn->remote.address ^ (uint32)conn->local.address;
+	h ^= ((uint32)conn->remote.port << 16) ^ conn->local.port;
+	h ^= h >> 16;
+	h ^= h >> 8;
+	return &Tcb_hash[h & (TCBHASH-1)];
+}
+/* Put TCB on the hash chain for its connection */
+void
+hash_tcb(tcb)
+struct tcb *tcb;
+{
+	struct tcb **chain;
+
+	chain = tcb_chain(&tcb->conn);
+	tcb->hnext = *chain;
+	*chain = tcb;
+}
+/* Take TCB off its hash chain; must be done before changing tcb->conn */
+void
+unhash_tcb(tcb)
+struct tcb *tcb;
+{
+	struct tcb **tpp;
+
+	for(tpp = tcb_chain(&tcb->conn);*tpp != NULL;tpp = &(*tpp)->hnext){
+		if(*tpp == tcb){
+			*tpp = tcb->hnext;
+			break;
+		}
+	}
+	tcb->hnext = NULL;
+}
 /* Look up TCP connection
  * Return TCB pointer or NULL if nonexistant.
- * Also move the entry to the top of the list to speed future searches.
+ * Also move the entry to the top of its hash chain to speed future searches.
  */
 struct tcb *
 lookup_tcb(conn)
 struct connection *conn;
 {
 	struct tcb *tcb;
+	struct tcb **chain;
 	struct tcb *tcblast = NULL;
 
-	for(tcb=Tcbs;tcb != NULL;tcblast = tcb,tcb = tcb->next){
+	chain = tcb_chain(conn);
+	for(tcb = *chain;tcb != NULL;tcblast = tcb,tcb = tcb->hnext){
 		/* Yet another structure compatibility hack */
 		if(conn->remote.port == tcb->conn.remote.port
 		 && conn->local.port == tcb->conn.local.port
 		 && conn->remote.address == tcb->conn.remote.address
 		 && conn->local.address == tcb->conn.local.address){
 			if(tcblast != NULL){
-				/* Move to top of list */
-				tcblast->next = tcb->next;
-				tcb->next = Tcbs;
-				Tcbs = tcb;
+				/* Move to top of chain */
+				tcblast->hnext = tcb->hnext;
+				tcb->hnext = *chain;
+				*chain = tcb;
 			}
 			return tcb;
 		}
-
 	}
 	return NULL;
 }
@@ -104,7 +154,7 @@ create_tcb(conn)
 struct connection *conn;
 {
 	struct tcb *tcb;
-	struct tcp_rtt *tp;
+	struct tcp_metric *tm;
 
 	if((tcb = lookup_tcb(conn)) != NULL)
 		return tcb;
@@ -114,19 +164,24 @@ struct connection *conn;
 	tcb->state = TCP_CLOSED;
 	tcb->cwind = tcb->mss = Tcp_mss;
 	tcb->ssthresh = 65535;
-	if((tp = rtt_get(tcb->conn.remote.address)) != NULL){
-		tcb->srtt = tp->srtt;
-		tcb->mdev = tp->mdev;
-	} else {
+	/* Time the SYN from experience; proc_syn() does the rest */
+	if((tm = tcpm_get(conn->remote.address)) != NULL && tm->srtt != 0){
+		tcb->srtt = tm->srtt;
+		tcb->mdev = tm->mdev;
+	} else
 		tcb->srtt = Tcp_irtt;	/* mdev = 0 */
-	}
 	/* Initialize timer intervals */
 	set_timer(&tcb->timer,tcb->srtt);
 	tcb->timer.func = tcp_timeout;
 	tcb->timer.arg = tcb;
+	tcb->acktimer.func = tcp_acktimeout;
+	tcb->acktimer.arg = tcb;
+	tcb->ackdelay = Tcp_ackdelay;
+	cc_select(tcb,NULL);
 
 	tcb->next = Tcbs;
-	Tcbs = tcb;		
+	Tcbs = tcb;
+	hash_tcb(tcb);
 	return tcb;
 }
 
@@ -136,22 +191,23 @@ close_self(tcb,reason)
 struct tcb *tcb;
 int reason;
 {
-	struct reseq *rp1;
-	struct reseq *rp;
-
 	if(tcb == NULL)
 		return;
 
 	stop_timer(&tcb->timer);
+	stop_timer(&tcb->acktimer);
 	tcb->reason = reason;
 
+	/* Remember what we learned about the path */
+	if(tcb->state != TCP_CLOSED)
+		tcpm_save(tcb);
+
+	/* A server's half-open connections go with it */
+	if(tcb->state == TCP_LISTEN && tcb->flags.clone)
+		syn_flush(tcb);
+
 	/* Flush reassembly queue; nothing more can arrive */
-	for(rp = tcb->reseq;rp != NULL;rp = rp1){
-		rp1 = rp->next;
-		free_p(&rp->bp);
-		free(rp);
-	}
-	tcb->reseq = NULL;
+	reseq_flush(tcb);
 	settcpstate(tcb,TCP_CLOSED);
 }
 
@@ -268,75 +324,52 @@ enum tcp_state newstate;
 		break;
 	}
 }
-/* Round trip timing cache routines.
- * These functions implement a very simple system for keeping track of
- * network performance for future use in new connections.
- * The emphasis here is on speed of update (rather than optimum cache hit
- * ratio) since rtt_add is called every time a TCP connection updates
- * its round trip estimate.
+/* Smallest window scale that lets a buffer of the given size be
+ * advertised in the 16-bit window field
  */
-void
-rtt_add(addr,rtt)
-int32 addr;		/* Destination IP address */
-int32 rtt;
-{
-	struct tcp_rtt *tp;
-	int32 abserr;
-
-	if(addr == 0)
-		return;
-	tp = &Tcp_rtt[(unsigned short)addr % RTTCACHE];
-	if(tp->addr != addr){
-		/* New entry */
-		tp->addr = addr;
-		tp->srtt = rtt;
-		tp->mdev = 0;
-	} else {
-		/* Run our own SRTT and MDEV integrators, with rounding */
-		abserr = (rtt > tp->srtt) ? rtt - tp->srtt : tp->srtt - rtt;
-		tp->srtt = ((AGAIN-1)*tp->srtt + rtt + (AGAIN/2)) >> LAGAIN;
-		tp->mdev = ((DGAIN-1)*tp->mdev + abserr + (DGAIN/2)) >> LDGAIN;
-	}
-}
-struct tcp_rtt *
-rtt_get(addr)
-int32 addr;
+int
+tcp_wscale(int32 size)
 {
-	struct tcp_rtt *tp;
+	int scale = 0;
 
-	if(addr == 0)
-		return NULL;
-	tp = &Tcp_rtt[(unsigned short)addr % RTTCACHE];
-	if(tp->addr != addr)
-		return NULL;
-	return tp;
+	while(scale < TCP_MAXWSCALE && (size >> scale) > TCP_MAXWIN)
+		scale++;
+	return scale;
 }
 
 /* TCP garbage collection - called by storage allocator when free space
  * runs low. The send and receive queues are crunched. If the situation
  * is red, the resequencing queue is discarded; otherwise it is
- * also crunched.
+ * also crunched. Either way the pool of free resequencing descriptors
+ * goes back to the heap. Receive buffers grown by auto-tuning are cut
+ * back halfway toward their original size, or all the way if red; the
+ * window then closes down to the new size as the user reads.
  */
 void
 tcp_garbage(red)
 int red;
 {
 	struct tcb *tcb;
-	struct reseq *rp,*rp1;
+	struct reseq *rp;
 
 	for(tcb = Tcbs;tcb != NULL;tcb = tcb->next){
 		mbuf_crunch(&tcb->rcvq);
 		mbuf_crunch(&tcb->sndq);
-		for(rp = tcb->reseq;rp != NULL;rp = rp1){
-			rp1 = rp->next;
-			if(red){
-				free_p(&rp->bp);
-				free(rp);
-			} else {
+		if(red){
+			reseq_flush(tcb);
+		} else {
+			for(rp = tcb->reseq[0];rp != NULL;rp = rp->next[0])
 				mbuf_crunch(&rp->bp);
-			}
 		}
-		if(red)
-			tcb->reseq = NULL;
+		if(tcb->rcvbuf > tcb->window){
+			if(red)
+				tcb->rcvbuf = tcb->window;
+			else
+				tcb->rcvbuf -= (tcb->rcvbuf - tcb->window)/2;
+			/* Start measuring afresh before growing again */
+			tcb->rcv_mseq = tcb->rcv.nxt;
+			tcb->rcv_mtime = msclock();
+		}
 	}
+	reseq_gc();
 }
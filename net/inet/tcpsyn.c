@@ -0,0 +1,398 @@
+/* TCP SYN cache and SYN cookies.
+ *
+ * A SYN to a server socket used to be answered by cloning a full TCB
+ * on the spot. Now it only gets a small syncache entry holding what's
+ * needed to answer it and, when the final ACK arrives, to build the
+ * TCB; tcp_input() then carries on as if the TCB had been there all
+ * along. Entries are hashed on the 4-tuple, resend their SYN/ACK on
+ * a backoff from a single timer, and number at most Tcp_synmax. When
+ * the cache is full the oldest entry is dropped, or if Tcp_syncookies
+ * is set the SYN/ACK is sent with its state encoded in our ISN and
+ * nothing is kept at all.
+ */
+#include "top.h"
+
+#include "global.h"
+#include "core/timer.h"
+#include "net/core/mbuf.h"
+
+#include "lib/inet/netuser.h"
+
+#include "net/inet/internet.h"
+#include "net/inet/tcp.h"
+#include "net/inet/ip.h"
+
+#define	SYNHASH		32	/* Hash chains (power of 2) */
+#define	SYN_TICK	500L	/* Timer interval, ms */
+#define	SYN_RTO		3000L	/* First SYN/ACK timeout if no metrics, ms */
+#define	SYN_RETRIES	3	/* SYN/ACK retransmissions before giving up */
+
+static struct syncache *Syn_hash[SYNHASH];
+static int Syn_count;
+static struct timer Syn_timer;
+static uint32 Syn_secret;
+
+int Tcp_synmax = DEF_SYNMAX;	/* Most entries in the SYN cache */
+int Tcp_syncookies = 1;		/* Send cookies when the cache is full */
+int Tcp_backlog = DEF_BACKLOG;	/* Default accept backlog */
+
+/* MSS values that fit in a cookie's three bits */
+static uint Cookie_mss[] = {
+	128, 256, 512, 536, 1024, 1440, 1460, 8960,
+};
+#define	NCOOKIEMSS	(sizeof(Cookie_mss)/sizeof(Cookie_mss[0]))
+
+static struct syncache **syn_chain(struct connection *conn);
+static void syn_free(struct syncache **scp);
+static void syn_send(struct syncache *sc);
+static int32 syn_rto(struct syncache *sc);
+static void syn_timeout(void *p);
+static int32 cookie_make(struct syncache *sc);
+static int cookie_check(struct tcb *lp,struct ip *ip,struct tcp *seg,
+	struct syncache *sc);
+static uint32 cookie_hash(struct connection *conn,int32 irs,uint32 t);
+
+/* Handle a segment for server socket lp with no TCB of its own. Return
+ * 1 if the handshake is now complete and sc has been filled in for
+ * building the TCB, 0 if the segment has been dealt with, or -1 if it
+ * should be answered with a reset.
+ */
+int
+syn_input(
+struct tcb *lp,
+struct ip *ip,
+struct tcp *seg,
+struct syncache *sc
+){
+	struct connection conn;
+	struct syncache **scp,**oldest;
+	struct syncache *sp;
+	int i;
+
+	conn.local.address = ip->dest;
+	conn.local.port = seg->dest;
+	conn.remote.address = ip->source;
+	conn.remote.port = seg->source;
+	for(scp = syn_chain(&conn);(sp = *scp) != NULL;scp = &sp->next){
+		if(sp->conn.remote.address == conn.remote.address
+		 && sp->conn.remote.port == conn.remote.port
+		 && sp->conn.local.address == conn.local.address
+		 && sp->conn.local.port == conn.local.port)
+			break;
+	}
+	if(seg->flags.rst){
+		/* Refused; acceptable only if in sequence */
+		if(sp != NULL && seg->seq == sp->irs + 1){
+			Tcp_stat.synreset++;
+			syn_free(scp);
+		}
+		return 0;
+	}
+	if(seg->flags.syn){
+		if(seg->flags.ack)
+			return -1;
+		if(sp != NULL && seg->seq == sp->irs){
+			/* They didn't hear our SYN/ACK */
+			syn_send(sp);
+			return 0;
+		}
+		if(lp->backlog != 0 && lp->aqlen >= lp->backlog){
+			/* Nobody's accepting; let them try again later */
+			Tcp_stat.synbacklog++;
+			return 0;
+		}
+		if(sp == NULL && Syn_count >= Tcp_synmax){
+			if(Tcp_syncookies){
+				memset(sc,0,sizeof(*sc));
+				sc->listener = lp;
+				ASSIGN(sc->conn,conn);
+				sc->irs = seg->seq;
+				sc->tos = ip->tos;
+				sc->mss = seg->flags.mss ? seg->mss : 536;
+				sc->iss = cookie_make(sc);
+				syn_send(sc);
+				Tcp_stat.cookiesent++;
+				return 0;
+			}
+			/* Make room by dropping the oldest */
+			oldest = NULL;
+			for(i=0;i<SYNHASH;i++){
+				for(scp = &Syn_hash[i];*scp != NULL;scp = &(*scp)->next){
+					if(oldest == NULL
+					 || (*scp)->iss - (*oldest)->iss < 0)
+						oldest = scp;
+				}
+			}
+			if(oldest != NULL){
+				Tcp_stat.synevict++;
+				syn_free(oldest);
+			}
+			scp = syn_chain(&conn);
+			sp = NULL;
+		}
+		if(sp == NULL){
+			if((sp = (struct syncache *)calloc(1,sizeof(*sp))) == NULL)
+				return 0;
+			ASSIGN(sp->conn,conn);
+			sp->next = *syn_chain(&conn);
+			*syn_chain(&conn) = sp;
+			Syn_count++;
+		}
+		/* A new SYN (e.g., after a restart) replaces any old one */
+		sp->listener = lp;
+		sp->iss = geniss();
+		sp->irs = seg->seq;
+		sp->tos = ip->tos;
+		sp->wnd = seg->wnd;
+		sp->mss = seg->flags.mss ? seg->mss : 0;
+		sp->opts = 0;
+		if(seg->flags.wscale){
+			sp->opts |= SC_WSCALE;
+			sp->wsopt = seg->wsopt;
+		}
+		if(seg->flags.tstamp && Tcp_tstamps){
+			sp->opts |= SC_TSTAMP;
+			sp->tsval = seg->tsval;
+		}
+		if(seg->flags.sackperm && Tcp_sack)
+			sp->opts |= SC_SACK;
+		sp->rexmits = 0;
+		Tcp_stat.synadd++;
+		syn_send(sp);
+		return 0;
+	}
+	if(!seg->flags.ack)
+		return -1;
+	if(sp == NULL){
+		if(!Tcp_syncookies || cookie_check(lp,ip,seg,sc) == -1)
+			return -1;
+		if(lp->backlog != 0 && lp->aqlen >= lp->backlog){
+			Tcp_stat.synbacklog++;
+			return 0;
+		}
+		Tcp_stat.cookieok++;
+		return 1;
+	}
+	if(seg->ack != sp->iss + 1 || seg->seq != sp->irs + 1)
+		return -1;
+	if(lp->backlog != 0 && lp->aqlen >= lp->backlog){
+		/* Keep the entry; the ACK will come again, or our
+		 * SYN/ACK retransmission will prompt one
+		 */
+		Tcp_stat.synbacklog++;
+		return 0;
+	}
+	ASSIGN(*sc,*sp);
+	syn_free(scp);
+	Tcp_stat.synok++;
+	return 1;
+}
+/* Drop the entries for a server socket that's going away, or all of
+ * them if lp is NULL
+ */
+void
+syn_flush(struct tcb *lp)
+{
+	struct syncache **scp;
+	int i;
+
+	for(i=0;i<SYNHASH;i++){
+		for(scp = &Syn_hash[i];*scp != NULL;){
+			if(lp == NULL || (*scp)->listener == lp)
+				syn_free(scp);
+			else
+				scp = &(*scp)->next;
+		}
+	}
+}
+/* Number of entries in use */
+int
+syn_count(void)
+{
+	return Syn_count;
+}
+
+static struct syncache **
+syn_chain(struct connection *conn)
+{
+	uint32 h;
+
+	h = (uint32)conn->remote.address ^ (uint32)conn->local.address;
+	h ^= ((uint32)conn->remote.port << 16) ^ conn->local.port;
+	h ^= h >> 16;
+	h ^= h >> 8;
+	return &Syn_hash[h & (SYNHASH-1)];
+}
+/* Unlink and free *scp */
+static void
+syn_free(struct syncache **scp)
+{
+	struct syncache *sp = *scp;
+
+	*scp = sp->next;
+	free(sp);
+	if(--Syn_count == 0)
+		stop_timer(&Syn_timer);
+}
+/* Send (or resend) our SYN/ACK. Options are only those the SYN
+ * asked for, so a cookie, which can't remember any, sends none.
+ */
+static void
+syn_send(struct syncache *sc)
+{
+	struct tcb *lp = sc->listener;
+	struct tcp seg;
+	struct mbuf *bp;
+
+	memset(&seg,0,sizeof(seg));
+	seg.source = sc->conn.local.port;
+	seg.dest = sc->conn.remote.port;
+	seg.seq = sc->iss;
+	seg.ack = sc->irs + 1;
+	seg.flags.syn = 1;
+	seg.flags.ack = 1;
+	seg.wnd = min(lp->rcv.wnd,TCP_MAXWIN);
+	seg.mss = Tcp_mss;
+	seg.flags.mss = 1;
+	if(sc->opts & SC_WSCALE){
+		seg.wsopt = lp->rcv.wind_scale;
+		seg.flags.wscale = 1;
+	}
+	if(sc->opts & SC_TSTAMP){
+		seg.flags.tstamp = 1;
+		seg.tsval = msclock();
+		seg.tsecr = sc->tsval;
+	}
+	if(sc->opts & SC_SACK)
+		seg.flags.sackperm = 1;
+
+	bp = ambufw(NET_HDR_PAD);	/* Prealloc room for headers */
+	bp->data += NET_HDR_PAD;
+	htontcp(&seg,&bp,sc->conn.local.address,sc->conn.remote.address);
+	ip_send(sc->conn.local.address,sc->conn.remote.address,TCP_PTCL,
+	 sc->tos,0,&bp,len_p(bp),0,0);
+	tcpOutSegs++;
+
+	sc->sent = msclock();
+	sc->due = sc->sent + (syn_rto(sc) << sc->rexmits);
+	if(Syn_count != 0 && !run_timer(&Syn_timer)){
+		set_timer(&Syn_timer,SYN_TICK);
+		Syn_timer.func = syn_timeout;
+		Syn_timer.arg = NULL;
+		start_timer(&Syn_timer);
+	}
+}
+/* Initial SYN/ACK timeout, from past experience with the peer if any */
+static int32
+syn_rto(struct syncache *sc)
+{
+	struct tcp_metric *tm;
+
+	if((tm = tcpm_get(sc->conn.remote.address)) != NULL && tm->srtt != 0)
+		return max(MIN_RTO,tm->srtt + 4*tm->mdev);
+	return SYN_RTO;
+}
+/* Resend overdue SYN/ACKs, and give up on those that have had enough */
+static void
+syn_timeout(void *p)
+{
+	struct syncache **scp;
+	int32 now;
+	int i;
+
+	now = msclock();
+	for(i=0;i<SYNHASH;i++){
+		for(scp = &Syn_hash[i];*scp != NULL;){
+			if(now - (*scp)->due < 0){
+				scp = &(*scp)->next;
+				continue;
+			}
+			if((*scp)->rexmits >= SYN_RETRIES){
+				Tcp_stat.synexpire++;
+				syn_free(scp);
+				continue;
+			}
+			(*scp)->rexmits++;
+			Tcp_stat.synrexmit++;
+			tcpRetransSegs++;
+			syn_send(*scp);
+			scp = &(*scp)->next;
+		}
+	}
+	if(Syn_count != 0)
+		start_timer(&Syn_timer);
+}
+
+/* A cookie ISN holds a 5-bit time counter (64-second units), a 3-bit
+ * MSS index and a 24-bit keyed hash of the connection and the other
+ * two. It is good for one to two counter periods.
+ */
+static int32
+cookie_make(struct syncache *sc)
+{
+	uint32 t;
+	uint i;
+
+	for(i=NCOOKIEMSS-1;i > 0 && Cookie_mss[i] > sc->mss;i--)
+		;
+	t = ((uint32)msclock() >> 16) & 0x1f;
+	return (int32)((t << 27) | (i << 24)
+	 | (cookie_hash(&sc->conn,sc->irs,(t << 3) | i) & 0xffffff));
+}
+/* Check the ACK of a cookie SYN/ACK; if good, fill in sc and return 0 */
+static int
+cookie_check(
+struct tcb *lp,
+struct ip *ip,
+struct tcp *seg,
+struct syncache *sc
+){
+	uint32 cookie,t,now;
+	uint i;
+
+	memset(sc,0,sizeof(*sc));
+	sc->conn.local.address = ip->dest;
+	sc->conn.local.port = seg->dest;
+	sc->conn.remote.address = ip->source;
+	sc->conn.remote.port = seg->source;
+	sc->iss = seg->ack - 1;
+	sc->irs = seg->seq - 1;
+	cookie = (uint32)sc->iss;
+	t = cookie >> 27;
+	i = (cookie >> 24) & 7;
+	now = ((uint32)msclock() >> 16) & 0x1f;
+	if(((now - t) & 0x1f) > 1
+	 || (cookie & 0xffffff) != (cookie_hash(&sc->conn,sc->irs,(t << 3) | i)
+	 & 0xffffff)){
+		Tcp_stat.cookiebad++;
+		return -1;
+	}
+	sc->listener = lp;
+	sc->tos = ip->tos;
+	sc->mss = Cookie_mss[i];
+	sc->wnd = seg->wnd;
+	sc->rexmits = 1;	/* Don't know when it was sent */
+	return 0;
+}
+static uint32
+cookie_hash(
+struct connection *conn,
+int32 irs,
+uint32 t
+){
+	uint32 h;
+
+	while(Syn_secret == 0)
+		Syn_secret = ((uint32)rand() << 16) ^ (uint32)rand() ^ msclock();
+	h = Syn_secret ^ t;
+	h = (h ^ (uint32)conn->local.address) * 2654435761UL;
+	h ^= h >> 15;
+	h = (h ^ (uint32)conn->remote.address) * 2654435761UL;
+	h ^= h >> 15;
+	h = (h ^ (((uint32)conn->local.port << 16) | conn->remote.port))
+	 * 2654435761UL;
+	h ^= h >> 15;
+	h = (h ^ (uint32)irs) * 2654435761UL;
+	h ^= h >> 13;
+	return h;
+}
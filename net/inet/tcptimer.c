@@ -35,11 +35,16 @@ tcp_timeout(void *p)
 		tcb->timeouts++;
 		tcb->flags.retran = 1;	/* Indicate > 1  transmission */
 		tcb->backoff++;
-		/* Reduce slowstart threshold to half current window */
-		tcb->ssthresh = tcb->cwind / 2;
-		tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
-		/* Shrink congestion window to 1 packet */
-		tcb->cwind = tcb->mss;
+		/* Typically halves the slowstart threshold and
+		 * shrinks the congestion window to 1 packet
+		 */
+		cc_timeout(tcb);
+		tcb->dupacks = 0;	/* Ends any fast recovery */
+		/* A second timeout in a row suggests the receiver may
+		 * have reneged on data it SACKed, so stop trusting it
+		 */
+		if(tcb->backoff > 1)
+			sack_clear(tcb);
 		/* Retransmit just the oldest unacked packet */
 		ptrsave = tcb->snd.ptr;
 		tcb->snd.ptr = tcb->snd.una;
@@ -47,6 +52,18 @@ tcp_timeout(void *p)
 		tcb->snd.ptr = ptrsave;
 	}
 }
+/* Delayed ack timer expiry: send the ack we've been holding */
+void
+tcp_acktimeout(void *p)
+{
+	struct tcb *tcb;
+
+	if((tcb = p) == NULL)
+		return;
+	Tcp_stat.ackto++;
+	tcb->flags.force = 1;
+	tcp_output(tcb);
+}
 /* Backoff function - the subject of much research */
 int32
 backoff(int n)
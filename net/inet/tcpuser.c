@@ -60,6 +60,9 @@ int user		/* User linkage area */
 		tcb->window = tcb->rcv.wnd = window;
 	else
 		tcb->window = tcb->rcv.wnd = Tcp_window;
+	tcb->rcvbuf = tcb->window;
+	/* Choose a window scale big enough for auto-tuning to use */
+	tcb->rcv.wind_scale = tcp_wscale(max(tcb->window,Tcp_wmax));
 	tcb->snd.wnd = 1;	/* Allow space for sending a SYN */
 	tcb->r_upcall = r_upcall;
 	tcb->t_upcall = t_upcall;
@@ -137,6 +140,8 @@ struct tcb *tcb,
 struct mbuf **bpp,
 int32 cnt
 ){
+	int32 old;
+
 	if(tcb == NULL || bpp == (struct mbuf **)NULL){
 		Net_error = INVALID;
 		return -1;
@@ -179,9 +184,15 @@ int32 cnt
 		(*bpp)->cnt = cnt;
 	}
 	tcb->rcvcnt -= cnt;
+	old = tcb->rcv.wnd;
 	tcb->rcv.wnd += cnt;
+	/* If tcp_garbage() has shrunk the buffer, reopen the window only
+	 * as far as the new size. Never pull back the right edge, though.
+	 */
+	if(tcb->rcv.wnd > tcb->rcvbuf - tcb->rcvcnt)
+		tcb->rcv.wnd = max(old,tcb->rcvbuf - tcb->rcvcnt);
 	/* Do a window update if it was less than one packet and now it's more */
-	if(tcb->rcv.wnd > tcb->mss && tcb->rcv.wnd - cnt < tcb->mss){
+	if(tcb->rcv.wnd > tcb->mss && old < tcb->mss){
 		tcb->flags.force = 1;
 		tcp_output(tcb);
 	}
@@ -237,7 +248,6 @@ del_tcp(struct tcb **conn)
 {
 	struct tcb *tcb;
 	struct tcb *tcblast = NULL;
-	struct reseq *rp,*rp1;
 
 	/* Remove from list */
 	for(tcb=Tcbs;tcb != NULL;tcblast = tcb,tcb = tcb->next)
@@ -252,14 +262,13 @@ del_tcp(struct tcb **conn)
 		tcblast->next = tcb->next;
 	else
 		Tcbs = tcb->next;	/* was first on list */
+	unhash_tcb(tcb);
 
 	stop_timer(&tcb->timer);
-	for(rp = tcb->reseq;rp != NULL;rp = rp1){
-		rp1 = rp->next;
-		free_p(&rp->bp);
-		free(rp);
-	}
-	tcb->reseq = NULL;
+	stop_timer(&tcb->acktimer);
+	if(tcb->state == TCP_LISTEN && tcb->flags.clone)
+		syn_flush(tcb);
+	reseq_flush(tcb);
 	free_p(&tcb->rcvq);
 	free_p(&tcb->sndq);
 	free(tcb);
@@ -27,6 +27,15 @@ struct mib_entry Udp_mib[] = {
 /* UDP control structures list */
 struct udp_cb *Udps;
 
+/* Control blocks are also hashed on local port, so that demultiplexing
+ * an incoming datagram only looks at those bound to its port.
+ */
+static struct udp_cb *Udp_hash[UDPHASH];
+
+int Udp_rcvmax = DEF_UDPRCVMAX;	/* Receive queue limit for new sockets */
+
+#define	udp_chain(port)	(&Udp_hash[((port) ^ ((port) >> 5)) & (UDPHASH-1)])
+
 /* Create a UDP control block for lsocket, so that we can queue
  * incoming datagrams.
  */
@@ -36,6 +45,7 @@ struct ksocket *lsocket;
 void (*r_upcall)();
 {
 	register struct udp_cb *up;
+	struct udp_cb **chain;
 
 	if((up = lookup_udp(lsocket)) != NULL){
 		/* Already exists */
@@ -50,9 +60,15 @@ void (*r_upcall)();
 	up->socket.address = lsocket->address;
 	up->socket.port = lsocket->port;
 	up->r_upcall = r_upcall;
+	up->rcvmax = Udp_rcvmax;
 
 	up->next = Udps;
+	if(Udps != NULL)
+		Udps->prev = up;
 	Udps = up;
+	chain = udp_chain(up->socket.port);
+	up->hnext = *chain;
+	*chain = up;
 	return up;
 }
 
@@ -144,9 +160,14 @@ del_udp(struct udp_cb **conn)
 {
 	struct mbuf *bp;
 	struct udp_cb *up;
-	struct udp_cb *udplast = NULL;
+	struct udp_cb **upp;
 
-	for(up = Udps;up != NULL;udplast = up,up = up->next){
+	if(*conn == NULL){
+		Net_error = INVALID;
+		return -1;
+	}
+	for(upp = udp_chain((*conn)->socket.port);(up = *upp) != NULL;
+	 upp = &up->hnext){
 		if(up == *conn)
 			break;
 	}
@@ -163,11 +184,14 @@ del_udp(struct udp_cb **conn)
 		free_p(&bp);
 		up->rcvcnt--;
 	}
-	/* Remove from list */
-	if(udplast != NULL)
-		udplast->next = up->next;
+	/* Remove from hash chain and list */
+	*upp = up->hnext;
+	if(up->prev != NULL)
+		up->prev->next = up->next;
 	else
 		Udps = up->next;	/* was first on list */
+	if(up->next != NULL)
+		up->next->prev = up->prev;
 
 	free(up);
 	return 0;
@@ -234,6 +258,13 @@ int32 said
 		free_p(bpp);
 		return;
 	}
+	if(up->rcvmax != 0 && up->rcvcnt >= up->rcvmax){
+		/* Reader isn't keeping up */
+		up->drops++;
+		udpInErrors++;
+		free_p(bpp);
+		return;
+	}
 	/* Prepend the foreign socket info */
 	fsocket.address = ip->source;
 	fsocket.port = udp.source;
@@ -246,31 +277,37 @@ int32 said
 	if(up->r_upcall)
 		(*up->r_upcall)(iface,up,up->rcvcnt);
 }
-/* Look up UDP socket. 
+/* Look up UDP socket, preferring one bound to the specific address
+ * over a wildcard on the same port.
  * Return control block pointer or NULL if nonexistant
- * As side effect, move control block to top of list to speed future
- * searches.
+ * As side effect, move control block to top of its hash chain to speed
+ * future searches.
  */
 static struct udp_cb *
 lookup_udp(struct ksocket *socket)
 {
 	struct udp_cb *up;
+	struct udp_cb **chain;
 	struct udp_cb *uplast = NULL;
+	struct udp_cb *wild = NULL;
 
-	for(up = Udps;up != NULL;uplast = up,up = up->next){
-		if(socket->port == up->socket.port
-		 && (socket->address == up->socket.address
-		 || up->socket.address == kINADDR_ANY)){
+	chain = udp_chain(socket->port);
+	for(up = *chain;up != NULL;uplast = up,up = up->hnext){
+		if(socket->port != up->socket.port)
+			continue;
+		if(socket->address == up->socket.address){
 			if(uplast != NULL){
-				/* Move to top of list */
-				uplast->next = up->next;
-				up->next = Udps;
-				Udps = up;
+				/* Move to top of chain */
+				uplast->hnext = up->hnext;
+				up->hnext = *chain;
+				*chain = up;
 			}
 			return up;
 		}
+		if(up->socket.address == kINADDR_ANY && wild == NULL)
+			wild = up;
 	}
-	return NULL;
+	return wild;
 }
 
 /* Attempt to reclaim unused space in UDP receive queues */
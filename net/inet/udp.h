@@ -33,15 +33,23 @@ struct udp {
  * remote socket structure, followed by any data
  */
 struct udp_cb {
-	struct udp_cb *next;
+	struct udp_cb *next;	/* All control blocks, newest first */
+	struct udp_cb *prev;
+	struct udp_cb *hnext;	/* Hash chain, by local port */
 	struct ksocket socket;	/* Local port accepting datagrams */
 	void (*r_upcall)(struct iface *iface,struct udp_cb *,int);
 				/* Function to call when one arrives */
 	struct mbuf *rcvq;	/* Queue of pending datagrams */
 	int rcvcnt;		/* Count of pending datagrams */
+	int rcvmax;		/* Most datagrams to queue, 0 = no limit */
+	int32 drops;		/* Datagrams dropped on a full queue */
 	int user;		/* User link */
 };
-extern struct udp_cb *Udps;	/* Hash table for UDP structures */
+extern struct udp_cb *Udps;	/* List of UDP structures */
+
+#define	UDPHASH		32	/* Hash chains for UDP demux (power of 2) */
+#define	DEF_UDPRCVMAX	64	/* Default receive queue limit, datagrams */
+extern int Udp_rcvmax;
 
 /* UDP primitives */
 
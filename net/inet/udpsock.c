@@ -163,7 +163,7 @@ struct iface *iface;
 struct udp_cb *udp;
 int cnt;
 {
-	ksignal(itop(udp->user),1);
+	sockwake(itop(udp->user),1);
 	kwait(NULL);
 }
 
@@ -317,7 +317,7 @@ struct nr4cb *cb;
 uint cnt;
 {
 	/* Wake up anybody waiting for data, and let them run */
-	ksignal(itop(cb->user),1);
+	sockwake(itop(cb->user),1);
 	kwait(NULL);
 }
 /* NET/ROM transmit upcall routine */
@@ -327,7 +327,7 @@ struct nr4cb *cb;
 uint cnt;
 {
 	/* Wake up anybody waiting to send data, and let them run */
-	ksignal(itop(cb->user),1);
+	sockwake(itop(cb->user),1);
 	kwait(NULL);
 }
 /* NET/ROM state change upcall routine */
@@ -374,6 +374,8 @@ int old,new;
 			nup->name = mallocw(sizeof(struct ksockaddr_nr));
 			nup->peername = mallocw(sizeof(struct ksockaddr_nr));
 			nup->index = ns;
+			nup->pollev = NULL;	/* Not the listener's poller */
+			nup->zout = nup->zin = NULL;
 			/* Store the new socket # in the old one */
 			up->rdysock = ns;
 			up = nup;
@@ -398,11 +400,11 @@ int old,new;
 		up->peernamelen = sizeof(struct ksockaddr_nr);
 
 		/* Wake up the guy accepting it, and let him run */
-		ksignal(oup,1);
+		sockwake(oup,1);
 		kwait(NULL);
 	}
  	/* Ignore all other state transitions */	
-	ksignal(up,0);	/* In case anybody's waiting */
+	sockwake(up,0);	/* In case anybody's waiting */
 }
 
 int
@@ -15,6 +15,7 @@
 
 /* PPP definitions */
 #define	PPP_ALLOC	128	/* mbuf allocation increment */
+#define	PPP_RXBUF	256	/* bytes read from the line at a time */
 
 
 struct ppp_hdr {
@@ -24,9 +25,15 @@ struct ppp_hdr {
 #define HDLC_UI			0x03	/* HDLC Unnumbered Information */
 	uint protocol;
 #define PPP_IP_PROTOCOL		0x0021	/* Internet Protocol */
+#define PPP_MP_PROTOCOL		0x003d	/* Multilink fragment */
 #define PPP_COMPR_PROTOCOL	0x002d	/* Van Jacobson Compressed TCP/IP */
 #define PPP_UNCOMP_PROTOCOL	0x002f	/* Van Jacobson Uncompressed TCP/IP */
+#define PPP_VJTS_PROTOCOL	0x202d	/* Compressed TCP/IP with timestamp
+					 * deltas (local, not IANA assigned) */
+#define PPP_LCOMP_PROTOCOL	0x00fb	/* Individual link compressed datagram */
+#define PPP_COMP_PROTOCOL	0x00fd	/* Compressed datagram */
 #define PPP_IPCP_PROTOCOL	0x8021	/* Internet Protocol Control Protocol */
+#define PPP_CCP_PROTOCOL	0x80fd	/* Compression Control Protocol */
 #define PPP_LCP_PROTOCOL	0xc021	/* Link Control Protocol */
 #define PPP_PAP_PROTOCOL	0xc023	/* Password Authentication Protocol */
 };
@@ -53,6 +60,9 @@ int ppp_init(struct iface *iface);
 int ppp_free(struct iface *iface);
 void ppp_proc(struct iface *iface, struct mbuf **bp);
 
+/* In pppmp.c */
+int mp_attach(int argc, char *argv[], void *p);
+
 /* In pppcmd.c */
 extern int PPPtrace;		/* trace flag */
 extern struct iface *PPPiface;	/* iface for trace */
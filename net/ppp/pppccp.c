@@ -0,0 +1,1438 @@
+/*
+ *  PPPCCP.C	-- negotiate and run PPP data compression
+ *
+ *	Compression Control Protocol (RFC 1962), with Predictor type 1
+ *	(RFC 1978) and, when built with zlib, Deflate (RFC 1979).
+ *
+ *	This implementation of PPP is declared to be in the public domain.
+ *
+ *	Acknowledgements and correction history may be found in PPP.C
+ */
+#include "top.h"
+#include "config.h"
+
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "lib/std/stdio.h"
+#include "global.h"
+#include "net/core/mbuf.h"
+#include "net/core/iface.h"
+#include "lib/util/cmdparse.h"
+#include "lib/util/crc.h"
+#include "core/timer.h"
+#include "core/trace.h"
+
+#include "net/ppp/ppp.h"
+#include "net/ppp/pppfsm.h"
+#include "net/ppp/ppplcp.h"
+#include "net/ppp/pppccp.h"
+
+
+/* These defaults are defined in the PPP RFCs, and must not be changed */
+static struct ccp_value_s ccp_default = {
+	FALSE,			/* no compression */
+	CCP_WINDOW_HI		/* largest Deflate window */
+};
+
+/* accept anything we understand */
+#ifdef HAVE_ZLIB
+static uint ccp_negotiate = CCP_N_PRED1 | CCP_N_DEFLATE;
+#else
+static uint ccp_negotiate = CCP_N_PRED1;
+#endif
+
+/* Predictor type 1 state, one per direction */
+struct pred1_s {
+	uint16 hash;
+	uint8 table[65536];	/* guess of the byte after each hash */
+};
+#define PRED1_HASH(h,c)	(uint16)(((h) << 4) ^ (c))
+#define PRED1_COMPRESSED 0x8000	/* in length field */
+
+
+static int doccp_local(int argc, char *argv[], void *p);
+static int doccp_open(int argc, char *argv[], void *p);
+static int doccp_remote(int argc, char *argv[], void *p);
+
+static int doccp_default(int argc, char *argv[], void *p);
+static int doccp_deflate(int argc, char *argv[], void *p);
+static int doccp_none(int argc, char *argv[], void *p);
+static int doccp_predictor(int argc, char *argv[], void *p);
+
+static uint ccp_preferred(uint negotiate);
+static char *ccp_name(uint method);
+static void ccp_option(struct mbuf **bpp,
+			struct ccp_value_s *value_p,
+			uint method);
+static struct mbuf *ccp_makereq(struct fsm_s *fsm_p);
+
+static int ccp_check(struct ccp_side_s *side_p,
+			struct option_hdr *option_p,
+			uint8 *body,
+			uint *method,
+			int request);
+
+static int ccp_request(struct fsm_s *fsm_p,
+			struct config_hdr *config,
+			struct mbuf **data);
+static int ccp_ack(struct fsm_s *fsm_p,
+			struct config_hdr *config,
+			struct mbuf **data);
+static int ccp_nak(struct fsm_s *fsm_p,
+			struct config_hdr *config,
+			struct mbuf **data);
+static int ccp_reject(struct fsm_s *fsm_p,
+			struct config_hdr *config,
+			struct mbuf **data);
+static int ccp_other(struct fsm_s *fsm_p,
+			struct config_hdr *config,
+			struct mbuf **data);
+
+static void ccp_reset(struct fsm_s *fsm_p);
+static void ccp_starting(struct fsm_s *fsm_p);
+static void ccp_stopping(struct fsm_s *fsm_p);
+static void ccp_closing(struct fsm_s *fsm_p);
+static void ccp_opening(struct fsm_s *fsm_p);
+static void ccp_free(struct fsm_s *fsm_p);
+
+static int comp_start(struct ccp_comp_s *comp_p, uint method,
+			int window, int decompress);
+static void comp_restart(struct ccp_comp_s *comp_p, int decompress);
+static void comp_stop(struct ccp_comp_s *comp_p, int decompress);
+static void ccp_resetreq(struct fsm_s *fsm_p);
+
+static uint pred1_comp(struct pred1_s *p, uint8 *src, uint len, uint8 *dst);
+static int pred1_decomp(struct pred1_s *p, uint8 *src, uint slen,
+			uint8 *dst, uint dlen);
+static void pred1_sync(struct pred1_s *p, uint8 *src, uint len);
+static struct mbuf *pred1_compress(struct pred1_s *p, uint protocol,
+			struct mbuf **bpp);
+static struct mbuf *pred1_decompress(struct pred1_s *p, struct mbuf **bpp);
+
+#ifdef HAVE_ZLIB
+static struct mbuf *deflate_compress(z_stream *zs, uint protocol,
+			struct mbuf **bpp);
+static struct mbuf *deflate_decompress(z_stream *zs, struct mbuf **bpp);
+#endif
+
+
+static struct fsm_constant_s ccp_constants = {
+	"Ccp",
+	PPP_CCP_PROTOCOL,
+	0xC0FE,				/* codes 1-7, 14-15 recognized */
+
+	Ccp,
+	CCP_REQ_TRY,
+	CCP_NAK_TRY,
+	CCP_TERM_TRY,
+	CCP_TIMEOUT * 1000L,
+
+	ccp_free,
+
+	ccp_reset,
+	ccp_starting,
+	ccp_opening,
+	ccp_closing,
+	ccp_stopping,
+
+	ccp_makereq,
+	ccp_request,
+	ccp_ack,
+	ccp_nak,
+	ccp_reject,
+	ccp_other,
+};
+
+
+/************************************************************************/
+
+/* "ppp <iface> ccp" subcommands */
+static struct cmds Ccpcmds[] = {
+	{ "close",	doppp_close,	0,	0,	NULL },
+	{ "listen",	doppp_passive,	0,	0,	NULL },
+	{ "local",	doccp_local,	0,	0,	NULL },
+	{ "open",	doccp_open,	0,	0,	NULL },
+	{ "remote",	doccp_remote,	0,	0,	NULL },
+	{ "timeout",	doppp_timeout,	0,	0,	NULL },
+	{ "try",	doppp_try,	0,	0,	NULL },
+	{ NULL },
+};
+
+/* "ppp <iface> ccp {local | remote}" subcommands */
+static struct cmds Ccpside_cmds[] = {
+	{ "default",	doccp_default,	0,	0,	NULL },
+	{ "deflate",	doccp_deflate,	0,	0,	NULL },
+	{ "none",	doccp_none,	0,	0,	NULL },
+	{ "predictor",	doccp_predictor,0,	0,	NULL },
+	{ NULL },
+};
+
+
+int
+doppp_ccp(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct iface *ifp = p;
+	struct ppp_s *ppp_p = ifp->edv;
+
+	return subcmd(Ccpcmds, argc, argv, &(ppp_p->fsm[Ccp]));
+}
+
+
+static int
+doccp_local(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct fsm_s *fsm_p = p;
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	return subcmd(Ccpside_cmds, argc, argv, &(ccp_p->local));
+}
+
+
+static int
+doccp_open(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct fsm_s *fsm_p = p;
+
+	doppp_active( argc, argv, p );
+
+	if ( fsm_p->ppp_p->phase == pppREADY ) {
+		fsm_start( fsm_p );
+	}
+	return 0;
+}
+
+
+static int
+doccp_remote(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct fsm_s *fsm_p = p;
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	return subcmd(Ccpside_cmds, argc, argv, &(ccp_p->remote));
+}
+
+
+/************************************************************************/
+static int
+doccp_default(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct ccp_side_s *side_p = p;
+
+	ASSIGN( side_p->want, ccp_default );
+	return 0;
+}
+
+
+/* Ask for (or allow) Deflate, with an optional window size */
+static int
+doccp_deflate(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct ccp_side_s *side_p = p;
+	int window;
+
+#ifndef HAVE_ZLIB
+	kprintf("Deflate not available\n");
+	return 1;
+#endif
+	if (argc < 2) {
+		if ( side_p->want.negotiate & CCP_N_DEFLATE )
+			kprintf("Deflate, window %d\n", side_p->want.window);
+		else
+			kprintf("None\n");
+		return 0;
+	} else if ( STRICMP(argv[1],"allow") == 0 ) {
+		return bitcmd( &(side_p->will_negotiate), CCP_N_DEFLATE,
+			"Allow Deflate", --argc, &argv[1] );
+	}
+	window = (int)strtol( argv[1], NULL, 0 );
+	if ( window < CCP_WINDOW_LO || window > CCP_WINDOW_HI ) {
+		kprintf("window must be in range %d to %d\n",
+			CCP_WINDOW_LO, CCP_WINDOW_HI);
+		return 1;
+	}
+	side_p->want.window = window;
+	side_p->want.negotiate |= CCP_N_DEFLATE;
+	return 0;
+}
+
+
+static int
+doccp_none(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct ccp_side_s *side_p = p;
+
+	side_p->want.negotiate = FALSE;
+	return 0;
+}
+
+
+static int
+doccp_predictor(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct ccp_side_s *side_p = p;
+
+	if (argc >= 2) {
+		if ( STRICMP(argv[1],"allow") == 0 ) {
+			return bitcmd( &(side_p->will_negotiate), CCP_N_PRED1,
+				"Allow Predictor", --argc, &argv[1] );
+		}
+		kprintf("allow\n");
+		return 1;
+	}
+	side_p->want.negotiate |= CCP_N_PRED1;
+	return 0;
+}
+
+
+/************************************************************************/
+/*			E V E N T   P R O C E S S I N G			*/
+/************************************************************************/
+
+/* Only one method may be used in each direction; pick the best */
+static uint
+ccp_preferred(negotiate)
+uint negotiate;
+{
+	if ( negotiate & CCP_N_DEFLATE )
+		return CCP_N_DEFLATE;
+	return negotiate & CCP_N_PRED1;
+}
+
+
+static char *
+ccp_name(method)
+uint method;
+{
+	switch ( method ) {
+	case CCP_N_PRED1:
+		return "Predictor-1";
+	case CCP_N_DEFLATE:
+		return "Deflate";
+	};
+	return "None";
+}
+
+
+static void
+ccp_option(
+  struct mbuf **bpp,
+  struct ccp_value_s *value_p,
+  uint method
+)
+{
+	struct mbuf *bp;
+	uint8 *cp;
+
+	switch ( method ) {
+	case CCP_N_PRED1:
+		if ((bp = alloc_mbuf(CCP_PRED1_LEN)) == NULL)
+			return;
+		cp = bp->data;
+		*cp++ = CCP_PRED1;
+		*cp++ = CCP_PRED1_LEN;
+		break;
+
+	case CCP_N_DEFLATE:
+		if ((bp = alloc_mbuf(CCP_DEFLATE_LEN)) == NULL)
+			return;
+		cp = bp->data;
+		*cp++ = CCP_DEFLATE;
+		*cp++ = CCP_DEFLATE_LEN;
+		*cp++ = ((value_p->window - 8) << 4) | CCP_DEFLATE_METHOD;
+		*cp++ = CCP_DEFLATE_CHK;
+		break;
+
+	default:
+		return;
+	};
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS)
+	trace_log(PPPiface, "    making %s, window %d",
+		ccp_name(method), value_p->window);
+#endif
+	bp->cnt = cp - bp->data;
+	append(bpp, &bp);
+}
+
+
+/************************************************************************/
+/* Build a request to send to remote host */
+static struct mbuf *
+ccp_makereq(fsm_p)
+struct fsm_s *fsm_p;
+{
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	struct mbuf *req_bp = NULL;
+
+	PPP_DEBUG_ROUTINES("ccp_makereq()");
+
+	ccp_option( &req_bp, &(ccp_p->local.work),
+		ccp_preferred(ccp_p->local.work.negotiate) );
+	return(req_bp);
+}
+
+
+/************************************************************************/
+/* Check an option whose body has been read, updating the working values.
+ * Returns ACK/NAK/REJ as appropriate, and the method in *method.
+ */
+static int
+ccp_check( side_p, option_p, body, method, request )
+struct ccp_side_s *side_p;
+struct option_hdr *option_p;
+uint8 *body;
+uint *method;
+int request;
+{
+	int option_result = CONFIG_ACK;		/* Assume good values */
+	int window;
+
+	switch(option_p->type) {
+	case CCP_PRED1:
+		*method = CCP_N_PRED1;
+		if ( option_p->len != CCP_PRED1_LEN )
+			option_result = CONFIG_REJ;
+		break;
+
+	case CCP_DEFLATE:
+		*method = CCP_N_DEFLATE;
+		if ( option_p->len != CCP_DEFLATE_LEN ) {
+			option_result = CONFIG_REJ;
+			break;
+		}
+		window = (body[0] >> 4) + 8;
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS)
+	trace_log(PPPiface, "    checking Deflate window %d, method %d, check %d",
+		window, body[0] & 0x0f, body[1]);
+#endif
+		if ( (body[0] & 0x0f) != CCP_DEFLATE_METHOD
+		 || body[1] != CCP_DEFLATE_CHK )
+			option_result = CONFIG_NAK;
+
+		/* A peer's request is the largest window it can take,
+		 * so anything we can make will do; a NAK of ours is
+		 * what it will send, which mustn't exceed what we asked.
+		 */
+		if ( window < CCP_WINDOW_LO ) {
+			window = CCP_WINDOW_LO;
+			option_result = CONFIG_NAK;
+		} else if ( !request && window > side_p->want.window ) {
+			window = side_p->want.window;
+			option_result = CONFIG_NAK;
+		} else if ( window > CCP_WINDOW_HI ) {
+			window = CCP_WINDOW_HI;
+			option_result = CONFIG_NAK;
+		}
+		side_p->work.window = window;
+		break;
+
+	default:
+		*method = 0;
+		option_result = CONFIG_REJ;
+		break;
+	};
+
+	if ( !(side_p->will_negotiate & *method) )
+		option_result = CONFIG_REJ;
+
+	return (option_result);
+}
+
+
+/************************************************************************/
+/* Check options requested by the remote host */
+static int
+ccp_request(
+struct fsm_s *fsm_p,
+struct config_hdr *config,
+struct mbuf **data
+){
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	int32 signed_length = config->len;
+	struct mbuf *reply_bp = NULL;	/* reply packet */
+	int reply_result = CONFIG_ACK;		/* reply to request */
+	uint desired;				/* desired to negotiate */
+	struct option_hdr option;		/* option header storage */
+	int option_result;			/* option reply */
+	uint8 body[256];			/* option contents */
+	uint method;
+	int len;
+
+	PPP_DEBUG_ROUTINES("ccp_request()");
+	ccp_p->remote.work.negotiate = FALSE;	/* clear flags */
+
+	/* Process options requested by remote host */
+	while (signed_length > 0  &&  ntohopt(&option, data) != -1) {
+		if ((signed_length -= option.len) < 0
+		 || option.len < OPTION_HDR_LEN) {
+			PPP_DEBUG_CHECKS("CCP REQ: bad header length");
+			free_p(data);
+			free_p(&reply_bp);
+			return -1;
+		}
+		len = option.len - OPTION_HDR_LEN;
+		if ( pullup(data, body, len) != len ) {
+			PPP_DEBUG_CHECKS("CCP REQ: ran out of data");
+			free_p(data);
+			free_p(&reply_bp);
+			return -1;
+		}
+		option_result = ccp_check( &(ccp_p->remote), &option, body,
+			&method, TRUE );
+
+		/* We send with only one method, so take the first */
+		if ( option_result != CONFIG_REJ
+		 && ccp_p->remote.work.negotiate != FALSE ) {
+			option_result = CONFIG_REJ;
+		}
+
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS) {
+	trace_log(PPPiface, "CCP REQ: result %s, option %d, length %d",
+		fsmCodes[option_result],
+		option.type,
+		option.len);
+}
+#endif
+		if ( option_result < reply_result ) {
+			continue;
+		} else if ( option_result > reply_result ) {
+			/* Discard current list of replies */
+			free_p(&reply_bp);
+			reply_bp = NULL;
+			reply_result = option_result;
+		}
+
+		/* remember that we processed option */
+		if ( option_result != CONFIG_REJ ) {
+			ccp_p->remote.work.negotiate |= method;
+		}
+
+		/* Add option response to the return list */
+		if ( option_result == CONFIG_NAK ) {
+			ccp_option( &reply_bp, &(ccp_p->remote.work), method );
+		} else {
+			struct mbuf *bp = ambufw(option.len);
+
+			bp->data[0] = option.type;
+			bp->data[1] = option.len;
+			memcpy(bp->data + OPTION_HDR_LEN, body, len);
+			bp->cnt = option.len;
+			append(&reply_bp, &bp);
+		}
+	}
+
+	/* Now check for a missing method which is desired */
+	if ( fsm_p->retry_nak > 0
+	 &&  ccp_p->remote.work.negotiate == FALSE
+	 &&  (desired = ccp_preferred(ccp_p->remote.want.negotiate)) != 0 ) {
+		switch ( reply_result ) {
+		case CONFIG_ACK:
+			free_p(&reply_bp);
+			reply_bp = NULL;
+			reply_result = CONFIG_NAK;
+			/* fallthru */
+		case CONFIG_NAK:
+			ccp_option( &reply_bp, &(ccp_p->remote.want), desired );
+			fsm_p->retry_nak--;
+			break;
+		case CONFIG_REJ:
+			/* do nothing */
+			break;
+		};
+	} else if ( reply_result == CONFIG_NAK ) {
+		/* if too many NAKs, reject instead */
+		if ( fsm_p->retry_nak > 0 )
+			fsm_p->retry_nak--;
+		else
+			reply_result = CONFIG_REJ;
+	}
+
+	/* Send ACK/NAK/REJ to remote host */
+	fsm_send(fsm_p, reply_result, config->id, &reply_bp);
+	free_p(data);
+	return (reply_result != CONFIG_ACK);
+}
+
+
+/************************************************************************/
+/* Process configuration ACK sent by remote host */
+static int
+ccp_ack(
+struct fsm_s *fsm_p,
+struct config_hdr *config,
+struct mbuf **data
+){
+	struct mbuf *req_bp;
+	int error = FALSE;
+
+	PPP_DEBUG_ROUTINES("ccp_ack()");
+
+	/* ID field must match last request we sent */
+	if (config->id != fsm_p->lastid) {
+		PPP_DEBUG_CHECKS("CCP ACK: wrong ID");
+		free_p(data);
+		return -1;
+	}
+
+	/* Get a copy of last request we sent */
+	req_bp = ccp_makereq(fsm_p);
+
+	/* Overall buffer length should match */
+	if (config->len != len_p(req_bp)) {
+		PPP_DEBUG_CHECKS("CCP ACK: buffer length mismatch");
+		error = TRUE;
+	} else {
+		int req_char;
+		int ack_char;
+
+		/* Each byte should match */
+		while ((req_char = pullchar(&req_bp)) != -1) {
+			if ((ack_char = pullchar(data)) == -1
+			 || ack_char != req_char ) {
+				PPP_DEBUG_CHECKS("CCP ACK: data mismatch");
+				error = TRUE;
+				break;
+			}
+		}
+	}
+	free_p(&req_bp);
+	free_p(data);
+
+	if (error) {
+		return -1;
+	}
+
+	PPP_DEBUG_CHECKS("CCP ACK: valid");
+	return 0;
+}
+
+
+/************************************************************************/
+/* Process configuration NAK sent by remote host */
+static int
+ccp_nak(
+struct fsm_s *fsm_p,
+struct config_hdr *config,
+struct mbuf **data
+){
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	struct ccp_side_s *local_p = &(ccp_p->local);
+	int32 signed_length = config->len;
+	struct option_hdr option;
+	uint8 body[256];
+	uint method;
+	int len;
+
+	PPP_DEBUG_ROUTINES("ccp_nak()");
+
+	/* ID field must match last request we sent */
+	if (config->id != fsm_p->lastid) {
+		PPP_DEBUG_CHECKS("CCP NAK: wrong ID");
+		free_p(data);
+		return -1;
+	}
+
+	while (signed_length > 0  &&  ntohopt(&option, data) != -1) {
+		if ((signed_length -= option.len) < 0
+		 || option.len < OPTION_HDR_LEN) {
+			PPP_DEBUG_CHECKS("CCP NAK: bad header length");
+			free_p(data);
+			return -1;
+		}
+		len = option.len - OPTION_HDR_LEN;
+		if ( pullup(data, body, len) != len ) {
+			PPP_DEBUG_CHECKS("CCP NAK: ran out of data");
+			free_p(data);
+			return -1;
+		}
+		if ( ccp_check( local_p, &option, body, &method, FALSE )
+		     == CONFIG_REJ ) {
+			continue;
+		}
+		/* The peer may suggest another method instead */
+		if ( method != ccp_preferred(local_p->work.negotiate) )
+			local_p->work.negotiate = method;
+	}
+	PPP_DEBUG_CHECKS("CCP NAK: valid");
+	free_p(data);
+	return 0;
+}
+
+
+/************************************************************************/
+/* Process configuration reject sent by remote host */
+static int
+ccp_reject(
+struct fsm_s *fsm_p,
+struct config_hdr *config,
+struct mbuf **data
+){
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	struct ccp_side_s *local_p = &(ccp_p->local);
+	int32 signed_length = config->len;
+	struct option_hdr option;
+	uint8 body[256];
+	uint method;
+	int len;
+
+	PPP_DEBUG_ROUTINES("ccp_reject()");
+
+	/* ID field must match last request we sent */
+	if (config->id != fsm_p->lastid) {
+		PPP_DEBUG_CHECKS("CCP REJ: wrong ID");
+		free_p(data);
+		return -1;
+	}
+
+	while (signed_length > 0  &&  ntohopt(&option, data) != -1) {
+		if ((signed_length -= option.len) < 0
+		 || option.len < OPTION_HDR_LEN) {
+			PPP_DEBUG_CHECKS("CCP REJ: bad header length");
+			free_p(data);
+			return -1;
+		}
+		len = option.len - OPTION_HDR_LEN;
+		if ( pullup(data, body, len) != len ) {
+			PPP_DEBUG_CHECKS("CCP REJ: ran out of data");
+			free_p(data);
+			return -1;
+		}
+		ccp_check( local_p, &option, body, &method, FALSE );
+		if ( !(local_p->work.negotiate & method) ) {
+			PPP_DEBUG_CHECKS("CCP REJ: option not requested");
+			free_p(data);
+			return -1;
+		}
+		/* Fall back to the next best method, if any */
+		local_p->work.negotiate &= ~method;
+	}
+	PPP_DEBUG_CHECKS("CCP REJ: valid");
+	free_p(data);
+	return 0;
+}
+
+
+/************************************************************************/
+/* Reset-Request and Reset-Ack */
+static int
+ccp_other(
+struct fsm_s *fsm_p,
+struct config_hdr *config,
+struct mbuf **data
+){
+	struct ccp_s *ccp_p = fsm_p->pdv;
+
+	if ( fsm_p->state != fsmOPENED ) {
+		free_p(data);
+		return -1;
+	}
+
+	switch ( config->code ) {
+	case RESET_REQ:
+		/* Peer lost sync; start our compressor afresh */
+		comp_restart( &(ccp_p->out), FALSE );
+		fsm_send( fsm_p, RESET_ACK, config->id, data );
+		break;
+
+	case RESET_ACK:
+		if ( !ccp_p->resetting || config->id != fsm_p->lastid ) {
+			PPP_DEBUG_CHECKS("CCP Reset-Ack: wrong ID");
+			free_p(data);
+			return -1;
+		}
+		comp_restart( &(ccp_p->in), TRUE );
+		ccp_p->resetting = FALSE;
+		free_p(data);
+		break;
+
+	default:
+		free_p(data);
+		return -1;
+	};
+	return 0;
+}
+
+
+/* Ask the peer to reset its compressor, at most once a second */
+static void
+ccp_resetreq(fsm_p)
+struct fsm_s *fsm_p;
+{
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	struct mbuf *bp = NULL;
+
+	if ( ccp_p->resetting
+	 && msclock() - ccp_p->reset_time < CCP_RESET_TIME )
+		return;
+
+	ccp_p->resetting = TRUE;
+	ccp_p->reset_time = msclock();
+	fsm_send( fsm_p, RESET_REQ, 0, &bp );
+}
+
+
+/************************************************************************/
+/* Compress a datagram about to be sent, changing *protocol to suit.
+ * Returns -1 (and frees the datagram) on error.
+ */
+int
+ccp_compress(
+struct ppp_s *ppp_p,
+uint *protocol,
+struct mbuf **bpp
+){
+	struct ccp_s *ccp_p = ppp_p->fsm[Ccp].pdv;
+	struct ccp_comp_s *comp_p = &(ccp_p->out);
+	struct mbuf *bp;
+	uint len;
+
+	if ( comp_p->method == 0 || !CCP_COMPRESSIBLE(*protocol) )
+		return 0;
+
+	len = len_p(*bpp);
+	switch ( comp_p->method ) {
+	case CCP_N_PRED1:
+		bp = pred1_compress( comp_p->state, *protocol, bpp );
+		break;
+#ifdef HAVE_ZLIB
+	case CCP_N_DEFLATE:
+		bp = deflate_compress( comp_p->state, *protocol, bpp );
+		if ( bp != NULL ) {
+			uint8 seq[2];
+
+			put16(seq, comp_p->seq++);
+			pushdown(&bp, seq, 2);
+		}
+		break;
+#endif
+	default:
+		bp = NULL;
+		break;
+	};
+	free_p(bpp);
+	if ( bp == NULL ) {
+		comp_p->errors++;
+		return -1;
+	}
+	comp_p->packets++;
+	comp_p->octets += len + (*protocol < 0x100 ? 1 : 2);
+	comp_p->comp_octets += len_p(bp);
+
+	*protocol = PPP_COMP_PROTOCOL;
+	*bpp = bp;
+	return 0;
+}
+
+
+/* Decompress a received datagram, leaving the inner datagram (without
+ * its protocol field) in *bpp. Returns the inner protocol, or 0 on error
+ * (leaving *bpp for the caller to discard).
+ */
+int
+ccp_decompress(
+struct ppp_s *ppp_p,
+struct mbuf **bpp
+){
+	struct fsm_s *fsm_p = &(ppp_p->fsm[Ccp]);
+	struct ccp_s *ccp_p = fsm_p->pdv;
+	struct ccp_comp_s *comp_p = &(ccp_p->in);
+	struct mbuf *bp = NULL;
+	uint len = len_p(*bpp);
+	int protocol;
+
+	if ( ccp_p->resetting ) {
+		/* Nothing can be made of it until the peer has reset */
+		ccp_resetreq( fsm_p );
+		return 0;
+	}
+
+	switch ( comp_p->method ) {
+	case CCP_N_PRED1:
+		bp = pred1_decompress( comp_p->state, bpp );
+		break;
+#ifdef HAVE_ZLIB
+	case CCP_N_DEFLATE:
+		if ( pull16(bpp) != comp_p->seq ) {
+			PPP_DEBUG_CHECKS("CCP: Deflate sequence error");
+			break;
+		}
+		comp_p->seq++;
+		bp = deflate_decompress( comp_p->state, bpp );
+		break;
+#endif
+	};
+
+	/* The inner protocol field may be compressed to one byte */
+	if ( bp != NULL
+	 && (protocol = PULLCHAR(&bp)) != -1
+	 && ( (protocol & 0x01)
+	   || ((protocol = (protocol << 8) | PULLCHAR(&bp)) & 0x01) ) ) {
+		comp_p->packets++;
+		comp_p->comp_octets += len;
+		comp_p->octets += len_p(bp) + (protocol < 0x100 ? 1 : 2);
+		free_p(bpp);
+		*bpp = bp;
+		return protocol;
+	}
+	free_p(&bp);
+	comp_p->errors++;
+	if ( comp_p->method != 0 )
+		ccp_resetreq( fsm_p );
+	return 0;
+}
+
+
+/* A datagram the peer sent uncompressed: Deflate still counts it, and
+ * it goes into the history just as if it had been compressed.
+ */
+void
+ccp_incomp(
+struct ppp_s *ppp_p,
+uint protocol,
+struct mbuf *bp
+){
+#ifdef HAVE_ZLIB
+	struct ccp_s *ccp_p = ppp_p->fsm[Ccp].pdv;
+	struct ccp_comp_s *comp_p = &(ccp_p->in);
+	z_stream *zs = comp_p->state;
+	uint8 proto[2];
+
+	if ( comp_p->method != CCP_N_DEFLATE || ccp_p->resetting
+	 || !CCP_COMPRESSIBLE(protocol) )
+		return;
+
+	comp_p->seq++;
+	if ( protocol < 0x100 ) {
+		proto[0] = protocol;
+		inflateSetDictionary(zs, proto, 1);
+	} else {
+		put16(proto, protocol);
+		inflateSetDictionary(zs, proto, 2);
+	}
+	for ( ; bp != NULL; bp = bp->next ) {
+		if ( bp->cnt != 0 )
+			inflateSetDictionary(zs, bp->data, bp->cnt);
+	}
+#endif
+}
+
+
+/************************************************************************/
+/*		C O M P R E S S I O N   M E T H O D S			*/
+/************************************************************************/
+
+/* Set up one direction; returns -1 if there's no memory */
+static int
+comp_start(
+struct ccp_comp_s *comp_p,
+uint method,
+int window,
+int decompress
+){
+	comp_p->method = 0;
+	comp_p->seq = 0;
+
+	switch ( method ) {
+	case CCP_N_PRED1:
+		if ( (comp_p->state = calloc(1, sizeof(struct pred1_s))) == NULL )
+			return -1;
+		break;
+#ifdef HAVE_ZLIB
+	case CCP_N_DEFLATE:
+	{
+		z_stream *zs;
+		int r;
+
+		if ( (comp_p->state = zs = calloc(1, sizeof(z_stream))) == NULL )
+			return -1;
+		/* Negative window bits: raw Deflate, no zlib header */
+		if ( decompress )
+			r = inflateInit2(zs, -window);
+		else
+			r = deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				-window, 8, Z_DEFAULT_STRATEGY);
+		if ( r != Z_OK ) {
+			free(zs);
+			comp_p->state = NULL;
+			return -1;
+		}
+		break;
+	}
+#endif
+	default:
+		return 0;
+	};
+	comp_p->method = method;
+	return 0;
+}
+
+
+/* Start afresh after a Reset-Request or Reset-Ack */
+static void
+comp_restart(
+struct ccp_comp_s *comp_p,
+int decompress
+){
+	comp_p->seq = 0;
+	comp_p->resets++;
+
+	switch ( comp_p->method ) {
+	case CCP_N_PRED1:
+		memset(comp_p->state, 0, sizeof(struct pred1_s));
+		break;
+#ifdef HAVE_ZLIB
+	case CCP_N_DEFLATE:
+		if ( decompress )
+			inflateReset(comp_p->state);
+		else
+			deflateReset(comp_p->state);
+		break;
+#endif
+	};
+}
+
+
+static void
+comp_stop(
+struct ccp_comp_s *comp_p,
+int decompress
+){
+#ifdef HAVE_ZLIB
+	if ( comp_p->method == CCP_N_DEFLATE ) {
+		if ( decompress )
+			inflateEnd(comp_p->state);
+		else
+			deflateEnd(comp_p->state);
+	}
+#endif
+	free( comp_p->state );
+	comp_p->state = NULL;
+	comp_p->method = 0;
+}
+
+
+/* Predictor type 1: guess each byte from a hash of the ones before it,
+ * and send only the wrong guesses, with a flag byte for every eight.
+ */
+static uint
+pred1_comp(
+struct pred1_s *p,
+uint8 *src,
+uint len,
+uint8 *dst
+){
+	uint8 *start = dst;
+	uint8 *table = p->table;
+	uint16 hash = p->hash;
+	uint8 *flagp;
+	uint8 flags;
+	int i;
+
+	while ( len != 0 ) {
+		flagp = dst++;
+		flags = 0;
+		for ( i = 0; i < 8 && len != 0; i++, len-- ) {
+			if ( table[hash] == *src ) {
+				flags |= 1 << i;
+			} else {
+				table[hash] = *src;
+				*dst++ = *src;
+			}
+			hash = PRED1_HASH(hash, *src++);
+		}
+		*flagp = flags;
+	}
+	p->hash = hash;
+	return dst - start;
+}
+
+
+/* Returns -1 unless exactly slen bytes make up dlen */
+static int
+pred1_decomp(
+struct pred1_s *p,
+uint8 *src,
+uint slen,
+uint8 *dst,
+uint dlen
+){
+	uint8 *table = p->table;
+	uint16 hash = p->hash;
+	uint8 flags;
+	uint8 c;
+	int i;
+
+	while ( dlen != 0 ) {
+		if ( slen-- == 0 )
+			return -1;
+		flags = *src++;
+		for ( i = 0; i < 8 && dlen != 0; i++, dlen-- ) {
+			if ( flags & (1 << i) ) {
+				c = table[hash];
+			} else {
+				if ( slen-- == 0 )
+					return -1;
+				c = table[hash] = *src++;
+			}
+			*dst++ = c;
+			hash = PRED1_HASH(hash, c);
+		}
+	}
+	p->hash = hash;
+	return slen == 0 ? 0 : -1;
+}
+
+
+/* Bring the table up to date with data sent as it was */
+static void
+pred1_sync(
+struct pred1_s *p,
+uint8 *src,
+uint len
+){
+	uint16 hash = p->hash;
+
+	while ( len-- != 0 ) {
+		p->table[hash] = *src;
+		hash = PRED1_HASH(hash, *src++);
+	}
+	p->hash = hash;
+}
+
+
+/* The packet is the length of the protocol and data, with the top bit
+ * set if they're compressed, then them, then an FCS over the length
+ * and the uncompressed protocol and data.
+ */
+static struct mbuf *
+pred1_compress(
+struct pred1_s *p,
+uint protocol,
+struct mbuf **bpp
+){
+	uint len = len_p(*bpp) + 2;
+	struct mbuf *bp;
+	uint8 *buf;
+	uint16 fcs;
+	uint n;
+
+	if ( len >= PRED1_COMPRESSED
+	 || (buf = malloc(len + 2)) == NULL )
+		return NULL;
+	put16(buf, len);
+	put16(buf + 2, protocol);
+	pullup(bpp, buf + 4, len - 2);
+	crc_init(&fcs);
+	crc_update(buf, len + 2, &fcs);
+
+	/* Worst case is a flag byte for every eight */
+	if ( (bp = alloc_mbuf(len + (len + 7) / 8 + 4)) == NULL ) {
+		free(buf);
+		return NULL;
+	}
+	n = pred1_comp(p, buf + 2, len, bp->data + 2);
+	if ( n < len ) {
+		put16(bp->data, len | PRED1_COMPRESSED);
+	} else {
+		/* The table was updated all the same */
+		memcpy(bp->data + 2, buf + 2, len);
+		put16(bp->data, len);
+		n = len;
+	}
+	crc_final_write(bp->data + 2 + n, fcs);
+	bp->cnt = n + 4;
+	free(buf);
+	return bp;
+}
+
+
+static struct mbuf *
+pred1_decompress(
+struct pred1_s *p,
+struct mbuf **bpp
+){
+	uint slen = len_p(*bpp);
+	struct mbuf *bp;
+	uint8 *buf;
+	uint len;
+	int r;
+
+	if ( slen < 4 || (buf = malloc(slen)) == NULL )
+		return NULL;
+	pullup(bpp, buf, slen);
+	len = get16(buf) & ~PRED1_COMPRESSED;
+	if ( (bp = alloc_mbuf(len + 4)) == NULL ) {
+		free(buf);
+		return NULL;
+	}
+	put16(bp->data, len);
+	if ( buf[0] & (PRED1_COMPRESSED >> 8) ) {
+		r = pred1_decomp(p, buf + 2, slen - 4, bp->data + 2, len);
+	} else if ( (r = (slen - 4 == len) ? 0 : -1) == 0 ) {
+		memcpy(bp->data + 2, buf + 2, len);
+		pred1_sync(p, bp->data + 2, len);
+	}
+	memcpy(bp->data + 2 + len, buf + slen - 2, 2);
+	free(buf);
+	if ( r == -1 || crc_check(bp->data, len + 4) == -1 ) {
+		PPP_DEBUG_CHECKS("CCP: Predictor-1 error");
+		free_p(&bp);
+		return NULL;
+	}
+	bp->data += 2;
+	bp->cnt = len;
+	return bp;
+}
+
+
+#ifdef HAVE_ZLIB
+/* Deflate the protocol and data, flushing to a byte boundary at the end.
+ * The four bytes of the empty stored block that ends the flush are
+ * always the same, so they aren't sent.
+ */
+static struct mbuf *
+deflate_compress(
+z_stream *zs,
+uint protocol,
+struct mbuf **bpp
+){
+	uint len = len_p(*bpp);
+	uint size = len + len / 8 + 64;
+	struct mbuf *bp;
+	struct mbuf *dp;
+	uint8 proto[2];
+
+	if ( (bp = alloc_mbuf(size)) == NULL )
+		return NULL;
+	zs->next_out = bp->data;
+	zs->avail_out = size;
+
+	if ( protocol < 0x100 ) {
+		proto[0] = protocol;
+		zs->avail_in = 1;
+	} else {
+		put16(proto, protocol);
+		zs->avail_in = 2;
+	}
+	zs->next_in = proto;
+	deflate(zs, Z_NO_FLUSH);
+
+	for ( dp = *bpp; dp != NULL; dp = dp->next ) {
+		if ( dp->cnt == 0 )
+			continue;
+		zs->next_in = dp->data;
+		zs->avail_in = dp->cnt;
+		deflate(zs, Z_NO_FLUSH);
+	}
+	if ( deflate(zs, Z_SYNC_FLUSH) != Z_OK || zs->avail_in != 0
+	 || zs->avail_out == 0 || size - zs->avail_out < 4 ) {
+		free_p(&bp);
+		return NULL;
+	}
+	bp->cnt = size - zs->avail_out - 4;
+	return bp;
+}
+
+
+/* Inflate a datagram, putting back the end of the flush */
+static struct mbuf *
+deflate_decompress(
+z_stream *zs,
+struct mbuf **bpp
+){
+	static uint8 tail[] = { 0x00, 0x00, 0xff, 0xff };
+	uint size = LCP_MRU_HI + PPP_HDR_LEN;
+	struct mbuf *bp;
+	struct mbuf *sp;
+	int r = Z_OK;
+
+	if ( (bp = alloc_mbuf(size)) == NULL )
+		return NULL;
+	zs->next_out = bp->data;
+	zs->avail_out = size;
+
+	for ( sp = *bpp; r == Z_OK; sp = sp->next ) {
+		if ( sp != NULL ) {
+			if ( sp->cnt == 0 )
+				continue;
+			zs->next_in = sp->data;
+			zs->avail_in = sp->cnt;
+		} else {
+			zs->next_in = tail;
+			zs->avail_in = sizeof(tail);
+		}
+		r = inflate(zs, Z_SYNC_FLUSH);
+		if ( r == Z_OK && (zs->avail_in != 0 || zs->avail_out == 0) ) {
+			/* Too big for any MRU */
+			r = Z_BUF_ERROR;
+		}
+		if ( sp == NULL )
+			break;
+	}
+	if ( r != Z_OK ) {
+		PPP_DEBUG_CHECKS("CCP: Deflate error");
+		free_p(&bp);
+		return NULL;
+	}
+	bp->cnt = size - zs->avail_out;
+	return bp;
+}
+#endif
+
+
+/************************************************************************/
+/*			I N I T I A L I Z A T I O N			*/
+/************************************************************************/
+
+/* Reset configuration options before request */
+static void
+ccp_reset(fsm_p)
+struct fsm_s *fsm_p;
+{
+	struct ccp_s *ccp_p =	fsm_p->pdv;
+
+	PPP_DEBUG_ROUTINES("ccp_reset()");
+
+	ASSIGN( ccp_p->local.work, ccp_p->local.want );
+	ccp_p->local.will_negotiate |= ccp_p->local.want.negotiate;
+
+	ccp_p->remote.work.negotiate = FALSE;
+	ccp_p->remote.will_negotiate |= ccp_p->remote.want.negotiate;
+}
+
+
+/************************************************************************/
+/* Prepare to begin configuration exchange */
+static void
+ccp_starting(fsm_p)
+struct fsm_s *fsm_p;
+{
+	PPP_DEBUG_ROUTINES("ccp_starting()");
+}
+
+
+/************************************************************************/
+/* After termination */
+static void
+ccp_stopping(fsm_p)
+struct fsm_s *fsm_p;
+{
+	PPP_DEBUG_ROUTINES("ccp_stopping()");
+}
+
+
+/************************************************************************/
+/* Close CCP */
+static void
+ccp_closing(fsm_p)
+struct fsm_s *fsm_p;
+{
+	struct ccp_s *ccp_p = 	fsm_p->pdv;
+
+	comp_stop( &(ccp_p->in), TRUE );
+	comp_stop( &(ccp_p->out), FALSE );
+	ccp_p->resetting = FALSE;
+}
+
+
+/************************************************************************/
+/* configuration negotiation complete */
+static void
+ccp_opening(fsm_p)
+struct fsm_s *fsm_p;
+{
+	struct ccp_s *ccp_p = 		fsm_p->pdv;
+	struct iface *ifp = 		fsm_p->ppp_p->iface;
+	uint rmethod = ccp_preferred(ccp_p->local.work.negotiate);
+	uint tmethod = ccp_p->remote.work.negotiate;
+	int twindow = ccp_p->remote.work.window;
+
+	ccp_closing( fsm_p );
+
+	/* We may compress with a smaller window than the peer takes */
+	if ( ccp_p->remote.want.window < twindow )
+		twindow = ccp_p->remote.want.window;
+
+	if ( comp_start( &(ccp_p->in), rmethod,
+		ccp_p->local.work.window, TRUE ) == -1
+	 || comp_start( &(ccp_p->out), tmethod, twindow, FALSE ) == -1 ) {
+		fsm_p->ppp_p->InMemory++;
+		ccp_closing( fsm_p );
+		fsm_close( fsm_p );
+		return;
+	}
+
+	if (PPPtrace > 1)
+		trace_log(PPPiface,"%s PPP/CCP Compression enabled;"
+			" Recv %s; Xmit %s",
+			ifp->name,
+			ccp_name(ccp_p->in.method),
+			ccp_name(ccp_p->out.method));
+}
+
+
+/************************************************************************/
+static void
+ccp_free(fsm_p)
+struct fsm_s *fsm_p;
+{
+	ccp_closing( fsm_p );
+}
+
+
+/* Initialize configuration structure */
+void
+ccp_init(ppp_p)
+struct ppp_s *ppp_p;
+{
+	struct fsm_s *fsm_p = &(ppp_p->fsm[Ccp]);
+	struct ccp_s *ccp_p;
+
+	PPPtrace = ppp_p->trace;
+	PPPiface = ppp_p->iface;
+
+	PPP_DEBUG_ROUTINES("ccp_init()");
+
+	fsm_p->ppp_p = ppp_p;
+	fsm_p->pdc = &ccp_constants;
+	fsm_p->pdv =
+	ccp_p = callocw(1,sizeof(struct ccp_s));
+
+	/* Ask for the best we can take */
+	ASSIGN( ccp_p->local.want, ccp_default );
+	ccp_p->local.want.negotiate = ccp_negotiate;
+	ccp_p->local.will_negotiate = ccp_negotiate;
+
+	ASSIGN( ccp_p->remote.want, ccp_default );
+	ASSIGN( ccp_p->remote.work, ccp_default);
+	ccp_p->remote.will_negotiate = ccp_negotiate;
+
+	fsm_init(fsm_p);
+}
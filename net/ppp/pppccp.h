@@ -0,0 +1,80 @@
+#ifndef _KA9Q_NET_PPPCCP_H
+#define _KA9Q_NET_PPPCCP_H
+
+					/* CCP option types */
+#define CCP_PRED1		0x01	/* Predictor type 1 (RFC 1978) */
+#define CCP_DEFLATE		0x1a	/* Deflate (RFC 1979) */
+
+#define CCP_PRED1_LEN		2
+#define CCP_DEFLATE_LEN		4
+
+/* Table for CCP configuration requests.
+ * Option types are too large to use as bit numbers, so each
+ * supported method gets a flag of its own.
+ */
+struct ccp_value_s {
+	uint negotiate;		/* negotiation flags */
+#define CCP_N_PRED1		0x01
+#define CCP_N_DEFLATE		0x02
+
+	byte_t window;		/* Deflate window size (bits) */
+};
+
+#define CCP_WINDOW_HI		15	/* Largest Deflate window */
+#define CCP_WINDOW_LO		9	/* Smallest zlib will do */
+#define CCP_DEFLATE_METHOD	8	/* Deflate method in option */
+#define CCP_DEFLATE_CHK		0	/* Sequence number check method */
+
+struct ccp_side_s {
+	uint will_negotiate;
+	struct ccp_value_s want;
+	struct ccp_value_s work;
+};
+
+/* One direction of compression */
+struct ccp_comp_s {
+	uint method;		/* CCP_N_xxx in use, 0 if none */
+	void *state;		/* method's private state */
+	uint16 seq;		/* next Deflate sequence number */
+
+	int32 octets;		/* # octets before compression */
+	int32 comp_octets;	/* # octets after compression */
+	uint packets;		/* # packets */
+	uint errors;		/* # packets we couldn't handle */
+	uint resets;		/* # times reset by Reset-Request/Ack */
+};
+
+/* CCP control block.
+ * Options we send say what we can decompress, so the local side
+ * describes what we receive, and the remote side what we send.
+ */
+struct ccp_s {
+	struct ccp_side_s local;
+	struct ccp_side_s remote;
+
+	struct ccp_comp_s in;		/* decompressor */
+	struct ccp_comp_s out;		/* compressor */
+
+	int resetting;			/* sent Reset-Request, awaiting Ack */
+	int32 reset_time;		/* when it was sent (msclock) */
+};
+
+/* Network-layer datagrams; never control protocols or compressed data */
+#define CCP_COMPRESSIBLE(p)	((p) < 0x4000 && (p) != PPP_COMP_PROTOCOL \
+				 && (p) != PPP_LCOMP_PROTOCOL)
+
+#define CCP_REQ_TRY	20		/* REQ attempts */
+#define CCP_NAK_TRY	10		/* NAK attempts */
+#define CCP_TERM_TRY	10		/* tries on TERM REQ */
+#define CCP_TIMEOUT	3		/* Seconds to wait for response */
+#define CCP_RESET_TIME	1000L		/* ms between Reset-Requests */
+
+
+int doppp_ccp(int argc, char *argv[], void *p);
+void ccp_init(struct ppp_s *ppp_p);
+
+int ccp_compress(struct ppp_s *ppp_p, uint *protocol, struct mbuf **bpp);
+int ccp_decompress(struct ppp_s *ppp_p, struct mbuf **bpp);
+void ccp_incomp(struct ppp_s *ppp_p, uint protocol, struct mbuf *bp);
+
+#endif /* _KA9Q_NET_PPPCCP_H */
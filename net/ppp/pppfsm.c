@@ -46,6 +46,10 @@ char *fsmCodes[] = {
 	"Echo Request",
 	"Echo Reply",
 	"Discard Request",
+	"Quality Report",
+	NULL,
+	"Reset Request",
+	"Reset Ack",
 };
 
 static int fsm_sendtermreq(struct fsm_s *fsm_p);
@@ -181,6 +185,7 @@ struct mbuf **data
 	case CONFIG_REQ:
 	case TERM_REQ:
 	case ECHO_REQ:
+	case RESET_REQ:
 		/* Save ID field for match against replies from remote host */
 		fsm_p->lastid = ppp_p->id;
 		/* fallthru */
@@ -196,6 +201,7 @@ struct mbuf **data
 	case TERM_ACK:
 	case CODE_REJ:
 	case ECHO_REPLY:
+	case RESET_ACK:
 		/* Use ID sent by remote host */
 		hdr.id = id;
 		break;
@@ -608,6 +614,12 @@ struct mbuf **bpp
 		break;
 
 	default:
+		if ( hdr.code < 16
+		 && (fsm_p->pdc->recognize & (1 << hdr.code))
+		 && fsm_p->pdc->other != NULL ) {
+			(*fsm_p->pdc->other)(fsm_p, &hdr, bpp);
+			break;
+		}
 		trace_log(PPPiface,"%s PPP/%s Unknown packet type: %d;"
 			" Sending Code Reject",
 			fsm_p->ppp_p->iface->name,
@@ -4,6 +4,7 @@
 #include "net/core/mbuf.h"
 #include "core/proc.h"
 #include "net/core/iface.h"
+#include "net/core/framer.h"
 #include "core/timer.h"
 
 				/* 00: serious internal problems */
@@ -29,6 +30,8 @@ struct config_hdr {
 #define ECHO_REPLY	10
 #define DISCARD_REQ	11
 #define QUALITY_REPORT	12
+#define RESET_REQ	14	/* CCP */
+#define RESET_ACK	15
 
 	byte_t id;
 	uint len;
@@ -49,6 +52,7 @@ enum {
 	Lcp,
 	Pap,
 	IPcp,
+	Ccp,
 	fsmi_Size
 };
 
@@ -94,6 +98,10 @@ struct fsm_constant_s {
 	int (*reject)(struct fsm_s *fsm_p,
 					struct config_hdr *hdr,
 					struct mbuf **bpp);
+	/* Other recognized codes (may be NULL) */
+	int (*other)(struct fsm_s *fsm_p,
+					struct config_hdr *hdr,
+					struct mbuf **bpp);
 };
 
 /* FSM states */
@@ -161,6 +169,11 @@ struct ppp_s {
 	int32 upsince;			/* Timestamp when Link Opened */
 	char *peername;			/* Peername from remote (if any) */
 
+	struct framer fr;		/* Transmit framing */
+
+	struct mp_s *mp;		/* Multilink bundle we are */
+	struct mp_link *mpl;		/* Multilink bundle we belong to */
+
 	int32 OutTxOctetCount;		/* # octets sent */
 	int32 OutOpenFlag;		/* # of open flags sent */
 	uint OutNCP[fsmi_Size];	/* # NCP packets sent by protocol */
@@ -36,7 +36,8 @@ static struct ipcp_value_s ipcp_default = {
 
 	0,			/* no compression protocol */
 	0,			/* no slots */
-	0			/* no slot compression */
+	0,			/* no slot compression */
+	TRUE			/* timestamp deltas if asked for */
 };
 
 /* for test purposes, accept anything we understand */
@@ -290,10 +291,12 @@ void *p;
 		if ( side_p->want.negotiate & IPCP_N_COMPRESS ) {
 			switch ( side_p->want.compression ) {
 			case PPP_COMPR_PROTOCOL:
+			case PPP_VJTS_PROTOCOL:
 				kprintf("TCP header compression enabled; "
-					"Slots = %d, slot compress = %x\n",
+					"Slots = %d, slot compress = %x%s\n",
 					side_p->want.slots,
-					side_p->want.slot_compress);
+					side_p->want.slot_compress,
+					side_p->want.tstamp ? ", tstamp" : "");
 				break;
 			default:
 				kprintf("0x%04x\n", side_p->want.compression);
@@ -307,11 +310,12 @@ void *p;
 			"Allow Compression", --argc, &argv[1] );
 	} else if ( STRICMP(argv[1],"tcp") == 0
 		 || STRICMP(argv[1],"vj") == 0 ) {
-		side_p->want.compression = PPP_COMPR_PROTOCOL;
 		if ( argc >= 3 ) {
 			side_p->want.slots = strtol(argv[2],NULL,0);
-			if ( side_p->want.slots < 1 || side_p->want.slots > 255 ) {
-				kprintf( "slots must be in range 1 to 255" );
+			if ( side_p->want.slots < IPCP_SLOT_LO
+			  || side_p->want.slots > IPCP_SLOT_HI ) {
+				kprintf( "slots must be in range %d to %d\n",
+					IPCP_SLOT_LO, IPCP_SLOT_HI );
 				return 1;
 			}
 		} else {
@@ -322,6 +326,14 @@ void *p;
 		} else {
 			side_p->want.slot_compress = IPCP_SLOT_COMPRESS;
 		}
+		/* Timestamp deltas use a private protocol number, so
+		 * they are only asked for on request; a peer that
+		 * doesn't know them will settle for plain VJ
+		 */
+		side_p->want.tstamp = ( argc >= 5
+			&& STRICMP(argv[4],"tstamp") == 0 );
+		side_p->want.compression = side_p->want.tstamp
+			? PPP_VJTS_PROTOCOL : PPP_COMPR_PROTOCOL;
 		side_p->want.negotiate |= IPCP_N_COMPRESS;
 	} else if (STRICMP(argv[1],"none") == 0) {
 		side_p->want.negotiate &= ~IPCP_N_COMPRESS;
@@ -393,7 +405,8 @@ if (PPPtrace & PPP_DEBUG_OPTIONS)
 	trace_log(PPPiface, "    making IP compression 0x%04x",
 		value_p->compression);
 #endif
-		if ( value_p->compression == PPP_COMPR_PROTOCOL ) {
+		if ( value_p->compression == PPP_COMPR_PROTOCOL
+		  || value_p->compression == PPP_VJTS_PROTOCOL ) {
 			*cp++ = value_p->slots - 1;
 			*cp++ = value_p->slot_compress;
 			toss -= 2;
@@ -538,6 +551,13 @@ if (PPPtrace & PPP_DEBUG_OPTIONS)
 #endif
 		/* Check if requested type is acceptable */
 		switch ( side_p->work.compression ) {
+		case PPP_VJTS_PROTOCOL:
+			if ( !side_p->want.tstamp ) {
+				/* Not enabled here; offer plain VJ */
+				side_p->work.compression = PPP_COMPR_PROTOCOL;
+				option_result = CONFIG_NAK;
+			}
+			/* fallthru */
 		case PPP_COMPR_PROTOCOL:
 			if ( (test = pullchar(bpp)) == -1 ) {
 				return -1;
@@ -869,7 +889,11 @@ struct mbuf **data
 		}
 		last_option = option.type;
 
-		if ( option.type <= IPCP_OPTION_LIMIT ) {
+		if ( option.type == IPCP_COMPRESS
+		 && local_p->work.compression == PPP_VJTS_PROTOCOL ) {
+			/* Peer may know only RFC 1144; try that next */
+			local_p->work.compression = PPP_COMPR_PROTOCOL;
+		} else if ( option.type <= IPCP_OPTION_LIMIT ) {
 			local_p->work.negotiate &= ~(1 << option.type);
 		}
 	}
@@ -988,6 +1012,12 @@ struct fsm_s *fsm_p;
 
 	if ( rslots != 0 || tslots != 0 ) {
 		ipcp_p->slhcp = slhc_init( rslots, tslots );
+		if ( rslots != 0
+		 && ipcp_p->local.work.compression == PPP_VJTS_PROTOCOL )
+			ipcp_p->slhcp->flags |= SLF_RTSTAMP;
+		if ( tslots != 0
+		 && ipcp_p->remote.work.compression == PPP_VJTS_PROTOCOL )
+			ipcp_p->slhcp->flags |= SLF_TTSTAMP;
 
 		if (PPPtrace > 1)
 			trace_log(PPPiface,"%s PPP/IPCP Compression enabled;"
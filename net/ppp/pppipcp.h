@@ -20,10 +20,12 @@ struct ipcp_value_s {
 	uint compression;		/* Compression protocol */
 	uint slots;			/* Slots (0-n)*/
 	byte_t slot_compress;		/* Slots may be compressed (flag)*/
+	byte_t tstamp;			/* Allow TCP timestamp deltas
+					 * (PPP_VJTS_PROTOCOL) */
 };
 
 #define IPCP_SLOT_DEFAULT	16	/* Default # of slots */
-#define IPCP_SLOT_HI		64	/* Maximum # of slots */
+#define IPCP_SLOT_HI		256	/* Maximum # of slots */
 #define IPCP_SLOT_LO 		 1	/* Minimum # of slots */
 #define IPCP_SLOT_COMPRESS	0x01	/* May compress slot id */
 
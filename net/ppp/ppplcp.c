@@ -24,6 +24,7 @@
 #include "net/ppp/pppfsm.h"
 #include "net/ppp/ppplcp.h"
 #include "net/ppp/ppppap.h"
+#include "net/ppp/pppmp.h"
 
 
 /* These defaults are defined in the PPP RFCs, and must not be changed */
@@ -36,6 +37,9 @@ static struct lcp_value_s lcp_default = {
 	0,		/* no encryption */
 	0L,		/* no magic number */
 	0L,		/* no reporting period */
+	LCP_MRU_DEFAULT,	/* MRRU, if multilink at all */
+	0,		/* null discriminator class */
+	0,
 };
 
 /* for test purposes, accept anything we understand in the NAK */
@@ -51,7 +55,11 @@ static byte_t option_length[] = {
 	 6,		/* magic number */
 	 6,		/* monitor reporting period */
 	 2,		/* Protocol compression */
-	 2		/* Address/Control compression */
+	 2,		/* Address/Control compression */
+	 0, 0, 0, 0, 0, 0, 0, 0,	/* unused */
+	 4,		/* Multilink MRRU */
+	 2,		/* Multilink short sequence numbers */
+	 3		/* Endpoint discriminator (plus address) */
 };
 
 
@@ -465,8 +473,30 @@ if (PPPtrace & PPP_DEBUG_OPTIONS)
 #endif
 		break;
 
+	case LCP_MRRU:
+		put16(cp, value_p->mrru);
+		toss -= 2;
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS)
+	trace_log(PPPiface, "    making MRRU: %d", value_p->mrru);
+#endif
+		break;
+
+	case LCP_DISCR:
+		*cp++ = value_p->discr_class;
+		memcpy(cp, value_p->discr, value_p->discr_len);
+		cp += value_p->discr_len;
+		toss -= 1 + value_p->discr_len;
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS)
+	trace_log(PPPiface, "    making Endpoint Discriminator: class %d",
+		value_p->discr_class);
+#endif
+		break;
+
 	case LCP_ENCRYPT:		/* not implemented */
 	case LCP_QUALITY:		/* not implemented */
+	case LCP_SSNHF:			/* not implemented */
 	default:
 #ifdef PPP_DEBUG_OPTIONS
 if (PPPtrace & PPP_DEBUG_OPTIONS)
@@ -497,8 +527,10 @@ uint negotiating;
 
 	for ( o_type = 1; o_type <= LCP_OPTION_LIMIT; o_type++ ) {
 		if (negotiating & (1 << o_type)) {
-			lcp_option( bpp, value_p,
-				o_type, option_length[ o_type ], NULL);
+			lcp_option( bpp, value_p, o_type,
+				option_length[ o_type ]
+				 + (o_type == LCP_DISCR ? value_p->discr_len : 0),
+				NULL);
 		}
 	}
 }
@@ -628,8 +660,48 @@ if (PPPtrace & PPP_DEBUG_OPTIONS)
 #endif
 		break;
 
+	case LCP_MRRU:
+		side_p->work.mrru = pull16(bpp);
+		toss -= 2;
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS)
+	trace_log(PPPiface, "    checking MRRU: %d", side_p->work.mrru);
+#endif
+		/* The peer must be able to take a whole datagram */
+		if (side_p->work.mrru < LCP_MRU_LO) {
+			side_p->work.mrru = LCP_MRU_LO;
+			option_result = CONFIG_NAK;
+		}
+		/* Nor can we be talked into reassembling more than the
+		 * bundle was set up for
+		 */
+		if ( !request && side_p->want.mrru != 0
+		  && side_p->work.mrru > side_p->want.mrru ) {
+			side_p->work.mrru = side_p->want.mrru;
+			option_result = CONFIG_NAK;
+		}
+		break;
+
+	case LCP_DISCR:
+		side_p->work.discr_class = pullchar(bpp);
+		toss--;
+		side_p->work.discr_len = (toss < 0) ? 0
+			: (toss > LCP_DISCR_MAX) ? LCP_DISCR_MAX : toss;
+		toss -= pullup(bpp, side_p->work.discr,
+			side_p->work.discr_len);
+#ifdef PPP_DEBUG_OPTIONS
+if (PPPtrace & PPP_DEBUG_OPTIONS)
+	trace_log(PPPiface, "    checking Endpoint Discriminator: class %d",
+		side_p->work.discr_class);
+#endif
+		/* Not negotiable; either we take it or we don't */
+		if (side_p->work.discr_class > 5 || toss > 0)
+			option_result = CONFIG_REJ;
+		break;
+
 	case LCP_ENCRYPT:		/* not implemented */
 	case LCP_QUALITY:		/* not implemented */
+	case LCP_SSNHF:			/* not implemented */
 	default:
 		option_result = CONFIG_REJ;
 		break;
@@ -943,7 +1015,13 @@ struct ppp_s *ppp_p;
 		ppp_p->phase = pppREADY;
 
 		ppp_p->upsince = secclock();
+
+		/* A multilink member leaves the rest to its bundle */
+		if ( ppp_p->mpl != NULL && mp_join( ppp_p ) == 0 )
+			return;
+
 		fsm_start( &(ppp_p->fsm[IPcp]) );
+		fsm_start( &(ppp_p->fsm[Ccp]) );
 	}
 }
 
@@ -1014,7 +1092,10 @@ struct fsm_s *fsm_p;
 
 	ppp_p->phase = pppTERMINATE;
 
+	if ( ppp_p->mpl != NULL )
+		mp_leave( ppp_p );
 	fsm_down( &(ppp_p->fsm[IPcp]) );
+	fsm_down( &(ppp_p->fsm[Ccp]) );
 	pap_down( &(ppp_p->fsm[Pap]) );
 }
 
@@ -10,7 +10,12 @@
 #define LCP_QUALITY		0x06
 #define LCP_PFC			0x07
 #define LCP_ACFC		0x08
-#define LCP_OPTION_LIMIT	0x08	/* highest # we can handle */
+#define LCP_MRRU		0x11	/* Multilink (RFC 1990) */
+#define LCP_SSNHF		0x12
+#define LCP_DISCR		0x13
+#define LCP_OPTION_LIMIT	0x13	/* highest # we can handle */
+
+#define LCP_DISCR_MAX	20		/* longest discriminator address */
 
 /* Table for LCP configuration requests */
 struct lcp_value_s {
@@ -23,6 +28,8 @@ struct lcp_value_s {
 #define LCP_N_QUALITY		(1 << LCP_QUALITY)
 #define LCP_N_PFC		(1 << LCP_PFC)
 #define LCP_N_ACFC		(1 << LCP_ACFC)
+#define LCP_N_MRRU		(1 << LCP_MRRU)
+#define LCP_N_DISCR		(1 << LCP_DISCR)
 
 	uint mru;			/* Maximum Receive Unit */
 	int32 accm;			/* Async Control Char Map */
@@ -30,6 +37,10 @@ struct lcp_value_s {
 	uint encryption;		/* Encryption protocol */
 	int32 magic_number;		/* Magic number value */
 	int32 reporting_period;		/* Link Quality reporting period */
+	uint mrru;			/* Max Receive Reconstructed Unit */
+	byte_t discr_class;		/* Endpoint Discriminator class */
+	byte_t discr_len;		/* and address length */
+	uint8 discr[LCP_DISCR_MAX];	/* and address */
 };
 
 /* Other configuration option values */
@@ -0,0 +1,843 @@
+/*
+ *  PPPMP.C	-- Multilink PPP (RFC 1990)
+ *
+ *	A bundle is attached as an interface of its own. Links are
+ *	added to it by name, and join it whenever their LCP opens with
+ *	the Multilink options in both directions; from then on they
+ *	carry only LCP and authentication for themselves, and the
+ *	bundle's packets in fragments.
+ *
+ *	Packets go out split across the joined links in proportion to
+ *	their speed, or whole on the least busy one if they are small.
+ *	Fragments coming in are put back in order and reassembled;
+ *	every link sends in sequence, so anything older than the last
+ *	fragment seen on every link (RFC 1990's M) that is still
+ *	missing has been lost.
+ */
+#include "top.h"
+
+#include "lib/std/stdio.h"
+#include "global.h"
+#include "net/core/mbuf.h"
+#include "net/core/iface.h"
+#include "core/proc.h"
+#include "lib/inet/netuser.h"
+#include "lib/util/cmdparse.h"
+#include "core/devparam.h"
+#include "core/trace.h"
+
+#include "net/ppp/ppp.h"
+#include "net/ppp/pppfsm.h"
+#include "net/ppp/ppplcp.h"
+#include "net/ppp/ppppap.h"
+#include "net/ppp/pppipcp.h"
+#include "net/ppp/pppccp.h"
+#include "net/ppp/pppmp.h"
+
+static int domp_add(int argc, char *argv[], void *p);
+static int domp_drop(int argc, char *argv[], void *p);
+static int domp_fragment(int argc, char *argv[], void *p);
+
+static void mp_log(struct ppp_s *ppp_p, char *comment);
+static int32 mp_seqdiff(int32 a, int32 b);
+static int32 mp_speed(struct mp_link *lp);
+static void mp_renegotiate(struct ppp_s *ppp_p);
+static int mp_raw(struct iface *ifp, struct mbuf **bpp);
+static int mp_stop(struct iface *ifp);
+static void mp_sendfrag(struct mp_s *mp_p, struct mp_link *lp,
+	byte_t flags, struct mbuf **bpp);
+static void mp_reassemble(struct mp_s *mp_p);
+static void mp_toss(struct mp_s *mp_p, struct mp_frag *last);
+static void mp_deliver(struct mp_s *mp_p, uint protocol, struct mbuf **bpp);
+static void mp_flush(struct mp_s *mp_p);
+
+
+/* "ppp <iface> multilink" subcommands */
+static struct cmds Mpcmds[] = {
+	{ "add",	domp_add,	0,	2,
+		"multilink add <iface> [<speed>]" },
+	{ "drop",	domp_drop,	0,	2,
+		"multilink drop <iface>" },
+	{ "fragment",	domp_fragment,	0,	0,	NULL },
+	{ NULL },
+};
+
+
+/****************************************************************************/
+
+/* Attach a multilink bundle
+ * argv[0]: hardware type, must be "mlppp"
+ * argv[1]: interface label, e.g., "ml0"
+ * argv[2]: maximum transmission unit, bytes, e.g., "1500"; this is
+ *	    also the largest packet we will reassemble
+ */
+int
+mp_attach(int argc, char *argv[], void *p)
+{
+	struct iface *ifp;
+	struct ppp_s *ppp_p;
+	struct mp_s *mp_p;
+	int32 discr;
+	int mtu;
+	char *cp;
+
+	if (if_lookup(argv[1]) != NULL) {
+		kprintf("Interface %s already exists\n",argv[1]);
+		return -1;
+	}
+	mtu = atoi(argv[2]);
+	if (mtu < LCP_MRU_LO || mtu > LCP_MRU_HI) {
+		kprintf("MTU %s out of range %d thru %d\n",
+			argv[2], LCP_MRU_LO, LCP_MRU_HI);
+		return -1;
+	}
+
+	ifp = (struct iface *)callocw(1,sizeof(struct iface));
+	ifp->addr = Ip_addr;
+	ifp->name = strdup(argv[1]);
+	ifp->mtu = mtu;
+	ifp->stop = mp_stop;
+	setencap(ifp,"PPP");
+
+	ppp_p = callocw(1,sizeof(struct ppp_s));
+	ifp->edv = ppp_p;
+	ifp->raw = mp_raw;
+	ifp->show = ppp_show;
+
+	ppp_p->iface = ifp;
+	ppp_p->phase = pppDEAD;
+
+	/* LCP and PAP run on the links, but ppp_proc wants them here too */
+	lcp_init(ppp_p);
+	pap_init(ppp_p);
+	ipcp_init(ppp_p);
+	ccp_init(ppp_p);
+
+	mp_p = callocw(1,sizeof(struct mp_s));
+	ppp_p->mp = mp_p;
+	mp_p->ppp_p = ppp_p;
+	mp_p->mtu = mtu;
+	mp_p->mrru = mtu;
+	mp_p->minfrag = MP_MINFRAG;
+
+	/* Locally assigned discriminator, to tell our bundles apart */
+	discr = rdclock() ^ ((int32)secclock() << 16) ^ (long)mp_p;
+	put32(mp_p->discr, discr);
+
+	ifp->next = Ifaces;
+	Ifaces = ifp;
+	cp = if_name(ifp," tx");
+	ifp->txproc = newproc(cp,768,if_tx,0,ifp,NULL,0);
+	free(cp);
+	return 0;
+}
+
+
+/* Shut the bundle down, letting its links go back to ordinary PPP */
+static int
+mp_stop(ifp)
+struct iface *ifp;
+{
+	struct ppp_s *ppp_p = ifp->edv;
+	struct mp_s *mp_p = ppp_p->mp;
+	struct ppp_s *link_p;
+	int fsmi;
+
+	while ( mp_p->links != NULL ) {
+		link_p = mp_p->links->ppp_p;
+		mp_unlink( link_p );
+		mp_renegotiate( link_p );
+	}
+	mp_flush( mp_p );
+
+	for ( fsmi = Lcp; fsmi < fsmi_Size; ) {
+		fsm_free( &(ppp_p->fsm[fsmi++]) );
+	}
+	free( mp_p->peer_name );
+	free( mp_p );
+	free( ppp_p->peername );
+	free( ppp_p );
+	ifp->edv = NULL;
+	return 0;
+}
+
+
+/****************************************************************************/
+
+int
+doppp_multilink(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct iface *ifp = p;
+	struct ppp_s *ppp_p = ifp->edv;
+
+	if ( ppp_p->mp == NULL ) {
+		kprintf("%s: not a multilink bundle\n", ifp->name);
+		return -1;
+	}
+	return subcmd(Mpcmds, argc, argv, ppp_p->mp);
+}
+
+
+/* Add a link to the bundle, renegotiating it if it's up */
+static int
+domp_add(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct mp_s *mp_p = p;
+	struct iface *ifp;
+	struct ppp_s *ppp_p;
+	struct lcp_s *lcp_p;
+	struct mp_link *lp, **lpp;
+	int32 speed = 0;
+
+	if ((ifp = if_lookup(argv[1])) == NULL) {
+		kprintf("%s: Interface unknown\n",argv[1]);
+		return -1;
+	}
+	if (ifp->iftype->type != CL_PPP
+	 || (ppp_p = ifp->edv) == NULL
+	 || ppp_p->mp != NULL) {
+		kprintf("%s: not a PPP link\n",ifp->name);
+		return -1;
+	}
+	if (argc > 2)
+		speed = atol(argv[2]);
+
+	if ( (lp = ppp_p->mpl) != NULL ) {
+		if ( lp->mp_p != mp_p ) {
+			kprintf("%s: already in bundle %s\n", ifp->name,
+				lp->mp_p->ppp_p->iface->name);
+			return -1;
+		}
+		lp->speed = speed;
+		return 0;
+	}
+
+	lp = callocw(1,sizeof(struct mp_link));
+	lp->mp_p = mp_p;
+	lp->ppp_p = ppp_p;
+	lp->speed = speed;
+	for ( lpp = &(mp_p->links); *lpp != NULL; lpp = &((*lpp)->next) )
+		;
+	*lpp = lp;
+	ppp_p->mpl = lp;
+
+	/* Ask for Multilink, and accept it from the peer */
+	lcp_p = ppp_p->fsm[Lcp].pdv;
+	lcp_p->local.want.mrru = mp_p->mrru;
+	lcp_p->local.want.discr_class = 1;	/* locally assigned */
+	lcp_p->local.want.discr_len = sizeof(mp_p->discr);
+	memcpy(lcp_p->local.want.discr, mp_p->discr, sizeof(mp_p->discr));
+	lcp_p->local.want.negotiate |= LCP_N_MRRU | LCP_N_DISCR;
+	lcp_p->local.will_negotiate |= LCP_N_MRRU | LCP_N_DISCR;
+	lcp_p->remote.will_negotiate |= LCP_N_MRRU | LCP_N_DISCR;
+
+	mp_renegotiate( ppp_p );
+	return 0;
+}
+
+
+/* Take a link out of the bundle; it carries on as ordinary PPP */
+static int
+domp_drop(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct mp_s *mp_p = p;
+	struct mp_link *lp;
+	struct ppp_s *ppp_p;
+
+	for ( lp = mp_p->links; lp != NULL; lp = lp->next ) {
+		if ( STRICMP(lp->ppp_p->iface->name, argv[1]) == 0 )
+			break;
+	}
+	if ( lp == NULL ) {
+		kprintf("%s: not in this bundle\n", argv[1]);
+		return -1;
+	}
+	ppp_p = lp->ppp_p;
+	mp_unlink( ppp_p );
+	mp_renegotiate( ppp_p );
+	return 0;
+}
+
+
+static int
+domp_fragment(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct mp_s *mp_p = p;
+
+	return setuns(&(mp_p->minfrag), "Minimum fragment", argc, argv);
+}
+
+
+/****************************************************************************/
+
+static void
+mp_log( ppp_p, comment )
+struct ppp_s *ppp_p;
+char *comment;
+{
+	if (ppp_p->trace)
+		trace_log(ppp_p->iface,"%s PPP %s",
+			ppp_p->iface->name,
+			comment);
+}
+
+
+/* Difference between two sequence numbers, allowing for wrap */
+static int32
+mp_seqdiff(a, b)
+int32 a;
+int32 b;
+{
+	int32 d = (a - b) & MP_SEQ_MASK;
+
+	return (d & 0x00800000L) ? d - 0x01000000L : d;
+}
+
+
+/* Link speed, for sharing out the traffic */
+static int32
+mp_speed(lp)
+struct mp_link *lp;
+{
+	struct iface *ifp = lp->ppp_p->iface;
+	int32 speed = lp->speed;
+
+	if ( speed <= 0 && ifp->ioctl != NULL )
+		speed = (*ifp->ioctl)(ifp, PARAM_SPEED, FALSE, 0L);
+	return (speed > 0) ? speed : MP_SPEED_DEF;
+}
+
+
+/* Have a link's LCP take another look at its options, without
+ * dropping the line
+ */
+static void
+mp_renegotiate(ppp_p)
+struct ppp_s *ppp_p;
+{
+	struct fsm_s *fsm_p = &(ppp_p->fsm[Lcp]);
+
+	if ( fsm_p->state >= fsmREQ_Sent && fsm_p->state <= fsmOPENED ) {
+		fsm_down( fsm_p );
+		fsm_start( fsm_p );
+	}
+}
+
+
+/****************************************************************************/
+
+/* A link is up with Multilink negotiated: put it to work for the bundle.
+ * Returns -1 if it should carry on by itself instead.
+ */
+int
+mp_join(ppp_p)
+struct ppp_s *ppp_p;
+{
+	struct mp_link *lp = ppp_p->mpl;
+	struct mp_s *mp_p = lp->mp_p;
+	struct lcp_s *lcp_p = ppp_p->fsm[Lcp].pdv;
+	struct lcp_value_s *remote_p = &(lcp_p->remote.work);
+	struct mp_link *jp;
+	byte_t class = 0;
+	byte_t len = 0;
+
+	if ( lp->joined )
+		return 0;
+	if ( !(lcp_p->local.work.negotiate & LCP_N_MRRU)
+	  || !(remote_p->negotiate & LCP_N_MRRU) ) {
+		mp_log( ppp_p, "Multilink not negotiated" );
+		return -1;
+	}
+	if ( remote_p->negotiate & LCP_N_DISCR ) {
+		class = remote_p->discr_class;
+		len = remote_p->discr_len;
+	}
+
+	for ( jp = mp_p->links; jp != NULL; jp = jp->next ) {
+		if ( jp->joined )
+			break;
+	}
+	if ( jp != NULL ) {
+		/* The bundle's up: this had better be the same peer */
+		if ( class != mp_p->peer_class
+		  || len != mp_p->peer_len
+		  || memcmp( remote_p->discr, mp_p->peer_discr, len ) != 0
+		  || (ppp_p->peername == NULL) != (mp_p->peer_name == NULL)
+		  || (ppp_p->peername != NULL
+		   && strcmp( ppp_p->peername, mp_p->peer_name ) != 0) ) {
+			mp_log( ppp_p, "Multilink peer differs from bundle's" );
+			return -1;
+		}
+	} else {
+		mp_p->peer_class = class;
+		mp_p->peer_len = len;
+		memcpy( mp_p->peer_discr, remote_p->discr, len );
+		free( mp_p->peer_name );
+		mp_p->peer_name = (ppp_p->peername != NULL)
+			? strdup( ppp_p->peername ) : NULL;
+
+		mp_p->ppp_p->iface->mtu = min(mp_p->mtu, remote_p->mrru);
+		mp_p->txseq = 0;
+		mp_p->rxsync = FALSE;
+		mp_flush( mp_p );
+	}
+
+	lp->joined = TRUE;
+	lp->seen = FALSE;
+	lp->load = 0;
+	mp_log( ppp_p, "Joined bundle" );
+
+	if ( jp == NULL )
+		ppp_ready( mp_p->ppp_p );
+	return 0;
+}
+
+
+/* A link has gone down, or is renegotiating */
+void
+mp_leave(ppp_p)
+struct ppp_s *ppp_p;
+{
+	struct mp_link *lp = ppp_p->mpl;
+	struct mp_s *mp_p;
+	struct ppp_s *bundle_p;
+	struct mp_link *jp;
+
+	if ( lp == NULL || !lp->joined )
+		return;
+	lp->joined = FALSE;
+	mp_log( ppp_p, "Left bundle" );
+
+	mp_p = lp->mp_p;
+	bundle_p = mp_p->ppp_p;
+	for ( jp = mp_p->links; jp != NULL; jp = jp->next ) {
+		if ( jp->joined )
+			break;
+	}
+	if ( jp != NULL ) {
+		/* Its fragments may have been all we were waiting for */
+		mp_reassemble( mp_p );
+		return;
+	}
+
+	/* Last one out takes the bundle down */
+	fsm_down( &(bundle_p->fsm[IPcp]) );
+	fsm_down( &(bundle_p->fsm[Ccp]) );
+	bundle_p->phase = pppDEAD;
+	mp_flush( mp_p );
+	free( mp_p->peer_name );
+	mp_p->peer_name = NULL;
+}
+
+
+/* Take a link out of its bundle for good */
+void
+mp_unlink(ppp_p)
+struct ppp_s *ppp_p;
+{
+	struct mp_link *lp = ppp_p->mpl;
+	struct mp_link **lpp;
+	struct lcp_s *lcp_p = ppp_p->fsm[Lcp].pdv;
+
+	if ( lp == NULL )
+		return;
+	mp_leave( ppp_p );
+
+	for ( lpp = &(lp->mp_p->links); *lpp != lp; lpp = &((*lpp)->next) )
+		;
+	*lpp = lp->next;
+	ppp_p->mpl = NULL;
+	free( lp );
+
+	if ( lcp_p != NULL ) {
+		lcp_p->local.want.negotiate &= ~(LCP_N_MRRU | LCP_N_DISCR);
+		lcp_p->local.will_negotiate &= ~(LCP_N_MRRU | LCP_N_DISCR);
+		lcp_p->remote.will_negotiate &= ~(LCP_N_MRRU | LCP_N_DISCR);
+	}
+}
+
+
+/****************************************************************************/
+/*			T R A N S M I T					*/
+/****************************************************************************/
+
+/* Send a packet on the bundle (called through iface raw vector) */
+static int
+mp_raw(ifp, bpp)
+struct iface *ifp;
+struct mbuf **bpp;
+{
+	struct ppp_s *ppp_p = ifp->edv;
+	struct mp_s *mp_p = ppp_p->mp;
+	struct mp_link *lp;
+	struct mp_link *best = NULL;
+	struct mbuf *bp;
+	int32 total = 0;
+	int32 share;
+	int links = 0;
+	uint len, left, cap;
+	byte_t flags = MP_B;
+
+	dump(ifp,IF_TRACE_OUT,*bpp);
+	ifp->rawsndcnt++;
+	ifp->lastsent = secclock();
+
+	/* The links put on their own address and control fields */
+	if ( pullup(bpp, NULL, 2) != 2 ) {
+		free_p(bpp);
+		ppp_p->OutError++;
+		return -1;
+	}
+	len = len_p(*bpp);
+	ppp_p->OutTxOctetCount += len;
+
+	for ( lp = mp_p->links; lp != NULL; lp = lp->next ) {
+		if ( !lp->joined )
+			continue;
+		total += mp_speed(lp);
+		links++;
+		if ( best == NULL || lp->load < best->load )
+			best = lp;
+	}
+	if ( best == NULL ) {
+		mp_log( ppp_p, "no links up" );
+		free_p(bpp);
+		ppp_p->OutError++;
+		return -1;
+	}
+	mp_p->OutPackets++;
+
+	/* Keep the backlogs from growing without limit */
+	share = best->load;
+	for ( lp = mp_p->links; lp != NULL; lp = lp->next ) {
+		if ( lp->joined )
+			lp->load -= share;
+	}
+
+	/* Too small to be worth splitting, or nowhere to split it to:
+	 * send it whole on the link that will get through it first
+	 */
+	if ( (len < 2 * mp_p->minfrag || links == 1)
+	  && len + MP_HDR_LEN <= best->ppp_p->iface->mtu ) {
+		mp_sendfrag( mp_p, best, MP_B | MP_E, bpp );
+		return 0;
+	}
+
+	/* Otherwise give each link a piece in proportion to its speed,
+	 * going round again if the links' MTUs don't let that finish it
+	 */
+	mp_p->OutSplit++;
+	left = len;
+	while ( left != 0 ) {
+		for ( lp = mp_p->links; lp != NULL && left != 0; lp = lp->next ) {
+			if ( !lp->joined )
+				continue;
+			cap = lp->ppp_p->iface->mtu - MP_HDR_LEN;
+			share = (int32)len * (mp_speed(lp) / ((total >> 10) + 1))
+				>> 10;
+			if ( share < mp_p->minfrag )
+				share = mp_p->minfrag;
+			if ( share == 0 )
+				share = 1;
+			if ( share > cap )
+				share = cap;
+			if ( left <= share
+			  || (left - share < mp_p->minfrag && left <= cap) )
+				share = left;
+
+			if ( share == left ) {
+				bp = *bpp;
+				*bpp = NULL;
+				flags |= MP_E;
+			} else if ( dup_p(&bp, *bpp, 0, (uint)share) != share ) {
+				free_p(&bp);
+				free_p(bpp);
+				ppp_p->OutMemory++;
+				return -1;
+			} else {
+				pullup(bpp, NULL, (uint)share);
+			}
+			left -= share;
+			mp_sendfrag( mp_p, lp, flags, &bp );
+			flags = 0;
+		}
+	}
+	return 0;
+}
+
+
+/* Put a Multilink header on a fragment and send it down a link */
+static void
+mp_sendfrag(mp_p, lp, flags, bpp)
+struct mp_s *mp_p;
+struct mp_link *lp;
+byte_t flags;
+struct mbuf **bpp;
+{
+	struct iface *ifp = lp->ppp_p->iface;
+
+	/* Backlog in bytes per kbit/s, so faster links take more */
+	lp->load += ((int32)len_p(*bpp) << 10) / (mp_speed(lp) / 1000 + 1);
+
+	pushdown(bpp, NULL, MP_HDR_LEN);
+	put32((*bpp)->data, ((int32)flags << 24) | mp_p->txseq);
+	mp_p->txseq = (mp_p->txseq + 1) & MP_SEQ_MASK;
+	lp->OutFrags++;
+
+	(*ifp->output)(ifp, NULL, NULL, PPP_MP_PROTOCOL, bpp);
+}
+
+
+/****************************************************************************/
+/*			R E C E I V E					*/
+/****************************************************************************/
+
+/* Packet on a link that has joined a bundle (called from ppp_proc) */
+void
+mp_input(ppp_p, protocol, bpp)
+struct ppp_s *ppp_p;
+uint protocol;
+struct mbuf **bpp;
+{
+	struct mp_link *lp = ppp_p->mpl;
+	struct mp_s *mp_p = lp->mp_p;
+	struct mp_frag *fp, **fpp;
+	int32 hdr;
+
+	if ( protocol != PPP_MP_PROTOCOL ) {
+		/* Unfragmented, but the bundle's all the same */
+		mp_deliver( mp_p, protocol, bpp );
+		return;
+	}
+	if ( len_p(*bpp) <= MP_HDR_LEN ) {
+		free_p(bpp);
+		mp_p->InError++;
+		return;
+	}
+	hdr = pull32(bpp);
+	lp->InFrags++;
+	lp->lastseq = hdr & MP_SEQ_MASK;
+	lp->seen = TRUE;
+
+	if ( (fp = malloc(sizeof(struct mp_frag))) == NULL ) {
+		free_p(bpp);
+		mp_p->ppp_p->InMemory++;
+		return;
+	}
+	fp->seq = hdr & MP_SEQ_MASK;
+	fp->flags = (hdr >> 24) & (MP_B | MP_E);
+	fp->bp = *bpp;
+	*bpp = NULL;
+
+	/* Anything we've gone past is no use now */
+	if ( mp_p->rxsync && mp_seqdiff(fp->seq, mp_p->rxseq) < 0 ) {
+		mp_p->InDup++;
+		free_p(&fp->bp);
+		free(fp);
+		return;
+	}
+
+	/* Keep the queue in sequence order */
+	for ( fpp = &(mp_p->rxq);
+	      *fpp != NULL && mp_seqdiff((*fpp)->seq, fp->seq) < 0;
+	      fpp = &((*fpp)->next) )
+		;
+	if ( *fpp != NULL && (*fpp)->seq == fp->seq ) {
+		mp_p->InDup++;
+		free_p(&fp->bp);
+		free(fp);
+		return;
+	}
+	fp->next = *fpp;
+	*fpp = fp;
+	mp_p->rxqlen++;
+
+	mp_reassemble( mp_p );
+}
+
+
+/* Pass on whatever packets are complete, and give up on those that
+ * can't be
+ */
+static void
+mp_reassemble(mp_p)
+struct mp_s *mp_p;
+{
+	struct mp_link *lp;
+	struct mp_frag *fp, *last;
+	struct mbuf *bp;
+	int32 m = 0;
+	int have_m = FALSE;
+	int force;
+	int done;
+	uint len;
+
+	/* M: the oldest of the newest sequence numbers on each link */
+	for ( lp = mp_p->links; lp != NULL; lp = lp->next ) {
+		if ( !lp->joined )
+			continue;
+		if ( !lp->seen ) {
+			have_m = FALSE;
+			break;
+		}
+		if ( !have_m || mp_seqdiff(lp->lastseq, m) < 0 )
+			m = lp->lastseq;
+		have_m = TRUE;
+	}
+
+#define MP_GONE(seq)	(force || (have_m && mp_seqdiff((seq), m) < 0))
+
+	while ( (fp = mp_p->rxq) != NULL ) {
+		/* If we're holding too much, don't wait any longer */
+		force = mp_p->rxqlen > MP_RXQ_MAX;
+
+		if ( !mp_p->rxsync ) {
+			if ( !(fp->flags & MP_B) && !MP_GONE(fp->seq) )
+				break;
+			mp_p->rxseq = fp->seq;
+			mp_p->rxsync = TRUE;
+		}
+
+		if ( fp->seq != mp_p->rxseq ) {
+			if ( !MP_GONE(mp_p->rxseq) )
+				break;
+			/* The next one isn't coming */
+			mp_p->InLost++;
+			mp_p->rxseq = fp->seq;
+		}
+
+		if ( !(fp->flags & MP_B) ) {
+			/* The rest of a packet whose start was lost */
+			mp_p->InLost++;
+			mp_toss( mp_p, fp );
+			continue;
+		}
+
+		/* Look for the end of this packet */
+		len = len_p(fp->bp);
+		for ( last = fp; !(last->flags & MP_E); last = last->next ) {
+			if ( last->next == NULL
+			  || last->next->seq != ((last->seq + 1) & MP_SEQ_MASK)
+			  || (last->next->flags & MP_B) )
+				break;
+			len += len_p(last->next->bp);
+		}
+
+		if ( !(last->flags & MP_E) ) {
+			/* Stop here unless the next packet has started
+			 * or the rest of this one isn't coming
+			 */
+			if ( (last->next == NULL
+			   || last->next->seq != ((last->seq + 1) & MP_SEQ_MASK))
+			  && !MP_GONE((last->seq + 1) & MP_SEQ_MASK) )
+				break;
+			mp_p->InLost++;
+			mp_toss( mp_p, last );
+			continue;
+		}
+
+		if ( len > mp_p->mrru ) {
+			mp_p->InError++;
+			mp_toss( mp_p, last );
+			continue;
+		}
+
+		/* Take it off the queue in one piece */
+		bp = NULL;
+		mp_p->rxseq = (last->seq + 1) & MP_SEQ_MASK;
+		do {
+			fp = mp_p->rxq;
+			mp_p->rxq = fp->next;
+			done = (fp == last);
+			append(&bp, &(fp->bp));
+			free( fp );
+			mp_p->rxqlen--;
+		} while ( !done );
+
+		mp_p->InPackets++;
+		mp_deliver( mp_p, PPP_MP_PROTOCOL, &bp );
+	}
+#undef MP_GONE
+}
+
+
+/* Throw away the fragments at the head of the queue, up to last */
+static void
+mp_toss(mp_p, last)
+struct mp_s *mp_p;
+struct mp_frag *last;
+{
+	struct mp_frag *fp;
+	int done;
+
+	mp_p->rxseq = (last->seq + 1) & MP_SEQ_MASK;
+	do {
+		fp = mp_p->rxq;
+		mp_p->rxq = fp->next;
+		done = (fp == last);
+		free_p(&(fp->bp));
+		free( fp );
+		mp_p->rxqlen--;
+	} while ( !done );
+}
+
+
+/* Hand a packet to the bundle, as though it had come in on a line of
+ * its own. A reassembled packet still has its protocol field, which may
+ * be compressed; put back the full one.
+ */
+static void
+mp_deliver(mp_p, protocol, bpp)
+struct mp_s *mp_p;
+uint protocol;
+struct mbuf **bpp;
+{
+	struct ppp_s *ppp_p = mp_p->ppp_p;
+	uint8 *cp;
+
+	if ( protocol == PPP_MP_PROTOCOL ) {
+		if ( len_p(*bpp) < 2 ) {
+			free_p(bpp);
+			mp_p->InError++;
+			return;
+		}
+		protocol = pullchar(bpp);
+		if ( !(protocol & 0x01) )
+			protocol = (protocol << 8) | pullchar(bpp);
+	}
+
+	pushdown(bpp, NULL, PPP_HDR_LEN);
+	cp = (*bpp)->data;
+	*cp++ = HDLC_ALL_ADDR;
+	*cp++ = HDLC_UI;
+	put16(cp, protocol);
+	net_route(ppp_p->iface, bpp);
+}
+
+
+/* Throw away everything awaiting reassembly */
+static void
+mp_flush(mp_p)
+struct mp_s *mp_p;
+{
+	struct mp_frag *fp;
+
+	while ( (fp = mp_p->rxq) != NULL ) {
+		mp_p->rxq = fp->next;
+		free_p(&fp->bp);
+		free(fp);
+	}
+	mp_p->rxqlen = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef _KA9Q_NET_PPPMP_H
+#define _KA9Q_NET_PPPMP_H
+
+/* Multilink PPP (RFC 1990).
+ * A bundle is an interface of its own that runs the network control
+ * protocols and carries the datagrams; its member links run only LCP
+ * and authentication, and carry the bundle's packets in fragments.
+ * Only the long (24-bit) sequence number format is used.
+ */
+
+/* Fragment header */
+#define MP_B		0x80	/* Beginning fragment */
+#define MP_E		0x40	/* Ending fragment */
+#define MP_HDR_LEN	4	/* Flags and sequence number */
+#define MP_SEQ_MASK	0x00ffffffL
+
+#define MP_MINFRAG	64	/* Don't split packets into less than this */
+#define MP_RXQ_MAX	64	/* Fragments held awaiting reassembly */
+#define MP_SPEED_DEF	9600L	/* Assumed speed of an unknown link */
+
+/* Fragment awaiting reassembly */
+struct mp_frag {
+	struct mp_frag *next;
+	int32 seq;
+	byte_t flags;		/* MP_B, MP_E */
+	struct mbuf *bp;	/* data, without the header */
+};
+
+/* Member link of a bundle */
+struct mp_link {
+	struct mp_link *next;
+	struct mp_s *mp_p;		/* bundle we belong to */
+	struct ppp_s *ppp_p;		/* the link itself */
+
+	int joined;			/* carrying bundle traffic */
+	int32 speed;			/* bits/sec, 0 to ask the device */
+	int32 load;			/* transmit backlog, scaled by speed */
+	int seen;			/* lastseq is valid */
+	int32 lastseq;			/* last sequence number received */
+
+	uint OutFrags;			/* # fragments sent */
+	uint InFrags;			/* # fragments received */
+};
+
+/* Bundle control block */
+struct mp_s {
+	struct ppp_s *ppp_p;		/* the bundle's own */
+	struct mp_link *links;		/* member links */
+
+	uint mtu;			/* MTU given at attach */
+	uint mrru;			/* largest packet we reassemble */
+	uint minfrag;			/* smallest fragment we send */
+	byte_t discr[4];		/* our Endpoint Discriminator */
+
+	/* Identity of the peer, taken from the first link to join */
+	byte_t peer_class;
+	byte_t peer_len;
+	uint8 peer_discr[LCP_DISCR_MAX];
+	char *peer_name;
+
+	int32 txseq;			/* next sequence number to send */
+	int32 rxseq;			/* next sequence number expected */
+	int rxsync;			/* rxseq is valid */
+	struct mp_frag *rxq;		/* awaiting reassembly, in order */
+	uint rxqlen;
+
+	uint OutPackets;		/* # packets sent */
+	uint OutSplit;			/* # of them fragmented */
+	uint InPackets;		/* # packets reassembled */
+	uint InLost;			/* # times we gave up waiting */
+	uint InDup;			/* # duplicate fragments */
+	uint InError;			/* # oversize and bad packets */
+};
+
+int doppp_multilink(int argc, char *argv[], void *p);
+
+int mp_join(struct ppp_s *ppp_p);
+void mp_leave(struct ppp_s *ppp_p);
+void mp_input(struct ppp_s *ppp_p, uint protocol, struct mbuf **bpp);
+void mp_unlink(struct ppp_s *ppp_p);
+
+#endif /* _KA9Q_NET_PPPMP_H */
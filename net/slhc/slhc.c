@@ -49,44 +49,58 @@
 
 static uint8 *encode(uint8 *cp,uint n);
 static long decode(struct mbuf **bpp);
-
+static uint8 *encode_ts(uint8 *cp,uint32 n);
+static int32 decode_ts(struct mbuf **bpp);
+static uint8 *slhc_hdr(struct mbuf **bpp,uint len);
+static byte_t find_tstamp(uint8 *hdr,uint ihl,uint hlen);
+static uint slhc_hash(uint8 *ip,uint8 *th);
+static void lru_touch(struct slcompress *comp,struct cstate *cs);
+static int slhc_pct(int32 part,int32 whole);
+
+#define	TH_FIN	0x01		/* TCP flags, as found in the header */
+#define	TH_SYN	0x02
+#define	TH_RST	0x04
+#define	TH_PSH	0x08
+#define	TH_ACK	0x10
+#define	TH_URG	0x20
 
 /* Initialize compression data structure
- *	slots must be in range 0 to 255 (zero meaning no compression)
+ *	slots must be in range 0 to 256 (zero meaning no compression)
  */
 struct slcompress *
 slhc_init(rslots,tslots)
 int rslots;
 int tslots;
 {
-	uint i;
+	int i;
 	struct cstate *ts;
 	struct slcompress *comp;
 
 	comp = callocw( 1, sizeof(struct slcompress) );
 
-	if ( rslots > 0  &&  rslots < 256 ) {
+	if ( rslots > 0  &&  rslots <= SLHC_MAXSLOTS ) {
 		comp->rstate = callocw( rslots, sizeof(struct cstate) );
 		comp->rslot_limit = rslots - 1;
 	}
 
-	if ( tslots > 0  &&  tslots < 256 ) {
+	if ( tslots > 0  &&  tslots <= SLHC_MAXSLOTS ) {
 		comp->tstate = callocw( tslots, sizeof(struct cstate) );
 		comp->tslot_limit = tslots - 1;
 	}
 
-	comp->xmit_oldest = 0;
-	comp->xmit_current = 255;
-	comp->recv_current = 255;
+	comp->xmit_current = -1;
+	comp->recv_current = -1;
+	comp->flags = SLF_TOSS;		/* until the first id arrives */
 
-	if ( tslots > 0 ) {
+	if ( comp->tstate != NULL ) {
+		/* Start the lru ring in slot order */
 		ts = comp->tstate;
-		for(i = comp->tslot_limit; i > 0; --i){
+		for(i = 0; i <= comp->tslot_limit; i++){
 			ts[i].this = i;
-			ts[i].next = &(ts[i - 1]);
+			ts[i].next = &ts[i == comp->tslot_limit ? 0 : i + 1];
+			ts[i].prev = &ts[i == 0 ? comp->tslot_limit : i - 1];
 		}
-		ts[0].next = &(ts[comp->tslot_limit]);
-		ts[0].this = 0;
+		comp->xmit_newest = &ts[0];
 	}
 	return comp;
 }
@@ -140,135 +154,262 @@ struct mbuf **bpp;
 	}
 }
 
+/* Encode a timestamp change, n <= TS_DELTA_MAX */
+static uint8 *
+encode_ts(cp,n)
+uint8 *cp;
+uint32 n;
+{
+	if(n < 0x80){
+		*cp++ = n;
+	} else if(n < 0x4000){
+		*cp++ = 0x80 | (n >> 8);
+		*cp++ = n;
+	} else {
+		*cp++ = 0xc0 | (n >> 24);
+		*cp++ = n >> 16;
+		*cp++ = n >> 8;
+		*cp++ = n;
+	}
+	return cp;
+}
+
+/* Decode a timestamp change; -1 on error */
+static int32
+decode_ts(bpp)
+struct mbuf **bpp;
+{
+	int32 n;
+	int c, cnt;
+
+	if((c = PULLCHAR(bpp)) == -1)
+		return -1;
+	if((c & 0x80) == 0)
+		return c;
+	if((c & 0xc0) == 0x80){
+		n = c & 0x3f;
+		cnt = 1;
+	} else if((c & 0xe0) == 0xc0){
+		n = c & 0x1f;
+		cnt = 3;
+	} else
+		return -1;
+	while(cnt-- != 0){
+		if((c = PULLCHAR(bpp)) == -1)
+			return -1;
+		n = (n << 8) | c;
+	}
+	return n;
+}
+
+/* Make the first len bytes of a packet contiguous so the headers can
+ * be looked at where they lie; they almost always are already.
+ * The caller must make sure the packet is long enough.
+ */
+static uint8 *
+slhc_hdr(bpp,len)
+struct mbuf **bpp;
+uint len;
+{
+	uint8 buf[SLHC_MAXHDR];
+
+	if((*bpp)->cnt < len){
+		pullup(bpp,buf,len);
+		pushdown(bpp,buf,len);
+	}
+	return (*bpp)->data;
+}
+
+/* Find the timestamp option in a saved header.
+ * Returns the offset of TSval within the header, or 0 if there is none.
+ */
+static byte_t
+find_tstamp(hdr,ihl,hlen)
+uint8 *hdr;
+uint ihl;
+uint hlen;
+{
+	uint i, len;
+
+	for(i = ihl + TCPLEN; i < hlen; i += len){
+		switch(hdr[i]){
+		case EOL_KIND:
+			return 0;
+		case NOOP_KIND:
+			len = 1;
+			continue;
+		}
+		if(i + 1 >= hlen || (len = hdr[i+1]) < 2 || i + len > hlen)
+			return 0;
+		if(hdr[i] == TSTAMP_KIND && len == TSTAMP_LENGTH)
+			return i + 2;
+	}
+	return 0;
+}
+
+/* Hash a conversation's addresses and ports */
+static uint
+slhc_hash(ip,th)
+uint8 *ip;
+uint8 *th;
+{
+	uint32 h, p;
+
+	h = get32(&ip[12]) ^ get32(&ip[16]);
+	p = get32(th);
+	h = (h ^ (h >> 16)) * 31 + (p ^ (p >> 16));
+	h ^= h >> 8;
+	return h & (SLHC_HASH-1);
+}
+
+/* Make a transmit state the most recently used */
+static void
+lru_touch(comp,cs)
+struct slcompress *comp;
+struct cstate *cs;
+{
+	struct cstate *newest = comp->xmit_newest;
+
+	if(cs == newest)
+		return;
+	if(cs != newest->prev){
+		/* Take it out of the ring and put it back in front */
+		cs->prev->next = cs->next;
+		cs->next->prev = cs->prev;
+		cs->next = newest;
+		cs->prev = newest->prev;
+		newest->prev->next = cs;
+		newest->prev = cs;
+	}
+	/* The ring is circular; the oldest is just behind the newest */
+	comp->xmit_newest = cs;
+}
+
 int
 slhc_compress(comp, bpp, compress_cid)
 struct slcompress *comp;
 struct mbuf **bpp;
 int compress_cid;
 {
-	struct cstate *ocs = &(comp->tstate[comp->xmit_oldest]);
-	struct cstate *lcs = ocs;
-	struct cstate *cs = lcs->next;
-	uint hlen,iplen;
-	struct tcp *oth;
-	unsigned long deltaS, deltaA;
+	struct cstate *cs, **csp;
+	uint ihl, hlen, thlen, plen, olen, tsoff, h;
+	uint8 *ip, *th, *oip, *oth;
+	uint32 deltaS, deltaA, tsv, tse;
 	uint changes = 0;
-	uint8 new_seq[16];
+	uint8 new_seq[32];
 	uint8 *cp = new_seq;
-	struct tcp th;
-	struct ip iph;
-	struct mbuf *copy;
+	uint16 csum;
 
-	/* Copy TCP/IP header, allowing for worst-case options in both
-	 * Using dup_p seemed to result in unexplained
-	 * memory leaks -- but only some of the time. Must find out why.
+	/* Look at the headers in place. Bail if this packet isn't TCP,
+	 * or is an IP fragment, or is too short to be real.
 	 */
-/*	dup_p(&copy,*bpp,0,IPLEN+IP_MAXOPT+TCPLEN+TCP_MAXOPT); */
-	copy = copy_p(*bpp,IPLEN+IP_MAXOPT+TCPLEN+TCP_MAXOPT);
-
-	/* Peek at IP header */
-	iplen = hlen = ntohip(&iph,&copy);
-
-	/* Bail if this packet isn't TCP, or is an IP fragment */
-	if(iph.protocol != TCP_PTCL || iph.offset != 0 || iph.flags.mf){
+	plen = len_p(*bpp);
+	if(plen < IPLEN || comp->tstate == NULL){
+		comp->sls_o_nontcp++;
+		return SL_TYPE_IP;
+	}
+	ip = slhc_hdr(bpp,IPLEN);
+	ihl = (ip[0] & 0xf) << 2;
+	if((ip[0] >> 4) != IPVERSION || ihl < IPLEN || ip[9] != TCP_PTCL){
+		comp->sls_o_nontcp++;
+		return SL_TYPE_IP;
+	}
+	if((get16(&ip[6]) & 0x3fff) != 0 || plen < ihl + TCPLEN){
 		/* Send as regular IP */
-		if(iph.protocol != TCP_PTCL)
-			comp->sls_o_nontcp++;
-		else
-			comp->sls_o_tcp++;
-		free_p(&copy);
+		comp->sls_o_tcp++;
 		return SL_TYPE_IP;
 	}
-	/* Extract TCP header */
-	hlen += ntohtcp(&th,&copy);
-	free_p(&copy);	/* Done with copy */
+	ip = slhc_hdr(bpp,ihl + TCPLEN);
+	thlen = (ip[ihl+12] >> 4) << 2;
+	hlen = ihl + thlen;
+	if(thlen < TCPLEN || hlen > plen || hlen > SLHC_MAXHDR){
+		comp->sls_o_tcp++;
+		return SL_TYPE_IP;
+	}
+	ip = slhc_hdr(bpp,hlen);
+	th = &ip[ihl];
 
 	/*  Bail if the TCP packet isn't `compressible' (i.e., ACK isn't set or
-	 *  some other control bit is set, or has options).
+	 *  some other control bit is set).  Options are fine as long as they
+	 *  don't change; see below.
 	 */
-	if(th.flags.syn || th.flags.fin || th.flags.rst || !th.flags.ack
-	 || th.flags.mss || th.flags.wscale || th.flags.tstamp){
+	if((th[13] & (TH_SYN|TH_FIN|TH_RST|TH_ACK)) != TH_ACK){
 		/* TCP connection stuff; send as regular IP */
 		comp->sls_o_tcp++;
 		return SL_TYPE_IP;
 	}
+	comp->sls_o_octets += plen;
 	/*
 	 * Packet is compressible -- we're going to send either a
 	 * COMPRESSED_TCP or UNCOMPRESSED_TCP packet.  Either way,
 	 * we need to locate (or create) the connection state.
 	 *
-	 * States are kept in a circularly linked list with
-	 * xmit_oldest pointing to the end of the list.  The
-	 * list is kept in lru order by moving a state to the
-	 * head of the list whenever it is referenced.  Since
-	 * the list is short and, empirically, the connection
-	 * we want is almost always near the front, we locate
-	 * states via linear search.  If we don't find a state
-	 * for the datagram, the oldest state is (re-)used.
+	 * States are found through a hash on the addresses and ports,
+	 * so the cost doesn't grow with the number of slots.  They are
+	 * also kept in a circular lru ring with xmit_newest at the head;
+	 * if we don't find a state for the datagram, the oldest state
+	 * (the one just behind the head) is (re-)used.
 	 */
-	for ( ; ; ) {
-		if( iph.source == cs->cs_ip.source
-		 && iph.dest == cs->cs_ip.dest
-		 && th.source == cs->cs_tcp.source
-		 && th.dest == cs->cs_tcp.dest)
-			goto found;
-
-		/* if current equal oldest, at end of list */
-		if ( cs == ocs )
+	h = slhc_hash(ip,th);
+	for(cs = comp->thash[h]; cs != NULL; cs = cs->hnext){
+		oip = cs->hdr;
+		if(memcmp(&ip[12],&oip[12],8) == 0
+		 && memcmp(th,&oip[(oip[0] & 0xf) << 2],4) == 0)
 			break;
-		lcs = cs;
-		cs = cs->next;
 		comp->sls_o_searches++;
-	};
-	/*
-	 * Didn't find it -- re-use oldest cstate.  Send an
-	 * uncompressed packet that tells the other side what
-	 * connection number we're using for this conversation.
-	 *
-	 * Note that since the state list is circular, the oldest
-	 * state points to the newest and we only need to set
-	 * xmit_oldest to update the lru linkage.
-	 */
-	comp->sls_o_misses++;
-	comp->xmit_oldest = lcs->this;
-
-	goto uncompressed;
-
-found:
-	/*
-	 * Found it -- move to the front on the connection list.
-	 */
-	if(lcs == ocs) {
-		/* found at most recently used */
-	} else if (cs == ocs) {
-		/* found at least recently used */
-		comp->xmit_oldest = lcs->this;
-	} else {
-		/* more than 2 elements */
-		lcs->next = cs->next;
-		cs->next = ocs->next;
-		ocs->next = cs;
 	}
+	if(cs == NULL){
+		/*
+		 * Didn't find it -- re-use oldest cstate.  Send an
+		 * uncompressed packet that tells the other side what
+		 * connection number we're using for this conversation.
+		 */
+		comp->sls_o_misses++;
+		cs = comp->xmit_newest->prev;
+		if(cs->hlen != 0){
+			/* Take it off its old hash chain */
+			for(csp = &comp->thash[cs->hash]; *csp != cs;
+			 csp = &(*csp)->hnext)
+				;
+			*csp = cs->hnext;
+		}
+		cs->hash = h;
+		cs->hnext = comp->thash[h];
+		comp->thash[h] = cs;
+		cs->hlen = 0;
+		lru_touch(comp,cs);
+		goto uncompressed;
+	}
+	lru_touch(comp,cs);
 
 	/*
 	 * Make sure that only what we expect to change changed.
 	 * Check the following:
 	 * IP protocol version, header length & type of service.
-	 * The "Don't fragment" bit.
+	 * The fragment bits.
 	 * The time-to-live field.
-	 * The TCP header length.
+	 * The TCP header length and flags other than PUSH and URG.
 	 * IP options, if any.
-	 * TCP options, if any.
+	 * TCP options, if any, except for timestamp values when we're
+	 * sending their changes.
 	 * If any of these things are different between the previous &
 	 * current datagram, we send the current datagram `uncompressed'.
 	 */
-	oth = &cs->cs_tcp;
-
-	if(iph.version != cs->cs_ip.version || iph.optlen != cs->cs_ip.optlen
-	 || iph.tos != cs->cs_ip.tos
-	 || iph.flags.df != cs->cs_ip.flags.df
-	 || iph.ttl != cs->cs_ip.ttl
-	 || (iph.optlen > 0 && memcmp(iph.options,cs->cs_ip.options,iph.optlen) != 0)){
+	oip = cs->hdr;
+	oth = &oip[ihl];
+	tsoff = (comp->flags & SLF_TTSTAMP) ? cs->tsoff : 0;
+
+	if(hlen != cs->hlen || ip[0] != oip[0] || ip[1] != oip[1]
+	 || ip[6] != oip[6] || ip[8] != oip[8]
+	 || th[12] != oth[12]
+	 || (th[13] & ~(TH_PSH|TH_URG)) != (oth[13] & ~(TH_PSH|TH_URG))
+	 || memcmp(&ip[IPLEN],&oip[IPLEN],ihl - IPLEN) != 0)
+		goto uncompressed;
+	if(tsoff == 0){
+		if(memcmp(&th[TCPLEN],&oth[TCPLEN],thlen - TCPLEN) != 0)
+			goto uncompressed;
+	} else if(memcmp(&ip[ihl+TCPLEN],&oip[ihl+TCPLEN],tsoff-ihl-TCPLEN) != 0
+	 || memcmp(&ip[tsoff+8],&oip[tsoff+8],hlen - tsoff - 8) != 0){
 		goto uncompressed;
 	}
 	/*
@@ -277,33 +418,34 @@ found:
 	 * ack, seq (the order minimizes the number of temporaries
 	 * needed in this section of code).
 	 */
-	if(th.flags.urg){
-		deltaS = th.up;
+	if(th[13] & TH_URG){
+		deltaS = get16(&th[18]);
 		cp = encode(cp,deltaS);
 		changes |= NEW_U;
-	} else if(th.up != oth->up){
+	} else if(get16(&th[18]) != get16(&oth[18])){
 		/* argh! URG not set but urp changed -- a sensible
 		 * implementation should never do this but RFC793
 		 * doesn't prohibit the change so we have to deal
 		 * with it. */
 		goto uncompressed;
 	}
-	if((deltaS = th.wnd - oth->wnd) != 0){
+	if((deltaS = (uint16)(get16(&th[14]) - get16(&oth[14]))) != 0){
 		cp = encode(cp,deltaS);
 		changes |= NEW_W;
 	}
-	if((deltaA = th.ack - oth->ack) != 0L){
+	if((deltaA = (uint32)get32(&th[8]) - (uint32)get32(&oth[8])) != 0){
 		if(deltaA > 0x0000ffff)
 			goto uncompressed;
 		cp = encode(cp,deltaA);
 		changes |= NEW_A;
 	}
-	if((deltaS = th.seq - oth->seq) != 0L){
+	if((deltaS = (uint32)get32(&th[4]) - (uint32)get32(&oth[4])) != 0){
 		if(deltaS > 0x0000ffff)
 			goto uncompressed;
 		cp = encode(cp,deltaS);
 		changes |= NEW_S;
 	}
+	olen = get16(&oip[2]);
 
 	switch(changes){
 	case 0:	/* Nothing changed. If this packet contains data and the
@@ -313,7 +455,7 @@ found:
 		 * retransmitted ack or window probe.  Send it uncompressed
 		 * in case the other side missed the compressed version.
 		 */
-		if(iph.length != cs->cs_ip.length && cs->cs_ip.length == hlen)
+		if(get16(&ip[2]) != olen && olen == hlen)
 			break;
 		goto uncompressed;
 	case SPECIAL_I:
@@ -322,35 +464,43 @@ found:
 		 * send packet uncompressed.
 		 */
 		goto uncompressed;
+	/* The special cases leave the urgent flag alone at the other end */
 	case NEW_S|NEW_A:
-		if(deltaS == deltaA &&
-		    deltaS == cs->cs_ip.length - hlen){
+		if(deltaS == deltaA && deltaS == olen - hlen
+		 && !(oth[13] & TH_URG)){
 			/* special case for echoed terminal traffic */
 			changes = SPECIAL_I;
 			cp = new_seq;
 		}
 		break;
 	case NEW_S:
-		if(deltaS == cs->cs_ip.length - hlen){
+		if(deltaS == olen - hlen && !(oth[13] & TH_URG)){
 			/* special case for data xfer */
 			changes = SPECIAL_D;
 			cp = new_seq;
 		}
 		break;
 	}
-	deltaS = iph.id - cs->cs_ip.id;
+	deltaS = (uint16)(get16(&ip[4]) - get16(&oip[4]));
 	if(deltaS != 1){
 		cp = encode(cp,deltaS);
 		changes |= NEW_I;
 	}
-	if(th.flags.psh)
+	if(tsoff != 0){
+		tsv = (uint32)get32(&ip[tsoff]) - (uint32)get32(&oip[tsoff]);
+		tse = (uint32)get32(&ip[tsoff+4]) - (uint32)get32(&oip[tsoff+4]);
+		if(tsv > TS_DELTA_MAX || tse > TS_DELTA_MAX)
+			goto uncompressed;
+		cp = encode_ts(cp,tsv);
+		cp = encode_ts(cp,tse);
+		comp->sls_o_tstamp++;
+	}
+	if(th[13] & TH_PSH)
 		changes |= TCP_PUSH_BIT;
-	/* Grab the cksum before we overwrite it below.  Then update our
-	 * state with this packet's header.
-	 */
-	deltaA = th.checksum;
-	ASSIGN(cs->cs_ip,iph);
-	ASSIGN(cs->cs_tcp,th);
+	/* Grab the cksum, then update our state with this packet's header */
+	csum = get16(&th[16]);
+	memcpy(cs->hdr,ip,hlen);
+
 	/* We want to use the original packet as our compressed packet.
 	 * (cp - new_seq) is the number of bytes we need for compressed
 	 * sequence numbers.  In addition we need one byte for the change
@@ -370,23 +520,27 @@ found:
 		cp = (*bpp)->data;
 		*cp++ = changes;
 	}
-	cp = put16(cp,deltaA);	/* Write TCP checksum */
+	cp = put16(cp,csum);	/* Write TCP checksum */
 	memcpy(cp,new_seq,deltaS);	/* Write list of deltas */
 	comp->sls_o_compressed++;
+	comp->sls_o_comp_octets += len_p(*bpp);
 	return SL_TYPE_COMPRESSED_TCP;
 
 	/* Update connection state cs & send uncompressed packet (i.e.,
 	 * a regular ip/tcp packet but with the 'conversation id' we hope
 	 * to use on future compressed packets in the protocol field).
+	 * The IP header checksum is left as it was, with TCP_PTCL.
 	 */
 uncompressed:
-	iph.protocol = cs->this;
-	ASSIGN(cs->cs_ip,iph);
-	ASSIGN(cs->cs_tcp,th);
+	memcpy(cs->hdr,ip,hlen);
+	cs->hlen = hlen;
+	cs->tsoff = find_tstamp(cs->hdr,ihl,hlen);
 	comp->xmit_current = cs->this;
 	comp->sls_o_uncompressed++;
-	pullup(bpp,NULL,iplen);	/* Strip old IP header */
-	htonip(&iph,bpp,IP_CS_OLD);	/* replace with new one */
+	comp->sls_o_comp_octets += plen;
+	pullup(bpp,NULL,ihl);		/* Strip old IP header */
+	pushdown(bpp,cs->hdr,ihl);	/* replace with new one */
+	(*bpp)->data[9] = cs->this;
 	return SL_TYPE_UNCOMPRESSED_TCP;
 }
 
@@ -398,8 +552,10 @@ struct mbuf **bpp;
 {
 	int changes;
 	long x;
-	struct tcp *thp;
+	int32 ts;
 	struct cstate *cs;
+	uint8 *hdr, *th;
+	uint ihl, i;
 	int len;
 
 	if(bpp == NULL){
@@ -408,17 +564,18 @@ struct mbuf **bpp;
 	}
 	/* We've got a compressed packet; read the change byte */
 	comp->sls_i_compressed++;
-	if(len_p(*bpp) < 3){
+	if((len = len_p(*bpp)) < 3){
 		comp->sls_i_error++;
 		return 0;
 	}
+	comp->sls_i_octets += len;
 	changes = PULLCHAR(bpp);	/* "Can't fail" */
 	if(changes & NEW_C){
 		/* Make sure the state index is in range, then grab the state.
 		 * If we have a good state index, clear the 'discard' flag.
 		 */
 		x = PULLCHAR(bpp);	/* Read conn index */
-		if(x < 0 || x > comp->rslot_limit)
+		if(x < 0 || x > comp->rslot_limit || comp->rstate[x].hlen == 0)
 			goto bad;
 
 		comp->flags &=~ SLF_TOSS;
@@ -433,71 +590,81 @@ struct mbuf **bpp;
 		}
 	}
 	cs = &comp->rstate[comp->recv_current];
-	thp = &cs->cs_tcp;
+	hdr = cs->hdr;
+	ihl = (hdr[0] & 0xf) << 2;
+	th = &hdr[ihl];
 
 	if((x = pull16(bpp)) == -1)	/* Read the TCP checksum */
 		goto bad;
-	thp->checksum = x;
+	put16(&th[16],x);
 
-	thp->flags.psh = (changes & TCP_PUSH_BIT) ? 1 : 0;
+	if(changes & TCP_PUSH_BIT)
+		th[13] |= TH_PSH;
+	else
+		th[13] &= ~TH_PSH;
 
 	switch(changes & SPECIALS_MASK){
 	case SPECIAL_I:		/* Echoed terminal traffic */
-		{
-		uint i;
-		i = cs->cs_ip.length;
-		i -= (cs->cs_ip.optlen + IPLEN + TCPLEN);
-		thp->ack += i;
-		thp->seq += i;
-		}
+		i = get16(&hdr[2]) - cs->hlen;
+		put32(&th[8],get32(&th[8]) + i);
+		put32(&th[4],get32(&th[4]) + i);
 		break;
 
 	case SPECIAL_D:			/* Unidirectional data */
-		thp->seq += cs->cs_ip.length - (cs->cs_ip.optlen +IPLEN + TCPLEN);
+		put32(&th[4],get32(&th[4]) + get16(&hdr[2]) - cs->hlen);
 		break;
 
 	default:
 		if(changes & NEW_U){
-			thp->flags.urg = 1;
+			th[13] |= TH_URG;
 			if((x = decode(bpp)) == -1)
 				goto bad;
-			thp->up = x;
+			put16(&th[18],x);
 		} else
-			thp->flags.urg = 0;
+			th[13] &= ~TH_URG;
 		if(changes & NEW_W){
 			if((x = decode(bpp)) == -1)
 				goto bad;
-			thp->wnd += x;
+			put16(&th[14],get16(&th[14]) + x);
 		}
 		if(changes & NEW_A){
 			if((x = decode(bpp)) == -1)
 				goto bad;
-			thp->ack += x;
+			put32(&th[8],get32(&th[8]) + x);
 		}
 		if(changes & NEW_S){
 			if((x = decode(bpp)) == -1)
 				goto bad;
-			thp->seq += x;
+			put32(&th[4],get32(&th[4]) + x);
 		}
 		break;
 	}
 	if(changes & NEW_I){
 		if((x = decode(bpp)) == -1)
 			goto bad;
-		cs->cs_ip.id += x;
+		put16(&hdr[4],get16(&hdr[4]) + x);
 	} else
-		cs->cs_ip.id++;
+		put16(&hdr[4],get16(&hdr[4]) + 1);
 
+	if((comp->flags & SLF_RTSTAMP) && cs->tsoff != 0){
+		if((ts = decode_ts(bpp)) == -1)
+			goto bad;
+		put32(&hdr[cs->tsoff],get32(&hdr[cs->tsoff]) + ts);
+		if((ts = decode_ts(bpp)) == -1)
+			goto bad;
+		put32(&hdr[cs->tsoff+4],get32(&hdr[cs->tsoff+4]) + ts);
+	}
 	/*
 	 * At this point, bpp points to the first byte of data in the
 	 * packet.  Put the reconstructed TCP and IP headers back on the
 	 * packet.  Recalculate IP checksum (but not TCP checksum).
 	 */
-	len = len_p(*bpp) + IPLEN + TCPLEN + cs->cs_ip.optlen;
-	cs->cs_ip.length = len;
-
-	htontcp(thp,bpp,0,0);
-	htonip(&cs->cs_ip,bpp,IP_CS_NEW);
+	len = len_p(*bpp) + cs->hlen;
+	put16(&hdr[2],len);
+	put16(&hdr[10],0);
+	pushdown(bpp,hdr,cs->hlen);
+	put16(&(*bpp)->data[10],cksum(NULL,*bpp,ihl));
+	comp->sls_i_uncomp_octets += len;
 	return len;
 bad:
 	comp->sls_i_error++;
@@ -511,63 +678,64 @@ struct slcompress *comp;
 struct mbuf **bpp;
 {
 	struct cstate *cs;
-	struct ip iph;
-	struct tcp th;
+	uint8 *ip;
 	uint len;
-	uint hdrlen;
+	uint ihl, hlen;
 	int slot;
 
-	if(bpp == NULL){
+	if(bpp == NULL || *bpp == NULL || comp->rstate == NULL){
 		comp->sls_i_error++;
 		return slhc_toss(comp);
 	}
+	len = len_p(*bpp);	/* Actual length of whole packet */
+	if(len < IPLEN + TCPLEN)
+		goto bad;
 
 	/* Sneak a peek at the IP header's IHL field to find its length */
-	hdrlen = ((*bpp)->data[0] & 0xf) << 2;
-	if(hdrlen < IPLEN){
+	ip = slhc_hdr(bpp,IPLEN);
+	ihl = (ip[0] & 0xf) << 2;
+	if(ihl < IPLEN || len < ihl + TCPLEN){
 		/* The IP header length field is too small to be valid */
-		comp->sls_i_error++;
-		return slhc_toss(comp);
+		goto bad;
 	}
-	len = len_p(*bpp);	/* Actual length of whole packet */
-	ntohip(&iph,bpp);	/* Extract IP header */
+	ip = slhc_hdr(bpp,ihl + TCPLEN);
+	hlen = ihl + (ip[ihl+12] >> 4) * 4;
 	/* Verify indicated length <= actual length */
-	if(iph.length > len){
+	if(hlen < ihl + TCPLEN || hlen > SLHC_MAXHDR || hlen > len
+	 || get16(&ip[2]) > len){
 		/* Packet has been truncated, or header is garbage */
-		comp->sls_i_error++;
-		return slhc_toss(comp);
+		goto bad;
 	}
+	ip = slhc_hdr(bpp,hlen);
+
 	/* Verify conn ID */
-	slot = iph.protocol;
+	slot = ip[9];
 	if(slot > comp->rslot_limit){
 		/* Out of range */
-		comp->sls_i_error++;
-		return slhc_toss(comp);
+		goto bad;
 	}
-	iph.protocol = TCP_PTCL;	/* Replace conn ID with TCP_PTCL */
-
-	/* Extract TCP header and replace both headers
-	 * Neither header checksum is recalculated
-	 */
-	ntohtcp(&th,bpp);
-	htontcp(&th,bpp,0,0);
-	htonip(&iph,bpp,IP_CS_OLD);
+	ip[9] = TCP_PTCL;	/* Replace conn ID with TCP_PTCL */
 
 	/* Checksum IP header (now that protocol field is TCP again) */
-	if(cksum(NULL,*bpp,hdrlen) != 0){
+	if(cksum(NULL,*bpp,ihl) != 0){
 		/* Bad IP header checksum; discard */
-		comp->sls_i_error++;
-		return slhc_toss(comp);
+		goto bad;
 	}
 	/* Update local state */
 	comp->recv_current = slot;
 	cs = &comp->rstate[slot];
 	comp->flags &=~ SLF_TOSS;
 
-	ASSIGN(cs->cs_ip,iph);
-	ASSIGN(cs->cs_tcp,th);
+	memcpy(cs->hdr,ip,hlen);
+	cs->hlen = hlen;
+	cs->tsoff = find_tstamp(cs->hdr,ihl,hlen);
 	comp->sls_i_uncompressed++;
+	comp->sls_i_octets += len;
+	comp->sls_i_uncomp_octets += len;
 	return len;
+bad:
+	comp->sls_i_error++;
+	return slhc_toss(comp);
 }
 
 
@@ -582,6 +750,21 @@ struct slcompress *comp;
 	return 0;
 }
 
+/* Percentage, without overflowing on large counts */
+static int
+slhc_pct(part,whole)
+int32 part;
+int32 whole;
+{
+	while(whole > 0x7fffffffL / 100){
+		part >>= 1;
+		whole >>= 1;
+	}
+	if(whole == 0)
+		return 0;
+	return (int)(part * 100 / whole);
+}
+
 void
 slhc_i_status(comp)
 struct slcompress *comp;
@@ -595,6 +778,11 @@ struct slcompress *comp;
 			comp->sls_i_uncompressed,
 			comp->sls_i_error,
 			comp->sls_i_tossed);
+		kprintf("\t%10ld Octets,"
+			" %10ld Expanded (%d%% of size)\n",
+			comp->sls_i_octets,
+			comp->sls_i_uncomp_octets,
+			slhc_pct(comp->sls_i_octets,comp->sls_i_uncomp_octets));
 	}
 }
 
@@ -613,10 +801,15 @@ struct slcompress *comp;
 			comp->sls_o_tcp,
 			comp->sls_o_nontcp);
 		kprintf("\t%10ld Searches,"
-			" %10ld Misses\n",
+			" %10ld Misses,"
+			" %10ld Tstamp\n",
 			comp->sls_o_searches,
-			comp->sls_o_misses);
+			comp->sls_o_misses,
+			comp->sls_o_tstamp);
+		kprintf("\t%10ld Octets,"
+			" %10ld Compressed (%d%% of size)\n",
+			comp->sls_o_octets,
+			comp->sls_o_comp_octets,
+			slhc_pct(comp->sls_o_comp_octets,comp->sls_o_octets));
 	}
 }
-
-
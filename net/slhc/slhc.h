@@ -116,17 +116,47 @@
  *	int		int32		long		32 bits
  */
 
+/*
+ * Timestamp extension (not part of RFC 1144).
+ *
+ * When both ends have agreed to it, a conversation whose saved
+ * header carries a TCP timestamp option (RFC 1323) may be compressed
+ * even though the option changes from packet to packet.  The changes
+ * in TSval and TSecr follow the IP ID field, each in a variable length
+ * code: 0xxxxxxx (0 - 127), 10xxxxxx xxxxxxxx (to 16383) or
+ * 110xxxxx followed by three octets (to 2^29 - 1).  A change that is
+ * negative or larger than that forces an uncompressed packet.  Nothing
+ * in a packet says whether the extension is in use, so it must never
+ * be enabled toward a peer that doesn't expect it.  PPP agrees on it
+ * in IPCP as a compression protocol of its own, PPP_VJTS_PROTOCOL,
+ * which is also the protocol number of such packets; SLIP never uses
+ * it.
+ */
+#define TS_DELTA_MAX	0x1fffffffL
+
+/* Largest saved header; anything bigger is sent as regular IP */
+#define SLHC_MAXHDR	(IPLEN+IP_MAXOPT+TCPLEN+TCP_MAXOPT)
+
+#define SLHC_MAXSLOTS	256	/* 8-bit conversation id */
+#define SLHC_HASH	64	/* transmit hash buckets (power of 2) */
+
 /*
  * "state" data for each active tcp conversation on the wire.  This is
- * basically a copy of the entire IP/TCP header from the last packet
- * we saw from the conversation together with a small identifier
+ * a copy of the entire IP/TCP header, options and all, from the last
+ * packet we saw from the conversation together with a small identifier
  * the transmit & receive ends of the line use to locate saved header.
+ * The header is kept in network byte order so it can be compared and
+ * restored without being converted.
  */
 struct cstate {
 	byte_t	this;		/* connection id number (xmit) */
-	struct cstate *next;	/* next in ring (xmit) */
-	struct ip cs_ip;	/* ip/tcp hdr from most recent packet */
-	struct tcp cs_tcp;
+	byte_t	hash;		/* hash bucket (xmit) */
+	byte_t	hlen;		/* length of saved header, 0 if none */
+	byte_t	tsoff;		/* offset of TSval in hdr, 0 if none */
+	struct cstate *hnext;	/* next in hash chain (xmit) */
+	struct cstate *next;	/* next older in lru ring (xmit) */
+	struct cstate *prev;	/* next newer in lru ring (xmit) */
+	uint8	hdr[SLHC_MAXHDR];	/* ip/tcp hdr from most recent packet */
 };
 
 /*
@@ -139,24 +169,32 @@ struct slcompress {
 	byte_t tslot_limit;	/* highest transmit slot id (0-l)*/
 	byte_t rslot_limit;	/* highest receive slot id (0-l)*/
 
-	byte_t xmit_oldest;	/* oldest xmit in ring */
-	byte_t xmit_current;	/* most recent xmit id */
-	byte_t recv_current;	/* most recent rcvd id */
+	struct cstate *xmit_newest;	/* head of lru ring */
+	struct cstate *thash[SLHC_HASH];	/* transmit states by address */
+	int xmit_current;	/* most recent xmit id, -1 if none */
+	int recv_current;	/* most recent rcvd id, -1 if none */
 
 	byte_t flags;
 #define SLF_TOSS	0x01	/* tossing rcvd frames until id received */
+#define SLF_TTSTAMP	0x02	/* send timestamp deltas */
+#define SLF_RTSTAMP	0x04	/* expect timestamp deltas */
 
 	int32 sls_o_nontcp;	/* outbound non-TCP packets */
 	int32 sls_o_tcp;	/* outbound TCP packets */
 	int32 sls_o_uncompressed;	/* outbound uncompressed packets */
 	int32 sls_o_compressed;	/* outbound compressed packets */
-	int32 sls_o_searches;	/* searches for connection state */
+	int32 sls_o_tstamp;	/* of them, with timestamp deltas */
+	int32 sls_o_searches;	/* hash chain entries passed over */
 	int32 sls_o_misses;	/* times couldn't find conn. state */
+	int32 sls_o_octets;	/* TCP octets given to the compressor */
+	int32 sls_o_comp_octets;	/* and sent after compression */
 
 	int32 sls_i_uncompressed;	/* inbound uncompressed packets */
 	int32 sls_i_compressed;	/* inbound compressed packets */
 	int32 sls_i_error;	/* inbound error packets */
 	int32 sls_i_tossed;	/* inbound packets tossed because of error */
+	int32 sls_i_octets;	/* TCP octets received */
+	int32 sls_i_uncomp_octets;	/* and after decompression */
 };
 
 /* In slhc.c: */
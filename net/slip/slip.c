@@ -20,8 +20,7 @@
 #include "net/slhc/slhc.h"
 #include "net/slip/slip.h"
 
-static struct mbuf *slip_decode(struct slip *sp,uint8 c);
-static struct mbuf *slip_encode(struct mbuf **bpp);
+static struct mbuf *slip_encode(struct slip *sp,struct mbuf **bpp);
 
 /* Slip level control structure */
 struct slip Slip[SLIP_MAX];
@@ -50,8 +49,9 @@ struct iface *ifp;
 
 	sp->iface = ifp;
 	sp->send = asy_send;
-	sp->get = get_asy;
+	sp->read = asy_read;
 	sp->type = CL_SERIAL_LINE;
+	fr_init(&sp->fr,FR_SLIP,SLIP_ALLOC,0);
 	if(ifp->send == vjslip_send){
 		sp->slcomp = slhc_init(16,16);
 	}
@@ -120,7 +120,7 @@ struct mbuf **bpp
 	dump(iface,IF_TRACE_OUT,*bpp);
 	iface->rawsndcnt++;
 	iface->lastsent = secclock();
-	if((bp1 = slip_encode(bpp)) == NULL){
+	if((bp1 = slip_encode(&Slip[iface->xdev],bpp)) == NULL){
 		return -1;
 	}
 	if (iface->trace & IF_TRACE_RAW)
@@ -129,16 +129,15 @@ struct mbuf **bpp
 }
 /* Encode a packet in SLIP format */
 static struct mbuf *
-slip_encode(struct mbuf **bpp)
+slip_encode(struct slip *sp,struct mbuf **bpp)
 {
 	struct mbuf *lbp;	/* Mbuf containing line-ready packet */
 	register uint8 *cp;
-	int c;
 
-	/* Allocate output mbuf that's twice as long as the packet.
-	 * This is a worst-case guess (consider a packet full of FR_ENDs!)
+	/* Size the output exactly, rather than allowing for a packet
+	 * full of FR_ENDs
 	 */
-	lbp = alloc_mbuf(2*len_p(*bpp) + 2);
+	lbp = alloc_mbuf(fr_stufflen(&sp->fr,*bpp) + 2);
 	if(lbp == NULL){
 		/* No space; drop */
 		free_p(bpp);
@@ -150,92 +149,12 @@ slip_encode(struct mbuf **bpp)
 	*cp++ = FR_END;
 
 	/* Copy input to output, escaping special characters */
-	while((c = PULLCHAR(bpp)) != -1){
-		switch(c){
-		case FR_ESC:
-			*cp++ = FR_ESC;
-			*cp++ = T_FR_ESC;
-			break;
-		case FR_END:
-			*cp++ = FR_ESC;
-			*cp++ = T_FR_END;
-			break;
-		default:
-			*cp++ = c;
-		}
-	}
+	cp = fr_stuff_mbuf(&sp->fr,cp,*bpp);
+	free_p(bpp);
 	*cp++ = FR_END;
 	lbp->cnt = cp - lbp->data;
 	return lbp;
 }
-/* Process incoming bytes in SLIP format
- * When a buffer is complete, return it; otherwise NULL
- */
-static struct mbuf *
-slip_decode(
-  struct slip *sp,
-  uint8 c		/* Incoming character */
-)
-{
-	struct mbuf *bp;
-
-	switch(c){
-	case FR_END:
-		bp = sp->rbp_head;
-		sp->rbp_head = NULL;
-		if(sp->escaped){
-			/* Treat this as an abort - discard frame */
-			free_p(&bp);
-			bp = NULL;
-		}
-		sp->escaped &= ~SLIP_FLAG;
-		return bp;	/* Will be NULL if empty frame */
-	case FR_ESC:
-		sp->escaped |= SLIP_FLAG;
-		return NULL;
-	}
-	if(sp->escaped & SLIP_FLAG){
-		/* Translate 2-char escape sequence back to original char */
-		sp->escaped &= ~SLIP_FLAG;
-		switch(c){
-		case T_FR_ESC:
-			c = FR_ESC;
-			break;
-		case T_FR_END:
-			c = FR_END;
-			break;
-		default:
-			sp->errors++;
-			break;
-		}
-	}
-	/* We reach here with a character for the buffer;
-	 * make sure there's space for it
-	 */
-	if(sp->rbp_head == NULL){
-		/* Allocate first mbuf for new packet */
-		if((sp->rbp_tail = sp->rbp_head = alloc_mbuf(SLIP_ALLOC)) == NULL)
-			return NULL; /* No memory, drop */
-		sp->rcp = sp->rbp_head->data;
-	} else if(sp->rbp_tail->cnt == SLIP_ALLOC){
-		/* Current mbuf is full; link in another */
-		if((sp->rbp_tail->next = alloc_mbuf(SLIP_ALLOC)) == NULL){
-			/* No memory, drop whole thing */
-			free_p(&sp->rbp_head);
-			sp->rbp_head = NULL;
-			return NULL;
-		}
-		sp->rbp_tail = sp->rbp_tail->next;
-		sp->rcp = sp->rbp_tail->data;
-	}
-	/* Store the character, increment fragment and total
-	 * byte counts
-	 */
-	*sp->rcp++ = c;
-	sp->rbp_tail->cnt++;
-	return NULL;
-}
-
 
 /* Process SLIP line input */
 void
@@ -248,12 +167,28 @@ void *p2;
 	struct mbuf *bp;
 	register struct slip *sp;
 	int cdev;
+	uint8 *buf,*cp;
+	int n;
+	uint cnt;
 
 	sp = &Slip[xdev];
 	cdev = sp->iface->dev;
-
-	while ( (c = sp->get(cdev)) != -1 ) {
-		if((bp = slip_decode(sp,c)) == NULL)
+	buf = mallocw(SLIP_RXBUF);
+
+	cp = buf;
+	cnt = 0;
+	for(;;){
+		if(cnt == 0){
+			/* Refill from the line */
+			if((n = sp->read(cdev,buf,SLIP_RXBUF)) <= 0)
+				break;
+			cp = buf;
+			cnt = n;
+		}
+		c = fr_unstuff(&sp->fr,&cp,&cnt,&bp);
+		sp->errors += sp->fr.errors;
+		sp->fr.errors = 0;
+		if(c != FR_FRAME)
 			continue;	/* More to come */
 
 		if (sp->iface->trace & IF_TRACE_RAW)
@@ -285,6 +220,7 @@ void *p2;
 		 */
 		kwait(NULL);
 	}
+	free(buf);
 	if(sp->iface->rxproc == Curproc)
 		sp->iface->rxproc = NULL;
 }
@@ -3,6 +3,7 @@
 
 #include "global.h"
 #include "net/core/iface.h"
+#include "net/core/framer.h"
 #include "net/slhc/slhc.h"
 
 #define SLIP_MAX 6		/* Maximum number of slip channels */
@@ -14,6 +15,9 @@
  */
 #define	SLIP_ALLOC	128
 
+/* Bytes taken from the line at a time */
+#define	SLIP_RXBUF	256
+
 #define	FR_END		0300	/* Frame End */
 #define	FR_ESC		0333	/* Frame Escape */
 #define	T_FR_END	0334	/* Transposed frame end */
@@ -22,18 +26,12 @@
 /* Slip protocol control structure */
 struct slip {
 	struct iface *iface;
-	uint8 escaped;		/* Receiver State control flag */
-#define SLIP_FLAG	0x01		/* Last char was a frame escape */
-#define SLIP_VJCOMPR	0x02		/* TCP header compression enabled */
-	struct mbuf *rbp_head;	/* Head of mbuf chain being filled */
-	struct mbuf *rbp_tail;	/* Pointer to mbuf currently being written */
-	uint8 *rcp;		/* Write pointer */
-	uint rcnt;		/* Length of mbuf chain */
+	struct framer fr;	/* Framing state */
 	struct mbuf *tbp;	/* Transmit mbuf being sent */
 	uint errors;		/* Receiver input errors */
 	int type;		/* Protocol of input */
 	int (*send)(int,struct mbuf **);	/* send mbufs to device */
-	int (*get)(int);	/* fetch input chars from device */
+	int (*read)(int,void *,unsigned short);	/* fetch input from device */
 	struct slcompress *slcomp;	/* TCP header compression table */
 };
 
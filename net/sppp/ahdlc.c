@@ -7,121 +7,82 @@
 
 #include "net/sppp/ahdlc.h"
 
-static uint8 *putbyte(uint8 *,uint8);
+static struct framer Ahdlctx;	/* Transmit framing; no ACCM */
 
 void
 init_hdlc(hp,maxsize)
 struct ahdlc *hp;
 int maxsize;
 {
-	hp->escaped = 0;
-	hp->hunt = 0;
-	hp->inframe = NULL;
-	hp->maxsize = maxsize;
-	hp->fcs = FCS_START;
+	/* Frames are kept in one mbuf of the maximum size */
+	fr_init(&hp->fr,FR_HDLC,maxsize,maxsize);
 	hp->rxframes = 0;
 	hp->aborts = 0;
 	hp->toobigs = 0;
 	hp->crcerrs = 0;
+	hp->runts = 0;
 }
 
-/* Process incoming data. Return completed packets, NULL otherwise */
+/* Process incoming data, advancing *cpp and reducing *lenp by the amount
+ * used. Return a completed packet, or NULL once the data is used up
+ */
 struct mbuf *
 ahdlcrx(
   struct ahdlc *ap,	/* HDLC Receiver control block */
-  uint8 c
+  uint8 **cpp,
+  uint *lenp
 )
 {
 	struct mbuf *bp;
 
-	if(c == HDLC_ESC_ASYNC){
-		ap->escaped = 1;
-		return NULL;
-	}
-	if(c != HDLC_FLAG){
-		if(ap->hunt)
-			return NULL; /* Ignore until next packet */
-		/* Normal character within packet */
-		if(ap->escaped){
-			c ^= HDLC_ESC_COMPL;
-			ap->escaped = 0;
-		}
-		if(ap->inframe == NULL)
-			ap->inframe = ambufw(ap->maxsize);
-		if(ap->inframe->cnt == ap->maxsize){
+	while(*lenp != 0){
+		switch(fr_unstuff(&ap->fr,cpp,lenp,&bp)){
+		case FR_MORE:
+		case FR_EMPTY:	/* Padding flags, ignore */
+			continue;
+		case FR_ABORT:
+			/* ESC, FLAG is frame abort */
+			ap->aborts++;
+#ifdef	debug
+			kprintf("AHDLC ABORT\n");
+#endif
+			continue;
+		case FR_TOSS:
 			/* Frame too large */
 			ap->toobigs++;
 #ifdef	debug
-			kprintf("FRAME TOO LARGE (>%u bytes)\n",ap->maxsize);
+			kprintf("FRAME TOO LARGE (>%u bytes)\n",ap->fr.maxsize);
 #endif
-			free_p(&ap->inframe);
-			ap->inframe = NULL;
-			ap->escaped = 0;
-			ap->fcs = FCS_START;
-			ap->hunt = 1;
-			return NULL;
+			continue;
 		}
-		/* Store character, update FCS */
-		ap->inframe->data[ap->inframe->cnt++] = c;
-		ap->fcs = FCS(ap->fcs,c);
-		return NULL;
-	}
-	/* We get here only if the character is a flag */
-	if(ap->escaped){
-		/* ESC, FLAG is frame abort */
-		ap->aborts++;
+		if(crc_check_mbuf(bp,0,len_p(bp)) != 0){
+			/* CRC error */
+			ap->crcerrs++;
 #ifdef	debug
-		kprintf("AHDLC ABORT, cnt = %u\n",ap->inframe->cnt);
+			kprintf("AHDLC CRC ERROR, cnt = %u\n",len_p(bp));
+			hex_dump(kstdout,&bp);
 #endif
-		ap->hunt = 1;
-		ap->escaped = 0;
-		free_p(&ap->inframe);
-		ap->inframe = NULL;
-		ap->fcs = FCS_START;
-		return NULL;
-	}
-	if(ap->hunt){
-		/* Found flag in hunt mode. Reset for new frame */
-		ap->hunt = 0;
-		return NULL;
-	}
-	if(ap->inframe == NULL){
-		/* Padding flags, ignore */
-		return NULL;
-	}
-	if(ap->fcs != FCS_FINAL){
-		/* CRC error */
-		ap->crcerrs++;
+			free_p(&bp);
+			continue;
+		}
+		if(len_p(bp) < 2){
+			/* Runt frame */
+			ap->runts++;
 #ifdef	debug
-		kprintf("AHDLC CRC ERROR, cnt = %u\n",ap->inframe->cnt);
-		hex_dump(kstdout,&ap->inframe);
+			kprintf("AHDLC RUNT, cnt = %u\n",len_p(bp));
 #endif
-		free_p(&ap->inframe);
-		ap->inframe = NULL;
-		ap->fcs = FCS_START;
-		return NULL;
-	}
-	if(ap->inframe->cnt < 2){
-		/* Runt frame */
-		ap->runts++;
+			free_p(&bp);
+			continue;
+		}
+		/* Normal end-of-frame */
+		ap->rxframes++;
+		trim_mbuf(&bp,len_p(bp) - 2);
 #ifdef	debug
-		kprintf("AHDLC RUNT, cnt = %u\n",ap->inframe->cnt);
+		kprintf("Normal AHDLC receive, len %u\n",len_p(bp));
 #endif
-		free_p(&ap->inframe);
-		ap->inframe = NULL;
-		ap->fcs = FCS_START;
-		return NULL;
+		return bp;
 	}
-	/* Normal end-of-frame */
-	ap->rxframes++;
-	bp = ap->inframe;
-	ap->inframe = NULL;
-	ap->fcs = FCS_START;
-	bp->cnt -= 2;
-#ifdef	debug
-	kprintf("Normal AHDLC receive, len %u\n",bp->cnt);
-#endif
-	return bp;
+	return NULL;
 }
 /* Encode a packet in asynchronous HDLC for transmission */
 struct mbuf *
@@ -130,39 +91,21 @@ struct mbuf *bp;
 {
 	struct mbuf *obp;
 	uint8 *cp;
-	int c;
-	uint fcs;
+	uint16 fcs;
+	uint8 fcsb[2];
 
-	fcs = FCS_START;
-	obp = ambufw(5+2*len_p(bp));	/* Allocate worst-case */
-	cp = obp->data;
-	while((c = PULLCHAR(&bp)) != -1){
-		fcs = FCS(fcs,c);
-		cp = putbyte(cp,c);
-	}
-	free_p(&bp);	/* Shouldn't be necessary */
+	if(Ahdlctx.flag == 0)
+		fr_init(&Ahdlctx,FR_HDLC,0,0);
+	crc_mbuf(bp,0,len_p(bp),&fcs);
 	fcs ^= 0xffff;
-	cp = putbyte(cp,fcs);
-	cp = putbyte(cp,fcs >> 8);
+	fcsb[0] = fcs;
+	fcsb[1] = fcs >> 8;
+	obp = ambufw(fr_stufflen(&Ahdlctx,bp) + 5);
+	cp = fr_stuff_mbuf(&Ahdlctx,obp->data,bp);
+	free_p(&bp);
+	cp = fr_stuff(&Ahdlctx,cp,fcsb,2);
 	*cp++ = HDLC_FLAG;
 
 	obp->cnt = cp - obp->data;
 	return obp;
 }
-static uint8 *
-putbyte(
-  uint8 *cp,
-  uint8 c
-)
-{
-	switch(c){
-	case HDLC_FLAG:
-	case HDLC_ESC_ASYNC:
-		*cp++ = HDLC_ESC_ASYNC;
-		*cp++ = c ^ HDLC_ESC_COMPL;
-		break;
-	default:
-		*cp++ = c;
-	}
-	return cp;
-}
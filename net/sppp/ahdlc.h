@@ -3,14 +3,11 @@
 
 #include "global.h"
 #include "net/core/mbuf.h"
+#include "net/core/framer.h"
 
 /* Asynch HDLC receiver control block */
 struct ahdlc {
-	int escaped;		/* Escape char (0x7d) just seen */
-	int hunt;		/* Flushing input until next flag */
-	struct mbuf *inframe;	/* Current frame being reassembled */
-	int maxsize;		/* Maximum packet size */
-	uint fcs;		/* current CRC value */
+	struct framer fr;	/* Frame being reassembled */
 	int32 rxframes;		/* Valid frames received */
 	int32 aborts;		/* Aborts seen */
 	int32 toobigs;		/* Frames larger than maxsize */
@@ -22,7 +19,7 @@ struct ahdlc {
 #define	HDLC_ESC_COMPL	0x20	/* XORed with special chars in data */
 
 void init_hdlc(struct ahdlc *,int);
-struct mbuf *ahdlcrx(struct ahdlc *,uint8);
+struct mbuf *ahdlcrx(struct ahdlc *,uint8 **,uint *);
 struct mbuf *ahdlctx(struct mbuf *);
 
 #endif	/* _KA9Q_AHDLC_H */
@@ -17,7 +17,9 @@
 #include "net/sppp/ahdlc.h"
 #include "net/sppp/sppp.h"
 
-static uint8 *putbyte(uint8 *cp,uint8 c);
+#define	SPPP_RXBUF	256	/* Bytes read from the line at a time */
+
+static struct framer Sppptx;	/* Transmit framing; no ACCM */
 
 int
 sppp_init(ifp)
@@ -27,6 +29,8 @@ struct iface *ifp;
 
 	ifp->ioctl = asy_ioctl;
 	ifp->edv = slhc_init(16,16);
+	if(Sppptx.flag == 0)
+		fr_init(&Sppptx,FR_HDLC,0,0);
 	ifp->rxproc = newproc(ifn = if_name(ifp," rx"),
 		512,sppp_rx,ifp->dev,ifp,NULL,0);
 	free(ifn);
@@ -76,46 +80,27 @@ struct mbuf **bpp
 ){
 	struct mbuf *obp;
 	uint8 *cp;
-	int c;
-	uint fcs;
+	uint8 pid = protocol;
+	uint8 fcsb[2];
+	uint16 fcs;
 
-	fcs = FCS_START;
-	obp = ambufw(6+2*len_p(*bpp));	/* Allocate worst-case */
+	fcs = FCS(FCS_START,protocol);
+	crc_update_mbuf(*bpp,0,len_p(*bpp),&fcs);
+	fcs ^= 0xffff;
+	fcsb[0] = fcs;
+	fcsb[1] = fcs >> 8;
+	obp = ambufw(fr_stufflen(&Sppptx,*bpp) + HDLC_ENVLEN);
 	cp = obp->data;
 	*cp++ = HDLC_FLAG;
-	cp = putbyte(cp,(char)protocol);
-	fcs = FCS(fcs,protocol);
-	while((c = PULLCHAR(bpp)) != -1){
-		fcs = FCS(fcs,c);
-		cp = putbyte(cp,c);
-	}
-	free_p(bpp);	/* Shouldn't be necessary */
-	fcs ^= 0xffff;
-	cp = putbyte(cp,fcs);
-	cp = putbyte(cp,fcs >> 8);
+	cp = fr_stuff(&Sppptx,cp,&pid,1);
+	cp = fr_stuff_mbuf(&Sppptx,cp,*bpp);
+	free_p(bpp);
+	cp = fr_stuff(&Sppptx,cp,fcsb,2);
 	*cp++ = HDLC_FLAG;
 
 	obp->cnt = cp - obp->data;
 	return asy_send(iface->dev,&obp);
 }
-/* Add a byte to the PPP output stream, byte stuffing for transparency */
-static uint8 *
-putbyte(
-  uint8 *cp,
-  uint8 c
-)
-{
-	switch(c){
-	case HDLC_FLAG:
-	case HDLC_ESC_ASYNC:
-		*cp++ = HDLC_ESC_ASYNC;
-		*cp++ = c ^ HDLC_ESC_COMPL;
-		break;
-	default:
-		*cp++ = c;
-	}
-	return cp;
-}
 
 /* Process simplified PPP line input */
 void
@@ -129,11 +114,22 @@ void *p2;
 	struct ahdlc ahdlc;
 	struct iface *ifp = (struct iface *)p1;
 	struct slcompress *sp = ifp->edv;
+	uint8 *buf,*cp;
+	uint cnt;
+	int n;
 
 	init_hdlc(&ahdlc,2048);
+	buf = mallocw(SPPP_RXBUF);
+	cp = buf;
+	cnt = 0;
 	for(;;){
-		c = get_asy(dev);
-		if((bp = ahdlcrx(&ahdlc,c)) == NULL)
+		if(cnt == 0){
+			if((n = asy_read(dev,buf,SPPP_RXBUF)) <= 0)
+				break;
+			cp = buf;
+			cnt = n;
+		}
+		if((bp = ahdlcrx(&ahdlc,&cp,&cnt)) == NULL)
 			continue;
 		c = PULLCHAR(&bp);
 		switch(c){	/* Turn compressed IP/TCP back to normal */
@@ -161,5 +157,9 @@ void *p2;
 			break;
 		}
 	}
+	fr_reset(&ahdlc.fr);
+	free(buf);
+	if(ifp->rxproc == Curproc)
+		ifp->rxproc = NULL;
 }
 
@@ -27,6 +27,12 @@
 #include "files.h"
 
 #include "service/pop/pop.h"
+#ifdef UNIX
+#include "unix/hostio_unix.h"
+#define	STAT(a,b)	hio_stat((a),(b))	/* Don't stall on the spool */
+#else
+#define	STAT(a,b)	stat((a),(b))
+#endif
 
 extern char Nospace[];
 
@@ -407,6 +413,7 @@ struct pop_scb *scb;
 			state_error(scb,"Unable to add new mail to folder");
 			return;
 		}
+		ksetvbuf(fd,NULL,_kIOMAP,0);
 
 		kfseek(scb->wf,0,kSEEK_END);
 		kfseek(fd,scb->folder_file_size,kSEEK_SET);
@@ -447,7 +454,7 @@ struct pop_scb *scb;
 
 	/* trash the updated mail folder if it is empty */
 
-	if ((stat(folder_pathname,&folder_stat) == 0) && (folder_stat.st_size == 0))
+	if ((STAT(folder_pathname,&folder_stat) == 0) && (folder_stat.st_size == 0))
 		unlink(folder_pathname);
 
 	kfclose(scb->wf);
@@ -471,7 +478,7 @@ struct pop_scb	*scb;
 	sprintf(folder_pathname,"%s/%s.txt",Mailspool,scb->username);
 	scb->folder_len       = 0;
 	scb->folder_file_size = 0;
-	if (stat(folder_pathname,&folder_stat)){
+	if (STAT(folder_pathname,&folder_stat)){
 		 (void) kfprintf(scb->network,no_mail_rsp);
 		 return;
 	}
@@ -481,6 +488,7 @@ struct pop_scb	*scb;
 		state_error(scb,"Unable to open mail folder");
 		return;
 	}
+	ksetvbuf(fd,NULL,_kIOMAP,0);
 
 	if ((scb->wf = ktmpfile()) == NULL) {
 		state_error(scb,"Unable to create work folder");
@@ -699,7 +707,7 @@ struct pop_scb *scb;
 
 	sprintf(folder_pathname,"%s/%s.txt",Mailspool,scb->username);
 
-	if (stat(folder_pathname,&folder_stat)) {
+	if (STAT(folder_pathname,&folder_stat)) {
 		state_error(scb,"Unable to get old mail folder's status");
 		return(FALSE);
 	} else
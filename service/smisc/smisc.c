@@ -7,6 +7,7 @@
 #include "global.h"
 #include "net/core/mbuf.h"
 #include "core/socket.h"
+#include "core/usock.h"
 #include "core/proc.h"
 #include "net/inet/tcp.h"
 #include "commands.h"
@@ -22,7 +23,6 @@
 #include "telnet.h"
 #include "lib/std/errno.h"
 
-static void discserv(int s,void *unused,void *p);
 static void echoserv(int s,void *unused,void *p);
 static void termrx(int s,void *p1,void *p2);
 static void tunregister(struct iface *,int);
@@ -35,36 +35,97 @@ struct tserv {
 };
 struct tserv *Tserv;
 
-/* Start up TCP discard server */
+static int Sdisc = -1;		/* Discard server's listening socket */
+static uint Discport;		/* and its port */
+
+/* Start up TCP discard server. Unlike the others this is one process
+ * serving every connection, waiting on all of them with ksockpoll()
+ */
 int
 dis1(
 int argc,
 char *argv[],
 void *p
 ){
-	uint port;
-
-	port = (argc < 2) ? IPPORT_DISCARD: atoi(argv[1]);
-	return start_tcp(port,"Discard Server",discserv,576);
-}
-static void
-discserv(
-int s,
-void *unused,
-void *p
-){
+	struct ksockaddr_in lsocket;
+	struct kpollfd *fds,*nfdp;
 	struct mbuf *bp;
+	int nfds,maxfds,i,s;
 
-	sockowner(s,Curproc);
-	logmsg(s,"open discard");
-	if(availmem() == 0){
-		while(recv_mbuf(s,&bp,0,NULL,NULL) > 0)
-			free_p(&bp);
+	if(Sdisc != -1)
+		return 0;
+
+	ksignal(Curproc,0);		/* Don't keep the parser waiting */
+	chname(Curproc,"Discard Server");
+
+	lsocket.sin_family = kAF_INET;
+	lsocket.sin_addr.s_addr = kINADDR_ANY;
+	lsocket.sin_port = (argc < 2) ? IPPORT_DISCARD : atoi(argv[1]);
+	Discport = lsocket.sin_port;
+	Sdisc = ksocket(kAF_INET,kSOCK_STREAM,0);
+	kbind(Sdisc,(struct ksockaddr *)&lsocket,sizeof(lsocket));
+	klisten(Sdisc,1);
+
+	/* Slot 0 is the listener, the rest are connections */
+	maxfds = 8;
+	fds = (struct kpollfd *)callocw(maxfds,sizeof(struct kpollfd));
+	fds[0].fd = Sdisc;
+	fds[0].events = kPOLLIN;
+	nfds = 1;
+	while(ksockpoll(fds,nfds,-1) > 0){
+		if(fds[0].revents & (kPOLLHUP|kPOLLNVAL))
+			break;	/* Service is shutting down */
+		for(i=1;i<nfds;i++){
+			if(fds[i].revents == 0)
+				continue;
+			if(fds[i].revents & kPOLLNVAL){
+				/* Closed out from under us */
+			} else if(recv_mbuf(fds[i].fd,&bp,0,NULL,NULL) > 0){
+				free_p(&bp);
+				continue;
+			} else {
+				logmsg(fds[i].fd,"close discard");
+				close_s(fds[i].fd);
+			}
+			/* Fill the hole from the end, and look at it next */
+			fds[i--] = fds[--nfds];
+		}
+		if((fds[0].revents & kPOLLIN)
+		 && (s = kaccept(Sdisc,NULL,(int *)NULL)) != -1){
+			sockowner(s,Curproc);
+			if(availmem() != 0){
+				close_s(s);
+				continue;
+			}
+			if(nfds == maxfds){
+				nfdp = (struct kpollfd *)realloc(fds,
+				 2*maxfds*sizeof(struct kpollfd));
+				if(nfdp == NULL){
+					close_s(s);
+					continue;
+				}
+				fds = nfdp;
+				maxfds *= 2;
+			}
+			logmsg(s,"open discard");
+			fds[nfds].fd = s;
+			fds[nfds].events = kPOLLIN;
+			nfds++;
+		}
 	}
-	logmsg(s,"close discard");
-	close_s(s);
+	for(i=1;i<nfds;i++){
+		if(itop(fds[i].fd) == NULL)
+			continue;
+		logmsg(fds[i].fd,"close discard");
+		close_s(fds[i].fd);
+	}
+	if(!(fds[0].revents & kPOLLNVAL))
+		close_s(Sdisc);
+	free(fds);
+	Sdisc = -1;
+	return 0;
 }
-/* Stop discard server */
+/* Stop discard server. Connections in progress are closed too */
 int
 dis0(
 int argc,
@@ -74,7 +135,9 @@ void *p
 	uint port;
 
 	port = (argc < 2) ? IPPORT_DISCARD : atoi(argv[1]);
-	return stop_tcp(port);
+	if(Sdisc == -1 || port != Discport)
+		return -1;
+	return kshutdown(Sdisc,2);
 }
 /* Start up TCP echo server */
 int
@@ -313,7 +313,7 @@ getmsgtxt(mp)
 struct smtpsv *mp;
 {
 	char buf[LINELEN];
-	register char *p = buf;
+	register char *p;
 	time_t t;
 	kFILE *network;
 	kFILE *data;
@@ -337,10 +337,13 @@ struct smtpsv *mp;
 		(void) kfprintf(network,Enter);
 	}
 	while(1) {
-		if(kfgets(p,sizeof(buf),network) == NULL){
-			return 1;
+		/* Use the line where it lies in the input if we can */
+		if((p = kfgetln(network,NULL)) == NULL){
+			if(kfgets(buf,sizeof(buf),network) == NULL)
+				return 1;
+			p = buf;
+			rip(p);
 		}
-		rip(p);
 		/* check for end of message ie a . or escaped .. */
 		if (*p == '.') {
 			if (*++p == '\0') {
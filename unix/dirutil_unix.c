@@ -4,10 +4,37 @@
  */
 #include "top.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <glob.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "global.h"
 #include "lib/std/stdio.h"
 #include "lib/std/dirutil.h"
+#include "lib/std/errno.h"
 #include "commands.h"
+#include "unix/hostio_unix.h"
+
+/* A directory listing, built up by a host I/O thread */
+struct dirscan {
+	const char *path;
+	int full;		/* Long form, like ls -l */
+	char *buf;		/* The listing */
+	size_t len;
+	size_t size;
+	time_t now;
+};
+
+static long scan(void *v);
+static void listent(struct dirscan *ds,const char *dir,const char *name);
+static void addline(struct dirscan *ds,const char *fmt,...);
 
 kFILE *
 dir(char *path,int full)
@@ -16,7 +43,10 @@ dir(char *path,int full)
 
 	fp = ktmpfile();
 	if (fp != NULL) {
-		getdir(path, full, fp);
+		if (getdir(path, full, fp) == -1) {
+			kfclose(fp);
+			return NULL;
+		}
 		krewind(fp);
 	}
 	return fp;
@@ -35,11 +65,131 @@ notimp()
 	kfputs("NOT IMPLEMENTED YET\n", kstdout);
 }
 
+/* List a directory, or the files matching a wildcard, on 'file'.
+ * The scan runs on a host I/O thread, since a big or remote directory
+ * can take a while.
+ */
 int
 getdir(char *path,int full,kFILE *file)
 {
-	kfputs("NOT IMPLEMENTED YET\n", file);
-	return -1;
+	struct dirscan ds;
+	long ret;
+
+	memset(&ds, 0, sizeof(ds));
+	ds.path = (path == NULL || *path == '\0') ? "." : path;
+	ds.full = full;
+	ds.now = time(NULL);
+
+	ret = hio_call(scan, &ds);
+	if (ret == -1)
+		kerrno = translate_sys_errno(errno);
+	else if (ds.len != 0)
+		kfwrite(ds.buf, 1, ds.len, file);
+	free(ds.buf);
+	return ret == -1 ? -1 : 0;
+}
+
+/* Runs on the host I/O thread; must not call into NOS */
+static long
+scan(void *v)
+{
+	struct dirscan *ds = (struct dirscan *)v;
+	struct dirent **names;
+	struct stat sb;
+	glob_t g;
+	int i, n;
+
+	if (stat(ds->path, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+		if ((n = scandir(ds->path, &names, NULL, alphasort)) == -1)
+			return -1;
+		for (i = 0; i < n; i++) {
+			if (names[i]->d_name[0] != '.')
+				listent(ds, ds->path, names[i]->d_name);
+			free(names[i]);
+		}
+		free(names);
+		return 0;
+	}
+	/* Not a directory; maybe a file name or a wildcard */
+	if (glob(ds->path, 0, NULL, &g) != 0) {
+		errno = ENOENT;
+		return -1;
+	}
+	for (i = 0; i < (int)g.gl_pathc; i++)
+		listent(ds, NULL, g.gl_pathv[i]);
+	globfree(&g);
+	return 0;
+}
+
+static void
+listent(struct dirscan *ds,const char *dir,const char *name)
+{
+	char path[1024], mode[11], date[16];
+	struct stat sb;
+	struct tm tm;
+
+	if (!ds->full) {
+		addline(ds, "%s\n", name);
+		return;
+	}
+	if (dir != NULL) {
+		snprintf(path, sizeof(path), "%s/%s", dir, name);
+		if (lstat(path, &sb) == -1)
+			return;
+	} else if (lstat(name, &sb) == -1)
+		return;
+
+	strcpy(mode, "----------");
+	if (S_ISDIR(sb.st_mode))
+		mode[0] = 'd';
+	else if (S_ISLNK(sb.st_mode))
+		mode[0] = 'l';
+	if (sb.st_mode & S_IRUSR) mode[1] = 'r';
+	if (sb.st_mode & S_IWUSR) mode[2] = 'w';
+	if (sb.st_mode & S_IXUSR) mode[3] = 'x';
+	if (sb.st_mode & S_IRGRP) mode[4] = 'r';
+	if (sb.st_mode & S_IWGRP) mode[5] = 'w';
+	if (sb.st_mode & S_IXGRP) mode[6] = 'x';
+	if (sb.st_mode & S_IROTH) mode[7] = 'r';
+	if (sb.st_mode & S_IWOTH) mode[8] = 'w';
+	if (sb.st_mode & S_IXOTH) mode[9] = 'x';
+
+	/* Same as ls: the year instead of the time if it's old */
+	localtime_r(&sb.st_mtime, &tm);
+	if (ds->now - sb.st_mtime > 180L*86400 || sb.st_mtime > ds->now)
+		strftime(date, sizeof(date), "%b %e  %Y", &tm);
+	else
+		strftime(date, sizeof(date), "%b %e %H:%M", &tm);
+
+	addline(ds, "%s %3lu %-8lu %-8lu %8lld %s %s\n", mode,
+		(unsigned long)sb.st_nlink, (unsigned long)sb.st_uid,
+		(unsigned long)sb.st_gid, (long long)sb.st_size, date, name);
+}
+
+static void
+addline(struct dirscan *ds,const char *fmt,...)
+{
+	va_list ap;
+	char *cp;
+	size_t size;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if (ds->len + n >= ds->size) {
+		size = ds->size * 2 + n + 1024;
+		if ((cp = realloc(ds->buf, size)) == NULL)
+			return;
+		ds->buf = cp;
+		ds->size = size;
+	}
+	va_start(ap, fmt);
+	vsnprintf(ds->buf + ds->len, ds->size - ds->len, fmt, ap);
+	va_end(ap);
+	ds->len += n;
 }
 
 int
@@ -0,0 +1,352 @@
+/* Host I/O service for UNIX-hosted KA9Q NOS.
+ *
+ * Copyright 2017 Jeremy Cooper, KE6JJJ.
+ *
+ * NOS processes take turns holding the single-process lock, so a host
+ * system call that blocks holds up everyone else. Calls that may block for
+ * a long time are instead put on a queue served by a few host threads. The
+ * calling process kwait()s on its job, which gives up the lock, and the
+ * thread that ran the job wakes it with ksignal() from "interrupt" level,
+ * just as the device threads do when their I/O completes.
+ *
+ * Jobs live on the caller's stack, so a caller always waits for its job
+ * to finish, even if it is alerted in the meantime.
+ */
+#include "top.h"
+
+#ifndef UNIX
+#error "This file should only be built on POSIX/UNIX systems."
+#endif
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "lib/std/stdio.h"
+#include "core/proc.h"
+#include "lib/util/cmdparse.h"
+#include "commands.h"
+#include "unix/nosunix.h"
+#include "unix/hostio_unix.h"
+
+#define	HIO_THREADS	4	/* Size of the thread pool */
+
+struct hiojob {
+	struct hiojob *next;
+	long (*func)(void *);
+	void *arg;
+	long ret;		/* Value returned by func */
+	int err;		/* and the errno it left */
+	int done;		/* Set at interrupt level when finished */
+};
+
+static struct {
+	pthread_mutex_t lock;	/* Protects the queue */
+	pthread_cond_t ready;	/* Signaled when a job is queued */
+	pthread_t thread[HIO_THREADS];
+	int nthreads;		/* Threads actually started */
+	int exit;		/* Threads should quit */
+	struct hiojob *head,*tail;
+	int qlen;		/* Jobs waiting for a thread */
+	int hiwat;		/* Most jobs ever waiting */
+	int busy;		/* Jobs being run */
+	unsigned long calls;	/* Jobs run by the pool */
+	unsigned long direct;	/* Calls made without the pool */
+} Hio;
+
+static int Hio_enable = 1;	/* Use the pool when it's running */
+
+static void *hio_thread(void *arg);
+
+/* Start the pool threads */
+int
+hio_start(void)
+{
+	int i;
+
+	if(pthread_mutex_init(&Hio.lock,NULL) != 0
+	 || pthread_cond_init(&Hio.ready,NULL) != 0)
+		return -1;
+	for(i=0;i<HIO_THREADS;i++){
+		if(pthread_create(&Hio.thread[i],NULL,hio_thread,NULL) != 0)
+			break;
+		Hio.nthreads++;
+	}
+	return Hio.nthreads != 0 ? 0 : -1;
+}
+/* Stop the pool threads, once they've run whatever is queued */
+void
+hio_stop(void)
+{
+	int i;
+
+	if(Hio.nthreads == 0)
+		return;
+	pthread_mutex_lock(&Hio.lock);
+	Hio.exit = 1;
+	pthread_cond_broadcast(&Hio.ready);
+	pthread_mutex_unlock(&Hio.lock);
+	for(i=0;i<Hio.nthreads;i++)
+		pthread_join(Hio.thread[i],NULL);
+	Hio.nthreads = 0;
+}
+long
+hio_call(long (*func)(void *),void *arg)
+{
+	struct hiojob job;
+	int i_state,done;
+
+	/* No pool, or not able to wait for it: just do it */
+	if(!Hio_enable || Hio.nthreads == 0 || Hio.exit || Curproc == NULL
+	 || !istate()){
+		Hio.direct++;
+		return (*func)(arg);
+	}
+	job.next = NULL;
+	job.func = func;
+	job.arg = arg;
+	job.done = 0;
+
+	pthread_mutex_lock(&Hio.lock);
+	if(Hio.tail == NULL)
+		Hio.head = &job;
+	else
+		Hio.tail->next = &job;
+	Hio.tail = &job;
+	if(++Hio.qlen > Hio.hiwat)
+		Hio.hiwat = Hio.qlen;
+	pthread_cond_signal(&Hio.ready);
+	pthread_mutex_unlock(&Hio.lock);
+
+	for(;;){
+		i_state = disable();
+		done = job.done;
+		restore(i_state);
+		if(done)
+			break;
+		kwait(&job);
+	}
+	errno = job.err;
+	return job.ret;
+}
+/* Pool thread: run jobs and signal their owners */
+static void *
+hio_thread(void *arg)
+{
+	struct hiojob *job;
+	long ret;
+	int err;
+
+	for(;;){
+		pthread_mutex_lock(&Hio.lock);
+		while(Hio.head == NULL && !Hio.exit)
+			pthread_cond_wait(&Hio.ready,&Hio.lock);
+		if(Hio.head == NULL){
+			pthread_mutex_unlock(&Hio.lock);
+			break;
+		}
+		job = Hio.head;
+		if((Hio.head = job->next) == NULL)
+			Hio.tail = NULL;
+		Hio.qlen--;
+		Hio.busy++;
+		pthread_mutex_unlock(&Hio.lock);
+
+		errno = 0;
+		ret = (*job->func)(job->arg);
+		err = errno;
+
+		interrupt_enter();
+		Hio.busy--;
+		Hio.calls++;
+		job->ret = ret;
+		job->err = err;
+		job->done = 1;
+		ksignal(job,1);
+		interrupt_leave();
+	}
+	return NULL;
+}
+
+/* Wrapped host calls. Each packs its arguments for the pool thread */
+struct hioargs {
+	int fd;
+	const char *path;
+	int flags;
+	int mode;
+	void *buf;
+	size_t cnt;
+	off_t off;
+	void *p;
+};
+
+static long
+hio_open_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+
+	return open(a->path,a->flags,a->mode);
+}
+int
+hio_open(const char *path,int flags,int mode)
+{
+	struct hioargs a;
+
+	a.path = path;
+	a.flags = flags;
+	a.mode = mode;
+	return (int)hio_call(hio_open_f,&a);
+}
+static long
+hio_close_f(void *v)
+{
+	return close(((struct hioargs *)v)->fd);
+}
+int
+hio_close(int fd)
+{
+	struct hioargs a;
+
+	a.fd = fd;
+	return (int)hio_call(hio_close_f,&a);
+}
+static long
+hio_read_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+
+	return read(a->fd,a->buf,a->cnt);
+}
+ssize_t
+hio_read(int fd,void *buf,size_t cnt)
+{
+	struct hioargs a;
+
+	a.fd = fd;
+	a.buf = buf;
+	a.cnt = cnt;
+	return hio_call(hio_read_f,&a);
+}
+static long
+hio_write_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+
+	return write(a->fd,a->buf,a->cnt);
+}
+ssize_t
+hio_write(int fd,const void *buf,size_t cnt)
+{
+	struct hioargs a;
+
+	a.fd = fd;
+	a.buf = (void *)buf;
+	a.cnt = cnt;
+	return hio_call(hio_write_f,&a);
+}
+static long
+hio_pread_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+
+	return pread(a->fd,a->buf,a->cnt,a->off);
+}
+ssize_t
+hio_pread(int fd,void *buf,size_t cnt,off_t off)
+{
+	struct hioargs a;
+
+	a.fd = fd;
+	a.buf = buf;
+	a.cnt = cnt;
+	a.off = off;
+	return hio_call(hio_pread_f,&a);
+}
+static long
+hio_pwrite_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+
+	if(a->off != -1)
+		return pwrite(a->fd,a->buf,a->cnt,a->off);
+	/* Append. Files opened for append have O_APPEND, so the host puts
+	 * each write at the end atomically; only a descriptor opened some
+	 * other way needs the seek, and that can race with other writers
+	 */
+	if(!(fcntl(a->fd,F_GETFL) & O_APPEND)
+	 && lseek(a->fd,0L,SEEK_END) == -1)
+		return -1;
+	return write(a->fd,a->buf,a->cnt);
+}
+ssize_t
+hio_pwrite(int fd,const void *buf,size_t cnt,off_t off)
+{
+	struct hioargs a;
+
+	a.fd = fd;
+	a.buf = (void *)buf;
+	a.cnt = cnt;
+	a.off = off;
+	return hio_call(hio_pwrite_f,&a);
+}
+static long
+hio_stat_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+
+	return stat(a->path,(struct stat *)a->p);
+}
+int
+hio_stat(const char *path,struct stat *sb)
+{
+	struct hioargs a;
+
+	a.path = path;
+	a.p = sb;
+	return (int)hio_call(hio_stat_f,&a);
+}
+/* Copy out of a mapping, unless the file has shrunk below the part
+ * wanted: touching pages past the end would raise SIGBUS and take the
+ * whole program down, so read it instead
+ */
+static long
+hio_mapread_f(void *v)
+{
+	struct hioargs *a = (struct hioargs *)v;
+	struct stat sb;
+
+	if(fstat(a->fd,&sb) == -1)
+		return -1;
+	if(sb.st_size < a->off + (off_t)a->cnt)
+		return pread(a->fd,a->buf,a->cnt,a->off);
+	memcpy(a->buf,(char *)a->p + a->off,a->cnt);
+	return a->cnt;
+}
+ssize_t
+hio_mapread(int fd,void *buf,const void *map,size_t cnt,off_t off)
+{
+	struct hioargs a;
+
+	a.fd = fd;
+	a.buf = buf;
+	a.p = (void *)map;
+	a.cnt = cnt;
+	a.off = off;
+	return (ssize_t)hio_call(hio_mapread_f,&a);
+}
+
+/* Show or set the state of the pool */
+int
+dohostio(int argc,char *argv[],void *p)
+{
+	if(argc < 2){
+		kprintf("Host I/O %s, threads %d busy %d queued %d hiwat %d\n",
+		 Hio_enable ? "on" : "off",Hio.nthreads,Hio.busy,Hio.qlen,
+		 Hio.hiwat);
+		kprintf("calls %lu direct %lu\n",Hio.calls,Hio.direct);
+		return 0;
+	}
+	return setbool(&Hio_enable,"Host I/O",argc,argv);
+}
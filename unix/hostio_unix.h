@@ -0,0 +1,46 @@
+/* Host I/O service for UNIX-hosted KA9Q NOS.
+ *
+ * Copyright 2017 Jeremy Cooper, KE6JJJ.
+ *
+ * Only one NOS process runs at a time, so a host system call that blocks
+ * (a read from a slow disk, a write to an NFS-mounted spool, a name lookup)
+ * stalls every other process, packet forwarding included. The calls here
+ * hand such work to a small pool of host threads and kwait() the calling
+ * process until it's done, letting the rest of NOS run in the meantime.
+ *
+ * Before the pool is started, or when called with interrupts disabled,
+ * they simply make the host call directly.
+ */
+#ifndef _KA9Q_HOSTIO_UNIX_H
+#define _KA9Q_HOSTIO_UNIX_H
+
+#include "../top.h"
+
+#ifndef UNIX
+#error "This file should only be built on POSIX/UNIX systems."
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* Start and stop the pool threads */
+int hio_start(void);
+void hio_stop(void);
+
+/* Run func(arg) on a pool thread and return its result, with the host
+ * errno it left behind.
+ */
+long hio_call(long (*func)(void *),void *arg);
+
+int hio_open(const char *path,int flags,int mode);
+int hio_close(int fd);
+ssize_t hio_read(int fd,void *buf,size_t cnt);
+ssize_t hio_write(int fd,const void *buf,size_t cnt);
+/* Positioned I/O; an offset of -1 writes at the end of the file */
+ssize_t hio_pread(int fd,void *buf,size_t cnt,off_t off);
+ssize_t hio_pwrite(int fd,const void *buf,size_t cnt,off_t off);
+int hio_stat(const char *path,struct stat *sb);
+/* Copy out of a mapping of fd, whose pages may have to come from disk */
+ssize_t hio_mapread(int fd,void *buf,const void *map,size_t cnt,off_t off);
+
+#endif /* _KA9Q_HOSTIO_UNIX_H */
@@ -28,6 +28,7 @@
 #include "unix/display_crs.h"
 #include "unix/timer_unix.h"
 #include "unix/asy_unix.h"
+#include "unix/hostio_unix.h"
 
 /* Initialize the machine-dependent I/O (misnomer)
  *
@@ -56,6 +57,13 @@ ioinit(int hinit)
 		exit(1);
 	}
 
+	/* Start the host I/O threads. Without them, host calls are
+	 * just made directly.
+	 */
+	if (hio_start() != 0)
+		fprintf(stderr, "Can't start host I/O threads: %s\n",
+			strerror(errno));
+
 	/* Start up CURSES */
 	curses_display_start();
 
@@ -91,6 +99,8 @@ iostop(void)
 
 	kfcloseall();
 
+	hio_stop();
+
 	/* curses deinit */
 	curses_display_stop();
 }
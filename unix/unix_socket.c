@@ -39,6 +39,7 @@
 #include "core/devparam.h"
 
 #include "unix/nosunix.h"
+#include "unix/hostio_unix.h"
 
 #include "unix_socket.h"
 
@@ -79,12 +80,41 @@ CantOpenDevice:
 	return -1;
 }
 
+/* Arguments for the lookup and connect, which are run on a host I/O
+ * thread since either can take a long time.
+ */
+struct unix_socket_hio {
+	const char *hostname;
+	const char *service;
+	const struct addrinfo *hints;
+	struct addrinfo **res;
+	int fd;
+	const struct addrinfo *ai;
+};
+
+static long
+unix_socket_getaddrinfo(void *v)
+{
+	struct unix_socket_hio *a = v;
+
+	return getaddrinfo(a->hostname, a->service, a->hints, a->res);
+}
+
+static long
+unix_socket_connect(void *v)
+{
+	struct unix_socket_hio *a = v;
+
+	return connect(a->fd, a->ai->ai_addr, a->ai->ai_addrlen);
+}
+
 static int
 unix_socket_open_socket(const char *spec)
 {
 	char *hostname, *service;
 	const char *sep;
 	struct addrinfo hints, *res0, *res;
+	struct unix_socket_hio hio;
 	int fd, error;
 	
 	sep = (const char *) strrchr(spec, ':');
@@ -117,7 +147,11 @@ unix_socket_open_socket(const char *spec)
 	hints.ai_canonname = NULL;
 	hints.ai_next = NULL;
 
-	error = getaddrinfo(hostname, service, &hints, &res0);
+	hio.hostname = hostname;
+	hio.service = service;
+	hio.hints = &hints;
+	hio.res = &res0;
+	error = (int)hio_call(unix_socket_getaddrinfo, &hio);
 	if (error != 0) {
 		kprintf("getaddrinfo() failure: %s\n", gai_strerror(error));
 		goto GetAddrInfoFailed;
@@ -132,7 +166,9 @@ unix_socket_open_socket(const char *spec)
 			goto SocketFailed;
 		}
 
-		error = connect(fd, res->ai_addr, res->ai_addrlen);
+		hio.fd = fd;
+		hio.ai = res;
+		error = (int)hio_call(unix_socket_connect, &hio);
 		if (error >= 0)
 			break;
 